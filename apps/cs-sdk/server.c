@@ -199,6 +199,7 @@ s32 Shutdown( void )
   /* save unassigned work data */
 
   /* save assigned/finished work data */
+  CosmLogClose( &__log_work );
 
   return COSM_PASS;
 }
@@ -342,6 +343,16 @@ void Accept( cosm_NET * net, cosm_HTTPD_REQUEST * http_req, u32 use_http )
 
   CosmPrint( "New total: %016Y\n", tmp );
 
+  /* the result must be on disk before the client is told to delete it */
+  if ( CosmLog( &__log_work, 0, COSM_LOG_NOECHO,
+    "%08X-%08X %016Y %.20s %.20s %.31s\n", results.start, results.end,
+    results.total, os_types[results.os], cpu_types[results.cpu],
+    results.email ) != COSM_PASS )
+  {
+    CosmPrint( "Work Log Failed\n" );
+    return;
+  }
+
   work_accept.type = PACKET_TYPE_ACCEPT;
   CosmU32Save( (u8 *) &work_accept.type, &work_accept.type );
   work_accept.result = COSM_PASS;
@@ -365,9 +376,6 @@ void Accept( cosm_NET * net, cosm_HTTPD_REQUEST * http_req, u32 use_http )
       return;
     }
   }
-
-  /* log work done */
-
 }
 
 int main( int argc, char * argv[] )
@@ -421,8 +429,8 @@ int main( int argc, char * argv[] )
   }
 
   /* open logs */
-  if ( CosmLogOpen( &__log_work, WORK_LOG, 100, COSM_LOG_MODE_NUMBER )
-    != COSM_PASS )
+  if ( CosmLogOpen( &__log_work, WORK_LOG, 100,
+    COSM_LOG_MODE_NUMBER | COSM_LOG_MODE_SYNC ) != COSM_PASS )
   {
     CosmPrint( "Unable to open work log.\n" );
     CosmProcessEnd( -1 );
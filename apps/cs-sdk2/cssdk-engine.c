@@ -223,10 +223,18 @@ static void Pinger( void * arg )
   CosmSystemClock( &now );
   now.hi += 0xFFFFFFFF; /* ~forever */
   CosmMemSet( &acl, sizeof( acl ), 0 );
-  /* deny everything */
-  CosmNetACLAdd( &acl, &server, 0, COSM_NET_DENY, now );
-  /* allow server */
-  CosmNetACLAdd( &acl, &server, 32, COSM_NET_ALLOW, now );
+  if ( ( CosmNetACLInit( &acl ) != COSM_PASS )
+    /* deny everything */
+    || ( CosmNetACLAdd( &acl, &server, 0, COSM_NET_DENY, now ) != COSM_PASS )
+    /* allow server */
+    || ( CosmNetACLAdd( &acl, &server, 32, COSM_NET_ALLOW, now )
+    != COSM_PASS ) )
+  {
+    CosmLog( __mylog, 0, COSM_LOG_ECHO,
+      "%.32sUnable to set up the server ACL\n", Now() );
+    CosmNetACLFree( &acl );
+    return;
+  }
 
   __pinger_alive = 1;
 
@@ -240,6 +248,7 @@ static void Pinger( void * arg )
         "Listening socket lost error=%i\n", error );
       *__shutdown_flag = 1;
       __pinger_alive = 0;
+      CosmNetACLFree( &acl );
       return;
     }
     PacketDecode( &pkt );
@@ -295,6 +304,7 @@ static void Pinger( void * arg )
     __last_checkin = now.hi;
   }
 
+  CosmNetACLFree( &acl );
   CosmNetClose( net );
   __pinger_alive = 0;
 }
@@ -68,12 +68,57 @@ typedef struct cosm_CONFIG_SECTION
   u32 key_count;
 } cosm_CONFIG_SECTION;
 
+/*
+  Readers never see the sections above. Every change builds a read only
+  snapshot with its own copy of the strings, indexed by a hash of the
+  section and key, and swaps it in. Readers count themselves in and out
+  of one of two readers counters, the writer waits for both to drain
+  before it drops its hold on the old snapshot.
+*/
+
+typedef struct cosm_CONFIG_ENTRY
+{
+  u64 hash;
+  const utf8 * section;
+  const utf8 * key; /* NULL for an empty slot */
+  const utf8 * value;
+  s64 number;
+  u32 is_number; /* value was a decimal integer, parsed into number */
+} cosm_CONFIG_ENTRY;
+
+typedef struct cosm_CONFIG_SNAPSHOT
+{
+  u32 refs;
+  u32 count;
+  u32 mask; /* slots - 1, slots is a power of 2 */
+  cosm_CONFIG_ENTRY * slots;
+} cosm_CONFIG_SNAPSHOT;
+
+struct cosm_CONFIG;
+
+typedef void (*cosm_CONFIG_CALLBACK)( void * arg, struct cosm_CONFIG * config,
+  const utf8 * section, const utf8 * key, const utf8 * value );
+
+typedef struct cosm_CONFIG_NOTIFY
+{
+  utf8 * section; /* NULL for every section */
+  utf8 * key;     /* NULL for every key, in the same alloc as section */
+  cosm_CONFIG_CALLBACK callback;
+  void * arg;
+} cosm_CONFIG_NOTIFY;
+
 typedef struct cosm_CONFIG
 {
   utf8 * memory;
   cosm_CONFIG_SECTION * sections;
   u32 section_count;
   cosm_MUTEX lock;
+  cosm_CONFIG_SNAPSHOT * snapshot;
+  u32 epoch;
+  u32 readers[2];
+  cosm_CONFIG_NOTIFY * notify;
+  u32 notify_count;
+  struct cosm_CONFIG_WATCH * watch;
 } cosm_CONFIG;
 
 /* Config Functions */
@@ -85,6 +130,40 @@ s32 CosmConfigLoad( cosm_CONFIG * config, const ascii * filename );
     Returns: COSM_PASS on success, or a COSM_FILE_ERROR_* on failure.
   */
 
+s32 CosmConfigReload( cosm_CONFIG * config, const ascii * filename );
+  /*
+    Read the config data from filename again and swap it in. The file is
+    read and parsed without holding the config's lock, readers are never
+    blocked, and see either all of the old config or all of the new one.
+    Keys set with CosmConfigSet that are not in the file are lost. The
+    change callbacks are called for every key added, changed, or deleted.
+    Returns: COSM_PASS on success, or a COSM_FILE_ERROR_* on failure, in
+      which case the config is unchanged.
+  */
+
+s32 CosmConfigWatch( cosm_CONFIG * config, const ascii * filename );
+  /*
+    Start a thread that calls CosmConfigReload each time filename is
+    written or replaced, see CosmFileWatchInit. Files that can't be read
+    are skipped, the config keeps the last good data. Only one file can
+    be watched, CosmConfigFree stops the thread.
+    Returns: COSM_PASS on success, or a COSM_FILE_ERROR_* on failure.
+  */
+
+s32 CosmConfigNotify( cosm_CONFIG * config, const utf8 * section,
+  const utf8 * key, cosm_CONFIG_CALLBACK callback, void * arg );
+  /*
+    Register callback to be called with arg for every change made by
+    CosmConfigSet or CosmConfigReload to key in section. If key is NULL
+    any key in the section matches, if both are NULL every key matches.
+    The value is NULL if the key was deleted. Callbacks are called once
+    the change can be seen by readers, on the thread making the change,
+    with the config's lock held. They may read the config but must not
+    call CosmConfigSet, CosmConfigReload, CosmConfigNotify, or
+    CosmConfigFree. Callbacks stay registered until CosmConfigFree.
+    Returns: COSM_PASS on success, or COSM_FAIL on failure.
+  */
+
 s32 CosmConfigSave( const cosm_CONFIG * config, const ascii * filename );
   /*
     Write out the config data to the file.
@@ -102,14 +181,48 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
 const utf8 * CosmConfigGet( cosm_CONFIG * config, const utf8 * section,
   const utf8 * key );
   /*
-    Get the value of the section/key pair. The returned pointer will
-    no longer be valid once another CosmConfig* call is made.
+    Get the value of the section/key pair. Takes no lock, the lookup is
+    done in the current snapshot. The returned pointer will no longer be
+    valid once another CosmConfigLoad, CosmConfigSet, or CosmConfigFree
+    call is made, if other threads may make them use CosmConfigSnapshot.
     Returns: A pointer to the value on success, or NULL on failure.
   */
 
+s32 CosmConfigGetNumber( s64 * number, cosm_CONFIG * config,
+  const utf8 * section, const utf8 * key );
+  /*
+    Get the value of the section/key pair as an integer. Values are parsed
+    once when the snapshot is built, so this is as cheap as CosmConfigGet.
+    Values are numbers if CosmS64Str reads all of them in base 10.
+    Returns: COSM_PASS on success, or COSM_FAIL if the key does not
+      exist or is not a number.
+  */
+
+cosm_CONFIG_SNAPSHOT * CosmConfigSnapshot( cosm_CONFIG * config );
+  /*
+    Get a hold on the current snapshot of the config without taking a lock.
+    The snapshot and its values do not change, and stay valid until it is
+    passed to CosmConfigSnapshotFree, even if the config is changed or
+    freed. Use it to read several values that are consistent together.
+    Returns: The snapshot, or NULL on failure.
+  */
+
+const utf8 * CosmConfigSnapshotGet( const cosm_CONFIG_SNAPSHOT * snapshot,
+  const utf8 * section, const utf8 * key );
+  /*
+    Get the value of the section/key pair in the snapshot.
+    Returns: A pointer to the value on success, or NULL on failure.
+  */
+
+void CosmConfigSnapshotFree( cosm_CONFIG_SNAPSHOT * snapshot );
+  /*
+    Release the hold on a snapshot from CosmConfigSnapshot.
+    Returns: nothing.
+  */
+
 void CosmConfigFree( cosm_CONFIG * config );
   /*
-    Free the internal config data.
+    Stop any watch, then free the internal config data and callbacks.
     Returns: nothing.
   */
 
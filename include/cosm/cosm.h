@@ -43,6 +43,7 @@
 #include "cosm/http.h"
 #include "cosm/language.h"
 #include "cosm/log.h"
+#include "cosm/metrics.h"
 #include "cosm/security.h"
 #include "cosm/time.h"
 #include "cosm/transform.h"
@@ -65,7 +66,7 @@ typedef struct cosm_TEST
   s32 (*function)(void); /**< Self test function name. */
 } cosm_TEST;
 
-#define COSM_TEST_MODULE_MAX 17
+#define COSM_TEST_MODULE_MAX 18
 extern cosm_TEST __cosm_test_modules[COSM_TEST_MODULE_MAX + 2];
 
 /**
@@ -94,6 +95,101 @@ Run all Cosm self tests. The function's code is in cosmtest.c
 */
 s32 CosmTest( s32 * failed_module, s32 * failed_test, s32 module_num );
 
+/**
+Print the speed of the vector CosmMemCmp, CosmStrBytes, CosmStrChar, and
+CosmStrStr next to the portable byte at a time versions, for strings from
+16 bytes to 64KB. The function's code is in cosmtest.c
+\code
+  CosmBenchStr();
+\endcode
+*/
+void CosmBenchStr( void );
+
+/**
+Start a CosmHTTPD on localhost and print the rate of small GET requests
+made with a new CosmHTTPOpen for each one, and then with a
+cosm_HTTP_POOL reusing keep-alive connections. The function's code is in
+cosmtest.c
+\code
+  CosmBenchHTTP();
+\endcode
+*/
+void CosmBenchHTTP( void );
+
+#define COSM_BENCH_TEXT  0
+#define COSM_BENCH_CSV   1
+#define COSM_BENCH_JSON  2
+
+#define COSM_BENCH_REPETITIONS 100
+
+/**
+Result of a CosmBench run. Times are for a single operation and in
+picoseconds, so operations taking only a few nanoseconds keep their
+precision.
+*/
+typedef struct cosm_BENCH
+{
+  const ascii * name; /**< Name of the benchmark. */
+  u64 bytes;          /**< Bytes handled by each operation, or 0. */
+  u64 loops;          /**< Operations in each timed repetition. */
+  u32 repetitions;    /**< Number of timed repetitions. */
+  u64 median;         /**< Median time of an operation. */
+  u64 p99;            /**< 99th percentile time of an operation. */
+  u64 ops;            /**< Operations per second at the median. */
+  u64 rate;           /**< Bytes per second at the median, or 0. */
+} cosm_BENCH;
+
+/**
+Time function, which must do loops operations each call and return
+COSM_PASS. The number of loops is doubled until one call takes about a
+millisecond, then calls are made for a short warmup, then repetitions
+calls are timed and the median and 99th percentile are taken from those.
+If repetitions is 0 then up to COSM_BENCH_REPETITIONS calls are timed,
+stopping after 10 if they have taken over 2 seconds. bytes is the amount
+of data each operation handles, for the bytes per second, or 0. The
+function's code is in cosmtest.c
+
+\param[out] bench The results.
+\param[in] name Name of the benchmark, which must stay valid.
+\param[in] function Function to time.
+\param[in] arg Passed to function.
+\param[in] bytes Bytes handled by each operation, or 0.
+\param[in] repetitions Number of timed calls, or 0 for the default.
+\return COSM_PASS on success, or COSM_FAIL if function failed or
+  there was not enough memory.
+\code
+  cosm_BENCH bench;
+
+  if ( CosmBench( &bench, "copy 4KB", Copy4K, &data, 4096, 0 )
+    == COSM_PASS )
+  {
+    CosmBenchReport( NULL, &bench, 1, COSM_BENCH_TEXT );
+  }
+\endcode
+*/
+s32 CosmBench( cosm_BENCH * bench, const ascii * name,
+  s32 (*function)( void * arg, u32 loops ), void * arg, u64 bytes,
+  u32 repetitions );
+
+/**
+Write count CosmBench results to file, or to the standard output device if
+file is NULL. format is COSM_BENCH_TEXT for a table, COSM_BENCH_CSV for a
+header line and a line per result, or COSM_BENCH_JSON for an array of
+objects. Times are written in nanoseconds. The function's code is in
+cosmtest.c
+
+\param[in] file Open file, or NULL.
+\param[in] benches Array of results.
+\param[in] count Number of results.
+\param[in] format COSM_BENCH_TEXT, COSM_BENCH_CSV, or COSM_BENCH_JSON.
+\return COSM_PASS on success, or COSM_FAIL on failure.
+\code
+  CosmBenchReport( NULL, benches, count, COSM_BENCH_JSON );
+\endcode
+*/
+s32 CosmBenchReport( cosm_FILE * file, const cosm_BENCH * benches,
+  u32 count, u32 format );
+
 /**
 @}
 */
@@ -280,6 +280,18 @@ End packed structure definitions.
 #  error "need correct struct packing macro, see cputypes.h"
 #endif
 
+/**
+@def COSM_THREAD_LOCAL
+Storage class for a static variable with one copy per thread.
+*/
+#if defined( __GNUC__ )
+#  define COSM_THREAD_LOCAL __thread
+#elif defined( _MSC_VER )
+#  define COSM_THREAD_LOCAL __declspec( thread )
+#else
+#  error "need correct thread local storage macro, see cputypes.h"
+#endif
+
 /* Vector types, up to 512 bits */
 
 PACKED_STRUCT_BEGIN
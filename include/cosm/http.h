@@ -21,6 +21,7 @@
 #include "cosm/os_net.h"
 #include "cosm/buffer.h"
 #include "cosm/log.h"
+#include "cosm/metrics.h"
 
 #define COSM_HTTP_ERROR_URI     -1 /* URI invalid */
 #define COSM_HTTP_ERROR_NET     -2 /* Host/proxy unreachable */
@@ -29,6 +30,7 @@
 #define COSM_HTTP_ERROR_CLOSED  -5 /* Connection closed or aborted */
 #define COSM_HTTP_ERROR_ORDER   -6 /* Functions called in wrong order */
 #define COSM_HTTP_ERROR_VERSION -7 /* Unsupported versions of HTTPD protcol */
+#define COSM_HTTP_ERROR_BUSY    -8 /* Pool has no connection free in time */
 
 #define COSM_HTTP_STATUS_NONE    0
 #define COSM_HTTP_STATUS_CLOSED  1 /* connection closed but settings valid */
@@ -45,6 +47,24 @@
 
 #define COSM_HTTP_MAX_HOSTNAME ( COSM_NET_MAX_HOSTNAME + 32 )
 
+#define COSM_HTTP_INPUT_BUFFER  4096  /* bytes read from the net at once */
+#define COSM_HTTP_HEADER_MAX    65536 /* largest header we will accept */
+
+typedef struct cosm_HTTP_INPUT
+{
+  u32 start; /* first byte not yet used */
+  u32 end;   /* end of the bytes read from the net */
+  u8 data[COSM_HTTP_INPUT_BUFFER];
+} cosm_HTTP_INPUT;
+
+#define COSM_HTTP_OUTPUT_BUFFER 16384 /* response bytes gathered per send */
+
+typedef struct cosm_HTTP_OUTPUT
+{
+  u32 length; /* bytes waiting to be sent */
+  u8 data[COSM_HTTP_OUTPUT_BUFFER];
+} cosm_HTTP_OUTPUT;
+
 typedef struct cosm_HTTP
 {
   cosm_NET net;
@@ -61,8 +81,32 @@ typedef struct cosm_HTTP
   ascii * user_auth;
   cosm_BUFFER header;
   u32 header_flag;
+  cosm_HTTP_INPUT input;
+  void * pool_host; /* cosm_HTTP_POOL_HOST this came from, or NULL */
+  cosm_NET_OPTIONS options; /* used for each connection */
 } cosm_HTTP;
 
+typedef struct cosm_HTTP_POOL_HOST
+{
+  ascii key[COSM_HTTP_MAX_HOSTNAME + 1]; /* "host[:port]" from the uri */
+  cosm_HTTP base;     /* opened but unconnected, holds the DNS result */
+  u64 dns_expire;     /* CosmClockMono time to look the host up again */
+  u32 active;         /* connections handed out */
+  u32 idle_count;
+  cosm_HTTP ** idle;  /* oldest first */
+  u64 * idle_time;    /* CosmClockMono time each one went idle */
+} cosm_HTTP_POOL_HOST;
+
+typedef struct cosm_HTTP_POOL
+{
+  cosm_MUTEX lock;
+  u32 max_per_host;
+  u64 idle_ns;
+  u64 dns_ttl_ns;
+  u32 host_count;
+  cosm_HTTP_POOL_HOST ** hosts;
+} cosm_HTTP_POOL;
+
 #define COSM_HTTPD_ERROR_ADDRESS  -1 /* Unable to listen on host/addr */
 #define COSM_HTTPD_ERROR_PARAM    -2 /* Parameter error */
 #define COSM_HTTPD_ERROR_ORDER    -3 /* Functions called in wrong order */
@@ -90,6 +134,7 @@ typedef struct cosm_HTTP
 #define COSM_HTTPD_REQUEST_START   1
 #define COSM_HTTPD_REQUEST_HEADER  2
 #define COSM_HTTPD_REQUEST_BODY    3
+#define COSM_HTTPD_REQUEST_DONE    4
 
 typedef struct cosm_HTTPD_REQUEST
 {
@@ -99,6 +144,8 @@ typedef struct cosm_HTTPD_REQUEST
   u32 persistent;
   ascii * path;
   cosm_NET * net;
+  cosm_HTTP_INPUT * input;
+  cosm_HTTP_OUTPUT * output;
   cosm_BUFFER header;
   u32 header_flag;
   u32 post_length;
@@ -106,6 +153,19 @@ typedef struct cosm_HTTPD_REQUEST
   u32 thread_number;
 } cosm_HTTPD_REQUEST;
 
+typedef struct cosm_HTTPD_ROUTE
+{
+  ascii * label;  /* the part of the path this node adds to its parent */
+  u32 label_length;
+  u32 child_count;
+  struct cosm_HTTPD_ROUTE ** children; /* sorted by first label byte */
+  s32 (*handler)( cosm_HTTPD_REQUEST * request );
+  cosm_NET_ACL * acl;
+  struct cosm_HTTPD_ROUTE * retired; /* replaced nodes, root only */
+} cosm_HTTPD_ROUTE;
+
+#define COSM_HTTPD_ACL_CACHE 8
+
 typedef struct cosm_HTTPD_THREAD
 {
   u64 id;
@@ -113,16 +173,18 @@ typedef struct cosm_HTTPD_THREAD
   u32 thread_number;
   void * httpd;
   cosm_NET net;
+  cosm_HTTP_INPUT input;
+  cosm_HTTP_OUTPUT output;
   cosm_SEMAPHORE semaphore;
+  cosm_HTTPD_ROUTE * acl_route[COSM_HTTPD_ACL_CACHE];
+  s32 acl_result[COSM_HTTPD_ACL_CACHE];
 } cosm_HTTPD_THREAD;
 
 typedef struct cosm_HTTPD
 {
   cosm_NET net;
   u32 status;
-  u32 handler_count;
-  ascii **paths;
-  s32 (**handlers)( cosm_HTTPD_REQUEST * request );
+  cosm_HTTPD_ROUTE * routes;
   u32 log_active;
   cosm_LOG log;
   cosm_NET_ADDR host;
@@ -132,6 +194,11 @@ typedef struct cosm_HTTPD
   u64 httpd_thread;
   u32 httpd_thread_stop;
   cosm_MUTEX lock;
+  cosm_NET_OPTIONS options; /* for the listener and connections */
+  cosm_METRIC * accepted;   /* shared by every server in the process */
+  cosm_METRIC * rejected;
+  cosm_METRIC * active;
+  cosm_METRIC * latency;
 } cosm_HTTPD;
 
 /* High level functions */
@@ -158,6 +225,13 @@ s32 CosmHTTPOpen( cosm_HTTP * http, const ascii * uri,
     specified for when you do not need to worry about proxies or passwords.
   */
 
+s32 CosmHTTPSetOptions( cosm_HTTP * http, const cosm_NET_OPTIONS * options );
+  /*
+    Set the socket options used for each connection the client makes, the
+    default is COSM_NET_OPTION_NODELAY. Takes effect on the next connect.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 s32 CosmHTTPGet( cosm_HTTP * http, u32 * status, const ascii * uri_path,
   u32 wait_ms );
   /*
@@ -197,6 +271,44 @@ s32 CosmHTTPClose( cosm_HTTP * http );
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmHTTPPoolInit( cosm_HTTP_POOL * pool, u32 max_per_host, u32 idle_ms,
+  u32 dns_ttl_ms );
+  /*
+    Initialize a thread safe pool of client connections, kept per
+    host:port. At most max_per_host connections to a host are open at
+    once, idle ones are closed after idle_ms milliseconds, and a host's
+    address is looked up again after dns_ttl_ms milliseconds.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmHTTPPoolGet( cosm_HTTP ** http, cosm_HTTP_POOL * pool,
+  const ascii * uri, u32 wait_ms );
+  /*
+    Set http to a connection for the host of the uri, which is of the same
+    form as for CosmHTTPOpen, for use with CosmHTTPGet and CosmHTTPPost.
+    An idle keep-alive connection is reused if there is one. If the host
+    already has max_per_host connections out, wait up to wait_ms
+    milliseconds for one to be put back. Proxies and passwords are not
+    supported by the pool.
+    Returns: COSM_PASS on success, COSM_HTTP_ERROR_BUSY if no connection
+      became free in time, or an error code on failure.
+  */
+
+s32 CosmHTTPPoolPut( cosm_HTTP_POOL * pool, cosm_HTTP * http );
+  /*
+    Give a connection from CosmHTTPPoolGet back to the pool. It is kept
+    for reuse if the whole reply was read and the server allows
+    keep-alive, otherwise it is closed. Never call CosmHTTPClose on it.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmHTTPPoolFree( cosm_HTTP_POOL * pool );
+  /*
+    Close all the idle connections and free the pool. Every connection
+    must have been put back first.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 s32 CosmHTTPDInit( cosm_HTTPD * httpd, ascii * log_path, u32 log_level,
   u32 threads, u32 stack_size, const cosm_NET_ADDR * host, u32 wait_ms );
   /*
@@ -206,6 +318,15 @@ s32 CosmHTTPDInit( cosm_HTTPD * httpd, ascii * log_path, u32 log_level,
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmHTTPDSetOptions( cosm_HTTPD * httpd,
+  const cosm_NET_OPTIONS * options );
+  /*
+    Set the socket options for the server, used when it is next started.
+    The default is COSM_NET_OPTION_NODELAY and COSM_NET_OPTION_REUSEADDR
+    with the OS maximum backlog. Accepted connections inherit the options.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 s32 CosmHTTPDSetHandler( cosm_HTTPD * httpd, const ascii * path,
   cosm_NET_ACL * acl, s32 (*handler)( cosm_HTTPD_REQUEST * request ) );
   /*
@@ -214,7 +335,10 @@ s32 CosmHTTPDSetHandler( cosm_HTTPD * httpd, const ascii * path,
     will be called, and the order handlers are added does not matter.
     if handler is NULL, the handler is removed. At minimum you must
     have a handler set for the path "/" which will be called if no other
-    handler matches.
+    handler matches. A client the ACL denies gets a 403. A NULL acl allows
+    everyone. acl must remain valid until the server is freed.
+    Handlers may be changed while the server is running, requests already
+    in progress finish with the old ones.
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
@@ -259,6 +383,24 @@ s32 CosmHTTPDSend( cosm_HTTPD_REQUEST * request, const void * data,
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmHTTPDSendFile( cosm_HTTPD_REQUEST * request, cosm_FILE * file,
+  u64 offset, u64 length );
+  /*
+    Send length bytes of the open file, starting at offset, to the client
+    in a handler function without copying them through user memory.
+    If no CosmHTTPDSend has been called yet the file is the whole body of
+    the response, and no further data may be sent after it.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmHTTPDFlush( cosm_HTTPD_REQUEST * request );
+  /*
+    Send any response data still held in the request's output buffer.
+    Handler output is gathered and sent in as few packets as possible,
+    so this is only needed when the client must see partial output now.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 s32 CosmHTTPDRecv( void * buffer, u32 * bytes_received,
   cosm_HTTPD_REQUEST * request, u32 length, u32 wait_ms );
   /*
@@ -269,6 +411,17 @@ s32 CosmHTTPDRecv( void * buffer, u32 * bytes_received,
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmHTTPDMetrics( cosm_HTTPD_REQUEST * request );
+  /*
+    A handler that sends CosmMetricsDump output, for Prometheus or anything
+    else that reads its text format. Set it for a path such as "/metrics",
+    usually with an ACL. Every server reports cosm_httpd_accepted_total,
+    cosm_httpd_rejected_total for connections turned away with a 503,
+    cosm_httpd_active_threads, and cosm_httpd_request_nanoseconds from a
+    parsed request to the end of its handler.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 s32 CosmHTTPDFree( cosm_HTTPD * httpd );
   /*
     Free the httpd and any remaining data. A server must not be running
@@ -284,9 +437,59 @@ s32 Cosm_HTTPNetOpen( cosm_HTTP * http );
     Returns: COSM_PASS on success, COSM_FAIL on failure.
   */
 
+s32 Cosm_HTTPInputFill( cosm_HTTP_INPUT * input, cosm_NET * net,
+  u32 wait_ms );
+  /*
+    Move any unused bytes to the front of the input buffer, then wait up to
+    wait_ms milliseconds for data and read as much as is available into the
+    rest of it. One fill replaces hundreds of single byte reads.
+    Returns: COSM_PASS on success or timeout, or the CosmNetRecv error.
+  */
+
+s32 Cosm_HTTPInputRecv( void * buffer, u32 * bytes_received,
+  cosm_HTTP_INPUT * input, cosm_NET * net, u32 length, u32 wait_ms );
+  /*
+    Read up to length bytes, using what is left in the input buffer first.
+    Small reads are filled through the input, large reads go straight from
+    the net into buffer.
+    Returns: COSM_PASS on success, or the CosmNetRecv error.
+  */
+
+s32 Cosm_HTTPInputHeader( cosm_BUFFER * header, cosm_HTTP_INPUT * input,
+  cosm_NET * net, u32 one_line, u32 wait_ms );
+  /*
+    Append bytes from the input to the header buffer, filling as needed,
+    until the blank line that ends a header, or just one line if one_line
+    is set. Any bytes after that are left in the input for the body or the
+    next request.
+    Returns: COSM_PASS on success, COSM_HTTP_ERROR_MEMORY if the buffer
+      fails, or COSM_HTTP_ERROR_NET if the net closes, times out, or the
+      header is over COSM_HTTP_HEADER_MAX.
+  */
+
+s32 Cosm_HTTPHeaderEnd( u32 * used, u32 * line, const void * data,
+  u32 length );
+  /*
+    Look for the blank line that ends a header in the length bytes of data.
+    line is the parse state, the length of the current line so far, so a
+    header can be given in any number of pieces. Set it to 0 before the
+    first piece. Lines may end in CRLF or a bare LF.
+    Returns: COSM_PASS with used set to the bytes up to and including the
+      blank line, or COSM_FAIL with used set to length if more is needed.
+  */
+
+s32 Cosm_HTTPHeaderField( const ascii ** value, u32 * value_length,
+  const void * header, u32 length, const ascii * name );
+  /*
+    Find the header line with the field name, ignoring case, and set value
+    and value_length to its value without the surrounding whitespace.
+    value points into header.
+    Returns: COSM_PASS if the field was found, or COSM_FAIL.
+  */
+
 s32 Cosm_HTTPParseHeader( cosm_HTTP * http, u32 wait_ms );
   /*
-    Parse the returned HTTP header beyond the status line and setup for Recv.
+    Parse the returned HTTP header and setup for Recv.
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
@@ -297,12 +500,49 @@ s32 Cosm_HTTPChunkLength( cosm_HTTP * http, u32 wait_ms );
   */
 
 s32 Cosm_HTTPDParseRequest( cosm_HTTPD_REQUEST * request, cosm_NET * net,
-  u32 wait_ms );
+  cosm_HTTP_INPUT * input, u32 wait_ms );
   /*
-    Parse the HTTP request.
+    Parse the HTTP request, reading from net through input. Bytes that
+    follow the header stay in input for CosmHTTPDRecv or the next request.
+    A response held in request->output is kept, and is sent before net is
+    closed on a bad request.
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 Cosm_HTTPDRouteInsert( cosm_HTTPD_ROUTE ** root, const ascii * path,
+  s32 (*handler)( cosm_HTTPD_REQUEST * request ), cosm_NET_ACL * acl );
+  /*
+    Set the handler and acl for path in the compressed radix trie at root,
+    which may be NULL, splitting a node if path ends or differs part way
+    through its label. A NULL handler removes path, leaving its nodes.
+    The old trie is not changed, root is set to a new one that copies the
+    nodes down to path and shares the rest, with the nodes it replaced on
+    its retired list. Removing a path that isn't there leaves root alone.
+    Returns: COSM_PASS on success, or COSM_FAIL if out of memory.
+  */
+
+cosm_HTTPD_ROUTE * Cosm_HTTPDRouteFind( cosm_HTTPD_ROUTE * root,
+  const ascii * path );
+  /*
+    Find the node with a handler for the longest prefix of path, in time
+    proportional to the length of path. Only reads the trie, so any number
+    of threads may do it at once.
+    Returns: The node, or NULL if no prefix of path has a handler.
+  */
+
+void Cosm_HTTPDRouteReclaim( cosm_HTTPD_ROUTE * root );
+  /*
+    Free the nodes on root's retired list, once no thread can be reading
+    them.
+    Returns: nothing.
+  */
+
+void Cosm_HTTPDRouteFree( cosm_HTTPD_ROUTE * root );
+  /*
+    Free the trie under root, root itself, and any retired nodes on it.
+    Returns: nothing.
+  */
+
 void Cosm_HTTPDThread( void * arg );
   /*
     HTTPD thread, handles one connection and calls handlers.
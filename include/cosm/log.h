@@ -20,12 +20,16 @@
 #include "cosm/cputypes.h"
 #include "cosm/os_file.h"
 #include "cosm/os_task.h"
+#include "cosm/metrics.h"
 
 #define COSM_LOG_STATUS_NULL  0
 #define COSM_LOG_STATUS_INIT  1
 
 #define COSM_LOG_MODE_NUMBER  1
 #define COSM_LOG_MODE_BITS    2
+#define COSM_LOG_MODE_SYNC    4  /* flag, records are on disk on return */
+
+#define COSM_LOG_SYNC_LINE    1024 /* longest record in COSM_LOG_MODE_SYNC */
 
 #define COSM_LOG_ECHO    3
 #define COSM_LOG_NOECHO  6
@@ -43,6 +47,9 @@ typedef struct cosm_LOG
   u32 mode;
   u32 level;
   cosm_MUTEX lock;
+  cosm_FILE_GROUP group;  /* COSM_LOG_MODE_SYNC only */
+  cosm_METRIC * queued;   /* shared by every log in the process */
+  cosm_METRIC * dropped;
 } cosm_LOG;
 
 s32 CosmLogOpen( cosm_LOG * log, ascii * filename, u32 max_level, u32 mode );
@@ -50,8 +57,14 @@ s32 CosmLogOpen( cosm_LOG * log, ascii * filename, u32 max_level, u32 mode );
     Initialize the log, setting the filename, max_level, and mode.
     If COSM_LOG_MODE_NUMBER then log any message with an equal or lower level
     than max_. If COSM_LOG_MODE_BITS then log any message with it's level
-    matching a bit in max_level. Initializing a log with a NULL filename or
-    invalid mode causes failure.
+    matching a bit in max_level. Either mode can have COSM_LOG_MODE_SYNC
+    added, then the file is held open and each record is on disk before
+    CosmLog returns, with records from threads logging at the same time
+    sharing one disk flush (see CosmFileGroupWrite). Synced records are
+    cut to COSM_LOG_SYNC_LINE - 1 bytes. Initializing a log with a NULL
+    filename or invalid mode causes failure. Every log counts the records
+    it writes in the cosm_log_queued_total metric, and records lost to a
+    file error in cosm_log_dropped_total.
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
@@ -0,0 +1,130 @@
+/*
+  Copyright 1995-2019 Mithral Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#ifndef COSM_METRICS_H
+#define COSM_METRICS_H
+
+#include "cosm/cputypes.h"
+#include "cosm/os_task.h"
+#include "cosm/buffer.h"
+
+/*
+  Process wide metrics, named the Prometheus way so CosmMetricsDump output
+  can be scraped as is. Metrics are found or created by name once, usually
+  at startup, and live until the program exits. Updating one is a few
+  atomic adds with no locks, so they can be used on hot paths.
+
+  Counters only go up, and use a cosm_COUNTER so threads don't share a
+  cache line. Gauges are set or moved either way. Histograms record values
+  such as nanoseconds into log-linear buckets, 16 per power of two, so any
+  quantile is within 1/16th of the true value.
+*/
+
+#define COSM_METRIC_COUNTER   1
+#define COSM_METRIC_GAUGE     2
+#define COSM_METRIC_HISTOGRAM 3
+
+#define COSM_METRIC_NAME_MAX  64  /* including the \0 */
+#define COSM_METRIC_HELP_MAX  128 /* longer help is cut */
+#define COSM_METRIC_SUB       16  /* histogram buckets per power of two */
+#define COSM_METRIC_BUCKETS   ( ( 64 - 3 ) * COSM_METRIC_SUB )
+
+typedef struct cosm_METRIC
+{
+  u32 type;
+  ascii name[COSM_METRIC_NAME_MAX];
+  ascii help[COSM_METRIC_HELP_MAX];
+  cosm_COUNTER total; /* the counter, or the sum of histogram values */
+  u64 gauge;
+  u64 * buckets;      /* histograms only */
+  struct cosm_METRIC * next;
+} cosm_METRIC;
+
+cosm_METRIC * CosmMetricCounter( const ascii * name, const ascii * help );
+  /*
+    Find the counter called name, or create it with the help text. Names
+    must match [a-zA-Z_:][a-zA-Z0-9_:]* and counter names should end in
+    _total.
+    Returns: The counter, or NULL if the name is invalid, already used by
+      another type of metric, or there is not enough memory.
+  */
+
+cosm_METRIC * CosmMetricGauge( const ascii * name, const ascii * help );
+  /*
+    Find or create the gauge called name, the same as CosmMetricCounter.
+    Returns: The gauge, or NULL on failure.
+  */
+
+cosm_METRIC * CosmMetricHistogram( const ascii * name, const ascii * help );
+  /*
+    Find or create the histogram called name, the same as
+    CosmMetricCounter. Use the unit in the name, such as
+    _nanoseconds or _bytes.
+    Returns: The histogram, or NULL on failure.
+  */
+
+void CosmMetricAdd( cosm_METRIC * metric, s64 add );
+  /*
+    Add add to a counter or gauge. Counters should only be given positive
+    values. metric may be NULL, so a failed create needs no checks later.
+    Returns: nothing.
+  */
+
+void CosmMetricSet( cosm_METRIC * gauge, s64 value );
+  /*
+    Set the gauge to value. Does nothing for other metric types.
+    Returns: nothing.
+  */
+
+void CosmMetricRecord( cosm_METRIC * histogram, u64 value );
+  /*
+    Record value in the histogram. Does nothing for other metric types.
+    Returns: nothing.
+  */
+
+s64 CosmMetricValue( cosm_METRIC * metric );
+  /*
+    Read a counter or gauge, or the number of values in a histogram.
+    Returns: The value, or 0 if metric is NULL.
+  */
+
+u64 CosmMetricQuantile( cosm_METRIC * histogram, u32 per_mille );
+  /*
+    Find the value per_mille thousandths of the way through the recorded
+    values, 500 for the median or 999 for the 99.9th percentile. The
+    result is the top of the bucket the value fell in.
+    Returns: The value, or 0 if nothing has been recorded.
+  */
+
+s32 CosmMetricsDump( cosm_BUFFER * buffer );
+  /*
+    Write every metric in the Prometheus text format, version 0.0.4, to the
+    end of the buffer. The memory and network totals from CosmMemCounters
+    and CosmNetCounters are always included. Histograms are written as
+    summaries with the 0.5, 0.9, 0.99, and 0.999 quantiles.
+    Returns: COSM_PASS on success, or COSM_FAIL if the buffer is full.
+  */
+
+/* testing */
+
+s32 Cosm_TestMetrics( void );
+  /*
+    Test functions in this header.
+    Returns: COSM_PASS on success, or a negative number corresponding to the
+      test that failed.
+  */
+
+#endif
@@ -61,6 +61,7 @@ enum COSM_FILE_MODE
   COSM_FILE_MODE_TRUNCATE = 0x20, /**< Truncate an existing file on open */
   COSM_FILE_MODE_SYNC     = 0x40, /**< Write to disk before return */
   COSM_FILE_MODE_NOBUFFER = 0x80  /**< No read/write buffering.
+    Every read and write goes to the OS, see CosmFileBuffer.
     This can have negative performance consequences for small read/writes.
     May requires sector and memory aligned read/writes on some platforms. */
 };
@@ -95,9 +96,25 @@ enum COSM_FILE_LOCK
 #define COSM_FILE_ERROR_LENGTH    -16  /* Unable to discover file size */
 #define COSM_FILE_ERROR_NOSPACE   -17  /* Device is full */
 #define COSM_FILE_ERROR_PARAM     -18  /* Parameter error */
+#define COSM_FILE_ERROR_BUSY      -19  /* Too many requests in flight */
+#define COSM_FILE_ERROR_TIMEOUT   -20  /* Nothing happened in time */
 
 #define COSM_FILE_MAX_FILENAME    256
 
+#define COSM_FILE_BUFFER_SIZE     16384 /* default read/write buffer */
+
+#define COSM_FILE_BUFFER_EMPTY    0
+#define COSM_FILE_BUFFER_READ     1 /* holds read-ahead */
+#define COSM_FILE_BUFFER_WRITE    2 /* holds writes not yet made */
+
+#define COSM_FILE_VECTORS         64 /* buffers per OS call, more are looped */
+
+#define COSM_FILE_ADVISE_NORMAL     0 /* no special treatment */
+#define COSM_FILE_ADVISE_SEQUENTIAL 1 /* read in order, read-ahead more */
+#define COSM_FILE_ADVISE_RANDOM     2 /* read out of order, no read-ahead */
+#define COSM_FILE_ADVISE_WILLNEED   3 /* start reading it in now */
+#define COSM_FILE_ADVISE_DONTNEED   4 /* done with it, drop it from cache */
+
 /**
 \typedef cosm_FILENAME
 \brief Internal filename type.
@@ -132,8 +149,20 @@ typedef struct cosm_FILE
   u32 status;    /**< Status of file. */
   u32 mode;      /**< Mode opened in. */
   u32 lockmode;  /**< Mode locked with. */
+  u8 * buffer;        /**< Read/write buffer, allocated on first use. */
+  u32 buffer_size;    /**< Size of buffer, 0 for unbuffered. */
+  u32 buffer_state;   /**< COSM_FILE_BUFFER_* of what buffer holds. */
+  u32 buffer_start;   /**< Next unread byte of read-ahead. */
+  u32 buffer_end;     /**< End of read-ahead or of the waiting writes. */
+  u64 buffer_offset;  /**< File offset of read-ahead buffer[0]. */
 } cosm_FILE;
 
+typedef struct cosm_FILE_VECTOR
+{
+  void * data;
+  u64 length;   /* bytes to write, or room in data when reading */
+} cosm_FILE_VECTOR;
+
 /** Memory mapped file structure. */
 typedef struct cosm_FILE_MEMORY_MAP
 {
@@ -144,6 +173,31 @@ typedef struct cosm_FILE_MEMORY_MAP
 #endif
 } cosm_FILE_MEMORY_MAP;
 
+#define COSM_FILE_MAP_WINDOW     0x4000000 /* default reader window, 64MiB */
+#define COSM_FILE_MAP_STEP       0x4000000 /* default writer growth, 64MiB */
+
+/** Reader walking a file through a sliding memory mapped window. */
+typedef struct cosm_FILE_MAP_READER
+{
+  cosm_FILE * file;
+  cosm_FILE_MEMORY_MAP map;  /* the current window, memory NULL if none */
+  u64 map_offset;            /* file offset of the window */
+  u64 window;                /* most bytes mapped at once */
+  u64 offset;                /* file offset of the next byte to read */
+  u64 length;                /* length of the file */
+} cosm_FILE_MAP_READER;
+
+/** Append-only writer into a memory mapped, growing file. */
+typedef struct cosm_FILE_MAP_WRITER
+{
+  cosm_FILE * file;
+  cosm_FILE_MEMORY_MAP map;  /* mapping of the space reserved */
+  u64 map_offset;            /* file offset of the mapping */
+  u64 step;                  /* bytes the file grows by at a time */
+  u64 length;                /* bytes in the file that are written */
+  u64 reserved;              /* length of the file with the space */
+} cosm_FILE_MAP_WRITER;
+
 #define COSM_FILE_TYPE_UNKNOWN   0  /* Unknown, filessytem error, etc */
 #define COSM_FILE_TYPE_FILE      1  /* Normal file */
 #define COSM_FILE_TYPE_DIR       2  /* Directory */
@@ -167,6 +221,80 @@ typedef struct cosm_FILE_INFO
   cosmtime access;
 } cosm_FILE_INFO;
 
+#define COSM_FILE_ASYNC_READ     1 /* read length bytes at offset into data */
+#define COSM_FILE_ASYNC_WRITE    2 /* write length bytes at offset from data */
+#define COSM_FILE_ASYNC_SYNC     3 /* force the file's writes to disk */
+
+#define COSM_FILE_ASYNC_THREADS  1 /* use the thread pool, even if io_uring */
+
+#define COSM_FILE_ASYNC_URING    1 /* engine is Linux io_uring */
+#define COSM_FILE_ASYNC_POOL     2 /* engine is a pool of threads */
+
+#define COSM_FILE_ASYNC_NOWAIT   0
+#define COSM_FILE_ASYNC_WAIT     1
+
+#define COSM_FILE_ASYNC_BUFFERS  64 /* most registered buffers */
+
+struct cosm_FILE_REQUEST;
+
+typedef void (*cosm_FILE_ASYNC_CALLBACK)( void * arg,
+  struct cosm_FILE_REQUEST * request );
+
+typedef struct cosm_FILE_REQUEST
+{
+  cosm_FILE * file;
+  u32 type;         /* COSM_FILE_ASYNC_READ, _WRITE or _SYNC */
+  u32 buffer;       /* registered buffer data is in, from 1, 0 for none */
+  void * data;
+  u32 length;
+  u64 offset;
+  cosm_FILE_ASYNC_CALLBACK callback;  /* NULL to collect with Reap */
+  void * arg;
+  u32 bytes;        /* when done, the bytes read or written */
+  s32 status;       /* when done, COSM_PASS or an error code */
+  struct cosm_FILE_REQUEST * next;    /* internal */
+} cosm_FILE_REQUEST;
+
+typedef struct cosm_FILE_ASYNC
+{
+  cosm_MUTEX lock;
+  cosm_SEMAPHORE work;   /* one up for each queued request, pool only */
+  cosm_SEMAPHORE ready;  /* one up for each request put on done */
+  void * ring;           /* io_uring state, NULL for the pool */
+  cosm_FILE_REQUEST * queue;
+  cosm_FILE_REQUEST * queue_tail;
+  cosm_FILE_REQUEST * done;
+  cosm_FILE_REQUEST * done_tail;
+  cosm_FILE_VECTOR buffers[COSM_FILE_ASYNC_BUFFERS];
+  u32 buffer_count;
+  u32 engine;            /* COSM_FILE_ASYNC_URING or COSM_FILE_ASYNC_POOL */
+  u32 depth;             /* most requests in flight */
+  u32 pending;           /* requests submitted and not yet done */
+  u32 threads;           /* threads running */
+  u32 stop;
+} cosm_FILE_ASYNC;
+
+typedef struct cosm_FILE_GROUP
+{
+  cosm_MUTEX lock;
+  cosm_FILE * file;
+  u64 offset;            /* where the next batch is written */
+  struct cosm_FILE_GROUP_WAITER * queue;       /* records not yet written */
+  struct cosm_FILE_GROUP_WAITER * queue_tail;
+  u32 leader;            /* a writer is writing a batch */
+  u32 writers;           /* writers inside CosmFileGroupWrite */
+  u64 batches;           /* writes and syncs done */
+  u64 records;           /* records written */
+} cosm_FILE_GROUP;
+
+typedef struct cosm_FILE_WATCH
+{
+  cosm_FILENAME filename;  /* as given, for polling */
+  cosm_FILENAME name;      /* native name without the directory */
+  cosm_FILE_INFO info;     /* last seen, for polling */
+  s32 handle;              /* OS change notification, or -1 to poll */
+} cosm_FILE_WATCH;
+
 /*
   File Functions
 */
@@ -202,15 +330,103 @@ s32 CosmFileRead( void * buffer, u64 * bytes_read, cosm_FILE * file,
   /*
     Read length bytes from the file into the buffer. bytes_read is set to the
     number of bytes actually read, which may be non-zero even on an error.
+    Small reads are served from the file's read-ahead buffer.
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmFileReadLine( utf8 * buffer, u64 * bytes_read, cosm_FILE * file,
+  u64 length );
+  /*
+    Read a line from the file into the buffer, up to and including the
+    '\n', or length - 1 bytes if the line is longer. The buffer is always
+    0 terminated. bytes_read is set to the number of bytes read, not
+    counting the terminator.
+    Returns: COSM_PASS on success, COSM_FILE_ERROR_EOF if there was
+      nothing left to read, or an error code on failure.
+  */
+
 s32 CosmFileWrite( cosm_FILE * file, u64 * bytes_written,
   const void * const buffer, u64 length );
   /*
     Write length bytes to the file from the buffer. bytes_written is set to
     the number of bytes actually written, which may be non-zero even on
-    an error.
+    an error. Small writes are held in the file's buffer until it fills or
+    is flushed, so errors writing them are returned by the call that
+    flushes them.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileFlush( cosm_FILE * file );
+  /*
+    Make any writes held in the file's buffer. Seeking, reading, truncating,
+    checking the length or EOF, and closing the file all flush first.
+    This does not force the data to disk, use COSM_FILE_MODE_SYNC for that.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileBuffer( cosm_FILE * file, u32 size );
+  /*
+    Set the size of the open file's read-ahead/write-behind buffer, 0 for
+    none. Files start with a COSM_FILE_BUFFER_SIZE buffer unless opened with
+    COSM_FILE_MODE_NOBUFFER. COSM_FILE_MODE_SYNC files only buffer reads.
+    Reads and writes of size bytes or more skip the buffer. Any buffered
+    writes are flushed first.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileReadAt( void * buffer, u64 * bytes_read, cosm_FILE * file,
+  u64 length, u64 offset );
+  /*
+    Read length bytes from the file at offset into the buffer, without
+    using or moving the current file offset. Any number of threads may make
+    positional reads and writes on one open file at the same time, but not
+    while another thread uses the other CosmFile calls on it. Reads stop
+    early only at the end of the file. bytes_read is set to the number of
+    bytes actually read, which may be non-zero even on an error. On Windows
+    the current file offset does move, to the end of what was read.
+    The file must be opened with COSM_FILE_MODE_READ.
+    Returns: COSM_PASS on success, COSM_FILE_ERROR_EOF if offset is at or
+      past the end of the file, or an error code on failure.
+  */
+
+s32 CosmFileWriteAt( cosm_FILE * file, u64 * bytes_written,
+  const void * const buffer, u64 length, u64 offset );
+  /*
+    Write length bytes from the buffer to the file at offset, without using
+    or moving the current file offset, see CosmFileReadAt. Writes held in
+    the file's buffer are made first. bytes_written is set to the number of
+    bytes actually written, which may be non-zero even on an error.
+    The file must be opened with COSM_FILE_MODE_WRITE and not
+    COSM_FILE_MODE_APPEND.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileReadAtV( const cosm_FILE_VECTOR * vector, u64 * bytes_read,
+  cosm_FILE * file, u32 count, u64 offset );
+  /*
+    CosmFileReadAt scattering the data across the count buffers in vector,
+    filling each in order before the next, with as few system calls as the
+    OS allows. A record header and body can be read into their own buffers.
+    bytes_read is set to the number of bytes actually read.
+    Returns: COSM_PASS on success, COSM_FILE_ERROR_EOF if offset is at or
+      past the end of the file, or an error code on failure.
+  */
+
+s32 CosmFileWriteAtV( cosm_FILE * file, u64 * bytes_written,
+  const cosm_FILE_VECTOR * vector, u32 count, u64 offset );
+  /*
+    CosmFileWriteAt gathering the data from the count buffers in vector, in
+    order. bytes_written is set to the number of bytes actually written.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileAdvise( cosm_FILE * file, u64 offset, u64 length, u32 advice );
+  /*
+    Tell the OS how length bytes of the file from offset will be used, 0
+    length for the rest of the file. advice is one of COSM_FILE_ADVISE_*.
+    COSM_FILE_ADVISE_WILLNEED starts reading the data into the cache in the
+    background, so a later read does not wait on the disk. These are only
+    hints, on an OS without them nothing is done.
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
@@ -279,6 +495,61 @@ s32 CosmFileUnmap( cosm_FILE_MEMORY_MAP * map );
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmFileMapReadOpen( cosm_FILE_MAP_READER * reader, cosm_FILE * file,
+  u64 offset, u64 window );
+  /*
+    Set up the reader to walk the open file from offset to its end through
+    a memory mapping of window bytes (0 for COSM_FILE_MAP_WINDOW) that
+    slides along as it is read. Each window is marked for sequential use,
+    and the OS is told to start reading the next one in before it is
+    needed. The file must be opened with COSM_FILE_MODE_READ, and not be
+    shortened while the reader is open.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileMapRead( const void ** data, u64 * bytes,
+  cosm_FILE_MAP_READER * reader, u64 max );
+  /*
+    Set data to the next bytes of the file, up to max or the end of the
+    current window, and bytes to how many, without copying them. data is
+    only good until the next call with the reader.
+    Returns: COSM_PASS on success, COSM_FILE_ERROR_EOF at the end of the
+      file, or an error code on failure.
+  */
+
+s32 CosmFileMapReadClose( cosm_FILE_MAP_READER * reader );
+  /*
+    Unmap the reader's window. The file is left open.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileMapWriteOpen( cosm_FILE_MAP_WRITER * writer, cosm_FILE * file,
+  u64 step );
+  /*
+    Set up the writer to append to the end of the open file through a
+    memory mapping. The file is grown step bytes (0 for COSM_FILE_MAP_STEP)
+    at a time, allocating the disk space at once where the OS can, and
+    remapped only when that space is used up. The file must be opened with
+    COSM_FILE_MODE_READ and COSM_FILE_MODE_WRITE, and only written with
+    the writer until it is closed.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileMapWrite( cosm_FILE_MAP_WRITER * writer, const void * data,
+  u64 length );
+  /*
+    Append length bytes of data to the file.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileMapWriteClose( cosm_FILE_MAP_WRITER * writer );
+  /*
+    Unmap the writer and cut the file back to the bytes written. If the
+    file was opened with COSM_FILE_MODE_SYNC they are forced to disk
+    first. The file is left open.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 s32 CosmFileClose( cosm_FILE * file );
   /*
     Close the file.
@@ -298,6 +569,119 @@ s32 CosmFileInfo( cosm_FILE_INFO * info, const ascii * filename );
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmFileAsyncInit( cosm_FILE_ASYNC * async, u32 depth, u32 threads,
+  u32 flags );
+  /*
+    Start an engine to run up to depth file requests at once without
+    blocking the threads that submit them. On Linux with io_uring the
+    kernel does the work, and one thread handles the completions.
+    Otherwise, or if flags has COSM_FILE_ASYNC_THREADS, threads worker
+    threads make the calls. async->engine is set to which is used.
+    Define NO_URING to build without io_uring.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileAsyncBuffers( cosm_FILE_ASYNC * async,
+  const cosm_FILE_VECTOR * buffers, u32 count );
+  /*
+    Register up to COSM_FILE_ASYNC_BUFFERS buffers that requests will read
+    into and write from over and over. With io_uring the kernel maps them
+    once instead of on every request. A request using one sets its buffer
+    to the buffer's number, from 1, and its data must lie inside it.
+    Replaces any buffers already registered, count 0 removes them. No
+    requests may be in flight.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileAsyncSubmit( cosm_FILE_ASYNC * async, u32 * started,
+  cosm_FILE_REQUEST ** requests, u32 count );
+  /*
+    Start the count requests, with io_uring in one system call. Each
+    request's file must stay open, and the request and its data untouched,
+    until it is done. Positional reads and writes follow the rules of
+    CosmFileReadAt and CosmFileWriteAt, and COSM_FILE_ASYNC_SYNC works on
+    files opened for writing. Writes held in a file's buffer are made
+    before this returns. When a request is done its bytes and status are
+    set and then its callback is called from an engine thread, so the
+    callback must not block for long, or without a callback it waits to
+    be collected by CosmFileAsyncReap. Requests may finish in any order,
+    a sync only covers writes already done. If any request is bad, or
+    there is no room for all of them under depth, none are started.
+    started is set to the number started, which are always the first
+    ones. If io_uring stops part way they finish as usual, but the rest
+    were not started and may be submitted again.
+    Returns: COSM_PASS if all were started, COSM_FILE_ERROR_BUSY if there
+      is no room or only some were started, or an error code on failure.
+  */
+
+u32 CosmFileAsyncReap( cosm_FILE_REQUEST ** requests, u32 max,
+  cosm_FILE_ASYNC * async, u32 wait );
+  /*
+    Collect up to max finished requests that have no callback. If wait is
+    COSM_FILE_ASYNC_WAIT, wait until there is at least one, otherwise
+    return at once with what is done.
+    Returns: The number of requests set, 0 if none.
+  */
+
+s32 CosmFileAsyncFree( cosm_FILE_ASYNC * async );
+  /*
+    Wait for the requests in flight to be done, then stop the engine.
+    Requests not collected by CosmFileAsyncReap are left as they are.
+    No other calls may be made with async once this starts.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileGroupInit( cosm_FILE_GROUP * group, cosm_FILE * file );
+  /*
+    Set up group to append durable records to the end of the open file,
+    which must be opened with COSM_FILE_MODE_WRITE and not
+    COSM_FILE_MODE_APPEND, and only be written through the group.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileGroupWrite( cosm_FILE_GROUP * group, const void * data,
+  u64 length );
+  /*
+    Append length bytes of data to the group's file, and return once they
+    are on disk. Records from threads calling at the same time are
+    gathered, and one of them writes up to COSM_FILE_VECTORS records with
+    a single write and a single data sync, so one flush covers many
+    records. Records are written in the order they arrive.
+    Returns: COSM_PASS once the record is on disk, or an error code on
+      failure.
+  */
+
+s32 CosmFileGroupFree( cosm_FILE_GROUP * group );
+  /*
+    Free the group. The file is left open.
+    Returns: COSM_PASS on success, COSM_FILE_ERROR_BUSY if a write is in
+      progress, or an error code on failure.
+  */
+
+s32 CosmFileWatchInit( cosm_FILE_WATCH * watch, const ascii * filename );
+  /*
+    Set up watch to notice when filename is written and closed, or when
+    another file is renamed over it, the way editors and careful programs
+    replace files. On Linux inotify watches the file's directory, so the
+    file does not need to exist yet. Elsewhere the length and modify time
+    of the file are polled, which can see a change before it is finished.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmFileWatchWait( cosm_FILE_WATCH * watch, u32 millisec );
+  /*
+    Wait up to millisec milliseconds for the file to change. Changes made
+    between calls are not lost, several may be reported as one.
+    Returns: COSM_PASS if the file changed, COSM_FILE_ERROR_TIMEOUT if it
+      did not, or an error code on failure.
+  */
+
+s32 CosmFileWatchFree( cosm_FILE_WATCH * watch );
+  /*
+    Stop watching the file and free the OS resources.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 /**
 @}
 */
@@ -330,6 +714,13 @@ Functions dealing with directories.
 #define COSM_DIR_ERROR_CLOSED    -8  /* Directory is closed */
 #define COSM_DIR_ERROR_NAME      -9  /* Invalid Dirname */
 #define COSM_DIR_ERROR_PARAM     -10 /* Parameter error */
+#define COSM_DIR_ERROR_ABORT     -11 /* Walk stopped by the callback */
+
+#define COSM_DIR_WALK_INFO       0x01 /* fill in all of the entry info */
+
+#define COSM_DIR_FILTER_PASS     0 /* report the entry, enter a directory */
+#define COSM_DIR_FILTER_SKIP     1 /* ignore the entry */
+#define COSM_DIR_FILTER_PRUNE    2 /* report the entry, don't enter it */
 
 typedef struct cosm_DIR
 {
@@ -345,6 +736,17 @@ typedef struct cosm_DIR
 #endif
 } cosm_DIR;
 
+typedef struct cosm_DIR_ENTRY
+{
+  const ascii * path;   /* native dirname/.../name, valid during the call */
+  const ascii * name;   /* the last part of path */
+  cosm_FILE_INFO info;  /* type is always set, the rest with WALK_INFO */
+  u32 depth;            /* 1 for the entries in dirname itself */
+} cosm_DIR_ENTRY;
+
+typedef s32 (*cosm_DIR_FILTER)( void * arg, const cosm_DIR_ENTRY * entry );
+typedef s32 (*cosm_DIR_CALLBACK)( void * arg, const cosm_DIR_ENTRY * entry );
+
 /**
 Attempt to open the dirname with mode.
 \return COSM_PASS on success, or an error code on failure.
@@ -365,6 +767,26 @@ s32 CosmDirClose( cosm_DIR * dir );
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmDirWalk( const ascii * dirname, u32 threads, u32 flags,
+  cosm_DIR_FILTER filter, cosm_DIR_CALLBACK callback, void * arg );
+  /*
+    Walk the tree under dirname, calling callback( arg, entry ) for every
+    file and directory in it. Each directory is read in large batches, and
+    the type comes from the directory itself, so the file is only stat'ed
+    when the filesystem doesn't give one, or flags has COSM_DIR_WALK_INFO.
+    Links are reported as COSM_FILE_TYPE_SPECIAL, and never followed.
+    If filter is not NULL it is called first, when only entry->info.type
+    is certain to be set, and returns COSM_DIR_FILTER_PASS, COSM_DIR_FILTER_SKIP, or
+    COSM_DIR_FILTER_PRUNE to report a directory without entering it.
+    With threads > 1 that many threads, including the caller, walk
+    subtrees at once, so filter and callback must be thread safe, and the
+    entries come in no particular order. A callback return other than
+    COSM_PASS stops the walk. Paths longer than COSM_FILE_MAX_FILENAME and
+    directories that can't be read are left out, and the walk goes on.
+    Returns: COSM_PASS on success, COSM_DIR_ERROR_ABORT if the callback
+      stopped the walk, or the first error code of what was left out.
+  */
+
 s32 CosmDirDelete( const ascii * dirname );
   /*
     Attempt to delete the dir. Will only work if the directory is empty.
@@ -496,6 +918,13 @@ s32 Cosm_FileWipe( cosm_FILE * file, u64 length );
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+void Cosm_FileAsyncWorker( void * arg );
+  /*
+    Async engine thread, arg is the cosm_FILE_ASYNC. Makes the calls for
+    the pool, or handles io_uring completions.
+    Returns: nothing.
+  */
+
 /* testing */
 
 /**
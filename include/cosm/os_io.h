@@ -44,6 +44,26 @@
 #define COSM_IO_DIGIT_E       14
 #define COSM_IO_DIGIT_X       33
 
+/*
+  A format string parsed once by CosmPrintCompile. The text pieces point
+  into the format string, so it has to stay unchanged until CosmPrintFree.
+*/
+typedef struct cosm_PRINT_SPEC
+{
+  u32 type;          /* literal text or the conversion */
+  u32 flags;         /* padding and where width/precision come from */
+  u32 width;
+  u32 precision;
+  const utf8 * text; /* literal text, not terminated */
+  u32 length;        /* bytes of text */
+} cosm_PRINT_SPEC;
+
+typedef struct cosm_PRINT_FORMAT
+{
+  cosm_PRINT_SPEC * specs;
+  u32 count;
+} cosm_PRINT_FORMAT;
+
 /*
   The following are defines/macros for the ANSI escape codes. Keep in mind
   that not all devices are ANSI, so use them only in fitting applications.
@@ -259,6 +279,44 @@ u32 CosmPrintFile( cosm_FILE * file, const utf8 * format, ... );
     Returns: Number of bytes written to file.
   */
 
+s32 CosmPrintCompile( cosm_PRINT_FORMAT * compiled, const utf8 * format );
+  /*
+    Parse the format once, for output that is printed over and over with
+    CosmPrintCompiled, CosmPrintStrCompiled, or CosmPrintFileCompiled.
+    The format string must not change or be freed until CosmPrintFree is
+    called. See CosmPrint for format usage.
+    Returns: COSM_PASS on success, or COSM_FAIL on failure.
+  */
+
+u32 CosmPrintCompiled( const cosm_PRINT_FORMAT * compiled, ... );
+  /*
+    Prints the formatted text to the standard output device, the same as
+    CosmPrint with the compiled format.
+    Returns: Number of bytes output.
+  */
+
+u32 CosmPrintStrCompiled( utf8 * string, u32 max_bytes,
+  const cosm_PRINT_FORMAT * compiled, ... );
+  /*
+    Prints the formatted text to the string, the same as CosmPrintStr
+    with the compiled format.
+    Returns: Number of bytes written to string.
+  */
+
+u32 CosmPrintFileCompiled( cosm_FILE * file,
+  const cosm_PRINT_FORMAT * compiled, ... );
+  /*
+    Prints the formatted text to the file, the same as CosmPrintFile
+    with the compiled format.
+    Returns: Number of bytes written to file.
+  */
+
+void CosmPrintFree( cosm_PRINT_FORMAT * compiled );
+  /*
+    Free the memory used by a compiled format.
+    Returns: nothing.
+  */
+
 /* low level */
 s32 Cosm_DecodeUTF8( utf8char * codepoint, utf8 ** next, utf8 * stream );
   /*
@@ -307,6 +365,17 @@ s32 Cosm_GetCharType( utf8char ch );
       >= 0                 a number - valid or not depending on radix.
   */
 
+u32 Cosm_StrBytesScalar( const utf8 * string );
+utf8 * Cosm_StrCharScalar( const utf8 * string, utf8char character,
+  u32 max_bytes );
+utf8 * Cosm_StrStrScalar( const utf8 * string, const utf8 * substring,
+  u32 max_bytes );
+  /*
+    Portable byte at a time versions of CosmStrBytes, CosmStrChar, and
+    CosmStrStr, used when there are no vector versions for the CPU.
+    Returns: Same as CosmStrBytes, CosmStrChar, and CosmStrStr.
+  */
+
 u32 Cosm_Print( cosm_FILE * file, void * string, u32 max_bytes,
   const void * format, va_list args );
   /*
@@ -314,9 +383,28 @@ u32 Cosm_Print( cosm_FILE * file, void * string, u32 max_bytes,
     If file is not NULL, then we write to the file.
     If string_ptr is not NULL, then we output to the string.
     If both are NULL, we write to the standard output.
+    File and standard output are collected and written in large pieces.
+    Returns: Number of characters written to file or string.
+  */
+
+u32 Cosm_PrintCompiled( cosm_FILE * file, void * string, u32 max_bytes,
+  const cosm_PRINT_FORMAT * compiled, va_list args );
+  /*
+    Cosm_Print with a format from CosmPrintCompile.
     Returns: Number of characters written to file or string.
   */
 
+u32 Cosm_PrintU64Dec( ascii * end, u64 number );
+u32 Cosm_PrintU64Hex( ascii * end, u64 number );
+u32 Cosm_PrintU128Dec( ascii * end, u128 number );
+u32 Cosm_PrintU128Hex( ascii * end, u128 number );
+  /*
+    Write the decimal or uppercase hex digits of number so the last digit
+    is at end[-1]. There must be room for 39 bytes before end. No sign,
+    prefix, or terminating 0 is written.
+    Returns: Number of digits written.
+  */
+
 s32 Cosm_PrintChar( u32 * bytes, cosm_FILE * file, void * string,
   u32 max_bytes, utf8char character );
   /*
@@ -106,6 +106,337 @@ u32 CosmS128Eq( s128 a, s128 b );    /* a == b ? 1 : 0; */
 u32 CosmS128Gt( s128 a, s128 b );    /* a > b ? 1 : 0; */
 u32 CosmS128Lt( s128 a, s128 b );    /* a < b ? 1 : 0; */
 
+/*
+  Native 128-bit backend. When the compiler has a 128-bit integer type
+  (GCC/Clang on 64-bit CPUs) the functions above are replaced by inline
+  versions that the compiler turns into a few instructions. The u128 and
+  s128 structs stay the same, so the ABI is unchanged, and the software
+  functions in os_math.c are still built for the function pointers and for
+  platforms without __int128. Define SOFTWARE_128 to force the software path.
+*/
+
+#if ( defined( __SIZEOF_INT128__ ) && !defined( SOFTWARE_128 ) )
+#define COSM_NATIVE_128
+
+__extension__ typedef unsigned __int128 cosm_n128;
+__extension__ typedef signed __int128 cosm_ns128;
+
+#define _COSM_N128( a ) \
+  ( ( ( (cosm_n128) (u64) (a).hi ) << 64 ) | (cosm_n128) (a).lo )
+
+static __inline__ u128 Cosm_U128Native( cosm_n128 x )
+{
+  u128 r;
+
+  r.hi = (u64) ( x >> 64 );
+  r.lo = (u64) x;
+  return r;
+}
+
+static __inline__ s128 Cosm_S128Native( cosm_n128 x )
+{
+  s128 r;
+
+  r.hi = (s64) ( x >> 64 );
+  r.lo = (u64) x;
+  return r;
+}
+
+static __inline__ u128 Cosm_U128U64Native( u64 a )
+{
+  u128 r;
+
+  r.hi = 0;
+  r.lo = a;
+  return r;
+}
+
+static __inline__ s128 Cosm_S128S64Native( s64 a )
+{
+  s128 r;
+
+  r.hi = ( a < 0 ) ? -1 : 0;
+  r.lo = (u64) a;
+  return r;
+}
+
+static __inline__ u128 Cosm_U128AddNative( u128 a, u128 b )
+{
+  return Cosm_U128Native( _COSM_N128( a ) + _COSM_N128( b ) );
+}
+
+static __inline__ u128 Cosm_U128SubNative( u128 a, u128 b )
+{
+  return Cosm_U128Native( _COSM_N128( a ) - _COSM_N128( b ) );
+}
+
+static __inline__ u128 Cosm_U128MulNative( u128 a, u128 b )
+{
+  return Cosm_U128Native( _COSM_N128( a ) * _COSM_N128( b ) );
+}
+
+static __inline__ void Cosm_U128DivModNative( u128 a, u128 b,
+  u128 * div, u128 * mod )
+{
+  cosm_n128 x, y;
+
+  x = _COSM_N128( a );
+  y = _COSM_N128( b );
+
+  /* 0/x or x/0 - Return 0, same as the software version */
+  if ( ( x == 0 ) || ( y == 0 ) )
+  {
+    div->hi = 0;
+    div->lo = 0;
+    mod->hi = 0;
+    mod->lo = 0;
+    return;
+  }
+
+  *div = Cosm_U128Native( x / y );
+  *mod = Cosm_U128Native( x % y );
+}
+
+static __inline__ u128 Cosm_U128DivNative( u128 a, u128 b )
+{
+  u128 div, mod;
+
+  Cosm_U128DivModNative( a, b, &div, &mod );
+  return div;
+}
+
+static __inline__ u128 Cosm_U128ModNative( u128 a, u128 b )
+{
+  u128 div, mod;
+
+  Cosm_U128DivModNative( a, b, &div, &mod );
+  return mod;
+}
+
+static __inline__ u128 Cosm_U128IncNative( u128 * a )
+{
+  u128 r;
+
+  r = *a;
+  *a = Cosm_U128Native( _COSM_N128( r ) + 1 );
+  return r;
+}
+
+static __inline__ u128 Cosm_U128DecNative( u128 * a )
+{
+  u128 r;
+
+  r = *a;
+  *a = Cosm_U128Native( _COSM_N128( r ) - 1 );
+  return r;
+}
+
+static __inline__ u128 Cosm_U128LshNative( u128 a, u32 x )
+{
+  if ( x > 127 )
+  {
+    return Cosm_U128Native( 0 );
+  }
+  return Cosm_U128Native( _COSM_N128( a ) << x );
+}
+
+static __inline__ u128 Cosm_U128RshNative( u128 a, u32 x )
+{
+  if ( x > 127 )
+  {
+    return Cosm_U128Native( 0 );
+  }
+  return Cosm_U128Native( _COSM_N128( a ) >> x );
+}
+
+static __inline__ u128 Cosm_U128AndNative( u128 a, u128 b )
+{
+  return Cosm_U128Native( _COSM_N128( a ) & _COSM_N128( b ) );
+}
+
+static __inline__ u128 Cosm_U128OrNative( u128 a, u128 b )
+{
+  return Cosm_U128Native( _COSM_N128( a ) | _COSM_N128( b ) );
+}
+
+static __inline__ u128 Cosm_U128XorNative( u128 a, u128 b )
+{
+  return Cosm_U128Native( _COSM_N128( a ) ^ _COSM_N128( b ) );
+}
+
+static __inline__ u128 Cosm_U128NotNative( u128 a )
+{
+  return Cosm_U128Native( ~_COSM_N128( a ) );
+}
+
+static __inline__ u32 Cosm_U128EqNative( u128 a, u128 b )
+{
+  return ( _COSM_N128( a ) == _COSM_N128( b ) );
+}
+
+static __inline__ u32 Cosm_U128GtNative( u128 a, u128 b )
+{
+  return ( _COSM_N128( a ) > _COSM_N128( b ) );
+}
+
+static __inline__ u32 Cosm_U128LtNative( u128 a, u128 b )
+{
+  return ( _COSM_N128( a ) < _COSM_N128( b ) );
+}
+
+static __inline__ s128 Cosm_S128AddNative( s128 a, s128 b )
+{
+  return Cosm_S128Native( _COSM_N128( a ) + _COSM_N128( b ) );
+}
+
+static __inline__ s128 Cosm_S128SubNative( s128 a, s128 b )
+{
+  return Cosm_S128Native( _COSM_N128( a ) - _COSM_N128( b ) );
+}
+
+static __inline__ s128 Cosm_S128MulNative( s128 a, s128 b )
+{
+  /* two's complement, the low 128 bits are the same signed or not */
+  return Cosm_S128Native( _COSM_N128( a ) * _COSM_N128( b ) );
+}
+
+static __inline__ s128 Cosm_S128DivNative( s128 a, s128 b )
+{
+  cosm_n128 x, y, r;
+  s32 sign;
+
+  /* work on magnitudes so INT128_MIN and x/0 match the software version */
+  x = _COSM_N128( a );
+  y = _COSM_N128( b );
+  sign = 0;
+  if ( a.hi < 0 )
+  {
+    sign ^= 1;
+    x = -x;
+  }
+  if ( b.hi < 0 )
+  {
+    sign ^= 1;
+    y = -y;
+  }
+
+  if ( ( x == 0 ) || ( y == 0 ) )
+  {
+    return Cosm_S128Native( 0 );
+  }
+
+  r = x / y;
+  if ( sign )
+  {
+    r = -r;
+  }
+
+  return Cosm_S128Native( r );
+}
+
+static __inline__ s128 Cosm_S128ModNative( s128 a, s128 b )
+{
+  cosm_n128 x, y, r;
+  s32 sign;
+
+  x = _COSM_N128( a );
+  y = _COSM_N128( b );
+  sign = 0;
+  if ( a.hi < 0 )
+  {
+    sign ^= 1;
+    x = -x;
+  }
+  if ( b.hi < 0 )
+  {
+    sign ^= 1;
+    y = -y;
+  }
+
+  if ( ( x == 0 ) || ( y == 0 ) )
+  {
+    return Cosm_S128Native( 0 );
+  }
+
+  r = x % y;
+  if ( sign && ( r != 0 ) )
+  {
+    r = y - r;
+  }
+
+  return Cosm_S128Native( r );
+}
+
+static __inline__ s128 Cosm_S128IncNative( s128 * a )
+{
+  s128 r;
+
+  r = *a;
+  *a = Cosm_S128Native( _COSM_N128( r ) + 1 );
+  return r;
+}
+
+static __inline__ s128 Cosm_S128DecNative( s128 * a )
+{
+  s128 r;
+
+  r = *a;
+  *a = Cosm_S128Native( _COSM_N128( r ) - 1 );
+  return r;
+}
+
+static __inline__ u32 Cosm_S128EqNative( s128 a, s128 b )
+{
+  return ( _COSM_N128( a ) == _COSM_N128( b ) );
+}
+
+static __inline__ u32 Cosm_S128GtNative( s128 a, s128 b )
+{
+  return ( (cosm_ns128) _COSM_N128( a ) > (cosm_ns128) _COSM_N128( b ) );
+}
+
+static __inline__ u32 Cosm_S128LtNative( s128 a, s128 b )
+{
+  return ( (cosm_ns128) _COSM_N128( a ) < (cosm_ns128) _COSM_N128( b ) );
+}
+
+#define CosmU128U64( a ) Cosm_U128U64Native( (u64) ( a ) )
+#define CosmS128S64( a ) Cosm_S128S64Native( (s64) ( a ) )
+#define CosmU128U32( a ) Cosm_U128U64Native( (u64) (u32) ( a ) )
+#define CosmS128S32( a ) Cosm_S128S64Native( (s64) (s32) ( a ) )
+
+#define CosmU128Add( a, b ) Cosm_U128AddNative( a, b )
+#define CosmU128Sub( a, b ) Cosm_U128SubNative( a, b )
+#define CosmU128Mul( a, b ) Cosm_U128MulNative( a, b )
+#define CosmU128Div( a, b ) Cosm_U128DivNative( a, b )
+#define CosmU128Mod( a, b ) Cosm_U128ModNative( a, b )
+#define CosmU128DivMod( a, b, div, mod ) \
+  Cosm_U128DivModNative( a, b, div, mod )
+#define CosmU128Inc( a ) Cosm_U128IncNative( a )
+#define CosmU128Dec( a ) Cosm_U128DecNative( a )
+#define CosmU128Lsh( a, x ) Cosm_U128LshNative( a, x )
+#define CosmU128Rsh( a, x ) Cosm_U128RshNative( a, x )
+#define CosmU128And( a, b ) Cosm_U128AndNative( a, b )
+#define CosmU128Or( a, b ) Cosm_U128OrNative( a, b )
+#define CosmU128Xor( a, b ) Cosm_U128XorNative( a, b )
+#define CosmU128Not( a ) Cosm_U128NotNative( a )
+#define CosmU128Eq( a, b ) Cosm_U128EqNative( a, b )
+#define CosmU128Gt( a, b ) Cosm_U128GtNative( a, b )
+#define CosmU128Lt( a, b ) Cosm_U128LtNative( a, b )
+
+#define CosmS128Add( a, b ) Cosm_S128AddNative( a, b )
+#define CosmS128Sub( a, b ) Cosm_S128SubNative( a, b )
+#define CosmS128Mul( a, b ) Cosm_S128MulNative( a, b )
+#define CosmS128Div( a, b ) Cosm_S128DivNative( a, b )
+#define CosmS128Mod( a, b ) Cosm_S128ModNative( a, b )
+#define CosmS128Inc( a ) Cosm_S128IncNative( a )
+#define CosmS128Dec( a ) Cosm_S128DecNative( a )
+#define CosmS128Eq( a, b ) Cosm_S128EqNative( a, b )
+#define CosmS128Gt( a, b ) Cosm_S128GtNative( a, b )
+#define CosmS128Lt( a, b ) Cosm_S128LtNative( a, b )
+
+#endif /* COSM_NATIVE_128 */
+
 /* floating point NaN and Inf testing */
 
 s32 CosmFloatNaN( f64 number );
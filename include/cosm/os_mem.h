@@ -21,6 +21,19 @@
 
 #include "cosm/cputypes.h"
 
+/*
+  Vector versions of CosmMemCmp and the string search functions are used
+  on x64 with GCC/Clang, AVX2 when the CPU has it, otherwise SSE2.
+  Define NO_SIMD to only use the portable versions.
+*/
+#if ( ( CPU_TYPE == CPU_X64 ) && defined( __GNUC__ ) && !defined( NO_SIMD ) )
+#define COSM_SIMD_X64
+#endif
+
+#define COSM_MEM_SIMD_NONE  0
+#define COSM_MEM_SIMD_SSE2  1
+#define COSM_MEM_SIMD_AVX2  2
+
 #if ( !defined( MEM_LEAK_FIND ) )
 #define CosmMemAlloc Cosm_MemAlloc
 #define CosmMemAllocSecure Cosm_MemAllocSecure
@@ -73,6 +86,15 @@ s32 CosmMemSystem( u64 * amount );
     Returns: COSM_PASS on success, or COSM_FAIL on failure.
   */
 
+void CosmMemCounters( u64 * allocs, u64 * frees, u64 * bytes );
+  /*
+    Get the number of allocations and frees made since the program started,
+    and the number of heap bytes currently allocated. bytes uses the size
+    the heap really reserved, so it is 0 on systems that cannot report it.
+    Any of the pointers may be NULL.
+    Returns: nothing.
+  */
+
 /* low level */
 
 void * Cosm_MemAlloc( u64 bytes );
@@ -155,6 +177,28 @@ s32 Cosm_MemDumpLeaks( const ascii * filename, const ascii * file, u32 line );
     Returns: COSM_PASS on success, or COSM_FAIL on failure.
   */
 
+u32 Cosm_MemSIMD( void );
+  /*
+    Detect the vector instructions the memory and string functions use,
+    only checks the CPU on the first call.
+    Returns: COSM_MEM_SIMD_NONE, COSM_MEM_SIMD_SSE2, or COSM_MEM_SIMD_AVX2.
+  */
+
+u64 Cosm_MemScan( const void * memory, u8 a, u8 b, u64 length );
+  /*
+    Find the first byte in the length bytes of memory that is either a or b,
+    pass the same value twice to look for a single byte. Unlike the string
+    functions this does not stop at a 0, so it is safe for network buffers.
+    Returns: The offset of the first matching byte, or length if none match.
+  */
+
+s32 Cosm_MemCmpScalar( const void * blockA, const void * blockB,
+  u64 max_bytes );
+  /*
+    Portable byte at a time version of CosmMemCmp.
+    Returns: Same as CosmMemCmp.
+  */
+
 /* testing */
 
 s32 Cosm_TestOSMem( void );
@@ -21,6 +21,7 @@
 
 #include "cosm/cputypes.h"
 #include "cosm/os_task.h"
+#include "cosm/os_file.h"
 
 #define COSM_NET_STATUS_CLOSED   0
 #define COSM_NET_STATUS_OPENING  1
@@ -30,6 +31,7 @@
 #define COSM_NET_MODE_NONE  0
 #define COSM_NET_MODE_TCP   85
 #define COSM_NET_MODE_UDP   153
+#define COSM_NET_MODE_SHARED 0x10000 /* or with mode for CosmNetListen */
 
 #define COSM_NET_ERROR_ADDRESS   -1  /* Unable to connect to host/port */
 #define COSM_NET_ERROR_MYADDRESS -2  /* Unable to bind to my host/port */
@@ -45,6 +47,8 @@
 #define COSM_NET_ERROR_SOCKET    -12 /* Internal socket error, now closed */
 #define COSM_NET_ERROR_ADDRTYPE  -13 /* Bad addr type, no IPV6 support? */
 #define COSM_NET_ERROR_NO_NET    -14 /* No networking support */
+#define COSM_NET_ERROR_FILE      -15 /* File read failed or too short */
+#define COSM_NET_ERROR_DNS       -16 /* No such name, or lookup failed */
 
 #define COSM_NET_ACCEPT_NOWAIT  0
 #define COSM_NET_ACCEPT_WAIT    1
@@ -83,22 +87,149 @@ typedef ascii cosm_NET_HOSTNAME[COSM_NET_MAX_HOSTNAME];
 #define COSM_NET_ALLOW  1
 #define COSM_NET_DENY   0
 
-typedef struct cosm_NET_ACL_ENTRY
+typedef struct cosm_NET_ACL_TIMER
 {
+  u128 key;
+  u32 bits;
+  u32 type;
   cosmtime expires;
-  cosm_NET_ADDR addr;
-  cosm_NET_ADDR mask;
-  u32 permission;
-  u32 null;  /* for memory alignment */
-} cosm_NET_ACL_ENTRY;
+  u32 slot;                             /* in the wheel */
+  struct cosm_NET_ACL_TIMER * prev;
+  struct cosm_NET_ACL_TIMER * next;
+} cosm_NET_ACL_TIMER;
+
+typedef struct cosm_NET_ACL_NODE
+{
+  u128 key;        /* prefix, left aligned, IPv4 in the top 32 bits */
+  u32 bits;        /* prefix length */
+  u32 permission;  /* COSM_NET_ALLOW, COSM_NET_DENY, or none for a split */
+  cosmtime expires;
+  cosm_NET_ACL_TIMER * timer;           /* the entry's one timer */
+  struct cosm_NET_ACL_NODE * child[2];  /* by the bit after the prefix */
+  struct cosm_NET_ACL_NODE * retired;   /* next node waiting to be freed */
+} cosm_NET_ACL_NODE;
+
+#define COSM_NET_ACL_WHEEL 256 /* one second per slot */
 
 typedef struct cosm_NET_ACL
 {
+  u32 count;
+  cosm_NET_ACL_NODE * v4;       /* tries, read without the lock */
+  cosm_NET_ACL_NODE * v6;
+  u32 epoch;                    /* readers count in readers[epoch & 1] */
+  u32 readers[2];
+  cosm_NET_ACL_NODE * retired;  /* replaced nodes readers may still see */
+  u32 retired_count;
+  s64 swept;                    /* wheel is swept through this second */
+  cosm_NET_ACL_TIMER * wheel[COSM_NET_ACL_WHEEL];
+  cosm_MUTEX lock;              /* for changes */
+} cosm_NET_ACL;
+
+typedef struct cosm_NET_PACKET
+{
+  cosm_NET_ADDR addr; /* where to send it, or who sent it */
+  void * data;
+  u32 length;         /* bytes to send, or bytes received */
+  u32 size;           /* room in data when receiving */
+} cosm_NET_PACKET;
+
+#define COSM_NET_VECTORS      64         /* buffers per send/recv call */
+#define COSM_NET_ZEROCOPY     65536      /* smallest zerocopy send */
+#define COSM_NET_WAIT_FOREVER 0xFFFFFFFF /* wait_ms for no time limit */
+
+typedef struct cosm_NET_VECTOR
+{
+  void * data;
+  u32 length;   /* bytes to send, or room in data when receiving */
+} cosm_NET_VECTOR;
+
+#define COSM_NET_OPTION_NODELAY    1  /* send small writes at once, no Nagle */
+#define COSM_NET_OPTION_QUICKACK   2  /* ack at once, no delayed acks */
+#define COSM_NET_OPTION_KEEPALIVE  4  /* probe idle connections */
+#define COSM_NET_OPTION_FASTOPEN   8  /* TCP Fast Open, data in the SYN */
+#define COSM_NET_OPTION_REUSEADDR  16 /* listen past TIME_WAIT leftovers */
+#define COSM_NET_OPTION_ZEROCOPY   32 /* large CosmNetSendAll skip copies */
+
+typedef struct cosm_NET_OPTIONS
+{
+  u32 flags;              /* COSM_NET_OPTION_* or'd together */
+  u32 send_buffer;        /* SO_SNDBUF bytes, 0 for the OS default */
+  u32 recv_buffer;        /* SO_RCVBUF bytes, 0 for the OS default */
+  u32 keepalive_idle;     /* seconds idle before probing, 0 for default */
+  u32 keepalive_interval; /* seconds between probes, 0 for default */
+  u32 keepalive_count;    /* unanswered probes before closing */
+  u32 busy_poll;          /* SO_BUSY_POLL microseconds, 0 for off */
+  u32 backlog;            /* listen queue, 0 for the OS maximum */
+} cosm_NET_OPTIONS;
+
+#define COSM_NET_POLL_READ    1 /* data or a connection is waiting */
+#define COSM_NET_POLL_WRITE   2 /* sends will not block */
+#define COSM_NET_POLL_CLOSED  4 /* closed or failed, if the OS can tell */
+
+typedef struct cosm_NET_EVENT
+{
+  cosm_NET * net;
+  u32 events;
+} cosm_NET_EVENT;
+
+typedef struct cosm_NET_POLLER
+{
+  u64 handle;        /* epoll descriptor where there is one */
+  u32 count;
   u32 length;
+  cosm_NET ** nets;  /* registered connections */
+  u32 * events;      /* what each one is registered for */
+  void * os_events;  /* OS event/pollfd array */
+  u32 os_length;
+} cosm_NET_POLLER;
+
+#define COSM_NET_DNS_ADDRS    8    /* addresses kept for each name */
+#define COSM_NET_DNS_SERVERS  4
+#define COSM_NET_DNS_TABLE    256  /* hash chains */
+#define COSM_NET_DNS_ENTRIES  4096 /* names cached before trimming */
+#define COSM_NET_DNS_TTL      60   /* CosmNetDNS cache seconds */
+#define COSM_NET_DNS_NEG_TTL  5    /* CosmNetDNS failure cache seconds */
+
+typedef void (*cosm_NET_DNS_CALLBACK)( void * arg, const ascii * name,
+  const cosm_NET_ADDR * addr, u32 count, s32 status );
+
+typedef struct cosm_NET_DNS_WAITER
+{
+  cosm_NET_DNS_CALLBACK callback;
+  void * arg;
+  u32 allocated;  /* freed after the callback */
+  struct cosm_NET_DNS_WAITER * next;
+} cosm_NET_DNS_WAITER;
+
+typedef struct cosm_NET_DNS_ENTRY
+{
+  ascii name[COSM_NET_MAX_HOSTNAME];
+  cosm_NET_ADDR addr[COSM_NET_DNS_ADDRS];
   u32 count;
-  cosm_NET_ACL_ENTRY * list;
+  s32 status;       /* COSM_PASS, or why there are no addresses */
+  u32 state;        /* waiting for, or being looked up by a worker, or done */
+  u64 expires;      /* CosmClockMono time the answer goes stale */
+  cosm_NET_DNS_WAITER * waiters;
+  struct cosm_NET_DNS_ENTRY * next;   /* hash chain */
+  struct cosm_NET_DNS_ENTRY * queue;  /* next lookup for the workers */
+} cosm_NET_DNS_ENTRY;
+
+typedef struct cosm_NET_RESOLVER
+{
   cosm_MUTEX lock;
-} cosm_NET_ACL;
+  cosm_SEMAPHORE work;  /* one up for each queued lookup */
+  cosm_NET_DNS_ENTRY * table[COSM_NET_DNS_TABLE];
+  u32 count;
+  cosm_NET_DNS_ENTRY * queue;
+  cosm_NET_DNS_ENTRY * queue_tail;
+  cosm_NET_ADDR servers[COSM_NET_DNS_SERVERS];  /* none for the system's */
+  u32 server_count;
+  u32 threads;          /* workers running */
+  u32 stop;
+  u32 ttl;              /* seconds, the most any answer is kept */
+  u32 negative_ttl;     /* seconds, the most a failure is kept */
+  u32 lookups;          /* names handed to the system or servers */
+} cosm_NET_RESOLVER;
 
 /* Network send and receive functions */
 
@@ -123,6 +254,17 @@ s32 CosmNetOpenSocks( cosm_NET * net, const cosm_NET_ADDR * addr,
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmNetOpenOptions( cosm_NET * net, cosm_NET_ADDR * my_addr,
+  const cosm_NET_ADDR * addr, u32 mode, const cosm_NET_OPTIONS * options );
+  /*
+    CosmNetOpen with the socket options set before connecting, so buffer
+    sizes are used for the TCP window and COSM_NET_OPTION_FASTOPEN can put
+    the first send in the SYN. A NULL options is the same as CosmNetOpen.
+    Options the OS does not support or refuses are skipped, use
+    CosmNetGetOptions to see what is in effect.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 #define _COSM_NETOPEN( net, host ) \
   CosmNetOpen( net, NULL, host, COSM_NET_MODE_TCP )
   /*
@@ -138,6 +280,47 @@ s32 CosmNetSend( cosm_NET * net, u32 * bytes_sent, const void * data,
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmNetSendV( cosm_NET * net, u64 * bytes_sent,
+  const cosm_NET_VECTOR * vector, u32 count );
+  /*
+    CosmNetSend gathering the data from the count buffers in vector, in
+    order, with one system call. A header and body go out together without
+    being copied into one buffer first. Zero length buffers are skipped.
+    bytes_sent is set to the number of bytes actually sent, which may be
+    less than the total.
+    Connection must be opened/accepted in COSM_NET_MODE_TCP mode.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmNetSendAll( cosm_NET * net, u64 * bytes_sent,
+  const cosm_NET_VECTOR * vector, u32 count, u32 wait_ms );
+  /*
+    CosmNetSendV that keeps sending until all of the data is sent or
+    wait_ms milliseconds have passed, COSM_NET_WAIT_FOREVER for no limit.
+    If the connection has COSM_NET_OPTION_ZEROCOPY set, sends of
+    COSM_NET_ZEROCOPY bytes or more are made from the buffers without
+    copying them where the OS supports it, and this waits until the OS is
+    done with them before returning. bytes_sent is set to the number of
+    bytes actually sent.
+    Connection must be opened/accepted in COSM_NET_MODE_TCP mode.
+    Returns: COSM_PASS if all the data was sent, COSM_NET_ERROR_TIMEOUT if
+      time ran out first, or an error code on failure.
+  */
+
+s32 CosmNetSendFile( cosm_NET * net, u64 * bytes_sent, cosm_FILE * file,
+  u64 offset, u64 length, const void * header, u32 header_length );
+  /*
+    Send header_length bytes of header, which may be NULL if it is 0, then
+    length bytes of the file starting at offset over the connection.
+    On Linux the file goes from the page cache straight to the socket with
+    sendfile, and the header is held back to share packets with it. Other
+    systems read and send the file in blocks. The file offset used by
+    CosmFileRead is not changed. bytes_sent is set to the number of bytes
+    actually sent, header included.
+    Connection must be opened/accepted in COSM_NET_MODE_TCP mode.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 s32 CosmNetRecv( void * buffer, u32 * bytes_received, cosm_NET * net,
   u32 length, u32 wait_ms );
   /*
@@ -149,6 +332,18 @@ s32 CosmNetRecv( void * buffer, u32 * bytes_received, cosm_NET * net,
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmNetRecvV( const cosm_NET_VECTOR * vector, u64 * bytes_received,
+  cosm_NET * net, u32 count, u32 wait_ms );
+  /*
+    CosmNetRecv scattering the data across the count buffers in vector,
+    filling each in order before the next, up to the total of their
+    lengths. If wait_ms is non-zero, then delay up to wait_ms milliseconds
+    until the buffers are full. bytes_received is set to the number of
+    bytes actually read.
+    Connection must be opened/accepted in COSM_NET_MODE_TCP mode.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 s32 CosmNetSendUDP( cosm_NET * net, const cosm_NET_ADDR * addr,
   const void * data, u32 length );
   /*
@@ -169,15 +364,53 @@ s32 CosmNetRecvUDP( void * buffer, u32 * bytes_read, cosm_NET_ADDR * from,
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmNetSendUDPBatch( u32 * sent, cosm_NET * net,
+  const cosm_NET_PACKET * packets, u32 count );
+  /*
+    Send count packets, each to its own addr, with as few system calls as
+    the OS allows (sendmmsg on Linux). sent is set to the number of packets
+    handed to the OS, which is count unless there is an error.
+    Connection must be opened in COSM_NET_MODE_UDP mode.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmNetRecvUDPBatch( u32 * count, cosm_NET_PACKET * packets,
+  cosm_NET * net, u32 max, cosm_NET_ACL * acl, u32 wait_ms );
+  /*
+    Wait up to wait_ms milliseconds for a UDP packet, then read it and any
+    others already waiting, up to max, into packets with as few system
+    calls as the OS allows (recvmmsg on Linux). Each packet's data and size
+    must be set, and length and addr are set for each packet read. Packets
+    from hosts that fail the acl masks are dropped, which may move entries
+    after the first count around. count is set to the number of packets
+    read, which is 0 on a timeout.
+    Connection must be listening in COSM_NET_MODE_UDP mode.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 s32 CosmNetListen( cosm_NET * net, const cosm_NET_ADDR * addr, u32 mode,
   u32 queue );
   /*
     Set up a listening point on addr that will accept connections.
     Listen on addr if possible, if the IP is zero listen on all interfaces.
     If mode is COSM_NET_MODE_TCP, TCP protocol is used. If mode is
-    COSM_NET_MODE_UDP, then the UDP protocol is used.
-    If port is zero, let OS pick one. Allow queue connections to be
-    queued before rejecting connections.
+    COSM_NET_MODE_UDP, then the UDP protocol is used. Or in
+    COSM_NET_MODE_SHARED to let several nets listen on the same port with
+    the OS spreading connections and packets across them, where the OS
+    supports it (SO_REUSEPORT), otherwise COSM_NET_ERROR_MODE is returned.
+    If port is zero, let OS pick one and set my_addr.port to it. Allow
+    queue connections to be queued before rejecting connections.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmNetListenOptions( cosm_NET * net, const cosm_NET_ADDR * addr,
+  u32 mode, const cosm_NET_OPTIONS * options );
+  /*
+    CosmNetListen with the socket options set before binding, and a queue
+    of options->backlog connections. Connections accepted from net
+    inherit the options on most OSes. A NULL options uses the OS maximum
+    queue and no other options. Options the OS does not support or
+    refuses are skipped, use CosmNetGetOptions to see what is in effect.
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
@@ -192,16 +425,84 @@ s32 CosmNetAccept( cosm_NET * new_connection, cosm_NET * net,
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+s32 CosmNetSetOptions( cosm_NET * net, const cosm_NET_OPTIONS * options );
+  /*
+    Set options on an open or listening net, such as one just accepted.
+    Zero fields are left alone, backlog and COSM_NET_OPTION_REUSEADDR only
+    apply when listening and are ignored here.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmNetGetOptions( cosm_NET_OPTIONS * options, cosm_NET * net );
+  /*
+    Set options to what is in effect on the open or listening net, as the
+    OS reports it. Buffer sizes may differ from what was asked for, and
+    backlog is always 0 since the OS does not report it.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 s32 CosmNetClose( cosm_NET * net );
   /*
     Close the network connection and clear out any remaining data.
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+void CosmNetCounters( u64 * sent, u64 * received, u64 * syscalls );
+  /*
+    Get the totals for every connection since the program started: bytes
+    sent, bytes received, and the number of socket system calls made to
+    connect, accept, wait, send, and receive. Any of the pointers may be
+    NULL.
+    Returns: nothing.
+  */
+
+s32 CosmNetPollerInit( cosm_NET_POLLER * poller );
+  /*
+    Initialize a poller, used to wait on many connections at once. Unlike
+    the per call waits, there is no limit on the number of connections or
+    on how large their descriptors are.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmNetPollerAdd( cosm_NET_POLLER * poller, cosm_NET * net,
+  u32 events );
+  /*
+    Register the open or listening net with the poller for events, any of
+    COSM_NET_POLL_READ and COSM_NET_POLL_WRITE or'd together. The net must
+    stay at the same address until it is removed. Events are level
+    triggered on every OS, so a connection is reported by each wait for
+    as long as it has data left to read or room to send.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmNetPollerRemove( cosm_NET_POLLER * poller, cosm_NET * net );
+  /*
+    Stop watching net. This must be done before it is closed.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmNetPollerWait( u32 * count, cosm_NET_EVENT * ready,
+  cosm_NET_POLLER * poller, u32 max, u32 wait_ms );
+  /*
+    Wait up to wait_ms milliseconds for any of the registered connections
+    to be ready, then set up to max entries of ready to the connections
+    and the COSM_NET_POLL_* events that happened on each. count is set to
+    the number of entries, which is 0 on a timeout.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmNetPollerFree( cosm_NET_POLLER * poller );
+  /*
+    Free the poller. The registered connections are not closed.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 u32 CosmNetDNS( cosm_NET_ADDR * addr, u32 count, ascii * name );
   /*
     Perform DNS lookup. Sets up to count addr's to the addresses of the
-    named host.
+    named host. Lookups go through a resolver shared by the process, so
+    answers are cached COSM_NET_DNS_TTL seconds and failures
+    COSM_NET_DNS_NEG_TTL seconds. IP addresses are converted directly.
     Returns: Number of IP's set, 0 indicates failure.
   */
 
@@ -211,6 +512,48 @@ s32 CosmNetRevDNS( cosm_NET_HOSTNAME * name, const cosm_NET_ADDR * addr );
     Returns: COSM_PASS on success, or COSM_FAIL on failure.
   */
 
+s32 CosmNetResolverInit( cosm_NET_RESOLVER * resolver,
+  const cosm_NET_ADDR * servers, u32 server_count, u32 threads,
+  u32 ttl, u32 negative_ttl );
+  /*
+    Start a resolver with threads worker threads doing lookups. With no
+    servers the system's lookup (getaddrinfo) is used and every answer is
+    kept ttl seconds. Otherwise A and AAAA queries are sent over UDP to the
+    up to COSM_NET_DNS_SERVERS servers in turn, answers are kept for their
+    own TTL up to ttl seconds, and NXDOMAIN for the zone's negative TTL.
+    Queries have random IDs, and replies must repeat the question asked.
+    Failures are kept at most negative_ttl seconds. Any number of threads
+    asking for the same name share one lookup.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+u32 CosmNetResolve( cosm_NET_ADDR * addr, u32 count,
+  cosm_NET_RESOLVER * resolver, const ascii * name );
+  /*
+    CosmNetDNS using the resolver's cache, waiting for a worker to look
+    the name up if it is not cached.
+    Returns: Number of IP's set, 0 indicates failure.
+  */
+
+s32 CosmNetResolveAsync( cosm_NET_RESOLVER * resolver, const ascii * name,
+  cosm_NET_DNS_CALLBACK callback, void * arg );
+  /*
+    Look name up without waiting. callback is called with arg, the name,
+    the addresses and their count, and a status of COSM_PASS,
+    COSM_NET_ERROR_DNS or COSM_NET_ERROR_TIMEOUT. That happens before this
+    returns if the name is cached or is an IP address, otherwise later
+    from a worker thread, so callback must not block for long.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
+s32 CosmNetResolverFree( cosm_NET_RESOLVER * resolver );
+  /*
+    Stop the workers once they finish the lookups they are doing, call
+    back any other waiters with COSM_NET_ERROR_CLOSED, and free the cache.
+    No other calls may be made with the resolver once this starts.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+
 u32 CosmNetMyIP( cosm_NET_ADDR * addr, u32 count );
   /*
     Sets up to length addresses to the IP of the host. Expect at least 2 IPv4
@@ -219,12 +562,20 @@ u32 CosmNetMyIP( cosm_NET_ADDR * addr, u32 count );
     Returns: Number of addresses set, 0 indicates failure or no networking.
   */
 
+s32 CosmNetACLInit( cosm_NET_ACL * acl );
+  /*
+    Initialize the acl before any other use. acl must be zeroed first.
+    Returns: COSM_PASS on success, or COSM_FAIL on failure.
+  */
+
 s32 CosmNetACLAdd( cosm_NET_ACL * acl, const cosm_NET_ADDR * addr,
   u32 mask_bits, u32 permission, cosmtime expires );
   /*
-    Add the ip/mask pair to the acl. perm should be either COSM_NET_ALLOW or
-    COSM_NET_DENY. expires is the time after which the entry will be deleted
-    automatically, and should be based off of CosmSystemClock time.
+    Add the ip/mask pair to the acl, replacing any entry for the same pair.
+    perm should be either COSM_NET_ALLOW or COSM_NET_DENY. expires is the
+    time after which the entry will be deleted automatically, and should be
+    based off of CosmSystemClock time. Adds to an acl that was never
+    initialized fail, and an acl with no entries allows every ip.
     Returns: COSM_PASS on success, or COSM_FAIL on failure.
   */
 
@@ -237,15 +588,17 @@ s32 CosmNetACLDelete( cosm_NET_ACL * acl, const cosm_NET_ADDR * addr,
 
 s32 CosmNetACLCheck( cosm_NET_ACL * acl, const cosm_NET_ADDR * addr );
   /*
-    Test if an ip is accepted by the acl. An ip is accepted if it passed
-    through each of the acl entries in order and has a COSM_NET_ALLOW setting
-    at the end. The default is to allow i.e. a NULL acl.
+    Test if an ip is accepted by the acl. The unexpired entry with the
+    longest mask matching the ip decides, and an ip no entry matches is
+    allowed, as is any ip with a NULL acl. Checks take no lock and cost the
+    mask length at most, however many entries there are, so they can run
+    in any number of threads while entries are added and deleted.
     Returns: COSM_NET_ALLOW if accepted, or COSM_NET_DENY if rejected.
   */
 
 void CosmNetACLFree( cosm_NET_ACL * acl );
   /*
-    Free the internal acl data.
+    Free the internal acl data. No checks may be running.
     Returns: nothing.
   */
 
@@ -262,6 +615,12 @@ s32 Cosm_NetClose( cosm_NET * net );
     Returns: COSM_PASS on success, or an error code on failure.
   */
 
+void Cosm_NetDNSWorker( void * arg );
+  /*
+    Resolver worker thread, arg is the resolver.
+    Returns: nothing.
+  */
+
 #if ( defined( NET_LOG_PACKETS ) )
 Cosm_NetLogPacket( const cosm_NET_ADDR * addr, ascii * tag,
   u8 * data, u32 length );
@@ -269,6 +628,12 @@ Cosm_NetLogPacket( const cosm_NET_ADDR * addr, ascii * tag,
 
 /* testing */
 
+void Cosm_NetDNSTestServer( void * arg );
+  /*
+    Stub DNS server thread for Cosm_TestOSNet.
+    Returns: nothing.
+  */
+
 s32 Cosm_TestOSNet( void );
   /*
     Test functions in this header.
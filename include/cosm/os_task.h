@@ -112,6 +112,18 @@ typedef struct cosm_DYNAMIC_LIB
 #endif
 } cosm_DYNAMIC_LIB;
 
+/*
+  A counter many threads add to at once. Each thread adds to one of the
+  shards, each on its own 64 byte cache line, so they do not fight over a
+  single line. Zero the structure before use.
+*/
+#define COSM_COUNTER_SHARDS 16
+
+typedef struct cosm_COUNTER
+{
+  u64 shard[COSM_COUNTER_SHARDS * 8];
+} cosm_COUNTER;
+
 /* Process Functions */
 
 u64 CosmProcessID( void );
@@ -272,6 +284,86 @@ void CosmSemaphoreFree( cosm_SEMAPHORE * sem );
     Returns: nothing.
   */
 
+/* Atomic pointers */
+
+void * CosmAtomicLoadPtr( void * const * pointer );
+  /*
+    Read the pointer stored at pointer. Everything written by the thread
+    that stored it, before the store, is visible after the load. This is
+    the read side of publishing a structure to other threads without a
+    mutex: build it, then store the pointer to it.
+    Returns: The pointer value.
+  */
+
+void CosmAtomicStorePtr( void ** pointer, void * value );
+  /*
+    Store value at pointer so that CosmAtomicLoadPtr in any thread sees
+    either the old pointer or the new one, and everything the new one
+    points to.
+    Returns: nothing.
+  */
+
+void * CosmAtomicSwapPtr( void ** pointer, void * value );
+  /*
+    Store value at pointer like CosmAtomicStorePtr, and get the pointer
+    that was replaced in one step.
+    Returns: The old pointer value.
+  */
+
+/* Atomic numbers */
+
+u32 CosmAtomicLoad32( const u32 * number );
+  /*
+    Read the number stored at number, ordered with every other atomic
+    operation in all threads.
+    Returns: The number.
+  */
+
+u32 CosmAtomicAdd32( u32 * number, s32 add );
+  /*
+    Add add, which may be negative, to the number at number in one step.
+    Ordered with every other atomic operation in all threads, so it can be
+    used for counters one thread waits on while others change them.
+    Returns: The new value.
+  */
+
+u64 CosmAtomicLoad64( const u64 * number );
+  /*
+    64 bit version of CosmAtomicLoad32, the read is never torn even on
+    32 bit CPUs.
+    Returns: The number.
+  */
+
+void CosmAtomicStore64( u64 * number, u64 value );
+  /*
+    Store value at number in one step, ordered with every other atomic
+    operation in all threads.
+    Returns: nothing.
+  */
+
+u64 CosmAtomicAdd64( u64 * number, s64 add );
+  /*
+    64 bit version of CosmAtomicAdd32.
+    Returns: The new value.
+  */
+
+/* Sharded counters */
+
+void CosmCounterAdd( cosm_COUNTER * counter, s64 add );
+  /*
+    Add add, which may be negative, to the counter. The shard used depends
+    on the calling thread, so threads rarely share a cache line and adding
+    costs about the same as an uncontended CosmAtomicAdd64.
+    Returns: nothing.
+  */
+
+s64 CosmCounterRead( const cosm_COUNTER * counter );
+  /*
+    Sum the shards of the counter. Adds in other threads during the read may
+    or may not be included, so only use the result as a snapshot.
+    Returns: The counter value.
+  */
+
 /* Sleep */
 
 void CosmSleep( u32 millisec );
@@ -345,6 +437,22 @@ s32 CosmSystemClock( cosmtime * clock );
     Returns: COSM_PASS on success, or COSM_FAIL on failure.
   */
 
+u64 CosmClockMono( void );
+  /*
+    Monotonic clock in nanoseconds from an unspecified starting point.
+    Unlike CosmSystemClock this never jumps when the wall clock is set, and
+    is cheap to call. Use it for timeouts and measuring intervals.
+    Returns: Nanoseconds, or 0 if the system has no monotonic clock.
+  */
+
+u64 CosmClockCoarse( void );
+  /*
+    The CosmClockMono time in milliseconds as last stored by a ticker thread
+    that updates it every millisecond, for hot paths where a system call
+    per timestamp is too much. The first call starts the ticker thread.
+    Returns: Milliseconds from the CosmClockMono starting point.
+  */
+
 /* Low level helper functions */
 
 u8 Cosm_PriorityToCosm( int pri );
@@ -359,6 +467,12 @@ int Cosm_PriorityToOS( u8 pri );
     Returns: Priority in native system terms.
   */
 
+void Cosm_ClockTicker( void * arg );
+  /*
+    Thread started by CosmClockCoarse, updates the coarse clock forever.
+    Returns: never.
+  */
+
 /* testing */
 
 void Cosm_ThreadTestSrc( void * arg );
@@ -134,6 +134,20 @@ s32 Cosm_TimeIsYearLeap( s64 year );
     Returns: 1 if the year is a leap year, or 0 if it is not a leap year.
   */
 
+s64 Cosm_TimeDaysFromCivil( s64 year, u32 month, u32 day );
+  /*
+    Number of days since Jan 1, 2000 of the zero based month and day in
+    year, using the proleptic Gregorian calendar. O(1), no loops.
+    Returns: The day number, negative before 2000.
+  */
+
+void Cosm_TimeCivilFromDays( s64 * year, u32 * month, u32 * day, s64 days );
+  /*
+    Inverse of Cosm_TimeDaysFromCivil, set the year and zero based month
+    and day for the day number days.
+    Returns: nothing.
+  */
+
 /* testing */
 
 s32 Cosm_TestTime( void );
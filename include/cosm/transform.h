@@ -18,6 +18,7 @@
 #define COSM_TRANSFORM_H
 
 #include "cosm/cputypes.h"
+#include "cosm/os_file.h"
 #include <stdarg.h>
 
 #define COSM_TRANSFORM_COOKIE  0x42DEC0DE /* cookie to check for next */
@@ -83,6 +84,15 @@ s32 CosmTransformEndAll( cosm_TRANSFORM * transform );
       Error returned will be the first error in the chain if there is one.
   */
 
+s32 CosmTransformFromFile( cosm_TRANSFORM * transform, cosm_FILE * file,
+  u64 offset );
+  /*
+    Feed the open file from offset to its end into the transform, straight
+    out of a sliding memory mapping (see CosmFileMapRead), so the data is
+    never copied into a read buffer on the way. The transform is not ended.
+    Returns: COSM_PASS on success, or a transform error code on failure.
+  */
+
 /* low level base64 API */
 
 s32 Cosm_Base64CInit( cosm_TRANSFORM * transform, va_list params );
@@ -0,0 +1,770 @@
+/*
+  Copyright 1995-2019 Mithral Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+/*
+  Speed of the main parts of the library, timed with CosmBench. Like
+  testlib, this code will not end up in libCosm.
+
+  benchlib.exe [-csv|-json] [-r repetitions] [name ...]
+
+  Only benchmarks starting with one of the names are run, or all of them
+  if there are no names.
+*/
+
+#include "cosm/cosm.h"
+
+#define BENCH_MAX    64
+#define BENCH_BLOCK  65536 /* bytes each transform operation handles */
+#define BENCH_KEYS   65536 /* hash table keys */
+#define BENCH_LOG    "benchlog.tmp"
+
+typedef struct BENCH_RUN
+{
+  cosm_BENCH results[BENCH_MAX];
+  u32 count;
+  u32 failed;
+  u32 format;
+  u32 repetitions;
+  int argc;
+  char ** argv;
+  int first;           /* first name argument */
+} BENCH_RUN;
+
+typedef struct BENCH_DATA
+{
+  u8 * block;
+  u8 * cipher;         /* block encrypted with AES-128 CBC, or scratch */
+  u64 cipher_length;
+  cosm_BUFFER buffer;
+  cosm_BUFFER sink;
+  cosm_TRANSFORM to_sink;
+  u64 * keys;
+  cosm_HASH_TABLE table;
+  cosm_BN a, b, m, x;
+  cosm_PRINT_FORMAT format;
+  cosm_LOG log;
+  u32 level;
+  cosm_METRIC * metric;
+  cosm_HTTP_POOL pool;
+  ascii uri[64];
+} BENCH_DATA;
+
+/* which transform and how it's setup, and the data it gets */
+typedef struct BENCH_TRANSFORM
+{
+  BENCH_DATA * data;
+  u32 type;
+  u32 mode;
+  u32 direction;
+  u32 key_bits;
+} BENCH_TRANSFORM;
+
+#define BENCH_CRC32   0
+#define BENCH_MD5     1
+#define BENCH_SHA1    2
+#define BENCH_SHA256  3
+#define BENCH_AES     4
+#define BENCH_BASE64  5
+
+static const u8 bench_key[32] =
+{
+  0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+  0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C,
+  0x60, 0x3D, 0xEB, 0x10, 0x15, 0xCA, 0x71, 0xBE,
+  0x2B, 0x73, 0xAE, 0xF0, 0x85, 0x7D, 0x77, 0x81
+};
+
+static const u8 bench_iv[16] =
+{
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+  0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F
+};
+
+/* the same "random" data every run */
+static void BenchFill( u8 * bytes, u32 length, u64 seed )
+{
+  u32 i;
+
+  for ( i = 0 ; i < length ; i++ )
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    bytes[i] = (u8) ( seed >> 24 );
+  }
+}
+
+/* buffer */
+
+static s32 BenchBuffer64( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  u8 out[64];
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    if ( ( CosmBufferPut( &data->buffer, data->block, 64 ) != COSM_PASS )
+      || ( CosmBufferGet( out, 64, &data->buffer ) != 64 ) )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+static s32 BenchBuffer4K( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    if ( ( CosmBufferPut( &data->buffer, data->block, 4096 ) != COSM_PASS )
+      || ( CosmBufferGet( data->cipher, 4096, &data->buffer ) != 4096 ) )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+/* hash table */
+
+static u64 BenchHash( void * key )
+{
+  return *(u64 *) key * 0x9E3779B97F4A7C15LL;
+}
+
+static s32 BenchEqual( void * keyA, void * keyB )
+{
+  return ( *(u64 *) keyA == *(u64 *) keyB );
+}
+
+static s32 BenchHashAdd( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  cosm_HASH_TABLE table;
+  u32 i;
+
+  /* a new table for each BENCH_KEYS adds, so it grows as it fills */
+  i = 0;
+  while ( i < loops )
+  {
+    CosmMemSet( &table, sizeof( cosm_HASH_TABLE ), 0 );
+    if ( CosmHashTableInit( &table, 16, BenchHash, BenchEqual,
+      NULL, NULL ) != COSM_PASS )
+    {
+      return COSM_FAIL;
+    }
+    for ( ; ( i < loops ) && ( table.count < BENCH_KEYS ) ; i++ )
+    {
+      if ( CosmHashTableAdd( &table, &data->keys[table.count],
+        &data->keys[table.count] ) != COSM_PASS )
+      {
+        CosmHashTableFree( &table );
+        return COSM_FAIL;
+      }
+    }
+    CosmHashTableFree( &table );
+  }
+
+  return COSM_PASS;
+}
+
+static s32 BenchHashLookup( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    if ( CosmHashTableValue( &data->table,
+      &data->keys[( i * 7919 ) % BENCH_KEYS] ) == NULL )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+/* transforms */
+
+static s32 BenchTransformInit( cosm_TRANSFORM * transform, cosm_HASH * hash,
+  BENCH_TRANSFORM * bench )
+{
+  CosmMemSet( transform, sizeof( cosm_TRANSFORM ), 0 );
+
+  switch ( bench->type )
+  {
+    case BENCH_CRC32:
+      return CosmTransformInit( transform, COSM_HASH_CRC32, NULL, hash );
+    case BENCH_MD5:
+      return CosmTransformInit( transform, COSM_HASH_MD5, NULL, hash );
+    case BENCH_SHA1:
+      return CosmTransformInit( transform, COSM_HASH_SHA1, NULL, hash );
+    case BENCH_SHA256:
+      return CosmTransformInit( transform, COSM_HASH_SHA256, NULL, hash );
+    case BENCH_AES:
+      return CosmTransformInit( transform, COSM_CRYPTO_AES,
+        &bench->data->to_sink, bench->mode, bench->direction, bench_key,
+        bench->key_bits, bench_iv );
+    default:
+      return CosmTransformInit( transform, COSM_BASE64_ENCODE,
+        &bench->data->to_sink );
+  }
+}
+
+static s32 BenchTransform( void * arg, u32 loops )
+{
+  BENCH_TRANSFORM * bench = arg;
+  cosm_TRANSFORM transform;
+  cosm_HASH hash;
+  const u8 * input;
+  u64 length;
+  u32 i;
+
+  /* decrypt what was encrypted, anything else fails the padding check */
+  if ( bench->direction == COSM_CRYPTO_DECRYPT )
+  {
+    input = bench->data->cipher;
+    length = bench->data->cipher_length;
+  }
+  else
+  {
+    input = bench->data->block;
+    length = BENCH_BLOCK;
+  }
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    if ( ( BenchTransformInit( &transform, &hash, bench ) != COSM_PASS )
+      || ( CosmTransform( &transform, input, length ) != COSM_PASS )
+      || ( CosmTransformEnd( &transform ) != COSM_PASS ) )
+    {
+      return COSM_FAIL;
+    }
+    CosmBufferClear( &bench->data->sink );
+  }
+
+  return COSM_PASS;
+}
+
+/* bignum */
+
+static s32 BenchBNMul( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    if ( CosmBNMul( &data->x, &data->a, &data->b ) != COSM_PASS )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+static s32 BenchBNModExp( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    if ( CosmBNModExp( &data->x, &data->a, &data->b, &data->m )
+      != COSM_PASS )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+static s32 BenchBNLoad( BENCH_DATA * data, u32 bits )
+{
+  BenchFill( data->cipher, bits / 8, 0x1234567 );
+  data->cipher[0] |= 0x80;
+  if ( CosmBNLoad( &data->a, data->cipher, bits ) != COSM_PASS )
+  {
+    return COSM_FAIL;
+  }
+  BenchFill( data->cipher, bits / 8, 0x7654321 );
+  data->cipher[0] |= 0x80;
+  if ( CosmBNLoad( &data->b, data->cipher, bits ) != COSM_PASS )
+  {
+    return COSM_FAIL;
+  }
+  BenchFill( data->cipher, bits / 8, 0x3141592 );
+  data->cipher[0] |= 0x80;
+  data->cipher[bits / 8 - 1] |= 0x01;
+
+  return CosmBNLoad( &data->m, data->cipher, bits );
+}
+
+/* print */
+
+static s32 BenchPrint( void * arg, u32 loops )
+{
+  utf8 string[128];
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    if ( CosmPrintStr( string, 128, "%.16s %u %v %X %j\n", "request",
+      i, (u64) i * 1000003, i, (s64) -1 - i ) == (u32) -1 )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+static s32 BenchPrintCompiled( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  utf8 string[128];
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    if ( CosmPrintStrCompiled( string, 128, &data->format, "request",
+      i, (u64) i * 1000003, i, (s64) -1 - i ) == (u32) -1 )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+/* log */
+
+static s32 BenchLog( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    if ( CosmLog( &data->log, data->level, COSM_LOG_NOECHO,
+      "%.16s %u\n", "request", i ) != COSM_PASS )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+/* metrics */
+
+static s32 BenchMetricAdd( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    CosmMetricAdd( data->metric, 1 );
+  }
+
+  return COSM_PASS;
+}
+
+static s32 BenchMetricRecord( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    CosmMetricRecord( data->metric, (u64) i * 997 );
+  }
+
+  return COSM_PASS;
+}
+
+/* HTTP */
+
+static s32 BenchHTTPHandler( cosm_HTTPD_REQUEST * request )
+{
+  if ( ( CosmHTTPDSendInit( request, 200, "OK", "text/plain" ) != COSM_PASS )
+    || ( CosmHTTPDSend( request, "ok", 2 ) != COSM_PASS ) )
+  {
+    return COSM_FAIL;
+  }
+
+  return CosmHTTPDSend( request, NULL, 0 );
+}
+
+static s32 BenchHTTPGet( cosm_HTTP * http )
+{
+  ascii body[16];
+  u32 status, bytes;
+
+  if ( ( CosmHTTPGet( http, &status, "/bench", 1000 ) != COSM_PASS )
+    || ( status != 200 ) )
+  {
+    return COSM_FAIL;
+  }
+
+  while ( http->status == COSM_HTTP_STATUS_BODY )
+  {
+    if ( CosmHTTPRecv( body, &bytes, http, 16, 1000 ) != COSM_PASS )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+static s32 BenchHTTPOpen( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  cosm_HTTP http;
+  s32 result;
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    CosmMemSet( &http, sizeof( cosm_HTTP ), 0 );
+    result = CosmHTTPOpen( &http, data->uri, NULL, NULL, NULL, NULL, NULL );
+    if ( result == COSM_PASS )
+    {
+      result = BenchHTTPGet( &http );
+    }
+    CosmHTTPClose( &http );
+    if ( result != COSM_PASS )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+static s32 BenchHTTPPool( void * arg, u32 loops )
+{
+  BENCH_DATA * data = arg;
+  cosm_HTTP * http;
+  s32 result;
+  u32 i;
+
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    if ( CosmHTTPPoolGet( &http, &data->pool, data->uri, 1000 )
+      != COSM_PASS )
+    {
+      return COSM_FAIL;
+    }
+    result = BenchHTTPGet( http );
+    CosmHTTPPoolPut( &data->pool, http );
+    if ( result != COSM_PASS )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+/* running them */
+
+static u32 BenchWanted( BENCH_RUN * run, const ascii * name )
+{
+  int i;
+
+  if ( run->first >= run->argc )
+  {
+    return 1;
+  }
+
+  for ( i = run->first ; i < run->argc ; i++ )
+  {
+    if ( CosmStrCmp( name, run->argv[i], CosmStrBytes( run->argv[i] ) )
+      == 0 )
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static void BenchRun( BENCH_RUN * run, const ascii * name,
+  s32 (*function)( void *, u32 ), void * arg, u64 bytes )
+{
+  if ( ( !BenchWanted( run, name ) ) || ( run->count == BENCH_MAX ) )
+  {
+    return;
+  }
+
+  if ( CosmBench( &run->results[run->count], name, function, arg, bytes,
+    run->repetitions ) == COSM_PASS )
+  {
+    run->count++;
+  }
+  else
+  {
+    run->failed++;
+    if ( run->format == COSM_BENCH_TEXT )
+    {
+      CosmPrint( "%.64s failed\n", name );
+    }
+  }
+}
+
+int main( int argc, char * argv[] )
+{
+  const struct
+  {
+    const ascii * name;
+    u32 type;
+    u32 mode;
+    u32 direction;
+    u32 key_bits;
+  } transforms[] =
+  {
+    { "transform CRC32 64KB", BENCH_CRC32, 0, 0, 0 },
+    { "transform MD5 64KB", BENCH_MD5, 0, 0, 0 },
+    { "transform SHA1 64KB", BENCH_SHA1, 0, 0, 0 },
+    { "transform SHA256 64KB", BENCH_SHA256, 0, 0, 0 },
+    { "transform AES-128 ECB 64KB", BENCH_AES, COSM_CRYPTO_MODE_ECB,
+      COSM_CRYPTO_ENCRYPT, 128 },
+    { "transform AES-128 CBC 64KB", BENCH_AES, COSM_CRYPTO_MODE_CBC,
+      COSM_CRYPTO_ENCRYPT, 128 },
+    { "transform AES-128 CBC dec 64KB", BENCH_AES, COSM_CRYPTO_MODE_CBC,
+      COSM_CRYPTO_DECRYPT, 128 },
+    { "transform AES-128 CFB 64KB", BENCH_AES, COSM_CRYPTO_MODE_CFB,
+      COSM_CRYPTO_ENCRYPT, 128 },
+    { "transform AES-256 CBC 64KB", BENCH_AES, COSM_CRYPTO_MODE_CBC,
+      COSM_CRYPTO_ENCRYPT, 256 },
+    { "transform Base64 64KB", BENCH_BASE64, 0, 0, 0 }
+  };
+  BENCH_TRANSFORM bench_transform[sizeof( transforms )
+    / sizeof( transforms[0] )];
+  const ascii * bn_names[3] =
+    { "bignum mul 1024", "bignum mul 4096", "bignum modexp 1024" };
+  const u32 bn_bits[3] = { 1024, 4096, 1024 };
+  static BENCH_RUN run;
+  static BENCH_DATA data;
+  cosm_TRANSFORM transform;
+  cosm_HTTPD httpd;
+  cosm_NET_ADDR addr;
+  u32 i;
+
+  CosmMemSet( &run, sizeof( BENCH_RUN ), 0 );
+  run.format = COSM_BENCH_TEXT;
+  run.argc = argc;
+  run.argv = argv;
+  for ( run.first = 1 ; ( run.first < argc )
+    && ( argv[run.first][0] == '-' ) ; run.first++ )
+  {
+    if ( CosmStrCmp( argv[run.first], "-csv", 5 ) == 0 )
+    {
+      run.format = COSM_BENCH_CSV;
+    }
+    else if ( CosmStrCmp( argv[run.first], "-json", 6 ) == 0 )
+    {
+      run.format = COSM_BENCH_JSON;
+    }
+    else if ( ( CosmStrCmp( argv[run.first], "-r", 3 ) == 0 )
+      && ( run.first + 1 < argc ) )
+    {
+      run.first++;
+      if ( CosmU32Str( &run.repetitions, NULL, argv[run.first], 10 )
+        != COSM_PASS )
+      {
+        run.repetitions = 0;
+      }
+    }
+    else
+    {
+      CosmPrint(
+        "Usage: %.64s [-csv|-json] [-r repetitions] [name ...]\n", argv[0] );
+      return -1;
+    }
+  }
+
+  CosmMemSet( &data, sizeof( BENCH_DATA ), 0 );
+  data.block = CosmMemAlloc( BENCH_BLOCK );
+  data.cipher = CosmMemAlloc( BENCH_BLOCK + 16 );
+  data.keys = CosmMemAlloc( BENCH_KEYS * sizeof( u64 ) );
+  if ( ( data.block == NULL ) || ( data.cipher == NULL )
+    || ( data.keys == NULL ) )
+  {
+    CosmPrint( "Out of memory.\n" );
+    return -1;
+  }
+  BenchFill( data.block, BENCH_BLOCK, 0x2545F4914F6CDD1DLL );
+
+  /* buffer */
+  if ( CosmBufferInit( &data.buffer, 8192, COSM_BUFFER_MODE_QUEUE, 8192,
+    NULL, 0 ) == COSM_PASS )
+  {
+    BenchRun( &run, "buffer put/get 64B", BenchBuffer64, &data, 64 );
+    BenchRun( &run, "buffer put/get 4KB", BenchBuffer4K, &data, 4096 );
+    CosmBufferFree( &data.buffer );
+  }
+
+  /* hash table */
+  for ( i = 0 ; i < BENCH_KEYS ; i++ )
+  {
+    data.keys[i] = i;
+  }
+  BenchRun( &run, "hashtable add", BenchHashAdd, &data, 0 );
+  if ( CosmHashTableInit( &data.table, BENCH_KEYS, BenchHash, BenchEqual,
+    NULL, NULL ) == COSM_PASS )
+  {
+    for ( i = 0 ; i < BENCH_KEYS ; i++ )
+    {
+      CosmHashTableAdd( &data.table, &data.keys[i], &data.keys[i] );
+    }
+    BenchRun( &run, "hashtable lookup", BenchHashLookup, &data, 0 );
+    CosmHashTableFree( &data.table );
+  }
+
+  /* transforms, ciphers write to a buffer that is emptied each time */
+  CosmBufferInit( &data.sink, BENCH_BLOCK * 2, COSM_BUFFER_MODE_QUEUE,
+    BENCH_BLOCK, NULL, 0 );
+  if ( CosmTransformInit( &data.to_sink, COSM_TRANSFORM_TO_BUFFER, NULL,
+    &data.sink ) == COSM_PASS )
+  {
+    CosmMemSet( &transform, sizeof( cosm_TRANSFORM ), 0 );
+    if ( ( CosmTransformInit( &transform, COSM_CRYPTO_AES, &data.to_sink,
+      COSM_CRYPTO_MODE_CBC, COSM_CRYPTO_ENCRYPT, bench_key, 128, bench_iv )
+      == COSM_PASS )
+      && ( CosmTransform( &transform, data.block, BENCH_BLOCK )
+      == COSM_PASS ) && ( CosmTransformEnd( &transform ) == COSM_PASS ) )
+    {
+      data.cipher_length = CosmBufferGet( data.cipher, BENCH_BLOCK + 16,
+        &data.sink );
+    }
+    CosmBufferClear( &data.sink );
+
+    for ( i = 0 ; i < sizeof( transforms ) / sizeof( transforms[0] ) ; i++ )
+    {
+      bench_transform[i].data = &data;
+      bench_transform[i].type = transforms[i].type;
+      bench_transform[i].mode = transforms[i].mode;
+      bench_transform[i].direction = transforms[i].direction;
+      bench_transform[i].key_bits = transforms[i].key_bits;
+      BenchRun( &run, transforms[i].name, BenchTransform,
+        &bench_transform[i], BENCH_BLOCK );
+    }
+    CosmTransformEnd( &data.to_sink );
+  }
+  CosmBufferFree( &data.sink );
+
+  /* bignum */
+  for ( i = 0 ; i < 3 ; i++ )
+  {
+    CosmBNInit( &data.a );
+    CosmBNInit( &data.b );
+    CosmBNInit( &data.m );
+    CosmBNInit( &data.x );
+    if ( BenchBNLoad( &data, bn_bits[i] ) == COSM_PASS )
+    {
+      BenchRun( &run, bn_names[i], ( i < 2 ) ? BenchBNMul : BenchBNModExp,
+        &data, 0 );
+    }
+    CosmBNFree( &data.a );
+    CosmBNFree( &data.b );
+    CosmBNFree( &data.m );
+    CosmBNFree( &data.x );
+  }
+
+  /* print */
+  BenchRun( &run, "CosmPrintStr", BenchPrint, &data, 0 );
+  if ( CosmPrintCompile( &data.format, "%.16s %u %v %X %j\n" )
+    == COSM_PASS )
+  {
+    BenchRun( &run, "CosmPrintStrCompiled", BenchPrintCompiled, &data, 0 );
+    CosmPrintFree( &data.format );
+  }
+
+  /* log, records that are written and records that are filtered out */
+  if ( CosmLogOpen( &data.log, BENCH_LOG, 1, COSM_LOG_MODE_NUMBER )
+    == COSM_PASS )
+  {
+    data.level = 1;
+    BenchRun( &run, "CosmLog", BenchLog, &data, 0 );
+    data.level = 2;
+    BenchRun( &run, "CosmLog filtered", BenchLog, &data, 0 );
+    CosmLogClose( &data.log );
+  }
+  if ( CosmLogOpen( &data.log, BENCH_LOG, 1,
+    COSM_LOG_MODE_NUMBER | COSM_LOG_MODE_SYNC ) == COSM_PASS )
+  {
+    data.level = 1;
+    BenchRun( &run, "CosmLog sync", BenchLog, &data, 0 );
+    CosmLogClose( &data.log );
+  }
+  CosmFileDelete( BENCH_LOG );
+
+  /* metrics */
+  if ( ( data.metric = CosmMetricCounter( "bench_adds_total", NULL ) )
+    != NULL )
+  {
+    BenchRun( &run, "CosmMetricAdd", BenchMetricAdd, &data, 0 );
+  }
+  if ( ( data.metric = CosmMetricHistogram( "bench_values", NULL ) )
+    != NULL )
+  {
+    BenchRun( &run, "CosmMetricRecord", BenchMetricRecord, &data, 0 );
+  }
+
+  /* requests to a server on localhost, with threads to spare */
+  if ( BenchWanted( &run, "HTTP GET new connection" )
+    || BenchWanted( &run, "HTTP GET pooled" ) )
+  {
+    CosmMemSet( &httpd, sizeof( cosm_HTTPD ), 0 );
+    addr.type = COSM_NET_IPV4;
+    addr.ip.v4 = 0x7F000001;
+    addr.port = 0;
+    if ( ( CosmHTTPDInit( &httpd, NULL, 0, 8, 0, &addr, 1000 ) == COSM_PASS )
+      && ( CosmHTTPDSetHandler( &httpd, "/", NULL, BenchHTTPHandler )
+      == COSM_PASS ) && ( CosmHTTPDStart( &httpd, 1000 ) == COSM_PASS ) )
+    {
+      CosmPrintStr( data.uri, 64, "http://localhost:%u/",
+        httpd.net.my_addr.port );
+      BenchRun( &run, "HTTP GET new connection", BenchHTTPOpen, &data, 0 );
+      CosmHTTPPoolInit( &data.pool, 4, 10000, 60000 );
+      BenchRun( &run, "HTTP GET pooled", BenchHTTPPool, &data, 0 );
+      CosmHTTPPoolFree( &data.pool );
+      CosmHTTPDStop( &httpd, 1000 );
+    }
+    CosmHTTPDFree( &httpd );
+  }
+
+  CosmMemFree( data.block );
+  CosmMemFree( data.cipher );
+  CosmMemFree( data.keys );
+
+  CosmBenchReport( NULL, run.results, run.count, run.format );
+
+  return (int) run.failed;
+}
@@ -19,8 +19,273 @@
 #include "cosm/os_file.h"
 #include "cosm/os_mem.h"
 
-s32 CosmConfigLoad( cosm_CONFIG * config, const ascii * filename )
+#define COSM_CONFIG_WATCH_WAIT  100          /* ms between stop checks */
+#define COSM_CONFIG_WATCH_STACK ( 256 * 1024 ) /* callbacks run here */
+
+typedef struct cosm_CONFIG_WATCH
+{
+  cosm_FILE_WATCH file;
+  cosm_CONFIG * config;
+  u64 thread;
+  u32 stop;
+  u32 done;
+} cosm_CONFIG_WATCH;
+
+static u64 Cosm_ConfigHash( const utf8 * section, const utf8 * key )
+{
+  /*
+    FNV-1a hash of the section, a 0, and the key.
+    Returns: The hash.
+  */
+  u64 hash;
+
+  hash = 0xCBF29CE484222325LL;
+  while ( *section != 0 )
+  {
+    hash = ( hash ^ (u8) *section++ ) * 0x00000100000001B3LL;
+  }
+  hash *= 0x00000100000001B3LL;
+  while ( *key != 0 )
+  {
+    hash = ( hash ^ (u8) *key++ ) * 0x00000100000001B3LL;
+  }
+
+  return hash;
+}
+
+static const cosm_CONFIG_ENTRY * Cosm_ConfigFind(
+  const cosm_CONFIG_SNAPSHOT * snapshot, const utf8 * section,
+  const utf8 * key )
+{
+  /*
+    Look up the section/key pair in the snapshot.
+    Returns: The entry, or NULL if it is not there.
+  */
+  const cosm_CONFIG_ENTRY * entry;
+  u64 hash;
+  u32 slot;
+
+  if ( ( snapshot == NULL ) || ( section == NULL ) || ( key == NULL ) )
+  {
+    return NULL;
+  }
+
+  hash = Cosm_ConfigHash( section, key );
+  slot = (u32) hash & snapshot->mask;
+  while ( ( entry = &snapshot->slots[slot] )->key != NULL )
+  {
+    if ( ( entry->hash == hash )
+      && ( CosmStrCmp( section, entry->section,
+        CosmStrBytes( section ) + 1 ) == 0 )
+      && ( CosmStrCmp( key, entry->key, CosmStrBytes( key ) + 1 ) == 0 ) )
+    {
+      return entry;
+    }
+    slot = ( slot + 1 ) & snapshot->mask;
+  }
+
+  return NULL;
+}
+
+static cosm_CONFIG_SNAPSHOT * Cosm_ConfigBuild( const cosm_CONFIG * config )
+{
+  /*
+    Copy the live keys into a new snapshot, config must not change. The
+    snapshot, its slots, and the strings are one allocation. If a key is
+    in the config twice the first one is kept, like the old linear search.
+    Returns: The snapshot with one hold for the config, or NULL on failure.
+  */
+  cosm_CONFIG_SNAPSHOT * snapshot;
+  cosm_CONFIG_SECTION * tmp_section;
+  cosm_CONFIG_KEY * tmp_key;
+  cosm_CONFIG_ENTRY * entry;
+  utf8 * strings, * section, * end;
+  u64 bytes, hash;
+  u32 count, slots, length, slot, i, j;
+
+  /* size it */
+  count = 0;
+  bytes = 0;
+  for ( i = 0 ; i < config->section_count ; i++ )
+  {
+    tmp_section = &config->sections[i];
+    bytes += CosmStrBytes( tmp_section->section ) + 1;
+    for ( j = 0 ; j < tmp_section->key_count ; j++ )
+    {
+      tmp_key = &tmp_section->keys[j];
+      if ( tmp_key->flag != COSM_CONFIG_DELETED )
+      {
+        count++;
+        bytes += CosmStrBytes( tmp_key->key )
+          + CosmStrBytes( tmp_key->value ) + 2;
+      }
+    }
+  }
+
+  /* keep the table at most half full */
+  slots = 8;
+  while ( slots < ( count * 2 ) )
+  {
+    slots *= 2;
+  }
+
+  if ( ( snapshot = (cosm_CONFIG_SNAPSHOT *) CosmMemAlloc(
+    sizeof( cosm_CONFIG_SNAPSHOT ) + (u64) slots * sizeof( cosm_CONFIG_ENTRY )
+    + bytes ) ) == NULL )
+  {
+    return NULL;
+  }
+  snapshot->refs = 1;
+  snapshot->count = 0;
+  snapshot->mask = slots - 1;
+  snapshot->slots = (cosm_CONFIG_ENTRY *) CosmMemOffset( snapshot,
+    sizeof( cosm_CONFIG_SNAPSHOT ) );
+  strings = (utf8 *) CosmMemOffset( snapshot->slots,
+    (u64) slots * sizeof( cosm_CONFIG_ENTRY ) );
+
+  for ( i = 0 ; i < config->section_count ; i++ )
+  {
+    tmp_section = &config->sections[i];
+    section = strings;
+    length = CosmStrBytes( tmp_section->section ) + 1;
+    CosmMemCopy( section, tmp_section->section, length );
+    strings += length;
+
+    for ( j = 0 ; j < tmp_section->key_count ; j++ )
+    {
+      tmp_key = &tmp_section->keys[j];
+      if ( ( tmp_key->flag == COSM_CONFIG_DELETED )
+        || ( Cosm_ConfigFind( snapshot, section, tmp_key->key ) != NULL ) )
+      {
+        continue;
+      }
+
+      hash = Cosm_ConfigHash( section, tmp_key->key );
+      slot = (u32) hash & snapshot->mask;
+      while ( snapshot->slots[slot].key != NULL )
+      {
+        slot = ( slot + 1 ) & snapshot->mask;
+      }
+      entry = &snapshot->slots[slot];
+      entry->hash = hash;
+      entry->section = section;
+
+      length = CosmStrBytes( tmp_key->key ) + 1;
+      CosmMemCopy( strings, tmp_key->key, length );
+      entry->key = strings;
+      strings += length;
+
+      length = CosmStrBytes( tmp_key->value ) + 1;
+      CosmMemCopy( strings, tmp_key->value, length );
+      entry->value = strings;
+      strings += length;
+
+      entry->is_number = ( ( CosmS64Str( &entry->number, &end, entry->value,
+        10 ) == COSM_PASS ) && ( *end == 0 ) );
+      snapshot->count++;
+    }
+  }
+
+  return snapshot;
+}
+
+static void Cosm_ConfigRelease( cosm_CONFIG_SNAPSHOT * snapshot )
 {
+  /*
+    Drop one hold on the snapshot, freeing it with the last one.
+    Returns: nothing.
+  */
+  if ( ( snapshot != NULL )
+    && ( CosmAtomicAdd32( &snapshot->refs, -1 ) == 0 ) )
+  {
+    CosmMemFree( snapshot );
+  }
+}
+
+static cosm_CONFIG_SNAPSHOT * Cosm_ConfigPublish( cosm_CONFIG * config,
+  cosm_CONFIG_SNAPSHOT * snapshot )
+{
+  /*
+    Swap in the new snapshot, which may be NULL, the lock must be held.
+    Any reader still using the old one counted itself in one of the two
+    readers counters before it loaded the pointer, so once both have been
+    seen at 0 with new readers sent to the other one, nobody can still be
+    inside it without a hold of their own.
+    Returns: The old snapshot, the config's hold on it passes to the caller.
+  */
+  cosm_CONFIG_SNAPSHOT * old;
+  u32 i, index;
+
+  old = (cosm_CONFIG_SNAPSHOT *) CosmAtomicSwapPtr(
+    (void **) &config->snapshot, snapshot );
+
+  for ( i = 0 ; i < 2 ; i++ )
+  {
+    index = ( CosmAtomicAdd32( &config->epoch, 1 ) - 1 ) & 1;
+    while ( CosmAtomicLoad32( &config->readers[index] ) != 0 )
+    {
+      CosmYield();
+    }
+  }
+
+  return old;
+}
+
+static cosm_CONFIG_SNAPSHOT * Cosm_ConfigReadBegin( cosm_CONFIG * config,
+  u32 * index )
+{
+  /*
+    Count a reader in and load the current snapshot, which can be used
+    until the count is taken back out of config->readers[*index].
+    Returns: The snapshot, or NULL if there is none.
+  */
+  *index = CosmAtomicLoad32( &config->epoch ) & 1;
+  CosmAtomicAdd32( &config->readers[*index], 1 );
+
+  return (cosm_CONFIG_SNAPSHOT *) CosmAtomicLoadPtr(
+    (void * const *) &config->snapshot );
+}
+
+static void Cosm_ConfigClear( cosm_CONFIG * config )
+{
+  /*
+    Free the sections, keys, and file memory of config.
+    Returns: nothing.
+  */
+  cosm_CONFIG_SECTION * section;
+  u32 i, j;
+
+  for ( i = 0 ; i < config->section_count; i++ )
+  {
+    section = &config->sections[i];
+    for ( j = 0 ; j < section->key_count; j++ )
+    {
+      if ( section->keys[j].flag == COSM_CONFIG_ALLOCATED )
+      {
+        CosmMemFree( section->keys[j].key );
+      }
+    }
+    if ( section->flag == COSM_CONFIG_ALLOCATED )
+    {
+      CosmMemFree( section->section );
+    }
+    CosmMemFree( section->keys );
+  }
+  CosmMemFree( config->sections );
+  CosmMemFree( config->memory );
+
+  config->memory = NULL;
+  config->sections = NULL;
+  config->section_count = 0;
+}
+
+static s32 Cosm_ConfigRead( cosm_CONFIG * parsed, const ascii * filename )
+{
+  /*
+    Read and parse the file into the empty sections of parsed, the parsed
+    strings point into parsed->memory. Only parsed is touched.
+    Returns: COSM_PASS on success, or a COSM_FILE_ERROR_* on failure.
+  */
   cosm_FILE file;
   cosm_CONFIG_SECTION * tmp_section;
   u64 length, bytes_read;
@@ -29,170 +294,461 @@ s32 CosmConfigLoad( cosm_CONFIG * config, const ascii * filename )
   u32 strlen;
   u32 i, j;
 
+  CosmMemSet( &file, sizeof( cosm_FILE ), 0 );
+
+  if ( ( error = CosmFileOpen( &file, filename, COSM_FILE_MODE_READ,
+    COSM_FILE_LOCK_READ ) ) != COSM_PASS )
+  {
+    return error;
+  }
+  if ( ( error = CosmFileLength( &length, &file ) ) != COSM_PASS )
+  {
+    CosmFileClose( &file );
+    return error;
+  }
+  /* one more zeroed byte so the parse always finds the end */
+  if ( ( parsed->memory = CosmMemAlloc( length + 1 ) )
+    == NULL )
+  {
+    CosmFileClose( &file );
+    return COSM_FILE_ERROR_DENIED;
+  }
+
+  if ( ( length > 0 ) && ( COSM_PASS != CosmFileRead( parsed->memory,
+    &bytes_read, &file, length ) ) )
+  {
+    CosmFileClose( &file );
+    Cosm_ConfigClear( parsed );
+    return COSM_FILE_ERROR_DENIED;
+  }
+  CosmFileClose( &file );
+
+  /* parse */
+  ptr = parsed->memory;
+  while ( ( section = CosmStrChar( ptr, '[', (u32) length ) ) != NULL )
+  {
+    section++;
+    if ( ( ptr = CosmStrChar( section, ']', (u32) length ) ) == NULL )
+    {
+      break;
+    }
+    *ptr = 0;
+    ptr++;
+    if ( *ptr == '\n' )
+    {
+      ptr++;
+    }
+
+    if ( parsed->section_count == 0 )
+    {
+      if ( ( parsed->sections = (cosm_CONFIG_SECTION *)
+        CosmMemAlloc( sizeof( cosm_CONFIG_SECTION ) ) ) == NULL )
+      {
+        Cosm_ConfigClear( parsed );
+        return COSM_FILE_ERROR_DENIED;
+      }
+      parsed->section_count = 1;
+    }
+    else
+    {
+      if ( ( parsed->sections = (cosm_CONFIG_SECTION *)
+        CosmMemRealloc( parsed->sections, (u64) ( parsed->section_count + 1 )
+          * sizeof( cosm_CONFIG_SECTION ) ) )
+        == NULL )
+      {
+        Cosm_ConfigClear( parsed );
+        return COSM_FILE_ERROR_DENIED;
+      }
+      CosmMemSet( &parsed->sections[parsed->section_count],
+        sizeof( cosm_CONFIG_SECTION ), 0 );
+      parsed->section_count += 1;
+    }
+    i = parsed->section_count - 1;
+    parsed->sections[i].flag = COSM_CONFIG_NORMAL;
+    parsed->sections[i].length = CosmStrBytes( section ) + 1;
+    parsed->sections[i].section = section;
+    parsed->sections[i].key_count = 0;
+    parsed->sections[i].keys = NULL;
+
+    /* now add the keys */
+    tmp_section = &parsed->sections[i];
+    while ( *ptr != '[' )
+    {
+      if ( ( eol = CosmStrChar( ptr, '\n', (u32) length ) ) == NULL )
+      {
+        if ( *ptr == 0 )
+        {
+          /* no more lines */
+          break;
+        }
+        /* last line, without a \n */
+        eol = CosmMemOffset( ptr, CosmStrBytes( ptr ) );
+      }
+      else
+      {
+        *eol = 0;
+        eol++;
+      }
+      if ( ( value = CosmStrChar( ptr, '=', (u32) length ) ) != NULL )
+      {
+        key = ptr;
+        *value = 0;
+        value++;
+        ptr = eol;
+
+        /* ignore empty lines */
+        while ( *ptr == '\n' )
+        {
+          ptr++;
+        }
+
+        if ( tmp_section->key_count == 0 )
+        {
+          if ( ( tmp_section->keys = (cosm_CONFIG_KEY *)
+            CosmMemAlloc( sizeof( cosm_CONFIG_KEY ) ) ) == NULL )
+          {
+            Cosm_ConfigClear( parsed );
+            return COSM_FILE_ERROR_DENIED;
+          }
+          tmp_section->key_count = 1;
+        }
+        else
+        {
+          if ( ( tmp_section->keys = (cosm_CONFIG_KEY *)
+            CosmMemRealloc( tmp_section->keys, (u64)
+              ( tmp_section->key_count + 1 ) * sizeof( cosm_CONFIG_KEY ) ) )
+            == NULL )
+          {
+            Cosm_ConfigClear( parsed );
+            return COSM_FILE_ERROR_DENIED;
+          }
+          CosmMemSet( &tmp_section->keys[tmp_section->key_count],
+            sizeof( cosm_CONFIG_KEY ), 0 );
+          tmp_section->key_count += 1;
+        }
+
+        j = tmp_section->key_count - 1;
+
+        strlen = CosmStrBytes( key ) + CosmStrBytes( value );
+        strlen += 2;
+
+        tmp_section->keys[j].key = key;
+        tmp_section->keys[j].value = value;
+        tmp_section->keys[j].length = strlen;
+        tmp_section->keys[j].flag = COSM_CONFIG_NORMAL;
+      } /* if key/value pair */
+      else
+      {
+        /* discard the line */
+        ptr = eol;
+      }
+    } /* while section */
+  } /* while more to file */
+
+  return COSM_PASS;
+}
+
+static void Cosm_ConfigCall( cosm_CONFIG * config, const utf8 * section,
+  const utf8 * key, const utf8 * value )
+{
+  /*
+    Call the callbacks registered for the section/key pair.
+    Returns: nothing.
+  */
+  cosm_CONFIG_NOTIFY * notify;
+  u32 i;
+
+  for ( i = 0 ; i < config->notify_count ; i++ )
+  {
+    notify = &config->notify[i];
+    if ( ( ( notify->section == NULL ) || ( CosmStrCmp( notify->section,
+      section, CosmStrBytes( section ) + 1 ) == 0 ) )
+      && ( ( notify->key == NULL ) || ( CosmStrCmp( notify->key, key,
+      CosmStrBytes( key ) + 1 ) == 0 ) ) )
+    {
+      (*notify->callback)( notify->arg, config, section, key, value );
+    }
+  }
+}
+
+static void Cosm_ConfigChanges( cosm_CONFIG * config,
+  const cosm_CONFIG_SNAPSHOT * old, const cosm_CONFIG_SNAPSHOT * snapshot )
+{
+  /*
+    Call the callbacks for every key that was added, changed, or deleted
+    going from the old snapshot to the new one, the lock must be held.
+    Returns: nothing.
+  */
+  const cosm_CONFIG_ENTRY * entry, * before;
+  u32 i;
+
+  if ( config->notify_count == 0 )
+  {
+    return;
+  }
+
+  if ( snapshot != NULL )
+  {
+    for ( i = 0 ; i <= snapshot->mask ; i++ )
+    {
+      entry = &snapshot->slots[i];
+      if ( entry->key == NULL )
+      {
+        continue;
+      }
+      before = Cosm_ConfigFind( old, entry->section, entry->key );
+      if ( ( before == NULL ) || ( CosmStrCmp( before->value, entry->value,
+        CosmStrBytes( entry->value ) + 1 ) != 0 ) )
+      {
+        Cosm_ConfigCall( config, entry->section, entry->key, entry->value );
+      }
+    }
+  }
+
+  if ( old != NULL )
+  {
+    for ( i = 0 ; i <= old->mask ; i++ )
+    {
+      entry = &old->slots[i];
+      if ( ( entry->key != NULL )
+        && ( Cosm_ConfigFind( snapshot, entry->section, entry->key )
+        == NULL ) )
+      {
+        Cosm_ConfigCall( config, entry->section, entry->key, NULL );
+      }
+    }
+  }
+}
+
+static void Cosm_ConfigWatcher( void * arg )
+{
+  /*
+    Thread reloading the watched file each time it changes.
+    Returns: nothing.
+  */
+  cosm_CONFIG_WATCH * watch;
+
+  watch = (cosm_CONFIG_WATCH *) arg;
+  while ( CosmAtomicLoad32( &watch->stop ) == 0 )
+  {
+    if ( CosmFileWatchWait( &watch->file, COSM_CONFIG_WATCH_WAIT )
+      == COSM_PASS )
+    {
+      /* a file that can't be read leaves the config as it was */
+      CosmConfigReload( watch->config, watch->file.filename );
+    }
+  }
+  CosmAtomicAdd32( &watch->done, 1 );
+}
+
+s32 CosmConfigLoad( cosm_CONFIG * config, const ascii * filename )
+{
+  cosm_CONFIG_SNAPSHOT * snapshot;
+  s32 error;
+
   if ( config == NULL )
   {
-    return COSM_FILE_ERROR_DENIED;
+    return COSM_FILE_ERROR_DENIED;
+  }
+
+  CosmMutexInit( &config->lock );
+  if ( CosmMutexLock( &config->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    return COSM_FILE_ERROR_DENIED;
+  }
+
+  if ( ( filename == NULL ) && ( config->section_count > 0 ) )
+  {
+    /* already in use */
+    CosmMutexUnlock( &config->lock );
+    return COSM_FILE_ERROR_DENIED;
+  }
+
+  /* fill in struct */
+  config->memory = NULL;
+  config->sections = NULL;
+  config->section_count = 0;
+  config->snapshot = NULL;
+  config->epoch = 0;
+  config->readers[0] = 0;
+  config->readers[1] = 0;
+  config->notify = NULL;
+  config->notify_count = 0;
+  config->watch = NULL;
+
+  if ( ( filename != NULL )
+    && ( ( error = Cosm_ConfigRead( config, filename ) ) != COSM_PASS ) )
+  {
+    CosmMutexUnlock( &config->lock );
+    return error;
+  }
+
+  if ( ( snapshot = Cosm_ConfigBuild( config ) ) == NULL )
+  {
+    Cosm_ConfigClear( config );
+    CosmMutexUnlock( &config->lock );
+    return COSM_FILE_ERROR_DENIED;
+  }
+  CosmAtomicStorePtr( (void **) &config->snapshot, snapshot );
+
+  CosmMutexUnlock( &config->lock );
+
+  return COSM_PASS;
+}
+
+s32 CosmConfigReload( cosm_CONFIG * config, const ascii * filename )
+{
+  cosm_CONFIG parsed;
+  cosm_CONFIG_SNAPSHOT * snapshot, * old;
+  cosm_CONFIG_SECTION * sections;
+  utf8 * memory;
+  u32 section_count;
+  s32 error;
+
+  if ( ( config == NULL ) || ( filename == NULL ) )
+  {
+    return COSM_FILE_ERROR_DENIED;
+  }
+
+  /* all the file I/O and parsing is done without the lock */
+  CosmMemSet( &parsed, sizeof( cosm_CONFIG ), 0 );
+  if ( ( error = Cosm_ConfigRead( &parsed, filename ) ) != COSM_PASS )
+  {
+    return error;
+  }
+  if ( ( snapshot = Cosm_ConfigBuild( &parsed ) ) == NULL )
+  {
+    Cosm_ConfigClear( &parsed );
+    return COSM_FILE_ERROR_DENIED;
+  }
+
+  if ( CosmMutexLock( &config->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    Cosm_ConfigRelease( snapshot );
+    Cosm_ConfigClear( &parsed );
+    return COSM_FILE_ERROR_DENIED;
+  }
+
+  /* trade sections, parsed then holds the old ones */
+  memory = config->memory;
+  sections = config->sections;
+  section_count = config->section_count;
+  config->memory = parsed.memory;
+  config->sections = parsed.sections;
+  config->section_count = parsed.section_count;
+  parsed.memory = memory;
+  parsed.sections = sections;
+  parsed.section_count = section_count;
+
+  old = Cosm_ConfigPublish( config, snapshot );
+  Cosm_ConfigChanges( config, old, snapshot );
+
+  CosmMutexUnlock( &config->lock );
+
+  Cosm_ConfigRelease( old );
+  Cosm_ConfigClear( &parsed );
+
+  return COSM_PASS;
+}
+
+s32 CosmConfigNotify( cosm_CONFIG * config, const utf8 * section,
+  const utf8 * key, cosm_CONFIG_CALLBACK callback, void * arg )
+{
+  cosm_CONFIG_NOTIFY * notify;
+  utf8 * names;
+  u32 section_len, key_len;
+
+  if ( ( config == NULL ) || ( callback == NULL )
+    || ( ( section == NULL ) && ( key != NULL ) ) )
+  {
+    return COSM_FAIL;
+  }
+
+  /* copy the names with one alloc */
+  section_len = ( section == NULL ) ? 0 : CosmStrBytes( section ) + 1;
+  key_len = ( key == NULL ) ? 0 : CosmStrBytes( key ) + 1;
+  names = NULL;
+  if ( ( section_len > 0 ) && ( ( names = CosmMemAlloc( (u64) section_len
+    + key_len ) ) == NULL ) )
+  {
+    return COSM_FAIL;
+  }
+
+  if ( CosmMutexLock( &config->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    CosmMemFree( names );
+    return COSM_FAIL;
+  }
+
+  if ( ( notify = (cosm_CONFIG_NOTIFY *) CosmMemRealloc( config->notify,
+    (u64) ( config->notify_count + 1 ) * sizeof( cosm_CONFIG_NOTIFY ) ) )
+    == NULL )
+  {
+    CosmMutexUnlock( &config->lock );
+    CosmMemFree( names );
+    return COSM_FAIL;
+  }
+  config->notify = notify;
+  notify = &config->notify[config->notify_count];
+  notify->section = NULL;
+  notify->key = NULL;
+  if ( section_len > 0 )
+  {
+    notify->section = names;
+    CosmStrCopy( notify->section, section, section_len );
+  }
+  if ( key_len > 0 )
+  {
+    notify->key = CosmMemOffset( names, section_len );
+    CosmStrCopy( notify->key, key, key_len );
+  }
+  notify->callback = callback;
+  notify->arg = arg;
+  config->notify_count++;
+
+  CosmMutexUnlock( &config->lock );
+
+  return COSM_PASS;
+}
+
+s32 CosmConfigWatch( cosm_CONFIG * config, const ascii * filename )
+{
+  cosm_CONFIG_WATCH * watch;
+  s32 error;
+
+  if ( ( config == NULL ) || ( filename == NULL ) )
+  {
+    return COSM_FILE_ERROR_DENIED;
+  }
+
+  if ( ( watch = (cosm_CONFIG_WATCH *) CosmMemAlloc(
+    sizeof( cosm_CONFIG_WATCH ) ) ) == NULL )
+  {
+    return COSM_FILE_ERROR_DENIED;
+  }
+  if ( ( error = CosmFileWatchInit( &watch->file, filename ) ) != COSM_PASS )
+  {
+    CosmMemFree( watch );
+    return error;
   }
+  watch->config = config;
 
-  CosmMutexInit( &config->lock );
   if ( CosmMutexLock( &config->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
   {
+    CosmFileWatchFree( &watch->file );
+    CosmMemFree( watch );
     return COSM_FILE_ERROR_DENIED;
   }
-
-  if ( filename == NULL )
-  {
-    if ( config->section_count > 0 )
-    {
-      /* already in use */
-      CosmMutexUnlock( &config->lock );
-      return COSM_FILE_ERROR_DENIED;
-    }
-    /* fill in struct */
-    config->memory = NULL;
-    config->sections = NULL;
-    config->section_count = 0;
-  }
-  else
+  if ( ( config->watch != NULL )
+    || ( CosmThreadBegin( &watch->thread, Cosm_ConfigWatcher, watch,
+    COSM_CONFIG_WATCH_STACK ) != COSM_PASS ) )
   {
-    CosmMemSet( &file, sizeof( cosm_FILE ), 0 );
-
-    if ( ( error = CosmFileOpen( &file, filename, COSM_FILE_MODE_READ,
-      COSM_FILE_LOCK_READ ) ) != COSM_PASS )
-    {
-      CosmMutexUnlock( &config->lock );
-      return error;
-    }
-    if ( ( error = CosmFileLength( &length, &file ) ) != COSM_PASS )
-    {
-      CosmFileClose( &file );
-      CosmMutexUnlock( &config->lock );
-      return error;
-    }
-    config->sections = NULL;
-    config->section_count = 0;
-    if ( ( config->memory = CosmMemAlloc( length ) )
-      == NULL )
-    {
-      CosmFileClose( &file );
-      CosmMutexUnlock( &config->lock );
-      return COSM_FILE_ERROR_DENIED;
-    }
-
-    if ( COSM_PASS != CosmFileRead( config->memory, &bytes_read, &file,
-      length ) )
-    {
-      CosmFileClose( &file );
-      CosmMemFree( config->memory );
-      CosmMutexUnlock( &config->lock );
-      return COSM_FILE_ERROR_DENIED;
-    }
-    CosmFileClose( &file );
-
-    /* parse */
-    ptr = config->memory;
-    while ( ( section = CosmStrChar( ptr, '[', (u32) length ) ) != NULL )
-    {
-      section++;
-      ptr = CosmStrChar( ptr, ']', (u32) length );
-      *ptr = 0;
-      ptr++;
-      ptr++;
-
-      if ( config->section_count == 0 )
-      {
-        if ( ( config->sections = (cosm_CONFIG_SECTION *)
-          CosmMemAlloc( sizeof( cosm_CONFIG_SECTION ) ) ) == NULL )
-        {
-          CosmMutexUnlock( &config->lock );
-          return COSM_FILE_ERROR_DENIED;
-        }
-        config->section_count = 1;
-      }
-      else
-      {
-        if ( ( config->sections = (cosm_CONFIG_SECTION *)
-          CosmMemRealloc( config->sections, (u64) ( config->section_count + 1 )
-            * sizeof( cosm_CONFIG_SECTION ) ) )
-          == NULL )
-        {
-          CosmMutexUnlock( &config->lock );
-          return COSM_FILE_ERROR_DENIED;
-        }
-        CosmMemSet( &config->sections[config->section_count],
-          sizeof( cosm_CONFIG_SECTION ), 0 );
-        config->section_count += 1;
-      }
-      i = config->section_count - 1;
-      config->sections[i].flag = COSM_CONFIG_NORMAL;
-      config->sections[i].length = CosmStrBytes( section ) + 1;
-      config->sections[i].section = section;
-      config->sections[i].key_count = 0;
-      config->sections[i].keys = NULL;
-
-      /* now add the keys */
-      tmp_section = &config->sections[i];
-      while ( *ptr != '[' )
-      {
-        if ( ( eol = CosmStrChar( ptr, '\n', (u32) length ) ) == NULL )
-        {
-          /* no more lines */
-          break;
-        }
-        *eol = 0;
-        eol++;
-        if ( ( value = CosmStrChar( ptr, '=', (u32) length ) ) != NULL )
-        {
-          key = ptr;
-          *value = 0;
-          value++;
-          ptr = eol;
-
-          /* ignore empty lines */
-          while ( *ptr == '\n' )
-          {
-            ptr++;
-          }
-
-          if ( tmp_section->key_count == 0 )
-          {
-            if ( ( tmp_section->keys = (cosm_CONFIG_KEY *)
-              CosmMemAlloc( sizeof( cosm_CONFIG_KEY ) ) ) == NULL )
-            {
-              CosmMutexUnlock( &config->lock );
-              return COSM_FILE_ERROR_DENIED;
-            }
-            tmp_section->key_count = 1;
-          }
-          else
-          {
-            if ( ( tmp_section->keys = (cosm_CONFIG_KEY *)
-              CosmMemRealloc( tmp_section->keys, (u64)
-                ( tmp_section->key_count + 1 ) * sizeof( cosm_CONFIG_KEY ) ) )
-              == NULL )
-            {
-              CosmMutexUnlock( &config->lock );
-              return COSM_FILE_ERROR_DENIED;
-            }
-            CosmMemSet( &tmp_section->keys[tmp_section->key_count],
-              sizeof( cosm_CONFIG_KEY ), 0 );
-            tmp_section->key_count += 1;
-          }
-
-          j = tmp_section->key_count - 1;
-
-          strlen = CosmStrBytes( key ) + CosmStrBytes( value );
-          strlen += 2;
-
-          tmp_section->keys[j].key = key;
-          tmp_section->keys[j].value = value;
-          tmp_section->keys[j].length = strlen;
-          tmp_section->keys[j].flag = COSM_CONFIG_NORMAL;
-        } /* if key/value pair */
-      } /* while section */
-    } /* while more to file */
+    CosmMutexUnlock( &config->lock );
+    CosmFileWatchFree( &watch->file );
+    CosmMemFree( watch );
+    return COSM_FILE_ERROR_DENIED;
   }
-
+  config->watch = watch;
   CosmMutexUnlock( &config->lock );
 
   return COSM_PASS;
@@ -265,40 +821,34 @@ s32 CosmConfigSave( const cosm_CONFIG * config, const ascii * filename )
   return COSM_PASS;
 }
 
-s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
+static s32 Cosm_ConfigSet( cosm_CONFIG * config, const utf8 * section,
   const utf8 * key, const utf8 * value )
 {
+  /*
+    Set the value in the sections, the lock must be held.
+    Returns: COSM_PASS on success, or COSM_FAIL on failure.
+  */
   u32 i, j;
   cosm_CONFIG_SECTION * tmp_section;
   u32 length;
   u32 key_len, val_len;
 
-  if ( ( config == NULL ) || ( section == NULL ) || ( key == NULL ) )
-  {
-    return COSM_FAIL;
-  }
-
   /* calculate length of key+value + 2 \0 */
   key_len = CosmStrBytes( key ) + 1;
   val_len = CosmStrBytes( value ) + 1;
   length = key_len + val_len;
 
-  if ( CosmMutexLock( &config->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
-  {
-    return COSM_FAIL;
-  }
-
   for ( i = 0 ; i < config->section_count; i++ )
   {
     if ( CosmStrCmp( section, config->sections[i].section,
-      CosmStrBytes( section ) ) == 0 )
+      CosmStrBytes( section ) + 1 ) == 0 )
     {
       /* found the section */
       tmp_section = &config->sections[i];
       for ( j = 0 ; j < tmp_section->key_count; j++ )
       {
         if ( CosmStrCmp( key, tmp_section->keys[j].key,
-          CosmStrBytes( key ) ) == 0 )
+          CosmStrBytes( key ) + 1 ) == 0 )
         {
           /* found an existing key */
           if ( value == NULL )
@@ -331,7 +881,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
               if ( ( tmp_section->keys[j].key =
                  CosmMemAlloc( (u64) length ) ) == NULL )
               {
-                CosmMutexUnlock( &config->lock );
                 return COSM_FAIL;
               }
               CosmStrCopy( tmp_section->keys[j].key, key, key_len );
@@ -347,7 +896,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
               if ( ( tmp_section->keys[j].key = CosmMemRealloc(
                 tmp_section->keys[j].key, (u64) length ) ) == NULL )
               {
-                CosmMutexUnlock( &config->lock );
                 return COSM_FAIL;
               }
               tmp_section->keys[j].value = CosmMemOffset(
@@ -361,7 +909,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
             if ( ( tmp_section->keys[j].key =
                CosmMemAlloc( (u64) length ) ) == NULL )
             {
-              CosmMutexUnlock( &config->lock );
               return COSM_FAIL;
             }
             CosmStrCopy( tmp_section->keys[j].key, key, key_len );
@@ -371,7 +918,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
             tmp_section->keys[j].length = length;
             tmp_section->keys[j].flag = COSM_CONFIG_ALLOCATED;
           }
-          CosmMutexUnlock( &config->lock );
           return COSM_PASS;
         } /* key matched */
       } /* section matched */
@@ -381,7 +927,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
         if ( ( tmp_section->keys = (cosm_CONFIG_KEY *) CosmMemAlloc(
           sizeof( cosm_CONFIG_KEY ) ) ) == NULL )
         {
-          CosmMutexUnlock( &config->lock );
           return COSM_FAIL;
         }
         tmp_section->key_count = 1;
@@ -393,7 +938,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
           ( tmp_section->key_count + 1 ) * sizeof( cosm_CONFIG_KEY ) ) )
           == NULL )
         {
-          CosmMutexUnlock( &config->lock );
           return COSM_FAIL;
         }
         CosmMemSet( &tmp_section->keys[tmp_section->key_count],
@@ -407,7 +951,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
          CosmMemAlloc( (u64) length ) ) == NULL )
       {
         tmp_section->key_count -= 1;
-        CosmMutexUnlock( &config->lock );
         return COSM_FAIL;
       }
       CosmStrCopy( tmp_section->keys[j].key, key, key_len );
@@ -416,7 +959,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
       CosmStrCopy( tmp_section->keys[j].value, value, val_len );
       tmp_section->keys[j].flag = COSM_CONFIG_ALLOCATED;
 
-      CosmMutexUnlock( &config->lock );
       return COSM_PASS;
     } /* section matched */
   } /* section loop */
@@ -426,7 +968,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
     if ( ( config->sections = (cosm_CONFIG_SECTION *)
       CosmMemAlloc( sizeof( cosm_CONFIG_SECTION ) ) ) == NULL )
     {
-      CosmMutexUnlock( &config->lock );
       return COSM_FAIL;
     }
     config->section_count = 1;
@@ -438,7 +979,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
       ( config->section_count + 1 ) * sizeof( cosm_CONFIG_SECTION ) ) )
       == NULL )
     {
-      CosmMutexUnlock( &config->lock );
       return COSM_FAIL;
     }
     CosmMemSet( &config->sections[config->section_count],
@@ -451,7 +991,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
   if ( ( config->sections[j].section = CosmMemAlloc(
     (u64) config->sections[j].length ) ) == NULL )
   {
-    CosmMutexUnlock( &config->lock );
     return COSM_FAIL;
   }
   CosmStrCopy( config->sections[j].section, section,
@@ -459,7 +998,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
   if ( ( config->sections[j].keys = (cosm_CONFIG_KEY *) CosmMemAlloc(
     sizeof( cosm_CONFIG_KEY ) ) ) == NULL )
   {
-    CosmMutexUnlock( &config->lock );
     return COSM_FAIL;
   }
   config->sections[j].key_count = 1;
@@ -469,7 +1007,6 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
   if ( ( tmp_section->keys[0].key =
      CosmMemAlloc( (u64) length ) ) == NULL )
   {
-    CosmMutexUnlock( &config->lock );
     return COSM_FAIL;
   }
   CosmStrCopy( tmp_section->keys[0].key, key, key_len );
@@ -478,96 +1015,249 @@ s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
   CosmStrCopy( tmp_section->keys[0].value, value, val_len );
   tmp_section->keys[0].flag = COSM_CONFIG_ALLOCATED;
 
-  CosmMutexUnlock( &config->lock );
   return COSM_PASS;
 }
 
+s32 CosmConfigSet( cosm_CONFIG * config, const utf8 * section,
+  const utf8 * key, const utf8 * value )
+{
+  cosm_CONFIG_SNAPSHOT * snapshot, * old;
+  s32 result;
+
+  if ( ( config == NULL ) || ( section == NULL ) || ( key == NULL ) )
+  {
+    return COSM_FAIL;
+  }
+
+  if ( CosmMutexLock( &config->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    return COSM_FAIL;
+  }
+
+  if ( ( result = Cosm_ConfigSet( config, section, key, value ) )
+    == COSM_PASS )
+  {
+    if ( ( snapshot = Cosm_ConfigBuild( config ) ) == NULL )
+    {
+      result = COSM_FAIL;
+    }
+    else
+    {
+      old = Cosm_ConfigPublish( config, snapshot );
+      Cosm_ConfigChanges( config, old, snapshot );
+      Cosm_ConfigRelease( old );
+    }
+  }
+
+  CosmMutexUnlock( &config->lock );
+  return result;
+}
+
 const utf8 * CosmConfigGet( cosm_CONFIG * config, const utf8 * section,
   const utf8 * key )
 {
-  u32 i, j;
-  cosm_CONFIG_SECTION * tmp_section;
+  const cosm_CONFIG_ENTRY * entry;
+  u32 index;
 
   if ( config == NULL )
   {
     return NULL;
   }
 
-  if ( CosmMutexLock( &config->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  entry = Cosm_ConfigFind( Cosm_ConfigReadBegin( config, &index ),
+    section, key );
+  CosmAtomicAdd32( &config->readers[index], -1 );
+
+  return ( ( entry == NULL ) ? NULL : entry->value );
+}
+
+s32 CosmConfigGetNumber( s64 * number, cosm_CONFIG * config,
+  const utf8 * section, const utf8 * key )
+{
+  const cosm_CONFIG_ENTRY * entry;
+  u32 index;
+
+  if ( ( number == NULL ) || ( config == NULL ) )
+  {
+    return COSM_FAIL;
+  }
+
+  entry = Cosm_ConfigFind( Cosm_ConfigReadBegin( config, &index ),
+    section, key );
+  if ( ( entry == NULL ) || ( !entry->is_number ) )
+  {
+    CosmAtomicAdd32( &config->readers[index], -1 );
+    return COSM_FAIL;
+  }
+  *number = entry->number;
+  CosmAtomicAdd32( &config->readers[index], -1 );
+
+  return COSM_PASS;
+}
+
+cosm_CONFIG_SNAPSHOT * CosmConfigSnapshot( cosm_CONFIG * config )
+{
+  cosm_CONFIG_SNAPSHOT * snapshot;
+  u32 index;
+
+  if ( config == NULL )
   {
     return NULL;
   }
 
-  for ( i = 0 ; i < config->section_count; i++ )
+  if ( ( snapshot = Cosm_ConfigReadBegin( config, &index ) ) != NULL )
   {
-    if ( CosmStrCmp( section, config->sections[i].section,
-      CosmStrBytes( section ) ) == 0 )
-    {
-      /* found the section */
-      tmp_section = &config->sections[i];
-      for ( j = 0 ; j < tmp_section->key_count; j++ )
-      {
-        if ( ( CosmStrCmp( key, tmp_section->keys[j].key, CosmStrBytes( key ) )
-          == 0 ) && ( ( tmp_section->keys[j].flag == COSM_CONFIG_NORMAL )
-          || ( tmp_section->keys[j].flag == COSM_CONFIG_ALLOCATED ) ) )
-        {
-          CosmMutexUnlock( &config->lock );
-          return tmp_section->keys[j].value;
-        }
-      }
-    }
+    CosmAtomicAdd32( &snapshot->refs, 1 );
   }
+  CosmAtomicAdd32( &config->readers[index], -1 );
 
-  CosmMutexUnlock( &config->lock );
-  return NULL;
+  return snapshot;
+}
+
+const utf8 * CosmConfigSnapshotGet( const cosm_CONFIG_SNAPSHOT * snapshot,
+  const utf8 * section, const utf8 * key )
+{
+  const cosm_CONFIG_ENTRY * entry;
+
+  entry = Cosm_ConfigFind( snapshot, section, key );
+
+  return ( ( entry == NULL ) ? NULL : entry->value );
+}
+
+void CosmConfigSnapshotFree( cosm_CONFIG_SNAPSHOT * snapshot )
+{
+  Cosm_ConfigRelease( snapshot );
 }
 
 void CosmConfigFree( cosm_CONFIG * config )
 {
-  u32 i, j;
-  cosm_CONFIG_SECTION * section;
+  u32 i;
 
   if ( config == NULL )
   {
     return;
   }
 
+  /* the watcher reloads with the lock, stop it first */
+  if ( config->watch != NULL )
+  {
+    CosmAtomicAdd32( &config->watch->stop, 1 );
+    while ( CosmAtomicLoad32( &config->watch->done ) == 0 )
+    {
+      CosmSleep( 1 );
+    }
+    CosmFileWatchFree( &config->watch->file );
+    CosmMemFree( config->watch );
+    config->watch = NULL;
+  }
+
   if ( CosmMutexLock( &config->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
   {
     return;
   }
 
-  for ( i = 0 ; i < config->section_count; i++ )
+  /* readers that hold a snapshot keep it */
+  Cosm_ConfigRelease( Cosm_ConfigPublish( config, NULL ) );
+
+  Cosm_ConfigClear( config );
+
+  for ( i = 0 ; i < config->notify_count ; i++ )
   {
-    section = &config->sections[i];
-    for ( j = 0 ; j < section->key_count; j++ )
+    CosmMemFree( config->notify[i].section );
+  }
+  CosmMemFree( config->notify );
+  config->notify = NULL;
+  config->notify_count = 0;
+
+  CosmMutexUnlock( &config->lock );
+  CosmMutexFree( &config->lock );
+}
+
+typedef struct cosm_CONFIG_TEST
+{
+  cosm_CONFIG * config;
+  u32 done;
+  u32 bad;
+} cosm_CONFIG_TEST;
+
+static void Cosm_ConfigTestRead( void * arg )
+{
+  /*
+    Thread for the snapshot tests, reads while the main thread writes and
+    counts any value that is not one it set.
+    Returns: nothing.
+  */
+  cosm_CONFIG_TEST * test;
+  cosm_CONFIG_SNAPSHOT * snapshot;
+  s64 number;
+  u32 i;
+
+  test = (cosm_CONFIG_TEST *) arg;
+  for ( i = 0 ; i < 20000 ; i++ )
+  {
+    snapshot = CosmConfigSnapshot( test->config );
+    if ( CosmStrCmp( CosmConfigSnapshotGet( snapshot, "s2", "k1" ),
+      "v21", 4 ) != 0 )
     {
-      if ( section->keys[j].flag == COSM_CONFIG_ALLOCATED )
-      {
-        CosmMemFree( section->keys[j].key );
-      }
+      CosmAtomicAdd32( &test->bad, 1 );
     }
-    if ( section->flag == COSM_CONFIG_ALLOCATED )
+    CosmConfigSnapshotFree( snapshot );
+    if ( ( CosmConfigGetNumber( &number, test->config, "s3", "n" )
+      != COSM_PASS ) || ( number < 0 ) || ( number >= 1000 ) )
     {
-      CosmMemFree( section->section );
+      CosmAtomicAdd32( &test->bad, 1 );
     }
-    CosmMemFree( section->keys );
   }
-  CosmMemFree( config->sections );
-  CosmMemFree( config->memory );
+  CosmAtomicAdd32( &test->done, 1 );
+}
 
-  config->memory = NULL;
-  config->sections = NULL;
-  config->section_count = 0;
+static void Cosm_ConfigTestChange( void * arg, cosm_CONFIG * config,
+  const utf8 * section, const utf8 * key, const utf8 * value )
+{
+  /*
+    Callback for the notify tests, counts the calls in arg.
+    Returns: nothing.
+  */
+  CosmAtomicAdd32( (u32 *) arg, 1 );
+}
 
-  CosmMutexUnlock( &config->lock );
-  CosmMutexFree( &config->lock );
+static s32 Cosm_ConfigTestWrite( const ascii * text )
+{
+  /*
+    Replace test.cfg with text.
+    Returns: COSM_PASS on success, or COSM_FAIL on failure.
+  */
+  cosm_FILE file;
+  u64 bytes;
+
+  CosmMemSet( &file, sizeof( cosm_FILE ), 0 );
+  if ( CosmFileOpen( &file, "test.cfg", COSM_FILE_MODE_WRITE
+    | COSM_FILE_MODE_CREATE | COSM_FILE_MODE_TRUNCATE, COSM_FILE_LOCK_WRITE )
+    != COSM_PASS )
+  {
+    return COSM_FAIL;
+  }
+  if ( CosmFileWrite( &file, &bytes, text, CosmStrBytes( text ) )
+    != COSM_PASS )
+  {
+    CosmFileClose( &file );
+    return COSM_FAIL;
+  }
+
+  return CosmFileClose( &file );
 }
 
 s32 Cosm_TestConfig( void )
 {
   cosm_CONFIG conf;
+  cosm_CONFIG_SNAPSHOT * snapshot;
+  cosm_CONFIG_TEST test;
+  u64 thread_id;
   const utf8 * ptr;
+  utf8 buf[16];
+  s64 number;
+  u32 changes[3];
+  u32 i;
 
   CosmMemSet( &conf, sizeof( cosm_CONFIG ), 0 );
 
@@ -711,7 +1401,161 @@ s32 Cosm_TestConfig( void )
     return -25;
   }
 
+  /* sections and keys must match exactly */
+  if ( ( CosmConfigGet( &conf, "s", "k2" ) != NULL )
+    || ( CosmConfigGet( &conf, "s1", "k" ) != NULL )
+    || ( CosmConfigGet( &conf, "s1", "k22" ) != NULL ) )
+  {
+    return -26;
+  }
+
+  /* numbers */
+  if ( ( CosmConfigSet( &conf, "s3", "n", "-42" ) != COSM_PASS )
+    || ( CosmConfigSet( &conf, "s3", "max", "9223372036854775807" )
+      != COSM_PASS )
+    || ( CosmConfigSet( &conf, "s3", "over", "9223372036854775808" )
+      != COSM_PASS ) )
+  {
+    return -27;
+  }
+  if ( ( CosmConfigGetNumber( &number, &conf, "s3", "n" ) != COSM_PASS )
+    || ( number != -42 )
+    || ( CosmConfigGetNumber( &number, &conf, "s3", "max" ) != COSM_PASS )
+    || ( number != 0x7FFFFFFFFFFFFFFFLL )
+    || ( CosmConfigGetNumber( &number, &conf, "s3", "over" ) != COSM_FAIL )
+    || ( CosmConfigGetNumber( &number, &conf, "s1", "k2" ) != COSM_FAIL )
+    || ( CosmConfigGetNumber( &number, &conf, "s3", "none" ) != COSM_FAIL ) )
+  {
+    return -28;
+  }
+
+  /* a snapshot does not change */
+  if ( ( snapshot = CosmConfigSnapshot( &conf ) ) == NULL )
+  {
+    return -29;
+  }
+  if ( ( CosmConfigSet( &conf, "s1", "k2", "changed" ) != COSM_PASS )
+    || ( CosmStrCmp( CosmConfigGet( &conf, "s1", "k2" ), "changed", 8 ) )
+    || ( CosmStrCmp( CosmConfigSnapshotGet( snapshot, "s1", "k2" ),
+      "v12", 4 ) ) )
+  {
+    return -30;
+  }
+
+  /* readers in other threads while the config changes */
+  if ( CosmConfigSet( &conf, "s3", "n", "0" ) != COSM_PASS )
+  {
+    return -31;
+  }
+  test.config = &conf;
+  test.done = 0;
+  test.bad = 0;
+  for ( i = 0 ; i < 2 ; i++ )
+  {
+    if ( CosmThreadBegin( &thread_id, Cosm_ConfigTestRead, &test,
+      64 * 1024 ) != COSM_PASS )
+    {
+      return -31;
+    }
+  }
+  for ( i = 0 ; ( i < 10000 ) && ( CosmAtomicLoad32( &test.done ) < 2 ) ;
+    i++ )
+  {
+    CosmPrintStr( buf, sizeof( buf ), "%u", i % 1000 );
+    if ( ( CosmConfigSet( &conf, "s3", "n", buf ) != COSM_PASS )
+      || ( CosmConfigSet( &conf, "s4", buf, "x" ) != COSM_PASS ) )
+    {
+      return -31;
+    }
+  }
+  while ( CosmAtomicLoad32( &test.done ) < 2 )
+  {
+    CosmSleep( 1 );
+  }
+  if ( test.bad != 0 )
+  {
+    return -32;
+  }
+
+  /* and outlives the config */
+  CosmConfigFree( &conf );
+  if ( ( CosmConfigGet( &conf, "s2", "k1" ) != NULL )
+    || ( CosmStrCmp( CosmConfigSnapshotGet( snapshot, "s2", "k1" ),
+      "v21", 4 ) ) )
+  {
+    return -33;
+  }
+  CosmConfigSnapshotFree( snapshot );
+
+  /* change callbacks */
+  CosmMemSet( &conf, sizeof( cosm_CONFIG ), 0 );
+  CosmMemSet( changes, sizeof( changes ), 0 );
+  if ( ( CosmConfigLoad( &conf, NULL ) != COSM_PASS )
+    || ( CosmConfigSet( &conf, "s1", "k1", "v11" ) != COSM_PASS )
+    || ( CosmConfigSet( &conf, "s2", "k1", "v21" ) != COSM_PASS ) )
+  {
+    return -34;
+  }
+  if ( ( CosmConfigNotify( &conf, NULL, NULL, Cosm_ConfigTestChange,
+    &changes[0] ) != COSM_PASS )
+    || ( CosmConfigNotify( &conf, "s1", NULL, Cosm_ConfigTestChange,
+    &changes[1] ) != COSM_PASS )
+    || ( CosmConfigNotify( &conf, "s2", "k1", Cosm_ConfigTestChange,
+    &changes[2] ) != COSM_PASS )
+    || ( CosmConfigNotify( &conf, NULL, "k1", Cosm_ConfigTestChange,
+    &changes[2] ) != COSM_FAIL ) )
+  {
+    return -35;
+  }
+  /* one new key, then setting the same value again is no change */
+  if ( ( CosmConfigSet( &conf, "s1", "k2", "v12" ) != COSM_PASS )
+    || ( CosmConfigSet( &conf, "s1", "k2", "v12" ) != COSM_PASS )
+    || ( changes[0] != 1 ) || ( changes[1] != 1 ) || ( changes[2] != 0 ) )
+  {
+    return -36;
+  }
+
+  /* reload, s1/k1 changes, s1/k2 goes, s3/k1 comes, and a bad line */
+  if ( ( Cosm_ConfigTestWrite( "[s1]\nk1=new\nnot a key\n\n[s2]\nk1=v21\n"
+    "\n[s3]\nk1=v31" ) != COSM_PASS )
+    || ( CosmConfigReload( &conf, "test.cfg" ) != COSM_PASS ) )
+  {
+    return -37;
+  }
+  if ( ( changes[0] != 4 ) || ( changes[1] != 3 ) || ( changes[2] != 0 )
+    || ( CosmStrCmp( CosmConfigGet( &conf, "s1", "k1" ), "new", 4 ) )
+    || ( CosmConfigGet( &conf, "s1", "k2" ) != NULL )
+    || ( CosmStrCmp( CosmConfigGet( &conf, "s3", "k1" ), "v31", 4 ) ) )
+  {
+    return -38;
+  }
+  if ( CosmConfigReload( &conf, "missing.cfg" ) == COSM_PASS )
+  {
+    return -39;
+  }
+
+  /* and the watcher does it when the file is replaced */
+  if ( CosmConfigWatch( &conf, "test.cfg" ) != COSM_PASS )
+  {
+    return -40;
+  }
+  if ( Cosm_ConfigTestWrite( "[s1]\nk1=new\n\n[s2]\nk1=watched\n\n"
+    "[s3]\nk1=v31\n\n" ) != COSM_PASS )
+  {
+    return -41;
+  }
+  for ( i = 0 ; ( i < 5000 ) && ( CosmAtomicLoad32( &changes[2] ) == 0 ) ;
+    i++ )
+  {
+    CosmSleep( 1 );
+  }
+  if ( ( CosmAtomicLoad32( &changes[2] ) != 1 )
+    || ( CosmStrCmp( CosmConfigGet( &conf, "s2", "k1" ), "watched", 8 ) ) )
+  {
+    return -42;
+  }
   CosmConfigFree( &conf );
+  CosmFileDelete( "test.cfg" );
 
   return COSM_PASS;
 }
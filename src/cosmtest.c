@@ -29,7 +29,7 @@ cosm_TEST __cosm_test_modules[COSM_TEST_MODULE_MAX + 2] =
   { "os_io", Cosm_TestOSIO },
   { "os_net", Cosm_TestOSNet },
 
-  /* Utility  7-17 */
+  /* Utility  7-18 */
   { "bignum", Cosm_TestBigNum },
   { "buffer", Cosm_TestBuffer },
   { "config", Cosm_TestConfig },
@@ -38,11 +38,12 @@ cosm_TEST __cosm_test_modules[COSM_TEST_MODULE_MAX + 2] =
   { "http", Cosm_TestHTTP },
   { "language", Cosm_TestLanguage },
   { "log", Cosm_TestLog },
+  { "metrics", Cosm_TestMetrics },
   { "security", Cosm_TestSecurity },
   { "time", Cosm_TestTime },
   { "transform", Cosm_TestTransform },
 
-  /* 18 */
+  /* 19 */
   { NULL, NULL }
 };
 
@@ -89,3 +90,405 @@ s32 CosmTest( s32 * failed_module, s32 * failed_test, s32 module_num )
 
   return COSM_PASS;
 }
+
+/* benchmarks */
+
+static u64 Cosm_BenchStrTime( u32 which, const utf8 * string,
+  const utf8 * copy, u32 length, u32 loops )
+{
+  u64 start;
+  u32 i;
+
+  start = CosmClockMono();
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    switch ( which )
+    {
+      case 0:
+        CosmMemCmp( string, copy, length );
+        break;
+      case 1:
+        Cosm_MemCmpScalar( string, copy, length );
+        break;
+      case 2:
+        CosmStrBytes( string );
+        break;
+      case 3:
+        Cosm_StrBytesScalar( string );
+        break;
+      case 4:
+        CosmStrChar( string, '!', length + 1 );
+        break;
+      case 5:
+        Cosm_StrCharScalar( string, '!', length + 1 );
+        break;
+      case 6:
+        CosmStrStr( string, "needle!", length + 1 );
+        break;
+      default:
+        Cosm_StrStrScalar( string, "needle!", length + 1 );
+        break;
+    }
+  }
+
+  return CosmClockMono() - start;
+}
+
+void CosmBenchStr( void )
+{
+  const ascii * names[4] =
+    { "CosmMemCmp  ", "CosmStrBytes", "CosmStrChar ", "CosmStrStr  " };
+  utf8 * string, * copy;
+  u64 fast, scalar;
+  u32 length, loops, test, i;
+
+  CosmPrint( "\nfunction        bytes   vector MB/s   scalar MB/s\n" );
+
+  for ( length = 16 ; length <= 65536 ; length *= 4 )
+  {
+    string = CosmMemAlloc( length + 1 );
+    copy = CosmMemAlloc( length + 1 );
+    if ( ( string == NULL ) || ( copy == NULL ) )
+    {
+      CosmMemFree( string );
+      CosmMemFree( copy );
+      return;
+    }
+
+    /* text full of near misses, with the targets at the very end */
+    for ( i = 0 ; i < length ; i++ )
+    {
+      string[i] = (utf8) ( ( i % 8 == 0 ) ? 'n' : 'a' + ( i % 23 ) );
+    }
+    CosmMemCopy( &string[length - 7], "needle!", 7 );
+    string[length] = 0;
+    CosmMemCopy( copy, string, length + 1 );
+
+    /* about 64MB of work for each function */
+    loops = 0x4000000 / length;
+
+    for ( test = 0 ; test < 4 ; test++ )
+    {
+      fast = Cosm_BenchStrTime( test * 2, string, copy, length, loops );
+      scalar = Cosm_BenchStrTime( test * 2 + 1, string, copy, length,
+        loops );
+      CosmPrint( "%.12s %8u %13v %13v\n", names[test], length,
+        ( (u64) length * loops * 1000 ) / ( ( fast == 0 ) ? 1 : fast ),
+        ( (u64) length * loops * 1000 ) / ( ( scalar == 0 ) ? 1 : scalar ) );
+    }
+
+    CosmMemFree( string );
+    CosmMemFree( copy );
+  }
+}
+
+static s32 Cosm_BenchHTTPHandler( cosm_HTTPD_REQUEST * request )
+{
+  if ( ( CosmHTTPDSendInit( request, 200, "OK", "text/plain" ) != COSM_PASS )
+    || ( CosmHTTPDSend( request, "ok", 2 ) != COSM_PASS ) )
+  {
+    return COSM_FAIL;
+  }
+
+  return CosmHTTPDSend( request, NULL, 0 );
+}
+
+static u32 Cosm_BenchHTTPGet( cosm_HTTP * http )
+{
+  ascii body[16];
+  u32 status, bytes;
+
+  if ( ( CosmHTTPGet( http, &status, "/bench", 1000 ) != COSM_PASS )
+    || ( status != 200 ) )
+  {
+    return 0;
+  }
+
+  while ( http->status == COSM_HTTP_STATUS_BODY )
+  {
+    if ( CosmHTTPRecv( body, &bytes, http, 16, 1000 ) != COSM_PASS )
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+void CosmBenchHTTP( void )
+{
+  cosm_HTTPD httpd;
+  cosm_HTTP_POOL pool;
+  cosm_HTTP http;
+  cosm_HTTP * pooled;
+  cosm_NET_ADDR addr;
+  ascii uri[64];
+  u64 plain, reused;
+  u32 loops, done, i;
+
+  CosmMemSet( &httpd, sizeof( cosm_HTTPD ), 0 );
+  addr.type = COSM_NET_IPV4;
+  addr.ip.v4 = 0x7F000001;
+  addr.port = 0;
+  if ( ( CosmHTTPDInit( &httpd, NULL, 0, 2, 0, &addr, 1000 ) != COSM_PASS )
+    || ( CosmHTTPDSetHandler( &httpd, "/", NULL, Cosm_BenchHTTPHandler )
+    != COSM_PASS ) || ( CosmHTTPDStart( &httpd, 1000 ) != COSM_PASS ) )
+  {
+    CosmPrint( "Unable to start the HTTP server.\n" );
+    CosmHTTPDFree( &httpd );
+    return;
+  }
+  CosmPrintStr( uri, 64, "http://localhost:%u/", httpd.net.my_addr.port );
+  loops = 2000;
+
+  /* a lookup, a handshake and a request each time */
+  done = 0;
+  plain = CosmClockMono();
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    CosmMemSet( &http, sizeof( cosm_HTTP ), 0 );
+    if ( CosmHTTPOpen( &http, uri, NULL, NULL, NULL, NULL, NULL )
+      == COSM_PASS )
+    {
+      done += Cosm_BenchHTTPGet( &http );
+    }
+    CosmHTTPClose( &http );
+  }
+  plain = CosmClockMono() - plain;
+  CosmPrint( "\nHTTP GET without pool %6u/%u ok %9v requests/s\n", done,
+    loops, ( (u64) done * 1000000000LL ) / ( ( plain == 0 ) ? 1 : plain ) );
+
+  /* the same requests over reused keep-alive connections */
+  done = 0;
+  CosmHTTPPoolInit( &pool, 4, 10000, 60000 );
+  reused = CosmClockMono();
+  for ( i = 0 ; i < loops ; i++ )
+  {
+    if ( CosmHTTPPoolGet( &pooled, &pool, uri, 1000 ) == COSM_PASS )
+    {
+      done += Cosm_BenchHTTPGet( pooled );
+      CosmHTTPPoolPut( &pool, pooled );
+    }
+  }
+  reused = CosmClockMono() - reused;
+  CosmHTTPPoolFree( &pool );
+  CosmPrint( "HTTP GET with pool    %6u/%u ok %9v requests/s\n", done,
+    loops, ( (u64) done * 1000000000LL ) / ( ( reused == 0 ) ? 1 : reused ) );
+
+  CosmHTTPDStop( &httpd, 1000 );
+  CosmHTTPDFree( &httpd );
+}
+
+/* benchmark framework */
+
+#define COSM_BENCH_BATCH   1000000    /* ns, target for one repetition */
+#define COSM_BENCH_WARMUP  20000000   /* ns of untimed repetitions */
+#define COSM_BENCH_TIME    2000000000 /* ns, when the default count stops */
+#define COSM_BENCH_MIN     10         /* repetitions before that */
+#define COSM_BENCH_LOOPS   0x40000000 /* most loops in one repetition */
+
+static s32 Cosm_BenchTime( u64 * elapsed, s32 (*function)( void *, u32 ),
+  void * arg, u32 loops )
+{
+  u64 start;
+
+  start = CosmClockMono();
+  if ( (*function)( arg, loops ) != COSM_PASS )
+  {
+    return COSM_FAIL;
+  }
+  *elapsed = CosmClockMono() - start;
+
+  return COSM_PASS;
+}
+
+s32 CosmBench( cosm_BENCH * bench, const ascii * name,
+  s32 (*function)( void * arg, u32 loops ), void * arg, u64 bytes,
+  u32 repetitions )
+{
+  u64 * times;
+  u64 elapsed, start, current;
+  u32 loops, limit, i, j;
+
+  if ( ( bench == NULL ) || ( name == NULL ) || ( function == NULL ) )
+  {
+    return COSM_FAIL;
+  }
+
+  CosmMemSet( bench, sizeof( cosm_BENCH ), 0 );
+  limit = ( repetitions == 0 );
+  if ( limit )
+  {
+    repetitions = COSM_BENCH_REPETITIONS;
+  }
+
+  if ( ( times = CosmMemAlloc( repetitions * sizeof( u64 ) ) ) == NULL )
+  {
+    return COSM_FAIL;
+  }
+
+  /* double the loops until a repetition is long enough to time */
+  loops = 1;
+  do
+  {
+    if ( Cosm_BenchTime( &elapsed, function, arg, loops ) != COSM_PASS )
+    {
+      CosmMemFree( times );
+      return COSM_FAIL;
+    }
+    if ( elapsed < COSM_BENCH_BATCH )
+    {
+      loops *= 2;
+    }
+  } while ( ( elapsed < COSM_BENCH_BATCH ) && ( loops < COSM_BENCH_LOOPS ) );
+
+  /* warm the caches, branch predictors, and CPU clock */
+  start = CosmClockMono();
+  do
+  {
+    if ( Cosm_BenchTime( &elapsed, function, arg, loops ) != COSM_PASS )
+    {
+      CosmMemFree( times );
+      return COSM_FAIL;
+    }
+  } while ( ( CosmClockMono() - start ) < COSM_BENCH_WARMUP );
+
+  /* the default count gives up early on slow operations */
+  start = CosmClockMono();
+  for ( i = 0 ; i < repetitions ; i++ )
+  {
+    if ( Cosm_BenchTime( &times[i], function, arg, loops ) != COSM_PASS )
+    {
+      CosmMemFree( times );
+      return COSM_FAIL;
+    }
+    if ( limit && ( i + 1 >= COSM_BENCH_MIN )
+      && ( ( CosmClockMono() - start ) > COSM_BENCH_TIME ) )
+    {
+      repetitions = i + 1;
+    }
+  }
+
+  /* insertion sort, there are only a few hundred at most */
+  for ( i = 1 ; i < repetitions ; i++ )
+  {
+    current = times[i];
+    for ( j = i ; ( j > 0 ) && ( times[j - 1] > current ) ; j-- )
+    {
+      times[j] = times[j - 1];
+    }
+    times[j] = current;
+  }
+
+  bench->name = name;
+  bench->bytes = bytes;
+  bench->loops = loops;
+  bench->repetitions = repetitions;
+  bench->median = ( ( times[( repetitions - 1 ) / 2]
+    + times[repetitions / 2] ) * 500 ) / loops;
+  bench->p99 = ( times[( repetitions * 99 + 99 ) / 100 - 1] * 1000 )
+    / loops;
+  if ( bench->median != 0 )
+  {
+    bench->ops = (u64) ( 1.0E12 / (f64) bench->median );
+    bench->rate = (u64) ( (f64) bytes * 1.0E12 / (f64) bench->median );
+  }
+
+  CosmMemFree( times );
+
+  return COSM_PASS;
+}
+
+static u32 Cosm_BenchPad( const ascii * name )
+{
+  u32 length;
+
+  length = CosmStrBytes( name );
+
+  return ( length < 32 ) ? 32 - length : 0;
+}
+
+static void Cosm_BenchOut( cosm_FILE * file, const utf8 * format, ... )
+{
+  va_list args;
+
+  va_start( args, format );
+  Cosm_Print( file, NULL, 0xFFFFFFFF, format, args );
+  va_end( args );
+}
+
+s32 CosmBenchReport( cosm_FILE * file, const cosm_BENCH * benches,
+  u32 count, u32 format )
+{
+  const cosm_BENCH * bench;
+  u32 i;
+
+  if ( ( benches == NULL ) && ( count != 0 ) )
+  {
+    return COSM_FAIL;
+  }
+
+  switch ( format )
+  {
+    case COSM_BENCH_TEXT:
+      Cosm_BenchOut( file, "%.128s\n", "benchmark                        "
+        " median ns/op     p99 ns/op        ops/s       MB/s" );
+      break;
+    case COSM_BENCH_CSV:
+      Cosm_BenchOut( file, "%.128s\n", "name,bytes,loops,repetitions,"
+        "median_ns,p99_ns,ops_per_sec,bytes_per_sec" );
+      break;
+    case COSM_BENCH_JSON:
+      Cosm_BenchOut( file, "[\n" );
+      break;
+    default:
+      return COSM_FAIL;
+  }
+
+  for ( i = 0 ; i < count ; i++ )
+  {
+    bench = &benches[i];
+    switch ( format )
+    {
+      case COSM_BENCH_TEXT:
+        /* strings are not padded, so pad the name ourselves */
+        Cosm_BenchOut( file, "%.32s%.*s %9v.%03v %9v.%03v %12v ",
+          bench->name, Cosm_BenchPad( bench->name ), "                "
+          "                ", bench->median / 1000, bench->median % 1000,
+          bench->p99 / 1000, bench->p99 % 1000, bench->ops );
+        if ( bench->bytes == 0 )
+        {
+          Cosm_BenchOut( file, "%.16s\n", "         -" );
+        }
+        else
+        {
+          Cosm_BenchOut( file, "%8v.%v\n", bench->rate / 1000000,
+            ( bench->rate / 100000 ) % 10 );
+        }
+        break;
+      case COSM_BENCH_CSV:
+        Cosm_BenchOut( file, "%.64s,%v,%v,%u,%v.%03v,%v.%03v,%v,%v\n",
+          bench->name, bench->bytes, bench->loops, bench->repetitions,
+          bench->median / 1000, bench->median % 1000,
+          bench->p99 / 1000, bench->p99 % 1000, bench->ops, bench->rate );
+        break;
+      default:
+        Cosm_BenchOut( file, "  { \"name\": \"%.64s\", \"bytes\": %v, "
+          "\"loops\": %v, \"repetitions\": %u,\n    \"median_ns\": %v.%03v, "
+          "\"p99_ns\": %v.%03v, \"ops_per_sec\": %v, "
+          "\"bytes_per_sec\": %v }%.1s\n",
+          bench->name, bench->bytes, bench->loops, bench->repetitions,
+          bench->median / 1000, bench->median % 1000,
+          bench->p99 / 1000, bench->p99 % 1000, bench->ops, bench->rate,
+          ( i + 1 < count ) ? "," : "" );
+        break;
+    }
+  }
+
+  if ( format == COSM_BENCH_JSON )
+  {
+    Cosm_BenchOut( file, "]\n" );
+  }
+
+  return COSM_PASS;
+}
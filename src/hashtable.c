@@ -43,7 +43,7 @@ s32 CosmHashTableInit( cosm_HASH_TABLE * hashtable, u64 minimum_size,
 
   /* do a quick test to see if we can have a hash table that big in RAM */
   if ( ( COSM_PASS == CosmMemSystem( &memory ) )
-    && ( minimum_size < ( memory << 5 ) ) )
+    && ( minimum_size > ( memory >> 5 ) ) )
   {
     return COSM_FAIL;
   }
@@ -175,6 +175,7 @@ s32 CosmHashTableAdd( cosm_HASH_TABLE * hashtable, void * key, void * value )
   new_entry->value = new_value;
   new_entry->next = hashtable->table[row];
   hashtable->table[row] = new_entry;
+  hashtable->count++;
 
   return COSM_PASS;
 }
@@ -465,15 +466,94 @@ void Cosm_HashTableGrow( cosm_HASH_TABLE * hashtable )
 
 /* testing */
 
+static u64 Cosm_HashTableTestHash( void * key )
+{
+  /* spread the test keys, which are small and in order */
+  return *(u64 *) key * 0x9E3779B97F4A7C15LL;
+}
+
+static s32 Cosm_HashTableTestEqual( void * a, void * b )
+{
+  return ( *(u64 *) a == *(u64 *) b );
+}
+
 s32 Cosm_TestHashTable( void )
 {
+  static u64 keys[1000];
   cosm_HASH_TABLE ht;
+  u64 count, i;
+
+  for ( i = 0 ; i < 1000 ; i++ )
+  {
+    keys[i] = i;
+  }
 
   CosmMemSet( &ht, sizeof( ht ), 0 );
+  if ( ( CosmHashTableInit( &ht, 4, NULL, Cosm_HashTableTestEqual, NULL,
+    NULL ) != COSM_FAIL )
+    || ( CosmHashTableInit( &ht, 4, Cosm_HashTableTestHash,
+    Cosm_HashTableTestEqual, NULL, NULL ) != COSM_PASS ) )
+  {
+    return -1;
+  }
+
+  /* count follows adds, and duplicates are refused */
+  for ( i = 0 ; i < 1000 ; i++ )
+  {
+    if ( CosmHashTableAdd( &ht, &keys[i], &keys[999 - i] ) != COSM_PASS )
+    {
+      CosmHashTableFree( &ht );
+      return -2;
+    }
+  }
+  if ( ( CosmHashTableAdd( &ht, &keys[7], &keys[7] ) != COSM_FAIL )
+    || ( CosmHashTableCount( &count, &ht ) != COSM_PASS ) || ( count != 1000 ) )
+  {
+    CosmHashTableFree( &ht );
+    return -3;
+  }
 
-  /*
-  CosmHashTableInit( &ht, 4, NULL, NULL, NULL, NULL );
-  */
+  /* the table grew, and every key is still found */
+  if ( ht.table_length <= 53 )
+  {
+    CosmHashTableFree( &ht );
+    return -4;
+  }
+  for ( i = 0 ; i < 1000 ; i++ )
+  {
+    if ( CosmHashTableValue( &ht, &keys[i] ) != &keys[999 - i] )
+    {
+      CosmHashTableFree( &ht );
+      return -5;
+    }
+  }
+
+  /* deletes lower the count and only remove their own keys */
+  for ( i = 0 ; i < 1000 ; i += 2 )
+  {
+    CosmHashTableDelete( &ht, &keys[i] );
+  }
+  CosmHashTableDelete( &ht, &keys[0] );
+  if ( ( CosmHashTableCount( &count, &ht ) != COSM_PASS ) || ( count != 500 ) )
+  {
+    CosmHashTableFree( &ht );
+    return -6;
+  }
+  for ( i = 0 ; i < 1000 ; i++ )
+  {
+    if ( CosmHashTableValue( &ht, &keys[i] )
+      != ( ( i & 1 ) ? &keys[999 - i] : NULL ) )
+    {
+      CosmHashTableFree( &ht );
+      return -7;
+    }
+  }
+
+  CosmHashTableFree( &ht );
+  if ( ht.state != COSM_HASH_TABLE_STATE_NONE )
+  {
+    return -8;
+  }
 
   return COSM_PASS;
 }
@@ -205,19 +205,40 @@ s32 CosmHTTPOpen( cosm_HTTP * http, const ascii * uri,
     http->user_auth = user_auth;
   }
 
+  CosmMemSet( &http->options, sizeof( cosm_NET_OPTIONS ), 0 );
+  http->options.flags = COSM_NET_OPTION_NODELAY;
+
   http->length = 0;
   http->status = COSM_HTTP_STATUS_CLOSED;
 
   return COSM_PASS;
 }
 
+s32 CosmHTTPSetOptions( cosm_HTTP * http, const cosm_NET_OPTIONS * options )
+{
+  if ( ( http == NULL ) || ( options == NULL ) )
+  {
+    return COSM_HTTP_ERROR_PARAM;
+  }
+
+  if ( http->status == COSM_HTTP_STATUS_NONE )
+  {
+    return COSM_HTTP_ERROR_ORDER;
+  }
+
+  http->options = *options;
+
+  return COSM_PASS;
+}
+
 s32 CosmHTTPGet( cosm_HTTP * http, u32 * status, const ascii * uri_path,
   u32 wait_ms )
 {
   u32 len;
   ascii * request;
   s32 result;
-  u32 bytes;
+  cosm_NET_VECTOR send;
+  u64 bytes;
 
   *status = 0;
 
@@ -270,8 +291,10 @@ Connection: Keep-Alive\r\n\r\n",
     ( http->user_auth != NULL ) ? CosmStrBytes( http->user_auth ) : 0,
     ( http->user_auth != NULL ) ? http->user_auth : NULL );
 
-  if ( CosmNetSend( &http->net, &bytes, request,
-    CosmStrBytes( request ) ) != COSM_PASS )
+  send.data = request;
+  send.length = CosmStrBytes( request );
+  if ( CosmNetSendAll( &http->net, &bytes, &send, 1, COSM_NET_WAIT_FOREVER )
+    != COSM_PASS )
   {
     CosmMemFree( request );
     return COSM_HTTP_ERROR_NET;
@@ -296,7 +319,8 @@ s32 CosmHTTPPost( cosm_HTTP * http, u32 * status, const ascii * uri_path,
   u32 len;
   ascii * request;
   s32 result;
-  u32 bytes;
+  cosm_NET_VECTOR send[2];
+  u64 bytes;
 
   *status = 0;
 
@@ -349,8 +373,13 @@ Content-Length: %u\r\n\r\n",
     ( http->user_auth != NULL ) ? CosmStrBytes( http->user_auth ) : 0,
     ( http->user_auth != NULL ) ? http->user_auth : NULL, length );
 
-  if ( CosmNetSend( &http->net, &bytes, request,
-    CosmStrBytes( request ) ) != COSM_PASS )
+  /* header and data go out together, small posts in the same packet */
+  send[0].data = request;
+  send[0].length = CosmStrBytes( request );
+  send[1].data = (void *) data;
+  send[1].length = length;
+  if ( CosmNetSendAll( &http->net, &bytes, send, 2, COSM_NET_WAIT_FOREVER )
+    != COSM_PASS )
   {
     CosmMemFree( request );
     return COSM_HTTP_ERROR_NET;
@@ -358,12 +387,6 @@ Content-Length: %u\r\n\r\n",
 
   CosmMemFree( request );
 
-  /* send data */
-  if ( CosmNetSend( &http->net, &bytes, data, length ) != COSM_PASS )
-  {
-    return COSM_HTTP_ERROR_NET;
-  }
-
   /* get header */
   if ( ( result = Cosm_HTTPParseHeader( http, wait_ms ) ) != COSM_PASS )
   {
@@ -379,7 +402,6 @@ s32 CosmHTTPRecv( void * buffer, u32 * bytes_received, cosm_HTTP * http,
   u32 length, u32 wait_ms )
 {
   u32 result;
-  u32 buffer_get;
   u32 get;
   u32 chunk_total;
 
@@ -390,25 +412,6 @@ s32 CosmHTTPRecv( void * buffer, u32 * bytes_received, cosm_HTTP * http,
     return COSM_HTTP_ERROR_ORDER;
   }
 
-  /* empty buffer if no header */
-  if ( ( http->version == COSM_HTTP_VERSION_0_9 )
-    && ( CosmBufferLength( &http->header ) > 0 ) )
-  {
-    buffer_get = (u32) CosmBufferGet( buffer, (u64) length, &http->header );
-
-    if ( buffer_get == length )
-    {
-      *bytes_received = buffer_get;
-      return COSM_PASS;
-    }
-    else
-    {
-      buffer = CosmMemOffset( buffer, (u64) buffer_get );
-      length = length - buffer_get;
-      *bytes_received = buffer_get;
-    }
-  }
-
   switch ( http->chunking )
   {
     case COSM_HTTP_CHUNKING_FIXED:
@@ -418,8 +421,8 @@ s32 CosmHTTPRecv( void * buffer, u32 * bytes_received, cosm_HTTP * http,
         return COSM_PASS;
       }
       get = ( length > http->length ) ? http->length : length;
-      if ( ( CosmNetRecv( buffer, &result, &http->net, get, wait_ms )
-        != COSM_PASS ) && ( result == 0 ) )
+      if ( ( Cosm_HTTPInputRecv( buffer, &result, &http->input, &http->net,
+        get, wait_ms ) != COSM_PASS ) && ( result == 0 ) )
       {
         CosmNetClose( &http->net );
         http->status = COSM_HTTP_STATUS_CLOSED;
@@ -434,13 +437,18 @@ s32 CosmHTTPRecv( void * buffer, u32 * bytes_received, cosm_HTTP * http,
         if ( http->length > 0 )
         {
           get = ( length > http->length ) ? http->length : length;
-          if ( ( CosmNetRecv( buffer, &result, &http->net, get, wait_ms )
-            != COSM_PASS ) && ( result == 0 ) )
+          if ( ( Cosm_HTTPInputRecv( buffer, &result, &http->input,
+            &http->net, get, wait_ms ) != COSM_PASS ) && ( result == 0 ) )
           {
             CosmNetClose( &http->net );
             http->status = COSM_HTTP_STATUS_CLOSED;
             return COSM_PASS;
           }
+          if ( result == 0 )
+          {
+            /* timed out */
+            break;
+          }
           buffer = CosmMemOffset( buffer, (u64) result );
           http->length -= result;
           length -= result;
@@ -473,8 +481,8 @@ s32 CosmHTTPRecv( void * buffer, u32 * bytes_received, cosm_HTTP * http,
     case COSM_HTTP_CHUNKING_CLOSE:
     default:
       /* read and close if nothing left */
-      if ( ( CosmNetRecv( buffer, &result, &http->net, length, wait_ms )
-        != COSM_PASS ) && ( result == 0 ) )
+      if ( ( Cosm_HTTPInputRecv( buffer, &result, &http->input, &http->net,
+        length, wait_ms ) != COSM_PASS ) && ( result == 0 ) )
       {
         CosmNetClose( &http->net );
         http->status = COSM_HTTP_STATUS_CLOSED;
@@ -515,6 +523,294 @@ s32 CosmHTTPClose( cosm_HTTP * http )
   return COSM_PASS;
 }
 
+static s32 Cosm_HTTPPoolKey( ascii * key, const ascii * uri )
+{
+  u32 i;
+
+  /* "http://" then the host[:port] up to the end or the first '/' */
+  if ( ( CosmStrBytes( uri ) < 8 )
+    || ( ( uri[0] != 'h' ) && ( uri[0] != 'H' ) )
+    || ( ( uri[1] != 't' ) && ( uri[1] != 'T' ) )
+    || ( ( uri[2] != 't' ) && ( uri[2] != 'T' ) )
+    || ( ( uri[3] != 'p' ) && ( uri[3] != 'P' ) )
+    || ( uri[4] != ':' ) || ( uri[5] != '/' ) || ( uri[6] != '/' ) )
+  {
+    return COSM_HTTP_ERROR_URI;
+  }
+
+  for ( i = 0 ; ( uri[i + 7] != 0 ) && ( uri[i + 7] != '/' ) ; i++ )
+  {
+    if ( i == COSM_HTTP_MAX_HOSTNAME )
+    {
+      return COSM_HTTP_ERROR_URI;
+    }
+    key[i] = uri[i + 7];
+  }
+  key[i] = 0;
+
+  return COSM_PASS;
+}
+
+static cosm_HTTP_POOL_HOST * Cosm_HTTPPoolFind( cosm_HTTP_POOL * pool,
+  const ascii * key )
+{
+  u32 i;
+
+  for ( i = 0 ; i < pool->host_count ; i++ )
+  {
+    if ( CosmStrCmp( pool->hosts[i]->key, key,
+      COSM_HTTP_MAX_HOSTNAME + 1 ) == 0 )
+    {
+      return pool->hosts[i];
+    }
+  }
+
+  return NULL;
+}
+
+static void Cosm_HTTPPoolDrop( cosm_HTTP * http )
+{
+  CosmHTTPClose( http );
+  CosmMemFree( http );
+}
+
+s32 CosmHTTPPoolInit( cosm_HTTP_POOL * pool, u32 max_per_host, u32 idle_ms,
+  u32 dns_ttl_ms )
+{
+  if ( ( pool == NULL ) || ( max_per_host == 0 ) )
+  {
+    return COSM_HTTP_ERROR_PARAM;
+  }
+
+  CosmMemSet( pool, sizeof( cosm_HTTP_POOL ), 0 );
+  if ( CosmMutexInit( &pool->lock ) != COSM_PASS )
+  {
+    return COSM_HTTP_ERROR_MEMORY;
+  }
+  pool->max_per_host = max_per_host;
+  pool->idle_ns = (u64) idle_ms * 1000000LL;
+  pool->dns_ttl_ns = (u64) dns_ttl_ms * 1000000LL;
+
+  return COSM_PASS;
+}
+
+s32 CosmHTTPPoolGet( cosm_HTTP ** http, cosm_HTTP_POOL * pool,
+  const ascii * uri, u32 wait_ms )
+{
+  ascii key[COSM_HTTP_MAX_HOSTNAME + 1];
+  cosm_HTTP_POOL_HOST * host;
+  cosm_HTTP_POOL_HOST ** hosts;
+  cosm_HTTP * conn;
+  cosm_HTTP base;
+  u64 now, deadline;
+  u32 i, j, bytes;
+  u8 byte;
+  s32 error;
+
+  if ( ( http == NULL ) || ( pool == NULL ) || ( uri == NULL ) )
+  {
+    return COSM_HTTP_ERROR_PARAM;
+  }
+  *http = NULL;
+
+  if ( ( error = Cosm_HTTPPoolKey( key, uri ) ) != COSM_PASS )
+  {
+    return error;
+  }
+
+  deadline = CosmClockMono() + (u64) wait_ms * 1000000LL;
+  for ( ; ; )
+  {
+    if ( CosmMutexLock( &pool->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+    {
+      return COSM_HTTP_ERROR_PARAM;
+    }
+    host = Cosm_HTTPPoolFind( pool, key );
+    now = CosmClockMono();
+
+    if ( ( host == NULL ) || ( now >= host->dns_expire ) )
+    {
+      /* the lookup can be slow, so do it without holding the pool */
+      CosmMutexUnlock( &pool->lock );
+      CosmMemSet( &base, sizeof( cosm_HTTP ), 0 );
+      if ( ( error = CosmHTTPOpen( &base, uri, NULL, NULL, NULL, NULL,
+        NULL ) ) != COSM_PASS )
+      {
+        return error;
+      }
+      if ( CosmMutexLock( &pool->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+      {
+        return COSM_HTTP_ERROR_PARAM;
+      }
+
+      if ( ( host = Cosm_HTTPPoolFind( pool, key ) ) == NULL )
+      {
+        hosts = CosmMemRealloc( pool->hosts,
+          sizeof( cosm_HTTP_POOL_HOST * ) * ( pool->host_count + 1 ) );
+        if ( hosts != NULL )
+        {
+          pool->hosts = hosts;
+          host = CosmMemAlloc( sizeof( cosm_HTTP_POOL_HOST ) );
+        }
+        if ( host != NULL )
+        {
+          host->idle = CosmMemAlloc( sizeof( cosm_HTTP * )
+            * pool->max_per_host );
+          host->idle_time = CosmMemAlloc( sizeof( u64 )
+            * pool->max_per_host );
+          if ( ( host->idle == NULL ) || ( host->idle_time == NULL ) )
+          {
+            CosmMemFree( host->idle );
+            CosmMemFree( host->idle_time );
+            CosmMemFree( host );
+            host = NULL;
+          }
+        }
+        if ( host == NULL )
+        {
+          CosmMutexUnlock( &pool->lock );
+          return COSM_HTTP_ERROR_MEMORY;
+        }
+        CosmStrCopy( host->key, key, COSM_HTTP_MAX_HOSTNAME + 1 );
+        pool->hosts[pool->host_count++] = host;
+      }
+
+      CosmMemCopy( &host->base, &base, sizeof( cosm_HTTP ) );
+      now = CosmClockMono();
+      host->dns_expire = now + pool->dns_ttl_ns;
+    }
+
+    /* close connections idle too long, the oldest are first */
+    for ( i = 0 ; ( i < host->idle_count )
+      && ( ( now - host->idle_time[i] ) > pool->idle_ns ) ; i++ )
+    {
+      Cosm_HTTPPoolDrop( host->idle[i] );
+    }
+    if ( i > 0 )
+    {
+      host->idle_count -= i;
+      for ( j = 0 ; j < host->idle_count ; j++ )
+      {
+        host->idle[j] = host->idle[j + i];
+        host->idle_time[j] = host->idle_time[j + i];
+      }
+    }
+
+    /* reuse the warmest connection the server has not closed */
+    while ( host->idle_count > 0 )
+    {
+      conn = host->idle[--host->idle_count];
+      if ( ( CosmNetRecv( &byte, &bytes, &conn->net, 1, 0 ) == COSM_PASS )
+        && ( bytes == 0 ) )
+      {
+        host->active++;
+        CosmMutexUnlock( &pool->lock );
+        *http = conn;
+        return COSM_PASS;
+      }
+      Cosm_HTTPPoolDrop( conn );
+    }
+
+    if ( host->active < pool->max_per_host )
+    {
+      host->active++;
+      if ( ( conn = CosmMemAlloc( sizeof( cosm_HTTP ) ) ) == NULL )
+      {
+        host->active--;
+        CosmMutexUnlock( &pool->lock );
+        return COSM_HTTP_ERROR_MEMORY;
+      }
+      CosmMemCopy( conn, &host->base, sizeof( cosm_HTTP ) );
+      conn->pool_host = host;
+      CosmMutexUnlock( &pool->lock );
+      *http = conn;
+      return COSM_PASS;
+    }
+    CosmMutexUnlock( &pool->lock );
+
+    if ( CosmClockMono() >= deadline )
+    {
+      return COSM_HTTP_ERROR_BUSY;
+    }
+    CosmSleep( 1 );
+  }
+}
+
+s32 CosmHTTPPoolPut( cosm_HTTP_POOL * pool, cosm_HTTP * http )
+{
+  cosm_HTTP_POOL_HOST * host;
+
+  if ( ( pool == NULL ) || ( http == NULL ) || ( http->pool_host == NULL ) )
+  {
+    return COSM_HTTP_ERROR_PARAM;
+  }
+  host = (cosm_HTTP_POOL_HOST *) http->pool_host;
+
+  if ( CosmMutexLock( &pool->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    return COSM_HTTP_ERROR_PARAM;
+  }
+  host->active--;
+
+  /* only a finished keep-alive exchange leaves a reusable connection */
+  if ( ( http->status == COSM_HTTP_STATUS_IDLE ) && ( http->persistent == 1 )
+    && ( http->input.start == http->input.end )
+    && ( host->idle_count < pool->max_per_host ) )
+  {
+    host->idle[host->idle_count] = http;
+    host->idle_time[host->idle_count++] = CosmClockMono();
+    CosmMutexUnlock( &pool->lock );
+    return COSM_PASS;
+  }
+  CosmMutexUnlock( &pool->lock );
+
+  Cosm_HTTPPoolDrop( http );
+
+  return COSM_PASS;
+}
+
+s32 CosmHTTPPoolFree( cosm_HTTP_POOL * pool )
+{
+  cosm_HTTP_POOL_HOST * host;
+  u32 i, j;
+
+  if ( pool == NULL )
+  {
+    return COSM_HTTP_ERROR_PARAM;
+  }
+
+  if ( CosmMutexLock( &pool->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    return COSM_HTTP_ERROR_PARAM;
+  }
+  for ( i = 0 ; i < pool->host_count ; i++ )
+  {
+    if ( pool->hosts[i]->active > 0 )
+    {
+      CosmMutexUnlock( &pool->lock );
+      return COSM_HTTP_ERROR_ORDER;
+    }
+  }
+
+  for ( i = 0 ; i < pool->host_count ; i++ )
+  {
+    host = pool->hosts[i];
+    for ( j = 0 ; j < host->idle_count ; j++ )
+    {
+      Cosm_HTTPPoolDrop( host->idle[j] );
+    }
+    CosmMemFree( host->idle );
+    CosmMemFree( host->idle_time );
+    CosmMemFree( host );
+  }
+  CosmMemFree( pool->hosts );
+  CosmMutexUnlock( &pool->lock );
+  CosmMutexFree( &pool->lock );
+  CosmMemSet( pool, sizeof( cosm_HTTP_POOL ), 0 );
+
+  return COSM_PASS;
+}
+
 s32 CosmHTTPDInit( cosm_HTTPD * httpd, ascii * log_path, u32 log_level,
   u32 threads, u32 stack_size, const cosm_NET_ADDR * host, u32 wait_ms )
 {
@@ -549,13 +845,21 @@ s32 CosmHTTPDInit( cosm_HTTPD * httpd, ascii * log_path, u32 log_level,
     httpd->log_active = 0;
   }
 
-  httpd->handler_count = 0;
   httpd->thread_count = threads;
   httpd->stack_size = stack_size;
-  httpd->paths = NULL;
-  httpd->handlers = NULL;
+  httpd->routes = NULL;
   httpd->host = *host;
   httpd->wait_ms = wait_ms;
+  CosmMemSet( &httpd->options, sizeof( cosm_NET_OPTIONS ), 0 );
+  httpd->options.flags = COSM_NET_OPTION_NODELAY | COSM_NET_OPTION_REUSEADDR;
+  httpd->accepted = CosmMetricCounter( "cosm_httpd_accepted_total",
+    "Connections handed to a server thread." );
+  httpd->rejected = CosmMetricCounter( "cosm_httpd_rejected_total",
+    "Connections sent a 503 with every thread busy." );
+  httpd->active = CosmMetricGauge( "cosm_httpd_active_threads",
+    "Server threads working on a connection." );
+  httpd->latency = CosmMetricHistogram( "cosm_httpd_request_nanoseconds",
+    "Time from a parsed request to the end of its handler." );
   httpd->status = COSM_HTTPD_STATUS_IDLE;
 
   CosmMutexUnlock( &httpd->lock );
@@ -563,11 +867,37 @@ s32 CosmHTTPDInit( cosm_HTTPD * httpd, ascii * log_path, u32 log_level,
   return COSM_PASS;
 }
 
+s32 CosmHTTPDSetOptions( cosm_HTTPD * httpd,
+  const cosm_NET_OPTIONS * options )
+{
+  if ( ( httpd == NULL ) || ( options == NULL ) )
+  {
+    return COSM_HTTPD_ERROR_PARAM;
+  }
+
+  if ( CosmMutexLock( &httpd->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    return COSM_HTTPD_ERROR_PARAM;
+  }
+
+  if ( ( httpd->status != COSM_HTTPD_STATUS_IDLE )
+    && ( httpd->status != COSM_HTTPD_STATUS_STOPPED ) )
+  {
+    CosmMutexUnlock( &httpd->lock );
+    return COSM_HTTPD_ERROR_ORDER;
+  }
+
+  httpd->options = *options;
+
+  CosmMutexUnlock( &httpd->lock );
+
+  return COSM_PASS;
+}
+
 s32 CosmHTTPDSetHandler( cosm_HTTPD * httpd, const ascii * path,
   cosm_NET_ACL * acl, s32 (*handler)( cosm_HTTPD_REQUEST * request ) )
 {
-  u32 i, j;
-  u32 max;
+  cosm_HTTPD_ROUTE * routes;
 
   if ( ( httpd == NULL ) || ( path == NULL ) )
   {
@@ -579,79 +909,43 @@ s32 CosmHTTPDSetHandler( cosm_HTTPD * httpd, const ascii * path,
     return COSM_HTTPD_ERROR_PARAM;
   }
 
-  if ( ( httpd->status != COSM_HTTPD_STATUS_IDLE )
-    && ( ( httpd->status != COSM_HTTPD_STATUS_STOPPED ) ) )
+  if ( httpd->status == COSM_HTTPD_STATUS_NONE )
   {
     CosmMutexUnlock( &httpd->lock );
     return COSM_HTTPD_ERROR_ORDER;
   }
 
-  /* already exists? replace handler */
-  for ( i = 0 ; i < httpd->handler_count ; i++ )
+  /*
+    Copy the nodes down to path into a new trie and publish it in one
+    store. Server threads look up handlers without the lock, any still in
+    the old trie finish with it, so while running the nodes it replaced
+    are kept until the server stops.
+  */
+  routes = httpd->routes;
+  if ( Cosm_HTTPDRouteInsert( &routes, path, handler, acl ) != COSM_PASS )
   {
-    max = ( CosmStrBytes( path ) > CosmStrBytes( httpd->paths[i] ) )
-      ? CosmStrBytes( path ) : CosmStrBytes( httpd->paths[i] );
-    if ( CosmStrCmp( httpd->paths[i], path, max ) == 0 )
-    {
-      /* if the new handler is NULL, then remove it */
-      if ( handler == NULL )
-      {
-        for ( j = i ; j < ( httpd->handler_count - 1 ) ; j++ )
-        {
-          httpd->paths[j] = httpd->paths[j + 1];
-          httpd->handlers[j] = httpd->handlers[j + 1];
-        }
-        httpd->handler_count--;
-      }
-      else
-      {
-        httpd->handlers[i] = handler;
-      }
-      CosmMutexUnlock( &httpd->lock );
-      return COSM_PASS;
-    }
+    CosmMutexUnlock( &httpd->lock );
+    return COSM_HTTPD_ERROR_MEMORY;
   }
-
-  /* if we didn't match something, a NULL handler doesn't do anything */
-  if ( handler == NULL )
+  if ( routes == httpd->routes )
   {
+    /* removing a handler that wasn't set */
     CosmMutexUnlock( &httpd->lock );
     return COSM_PASS;
   }
+  CosmAtomicStorePtr( (void **) &httpd->routes, routes );
 
-  httpd->paths = CosmMemRealloc( httpd->paths,
-    sizeof( ascii * ) * ( httpd->handler_count + 1 ) );
-  httpd->handlers = CosmMemRealloc( httpd->handlers,
-    sizeof( s32 (*)( cosm_HTTPD_THREAD * thread ) )
-    * ( httpd->handler_count + 1 ) );
-
-  /* not found, add it, longer matching paths before shorter ones */
-  for ( i = 0 ; i < httpd->handler_count ; i++ )
+  if ( ( httpd->status == COSM_HTTPD_STATUS_IDLE )
+    || ( httpd->status == COSM_HTTPD_STATUS_STOPPED ) )
   {
-    /* if current one is a substr of path, path goes before it */
-    if ( CosmStrStr( path, httpd->paths[i], CosmStrBytes( path ) + 1 ) == path )
-    {
-      for ( j = httpd->handler_count ; j > i ; j-- )
-      {
-        httpd->paths[j] = httpd->paths[j - 1];
-        httpd->handlers[j] = httpd->handlers[j - 1];
-      }
-      httpd->paths[i] = (ascii *) path;
-      httpd->handlers[i] = handler;
-      break;
-    }
+    Cosm_HTTPDRouteReclaim( routes );
   }
 
-  /* if we didn't insert and break out of last loop, it goes at end */
-  if ( i == httpd->handler_count )
+  if ( httpd->status == COSM_HTTPD_STATUS_IDLE )
   {
-    httpd->paths[i] = (ascii *) path;
-    httpd->handlers[i] = handler;
+    httpd->status = COSM_HTTPD_STATUS_STOPPED;
   }
 
-  httpd->handler_count++;
-  httpd->status = COSM_HTTPD_STATUS_STOPPED;
-
   CosmMutexUnlock( &httpd->lock );
 
   return COSM_PASS;
@@ -660,7 +954,7 @@ s32 CosmHTTPDSetHandler( cosm_HTTPD * httpd, const ascii * path,
 s32 CosmHTTPDStart( cosm_HTTPD * httpd, u32 timeout_ms )
 {
   u32 running;
-  u32 sleep;
+  u64 deadline, now;
 
   /* start the server thread */
 
@@ -695,11 +989,12 @@ s32 CosmHTTPDStart( cosm_HTTPD * httpd, u32 timeout_ms )
 
   /* wait till timeout expires, and report status */
   running = 0;
-  while ( timeout_ms > 0 )
+  deadline = CosmClockMono() + (u64) timeout_ms * 1000000LL;
+  while ( ( now = CosmClockMono() ) < deadline )
   {
-    sleep = ( timeout_ms > 100 ) ? 100 : timeout_ms;
-    timeout_ms -= sleep;
-    CosmSleep( sleep );
+    /* sleep up to 100ms, less if the deadline is closer */
+    CosmSleep( ( deadline - now > 100000000LL ) ? 100
+      : (u32) ( ( deadline - now + 999999LL ) / 1000000LL ) );
 
     if ( CosmMutexLock( &httpd->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
     {
@@ -731,7 +1026,7 @@ s32 CosmHTTPDStart( cosm_HTTPD * httpd, u32 timeout_ms )
 s32 CosmHTTPDStop( cosm_HTTPD * httpd, u32 timeout_ms )
 {
   u32 stopped;
-  u32 sleep;
+  u64 deadline, now;
   cosm_NET net;
 
   /* stop the server thread */
@@ -764,11 +1059,12 @@ s32 CosmHTTPDStop( cosm_HTTPD * httpd, u32 timeout_ms )
 
   /* wait till timeout expires, and report status */
   stopped = 0;
-  while ( timeout_ms > 0 )
+  deadline = CosmClockMono() + (u64) timeout_ms * 1000000LL;
+  while ( ( now = CosmClockMono() ) < deadline )
   {
-    sleep = timeout_ms > 100 ? 100 : timeout_ms;
-    timeout_ms -= sleep;
-    CosmSleep( sleep );
+    /* sleep up to 100ms, less if the deadline is closer */
+    CosmSleep( ( deadline - now > 100000000LL ) ? 100
+      : (u32) ( ( deadline - now + 999999LL ) / 1000000LL ) );
 
     if ( CosmMutexLock( &httpd->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
     {
@@ -789,57 +1085,101 @@ s32 CosmHTTPDStop( cosm_HTTPD * httpd, u32 timeout_ms )
   return COSM_HTTPD_ERROR_TIMEOUT;
 }
 
-s32 CosmHTTPDSendInit( cosm_HTTPD_REQUEST * request, u32 status_code,
-  ascii * status_string, ascii * mime_type )
+static s32 Cosm_HTTPDSendAll( cosm_NET * net, const cosm_NET_VECTOR * vector,
+  u32 count )
 {
-  u32 sent;
-  u32 bytes;
-  ascii * header;
+  u64 sent;
 
-  if ( ( request == NULL ) || ( status_code < 100 ) || ( status_code > 999 )
-    || ( mime_type == NULL ) || ( mime_type == NULL ) )
+  if ( CosmNetSendAll( net, &sent, vector, count, COSM_NET_WAIT_FOREVER )
+    != COSM_PASS )
   {
-    return COSM_HTTPD_ERROR_PARAM;
+    return COSM_HTTPD_ERROR_NET;
   }
 
-  if ( request->state != COSM_HTTPD_REQUEST_START )
-  {
-    return COSM_HTTPD_ERROR_ORDER;
-  }
-  request->state = COSM_HTTPD_REQUEST_HEADER;
+  return COSM_PASS;
+}
 
-  /* 0.9 has no header */
-  if ( request->version == COSM_HTTP_VERSION_0_9 )
-  {
-    return COSM_PASS;
-  }
+static s32 Cosm_HTTPDWrite( cosm_HTTPD_REQUEST * request, const void * data,
+  u32 length )
+{
+  cosm_HTTP_OUTPUT * output;
+  cosm_NET_VECTOR send[2];
 
-  /*
-    HTTP/1.x <status_code> <status_string>\r\n
-    Content-Type: <mime_type>\r\n
+  send[0].data = (void *) data;
+  send[0].length = length;
 
-    length = 9 + 3 + 1 + status_string + 2
-      + 14 + mime_type + 2 ( + 1 for the \0 )
-  */
-  bytes = 32 + CosmStrBytes( status_string ) + CosmStrBytes( mime_type );
-  if ( ( header = CosmMemAlloc( bytes ) ) == NULL )
+  output = request->output;
+  if ( output == NULL )
   {
-    return COSM_HTTPD_ERROR_MEMORY;
+    return Cosm_HTTPDSendAll( request->net, send, 1 );
   }
 
-  CosmPrintStr( header, bytes,
-    "HTTP/1.%c %u %.*s\r\n"
-    "Content-Type: %.*s\r\n",
-    ( request->version == COSM_HTTP_VERSION_1_1 ) ? '1' : '0', status_code,
-    CosmStrBytes( status_string ), status_string,
-    CosmStrBytes( mime_type ), mime_type );
-
-  if ( CosmNetSend( request->net, &sent, header, bytes - 1 ) != COSM_PASS )
+  /* large writes would only be copied to be sent whole anyway */
+  if ( length >= ( COSM_HTTP_OUTPUT_BUFFER / 2 ) )
   {
-    CosmMemFree( header );
-    return COSM_HTTPD_ERROR_NET;
+    /* so send what's buffered, usually the header, in the same call */
+    send[1] = send[0];
+    send[0].data = output->data;
+    send[0].length = output->length;
+    output->length = 0;
+    return Cosm_HTTPDSendAll( request->net, send, 2 );
+  }
+
+  if ( ( output->length + length ) > COSM_HTTP_OUTPUT_BUFFER )
+  {
+    if ( CosmHTTPDFlush( request ) != COSM_PASS )
+    {
+      return COSM_HTTPD_ERROR_NET;
+    }
+  }
+
+  CosmMemCopy( &output->data[output->length], data, length );
+  output->length += length;
+
+  return COSM_PASS;
+}
+
+s32 CosmHTTPDSendInit( cosm_HTTPD_REQUEST * request, u32 status_code,
+  ascii * status_string, ascii * mime_type )
+{
+  ascii status[24];
+  u32 bytes;
+
+  if ( ( request == NULL ) || ( status_code < 100 ) || ( status_code > 999 )
+    || ( status_string == NULL ) || ( mime_type == NULL ) )
+  {
+    return COSM_HTTPD_ERROR_PARAM;
+  }
+
+  if ( request->state != COSM_HTTPD_REQUEST_START )
+  {
+    return COSM_HTTPD_ERROR_ORDER;
+  }
+  request->state = COSM_HTTPD_REQUEST_HEADER;
+
+  /* 0.9 has no header */
+  if ( request->version == COSM_HTTP_VERSION_0_9 )
+  {
+    return COSM_PASS;
+  }
+
+  /*
+    HTTP/1.x <status_code> <status_string>\r\n
+    Content-Type: <mime_type>\r\n
+  */
+  bytes = CosmPrintStr( status, 24, "HTTP/1.%c %u ",
+    ( request->version == COSM_HTTP_VERSION_1_1 ) ? '1' : '0', status_code );
+
+  if ( ( Cosm_HTTPDWrite( request, status, bytes ) != COSM_PASS )
+    || ( Cosm_HTTPDWrite( request, status_string,
+      CosmStrBytes( status_string ) ) != COSM_PASS )
+    || ( Cosm_HTTPDWrite( request, "\r\nContent-Type: ", 16 ) != COSM_PASS )
+    || ( Cosm_HTTPDWrite( request, mime_type,
+      CosmStrBytes( mime_type ) ) != COSM_PASS )
+    || ( Cosm_HTTPDWrite( request, "\r\n", 2 ) != COSM_PASS ) )
+  {
+    return COSM_HTTPD_ERROR_NET;
   }
-  CosmMemFree( header );
 
   return COSM_PASS;
 }
@@ -847,8 +1187,6 @@ s32 CosmHTTPDSendInit( cosm_HTTPD_REQUEST * request, u32 status_code,
 
 s32 CosmHTTPDSendHead( cosm_HTTPD_REQUEST * request, const void * string )
 {
-  u32 sent;
-
   if ( ( request == NULL ) || ( string == NULL ) )
   {
     return COSM_HTTPD_ERROR_PARAM;
@@ -865,9 +1203,9 @@ s32 CosmHTTPDSendHead( cosm_HTTPD_REQUEST * request, const void * string )
   }
   else
   {
-    if ( ( CosmNetSend( request->net, &sent, string,
+    if ( ( Cosm_HTTPDWrite( request, string,
       CosmStrBytes( string ) ) != COSM_PASS )
-      || ( CosmNetSend( request->net, &sent, "\r\n", 2 ) != COSM_PASS ) )
+      || ( Cosm_HTTPDWrite( request, "\r\n", 2 ) != COSM_PASS ) )
     {
       return COSM_HTTPD_ERROR_NET;
     }
@@ -878,7 +1216,6 @@ s32 CosmHTTPDSendHead( cosm_HTTPD_REQUEST * request, const void * string )
 
 s32 CosmHTTPDSend( cosm_HTTPD_REQUEST * request, const void * data, u32 length )
 {
-  u32 sent;
   ascii str[16];
   u32 len_length;
 
@@ -892,16 +1229,28 @@ s32 CosmHTTPDSend( cosm_HTTPD_REQUEST * request, const void * data, u32 length )
     /* end the header */
     if ( request->version == COSM_HTTP_VERSION_1_1 )
     {
-      CosmNetSend( request->net, &sent,
-       "Transfer-Encoding: chunked\r\n\r\n", 30 );
+      if ( Cosm_HTTPDWrite( request,
+        "Transfer-Encoding: chunked\r\n\r\n", 30 ) != COSM_PASS )
+      {
+        return COSM_HTTPD_ERROR_NET;
+      }
     }
     else if ( request->version == COSM_HTTP_VERSION_1_0 )
     {
-      CosmNetSend( request->net, &sent, "\r\n", 2 );
+      if ( Cosm_HTTPDWrite( request, "\r\n", 2 ) != COSM_PASS )
+      {
+        return COSM_HTTPD_ERROR_NET;
+      }
     }
     request->state = COSM_HTTPD_REQUEST_BODY;
   }
 
+  if ( request->state == COSM_HTTPD_REQUEST_DONE )
+  {
+    /* the body is complete, only the final empty send is allowed */
+    return ( length == 0 ) ? COSM_PASS : COSM_HTTPD_ERROR_ORDER;
+  }
+
   if ( request->state != COSM_HTTPD_REQUEST_BODY )
   {
     return COSM_HTTPD_ERROR_ORDER;
@@ -916,24 +1265,104 @@ s32 CosmHTTPDSend( cosm_HTTPD_REQUEST * request, const void * data, u32 length )
     if ( length > 0 )
     {
       len_length = CosmPrintStr( str, 16, "%X\r\n", length );
-      if ( ( CosmNetSend( request->net, &sent, str, len_length ) != COSM_PASS )
-        || ( CosmNetSend( request->net, &sent, data, length ) != COSM_PASS )
-        || ( CosmNetSend( request->net, &sent, "\r\n", 2 ) != COSM_PASS ) )
+      if ( ( Cosm_HTTPDWrite( request, str, len_length ) != COSM_PASS )
+        || ( Cosm_HTTPDWrite( request, data, length ) != COSM_PASS )
+        || ( Cosm_HTTPDWrite( request, "\r\n", 2 ) != COSM_PASS ) )
       {
         return COSM_HTTPD_ERROR_NET;
       }
     }
     else
     {
-      if ( CosmNetSend( request->net, &sent, "0\r\n\r\n", 5 ) != COSM_PASS )
+      if ( Cosm_HTTPDWrite( request, "0\r\n\r\n", 5 ) != COSM_PASS )
       {
         return COSM_HTTPD_ERROR_NET;
       }
+      request->state = COSM_HTTPD_REQUEST_DONE;
     }
   }
   else
   {
-    if ( CosmNetSend( request->net, &sent, data, length ) != COSM_PASS )
+    if ( Cosm_HTTPDWrite( request, data, length ) != COSM_PASS )
+    {
+      return COSM_HTTPD_ERROR_NET;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+s32 CosmHTTPDSendFile( cosm_HTTPD_REQUEST * request, cosm_FILE * file,
+  u64 offset, u64 length )
+{
+  ascii str[40];
+  u64 sent;
+  u32 len_length;
+  u32 chunked;
+  const void * header;
+  u32 header_length;
+
+  if ( ( request == NULL ) || ( file == NULL ) )
+  {
+    return COSM_HTTPD_ERROR_PARAM;
+  }
+
+  chunked = 0;
+  if ( request->state == COSM_HTTPD_REQUEST_HEADER )
+  {
+    /* the file is the whole body, so its length is known */
+    if ( request->version != COSM_HTTP_VERSION_0_9 )
+    {
+      len_length = CosmPrintStr( str, 40, "Content-Length: %v\r\n\r\n",
+        length );
+      if ( Cosm_HTTPDWrite( request, str, len_length ) != COSM_PASS )
+      {
+        return COSM_HTTPD_ERROR_NET;
+      }
+    }
+    request->state = COSM_HTTPD_REQUEST_DONE;
+  }
+  else if ( request->state == COSM_HTTPD_REQUEST_BODY )
+  {
+    if ( request->version == COSM_HTTP_VERSION_1_1 )
+    {
+      if ( length == 0 )
+      {
+        /* an empty chunk would end the body */
+        return COSM_PASS;
+      }
+      len_length = CosmPrintStr( str, 40, "%Y\r\n", length );
+      if ( Cosm_HTTPDWrite( request, str, len_length ) != COSM_PASS )
+      {
+        return COSM_HTTPD_ERROR_NET;
+      }
+      chunked = 1;
+    }
+  }
+  else
+  {
+    return COSM_HTTPD_ERROR_ORDER;
+  }
+
+  /* whatever is buffered goes out in front of the file in one packet */
+  header = NULL;
+  header_length = 0;
+  if ( request->output != NULL )
+  {
+    header = request->output->data;
+    header_length = request->output->length;
+    request->output->length = 0;
+  }
+
+  if ( CosmNetSendFile( request->net, &sent, file, offset, length,
+    header, header_length ) != COSM_PASS )
+  {
+    return COSM_HTTPD_ERROR_NET;
+  }
+
+  if ( chunked )
+  {
+    if ( Cosm_HTTPDWrite( request, "\r\n", 2 ) != COSM_PASS )
     {
       return COSM_HTTPD_ERROR_NET;
     }
@@ -942,6 +1371,27 @@ s32 CosmHTTPDSend( cosm_HTTPD_REQUEST * request, const void * data, u32 length )
   return COSM_PASS;
 }
 
+s32 CosmHTTPDFlush( cosm_HTTPD_REQUEST * request )
+{
+  cosm_NET_VECTOR send;
+
+  if ( request == NULL )
+  {
+    return COSM_HTTPD_ERROR_PARAM;
+  }
+
+  if ( ( request->output == NULL ) || ( request->output->length == 0 ) )
+  {
+    return COSM_PASS;
+  }
+
+  send.data = request->output->data;
+  send.length = request->output->length;
+  request->output->length = 0;
+
+  return Cosm_HTTPDSendAll( request->net, &send, 1 );
+}
+
 s32 CosmHTTPDRecv( void * buffer, u32 * bytes_received,
   cosm_HTTPD_REQUEST * request, u32 length, u32 wait_ms )
 {
@@ -952,9 +1402,17 @@ s32 CosmHTTPDRecv( void * buffer, u32 * bytes_received,
 
   if ( request->post_length > 0 )
   {
+    /* the client may be waiting on our output before it sends more */
+    if ( ( request->input->start == request->input->end )
+      && ( CosmHTTPDFlush( request ) != COSM_PASS ) )
+    {
+      CosmNetClose( request->net );
+      return COSM_HTTPD_ERROR_NET;
+    }
+
     get = ( length > request->post_length ) ? request->post_length : length;
-    if ( ( CosmNetRecv( buffer, &result, request->net, get, wait_ms )
-      != COSM_PASS ) && ( result == 0 ) )
+    if ( ( Cosm_HTTPInputRecv( buffer, &result, request->input, request->net,
+      get, wait_ms ) != COSM_PASS ) && ( result == 0 ) )
     {
       CosmNetClose( request->net );
       return COSM_HTTPD_ERROR_NET;
@@ -966,6 +1424,48 @@ s32 CosmHTTPDRecv( void * buffer, u32 * bytes_received,
   return COSM_PASS;
 }
 
+s32 CosmHTTPDMetrics( cosm_HTTPD_REQUEST * request )
+{
+  cosm_BUFFER buffer;
+  u8 chunk[4096];
+  u64 length;
+  s32 error;
+
+  CosmMemSet( &buffer, sizeof( buffer ), 0 );
+  if ( CosmBufferInit( &buffer, 16384, COSM_BUFFER_MODE_QUEUE, 16384,
+    NULL, 0 ) != COSM_PASS )
+  {
+    return COSM_HTTPD_ERROR_MEMORY;
+  }
+  if ( CosmMetricsDump( &buffer ) != COSM_PASS )
+  {
+    CosmBufferFree( &buffer );
+    return COSM_HTTPD_ERROR_MEMORY;
+  }
+
+  if ( ( error = CosmHTTPDSendInit( request, 200, "OK",
+    "text/plain; version=0.0.4" ) ) == COSM_PASS )
+  {
+    while ( ( length = CosmBufferGet( chunk, sizeof( chunk ), &buffer ) )
+      > 0 )
+    {
+      if ( ( error = CosmHTTPDSend( request, chunk, (u32) length ) )
+        != COSM_PASS )
+      {
+        break;
+      }
+    }
+    if ( error == COSM_PASS )
+    {
+      /* end the chunked body */
+      error = CosmHTTPDSend( request, NULL, 0 );
+    }
+  }
+  CosmBufferFree( &buffer );
+
+  return error;
+}
+
 s32 CosmHTTPDFree( cosm_HTTPD * httpd )
 {
   if ( CosmMutexLock( &httpd->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
@@ -980,8 +1480,8 @@ s32 CosmHTTPDFree( cosm_HTTPD * httpd )
     return COSM_HTTPD_ERROR_ORDER;
   }
 
-  CosmMemFree( httpd->paths );
-  CosmMemFree( httpd->handlers );
+  Cosm_HTTPDRouteFree( httpd->routes );
+  httpd->routes = NULL;
   httpd->status = COSM_HTTPD_STATUS_NONE;
   if ( httpd->log_active )
   {
@@ -998,32 +1498,285 @@ s32 Cosm_HTTPNetOpen( cosm_HTTP * http )
 {
   if ( ( http->proxy.ip.v4 != 0 ) && ( http->proxy.port != 0 ) )
   {
-    if ( _COSM_NETOPEN( &http->net, &http->proxy )
-      != COSM_PASS )
+    if ( CosmNetOpenOptions( &http->net, NULL, &http->proxy,
+      COSM_NET_MODE_TCP, &http->options ) != COSM_PASS )
     {
       return COSM_FAIL;
     }
   }
   else
   {
-    if ( _COSM_NETOPEN( &http->net, &http->host ) != COSM_PASS )
+    if ( CosmNetOpenOptions( &http->net, NULL, &http->host,
+      COSM_NET_MODE_TCP, &http->options ) != COSM_PASS )
     {
       return COSM_FAIL;
     }
   }
 
+  http->input.start = 0;
+  http->input.end = 0;
   http->status = COSM_HTTP_STATUS_IDLE;
   return COSM_PASS;
 }
 
+static u8 Cosm_HTTPLower( u8 ch )
+{
+  return ( ( ch >= 'A' ) && ( ch <= 'Z' ) ) ? (u8) ( ch + 32 ) : ch;
+}
+
+s32 Cosm_HTTPInputFill( cosm_HTTP_INPUT * input, cosm_NET * net,
+  u32 wait_ms )
+{
+  u32 result, more;
+  s32 error;
+
+  /* slide the unused bytes to the front */
+  if ( input->start > 0 )
+  {
+    CosmMemCopy( input->data, &input->data[input->start],
+      (u64) ( input->end - input->start ) );
+    input->end -= input->start;
+    input->start = 0;
+  }
+
+  if ( input->end == COSM_HTTP_INPUT_BUFFER )
+  {
+    return COSM_PASS;
+  }
+
+  /* wait for the first byte, then take whatever else has arrived */
+  error = CosmNetRecv( &input->data[input->end], &result, net, 1, wait_ms );
+  if ( result == 0 )
+  {
+    return error;
+  }
+  input->end += result;
+
+  if ( input->end < COSM_HTTP_INPUT_BUFFER )
+  {
+    CosmNetRecv( &input->data[input->end], &more, net,
+      COSM_HTTP_INPUT_BUFFER - input->end, 0 );
+    input->end += more;
+  }
+
+  return COSM_PASS;
+}
+
+s32 Cosm_HTTPInputRecv( void * buffer, u32 * bytes_received,
+  cosm_HTTP_INPUT * input, cosm_NET * net, u32 length, u32 wait_ms )
+{
+  u32 get;
+  s32 error;
+
+  *bytes_received = 0;
+
+  if ( ( input->start == input->end )
+    && ( length < ( COSM_HTTP_INPUT_BUFFER / 2 ) ) )
+  {
+    /* one fill will likely cover this and the next few reads */
+    if ( ( ( error = Cosm_HTTPInputFill( input, net, wait_ms ) )
+      != COSM_PASS ) && ( input->start == input->end ) )
+    {
+      return error;
+    }
+  }
+
+  if ( input->start < input->end )
+  {
+    get = input->end - input->start;
+    get = ( length > get ) ? get : length;
+    CosmMemCopy( buffer, &input->data[input->start], (u64) get );
+    input->start += get;
+    *bytes_received = get;
+    return COSM_PASS;
+  }
+
+  return CosmNetRecv( buffer, bytes_received, net, length, wait_ms );
+}
+
+s32 Cosm_HTTPInputHeader( cosm_BUFFER * header, cosm_HTTP_INPUT * input,
+  cosm_NET * net, u32 one_line, u32 wait_ms )
+{
+  u8 * data;
+  u32 line, used, available, found;
+
+  line = 0;
+  for ( ; ; )
+  {
+    if ( input->start == input->end )
+    {
+      Cosm_HTTPInputFill( input, net, wait_ms );
+      if ( input->start == input->end )
+      {
+        /* closed or timed out mid header */
+        return COSM_HTTP_ERROR_NET;
+      }
+    }
+
+    data = &input->data[input->start];
+    available = input->end - input->start;
+    if ( one_line )
+    {
+      used = (u32) Cosm_MemScan( data, '\n', '\n', (u64) available );
+      found = ( used < available );
+      used += found;
+    }
+    else
+    {
+      found = ( Cosm_HTTPHeaderEnd( &used, &line, data, available )
+        == COSM_PASS );
+    }
+
+    if ( CosmBufferPut( header, data, (u64) used ) != COSM_PASS )
+    {
+      return COSM_HTTP_ERROR_MEMORY;
+    }
+    input->start += used;
+
+    if ( found )
+    {
+      return COSM_PASS;
+    }
+
+    if ( CosmBufferLength( header ) > COSM_HTTP_HEADER_MAX )
+    {
+      return COSM_HTTP_ERROR_NET;
+    }
+  }
+}
+
+s32 Cosm_HTTPHeaderEnd( u32 * used, u32 * line, const void * data,
+  u32 length )
+{
+  const u8 * bytes;
+  u32 pos, next;
+
+  bytes = (const u8 *) data;
+  pos = 0;
+  while ( pos < length )
+  {
+    next = (u32) Cosm_MemScan( &bytes[pos], '\n', '\n', (u64) ( length - pos ) );
+
+    /* count the line, but a lone \r does not make it a real line */
+    if ( ( next > 1 ) || ( ( next == 1 ) && ( bytes[pos] != '\r' ) ) )
+    {
+      *line += next;
+    }
+
+    if ( ( pos + next ) == length )
+    {
+      break;
+    }
+
+    pos += next + 1;
+    if ( *line == 0 )
+    {
+      *used = pos;
+      return COSM_PASS;
+    }
+    *line = 0;
+  }
+
+  *used = length;
+  return COSM_FAIL;
+}
+
+s32 Cosm_HTTPHeaderField( const ascii ** value, u32 * value_length,
+  const void * header, u32 length, const ascii * name )
+{
+  const u8 * bytes;
+  u32 name_length;
+  u32 pos, next, start, end, i;
+
+  bytes = (const u8 *) header;
+  name_length = CosmStrBytes( name );
+
+  pos = 0;
+  while ( pos < length )
+  {
+    /* the end of the field name, or of a line without one */
+    next = pos + (u32) Cosm_MemScan( &bytes[pos], ':', '\n',
+      (u64) ( length - pos ) );
+    if ( next == length )
+    {
+      break;
+    }
+
+    if ( bytes[next] == ':' )
+    {
+      if ( ( next - pos ) == name_length )
+      {
+        for ( i = 0 ; i < name_length ; i++ )
+        {
+          if ( Cosm_HTTPLower( bytes[pos + i] )
+            != Cosm_HTTPLower( (u8) name[i] ) )
+          {
+            break;
+          }
+        }
+        if ( i == name_length )
+        {
+          start = next + 1;
+          while ( ( start < length )
+            && ( ( bytes[start] == ' ' ) || ( bytes[start] == '\t' ) ) )
+          {
+            start++;
+          }
+          end = start + (u32) Cosm_MemScan( &bytes[start], '\n', '\n',
+            (u64) ( length - start ) );
+          while ( ( end > start ) && ( ( bytes[end - 1] == '\r' )
+            || ( bytes[end - 1] == ' ' ) || ( bytes[end - 1] == '\t' ) ) )
+          {
+            end--;
+          }
+          *value = (const ascii *) &bytes[start];
+          *value_length = end - start;
+          return COSM_PASS;
+        }
+      }
+      /* skip the rest of this line */
+      next++;
+      next += (u32) Cosm_MemScan( &bytes[next], '\n', '\n',
+        (u64) ( length - next ) );
+    }
+    pos = next + 1;
+  }
+
+  return COSM_FAIL;
+}
+
+static u32 Cosm_HTTPFieldIs( const ascii * value, u32 value_length,
+  const ascii * token )
+{
+  u32 token_length, i;
+
+  /* does the value end with token, "gzip, chunked" ends with chunked */
+  token_length = CosmStrBytes( token );
+  if ( value_length < token_length )
+  {
+    return 0;
+  }
+  value = &value[value_length - token_length];
+  for ( i = 0 ; i < token_length ; i++ )
+  {
+    if ( Cosm_HTTPLower( (u8) value[i] ) != (u8) token[i] )
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
 s32 Cosm_HTTPParseHeader( cosm_HTTP * http, u32 wait_ms )
 {
-  static ascii http_magic[2][8] = { "HTTP/1.1", "http/1.0" };
+  static const ascii http_magic[8] = "http/1.";
+  cosm_HTTP_INPUT * input;
+  const ascii * value;
   utf8 tmp_buffer[8];
-  u32 result;
-  u32 i, count, length;
-  ascii * ptr;
-  ascii ch;
+  u8 * data;
+  u32 i, available, length, value_length, legacy;
+  s32 error;
 
   /*
   Example format:
@@ -1056,170 +1809,133 @@ s32 Cosm_HTTPParseHeader( cosm_HTTP * http, u32 wait_ms )
   }
   http->header_flag = 1;
 
-  /* look for the version at start of header */
-  count = 0;
-  for ( i = 0 ; i < 8 ; i++ )
+  /*
+    "HTTP/1.x nnn" tells a header from a legacy reply, which is all body.
+    Fill until we have that much, or the start fails to match.
+  */
+  input = &http->input;
+  legacy = 0;
+  for ( ; ; )
   {
-    if ( ( CosmNetRecv( &tmp_buffer[i], &result, &http->net, 1, wait_ms )
-      != COSM_PASS ) && ( result == 0 ) )
+    data = &input->data[input->start];
+    available = input->end - input->start;
+    for ( i = 0 ; ( i < available ) && ( i < 7 ) ; i++ )
     {
-      if ( i == 0 )
-      {
-        /* nothing read yet */
-        CosmNetClose( &http->net );
-        http->status = COSM_HTTP_STATUS_CLOSED;
-        return COSM_HTTP_ERROR_NET;
-      }
-      else
+      if ( Cosm_HTTPLower( data[i] ) != (u8) http_magic[i] )
       {
-        /* we have some bytes already */
-        http->version = COSM_HTTP_VERSION_0_9;
-        http->persistent = 0;
         break;
       }
     }
-    count = i + 1;
-
-    if ( i == 7 )
+    if ( ( i < available ) && ( i < 7 ) )
     {
-      if ( tmp_buffer[7] == '1' )
-      {
-        http->version = COSM_HTTP_VERSION_1_1;
-        http->persistent = 1;
-      }
-      else if ( tmp_buffer[7] == '0' )
-      {
-        http->version = COSM_HTTP_VERSION_1_0;
-        http->persistent = 0;
-      }
-      else
-      {
-        return COSM_HTTP_ERROR_VERSION;
-      }
+      legacy = 1;
+      break;
     }
-    else
+    if ( available >= 12 )
+    {
+      break;
+    }
+
+    Cosm_HTTPInputFill( input, &http->net, wait_ms );
+    if ( ( input->end - input->start ) == available )
     {
-      if ( ( ( tmp_buffer[i] != http_magic[0][i] )
-        && ( tmp_buffer[i] != http_magic[1][i] ) ) )
+      if ( available == 0 )
       {
-        http->version = COSM_HTTP_VERSION_0_9;
-        http->persistent = 0;
-        break;
+        /* nothing read */
+        CosmNetClose( &http->net );
+        http->status = COSM_HTTP_STATUS_CLOSED;
+        return COSM_HTTP_ERROR_NET;
       }
+      /* we have some bytes, but not a header */
+      legacy = 1;
+      break;
     }
   }
 
-  if ( CosmBufferPut( &http->header, tmp_buffer, (u64) count )
-    != COSM_PASS )
+  if ( legacy == 0 )
   {
-    return COSM_HTTP_ERROR_MEMORY;
+    if ( data[7] == '1' )
+    {
+      http->version = COSM_HTTP_VERSION_1_1;
+    }
+    else if ( data[7] == '0' )
+    {
+      http->version = COSM_HTTP_VERSION_1_0;
+    }
+    else
+    {
+      return COSM_HTTP_ERROR_VERSION;
+    }
+
+    /* get the status */
+    CosmMemCopy( tmp_buffer, &data[8], 4LL );
+    tmp_buffer[4] = 0;
+    if ( CosmU32Str( &http->http_status, NULL, tmp_buffer, 10 )
+      != COSM_PASS )
+    {
+      /* wasnt a valid header after all */
+      legacy = 1;
+    }
   }
 
-  /* if it's a legacy connection we're done looking for headers */
-  if ( http->version == COSM_HTTP_VERSION_0_9 )
+  /* if it's a legacy connection the bytes we have are body for Recv */
+  if ( legacy )
   {
+    http->version = COSM_HTTP_VERSION_0_9;
     http->http_status = 200;
     http->status = COSM_HTTP_STATUS_BODY;
     http->chunking = COSM_HTTP_CHUNKING_CLOSE;
+    http->persistent = 0;
     return COSM_PASS;
   }
+  http->persistent = ( http->version == COSM_HTTP_VERSION_1_1 ) ? 1 : 0;
 
-  /* get the status */
-  if ( ( CosmNetRecv( tmp_buffer, &result, &http->net, 4, wait_ms ) != COSM_PASS )
-    || ( result != 4 ) )
+  /* read the whole header into the buffer */
+  if ( ( error = Cosm_HTTPInputHeader( &http->header, input, &http->net, 0,
+    wait_ms ) ) != COSM_PASS )
   {
-    CosmNetClose( &http->net );
-    http->status = COSM_HTTP_STATUS_CLOSED;
-    return COSM_HTTP_ERROR_NET;
+    if ( error == COSM_HTTP_ERROR_NET )
+    {
+      CosmNetClose( &http->net );
+      http->status = COSM_HTTP_STATUS_CLOSED;
+    }
+    return error;
   }
-  tmp_buffer[4] = 0;
+  length = (u32) CosmBufferLength( &http->header );
 
-  if ( CosmBufferPut( &http->header, tmp_buffer, (u64) result )
-    != COSM_PASS )
+  /* terminate buffer string */
+  tmp_buffer[0] = 0;
+  if ( CosmBufferPut( &http->header, tmp_buffer, (u64) 1 ) != COSM_PASS )
   {
     return COSM_HTTP_ERROR_MEMORY;
   }
 
-  if ( CosmU32Str( &http->http_status, NULL, tmp_buffer, 10 ) != COSM_PASS )
+  if ( ( Cosm_HTTPHeaderField( &value, &value_length, http->header.memory,
+    length, "Connection" ) == COSM_PASS )
+    && ( Cosm_HTTPFieldIs( value, value_length, "close" ) ) )
   {
-    /* wasnt a valid header after all */
-    http->version = COSM_HTTP_VERSION_0_9;
-    http->chunking = COSM_HTTP_CHUNKING_CLOSE;
     http->persistent = 0;
-    return COSM_PASS;
+  }
+
+  /* look for "Content-Length" or "Transfer-Encoding: chunked" */
+  if ( ( Cosm_HTTPHeaderField( &value, &value_length, http->header.memory,
+    length, "Content-Length" ) == COSM_PASS )
+    && ( CosmU32Str( &http->length, NULL, value, 10 ) == COSM_PASS ) )
+  {
+    http->chunking = COSM_HTTP_CHUNKING_FIXED;
+  }
+  else if ( ( Cosm_HTTPHeaderField( &value, &value_length,
+    http->header.memory, length, "Transfer-Encoding" ) == COSM_PASS )
+    && ( Cosm_HTTPFieldIs( value, value_length, "chunked" ) ) )
+  {
+    http->length = 0;
+    http->chunking = COSM_HTTP_CHUNKING_CHUNKED;
   }
   else
   {
-    /* read from net until \r\n\r\n, stuff into buffer */
-    i = 0;
-    result = 1;
-    while ( ( i < 4 ) && ( result == 1 ) )
-    {
-      if ( ( CosmNetRecv( &ch, &result, &http->net, 1, wait_ms ) != COSM_PASS )
-        && ( result == 0 ) )
-      {
-        CosmNetClose( &http->net );
-        http->status = COSM_HTTP_STATUS_CLOSED;
-        return COSM_HTTP_ERROR_NET;
-      }
-
-      if ( CosmBufferPut( &http->header, &ch, (u64) 1 ) != COSM_PASS )
-      {
-        return COSM_HTTP_ERROR_MEMORY;
-      }
-
-      if ( ( i % 2 ) == 0 )
-      {
-        if ( ch == '\r' )
-        {
-          i++;
-        }
-        else
-        {
-          i = 0;
-        }
-      }
-      else
-      {
-        if ( ch == '\n' )
-        {
-          i++;
-        }
-        else
-        {
-          i = 0;
-        }
-      }
-    }
-
-    /* terminate buffer string */
-    ch = 0;
-    if ( CosmBufferPut( &http->header, &ch, (u64) 1 ) != COSM_PASS )
-    {
-      return COSM_HTTP_ERROR_MEMORY;
-    }
-
-    /* look for "Content-Length: " or "Transfer-Encoding: chunked" */
-    if ( ( ( ptr = CosmStrStr( http->header.memory,
-      "Content-Length: ", (u32) http->header.data_length ) ) != NULL )
-      && ( ( CosmU32Str( &length, NULL, &ptr[16], 10 ) == COSM_PASS ) ) )
-    {
-      http->length = length;
-      http->chunking = COSM_HTTP_CHUNKING_FIXED;
-    }
-    else if ( CosmStrStr( http->header.memory,
-      "Transfer-Encoding: chunked", (u32) http->header.data_length )
-      != NULL )
-    {
-      http->length = 0;
-      http->chunking = COSM_HTTP_CHUNKING_CHUNKED;
-    }
-    else
-    {
-      /* read until close */
-      http->chunking = COSM_HTTP_CHUNKING_CLOSE;
-      http->persistent = 0;
-    }
+    /* read until close */
+    http->chunking = COSM_HTTP_CHUNKING_CLOSE;
+    http->persistent = 0;
   }
 
   http->status = COSM_HTTP_STATUS_BODY;
@@ -1229,61 +1945,92 @@ s32 Cosm_HTTPParseHeader( cosm_HTTP * http, u32 wait_ms )
 
 s32 Cosm_HTTPChunkLength( cosm_HTTP * http, u32 wait_ms )
 {
-  ascii tmp_buffer[16];
-  ascii ch;
-  u32 count;
-  u32 result;
+  cosm_HTTP_INPUT * input;
+  u8 * data;
+  u32 available, pos, line, used;
+
+  input = &http->input;
 
   /* get the length line, but midstream we have a blank line first */
-  do
+  for ( ; ; )
   {
-    ch = 0;
-    count = 0;
-    /* should only be 8 hex characters */
-    while ( ( ch != '\n' ) && ( count < 15 ) )
+    data = &input->data[input->start];
+    available = input->end - input->start;
+    pos = (u32) Cosm_MemScan( data, '\n', '\n', (u64) available );
+    if ( pos == available )
     {
-      CosmNetRecv( &ch, &result, &http->net, 1, wait_ms );
-      if ( result != 1 )
+      /* a chunk length line is never this long */
+      if ( available > 256 )
       {
-        /* abort */
-        break;
+        return COSM_FAIL;
+      }
+      Cosm_HTTPInputFill( input, &http->net, wait_ms );
+      if ( ( input->end - input->start ) == available )
+      {
+        return COSM_FAIL;
       }
-      tmp_buffer[count++] = ch;
+      continue;
+    }
+
+    input->start += pos + 1;
+    if ( ( pos > 1 ) || ( ( pos == 1 ) && ( data[0] != '\r' ) ) )
+    {
+      break;
     }
-  } while ( count == 2 );
+  }
+
+  /* hex digits, then an optional ;extension */
+  if ( CosmU32Str( &http->length, NULL, (utf8 *) data, 16 ) != COSM_PASS )
+  {
+    return COSM_FAIL;
+  }
 
-  if ( ( count > 2 ) && ( ch == '\n' ) && ( tmp_buffer[count-2] == '\r' ) )
+  if ( http->length == 0 )
   {
-    result = CosmU32Str( &http->length, NULL, tmp_buffer, 16 );
-    if ( ( result == COSM_PASS ) && ( http->length == 0 ) )
+    /* last chunk, skip any trailer up to the final blank line */
+    line = 0;
+    for ( ; ; )
     {
-      /* we need to get 2 more bytes, yet another "\r\n" we know is coming */
-      if ( ( CosmNetRecv( tmp_buffer, &result, &http->net, 2, wait_ms )
-        == COSM_PASS ) && ( result == 2 ) )
+      if ( Cosm_HTTPHeaderEnd( &used, &line, &input->data[input->start],
+        input->end - input->start ) == COSM_PASS )
       {
+        input->start += used;
         return COSM_PASS;
       }
-      else
+      input->start += used;
+      Cosm_HTTPInputFill( input, &http->net, wait_ms );
+      if ( input->start == input->end )
       {
-        return COSM_FAIL;
-      }
-    }
-    else
-    {
-      return result;
+        return COSM_FAIL;
+      }
     }
   }
 
-  return COSM_FAIL;
+  return COSM_PASS;
+}
+
+static s32 Cosm_HTTPDParseClose( cosm_HTTPD_REQUEST * request )
+{
+  /*
+    The request can't be answered, but the responses held back for it
+    still go out before the connection is closed.
+  */
+  CosmHTTPDFlush( request );
+  CosmNetClose( request->net );
+
+  return COSM_HTTPD_ERROR_NET;
 }
 
 s32 Cosm_HTTPDParseRequest( cosm_HTTPD_REQUEST * request, cosm_NET * net,
-  u32 wait_ms )
+  cosm_HTTP_INPUT * input, u32 wait_ms )
 {
-  u32 i, result;
+  cosm_HTTP_OUTPUT * output;
+  u32 i, length, value_length;
+  s32 error;
   ascii ch;
   ascii * tmp;
   ascii * tmp_path;
+  const ascii * value;
   utf8 tmp_num[3] = { 0x00, 0x00, 0x00 };
 
   /*
@@ -1310,8 +2057,11 @@ s32 Cosm_HTTPDParseRequest( cosm_HTTPD_REQUEST * request, cosm_NET * net,
     request->header_flag = 0;
   }
 
-  /* init the new one */
+  /* init the new one, keeping any response held for pipelining */
+  output = request->output;
   CosmMemSet( request, sizeof( cosm_HTTPD_REQUEST ), 0 );
+  request->output = output;
+  request->net = net;
   if ( CosmBufferInit( &request->header, 1024LL,
     COSM_BUFFER_MODE_QUEUE, 1024LL, NULL, 0 )
     == COSM_FAIL )
@@ -1319,23 +2069,17 @@ s32 Cosm_HTTPDParseRequest( cosm_HTTPD_REQUEST * request, cosm_NET * net,
     return COSM_HTTPD_ERROR_MEMORY;
   }
   request->header_flag = 1;
+  request->input = input;
 
   /* read in first line */
-  ch = 0;
-  result = 1;
-  while ( ( result == 1 ) && ( ch != '\n' ) )
+  if ( ( error = Cosm_HTTPInputHeader( &request->header, input, net, 1,
+    wait_ms ) ) != COSM_PASS )
   {
-    if ( ( CosmNetRecv( &ch, &result, net, 1, wait_ms ) != COSM_PASS )
-      && ( result == 0 ) )
-    {
-      CosmNetClose( net );
-      return COSM_HTTPD_ERROR_NET;
-    }
-
-    if ( CosmBufferPut( &request->header, &ch, 1LL ) != COSM_PASS )
+    if ( error == COSM_HTTP_ERROR_MEMORY )
     {
       return COSM_HTTPD_ERROR_MEMORY;
     }
+    return Cosm_HTTPDParseClose( request );
   }
 
   /* terminate buffer string */
@@ -1362,8 +2106,7 @@ s32 Cosm_HTTPDParseRequest( cosm_HTTPD_REQUEST * request, cosm_NET * net,
   else
   {
     /* invalid request */
-    CosmNetClose( net );
-    return COSM_HTTPD_ERROR_NET;
+    return Cosm_HTTPDParseClose( request );
   }
 
   if ( ( tmp = CosmStrChar( tmp_path, ' ',
@@ -1445,47 +2188,18 @@ s32 Cosm_HTTPDParseRequest( cosm_HTTPD_REQUEST * request, cosm_NET * net,
 
   if ( request->version >= COSM_HTTP_VERSION_1_0 )
   {
-    /* read remaining header until \r\n\r\n into buffer */
-    i = 2; /* already read one \r\n */
-    result = 1;
-    while ( ( i < 4 ) && ( result == 1 ) )
+    /* read remaining header up to the blank line into buffer */
+    if ( ( error = Cosm_HTTPInputHeader( &request->header, input, net, 0,
+      wait_ms ) ) != COSM_PASS )
     {
-      if ( ( CosmNetRecv( &ch, &result, net, 1, wait_ms ) != COSM_PASS )
-        && ( result == 0 ) )
-      {
-        CosmNetClose( net );
-        return COSM_HTTPD_ERROR_NET;
-      }
-
-      if ( CosmBufferPut( &request->header, &ch, (u64) 1 ) != COSM_PASS )
+      if ( error == COSM_HTTP_ERROR_MEMORY )
       {
         return COSM_HTTPD_ERROR_MEMORY;
       }
-
-      if ( ( i % 2 ) == 0 )
-      {
-        if ( ch == '\r' )
-        {
-          i++;
-        }
-        else
-        {
-          i = 0;
-        }
-      }
-      else
-      {
-        if ( ch == '\n' )
-        {
-          i++;
-        }
-        else
-        {
-          i = 0;
-        }
-      }
+      return Cosm_HTTPDParseClose( request );
     }
   }
+  length = (u32) CosmBufferLength( &request->header );
 
   /* terminate buffer string */
   ch = 0;
@@ -1494,37 +2208,393 @@ s32 Cosm_HTTPDParseRequest( cosm_HTTPD_REQUEST * request, cosm_NET * net,
     return COSM_HTTPD_ERROR_MEMORY;
   }
 
-  /* keepalive in 1.0? */
-  if ( ( request->version == COSM_HTTP_VERSION_1_0 )
-    && ( ( CosmStrStr( request->header.memory, "Connection: Keep-Alive",
-    (u32) request->header.data_length ) != NULL )
-    || ( CosmStrStr( request->header.memory, "Connection: keep-alive",
-    (u32) request->header.data_length ) != NULL ) ) )
+  /* keepalive in 1.0, or close in 1.1? */
+  if ( Cosm_HTTPHeaderField( &value, &value_length, request->header.memory,
+    length, "Connection" ) == COSM_PASS )
   {
-    request->persistent = 1;
+    if ( ( request->version == COSM_HTTP_VERSION_1_0 )
+      && ( Cosm_HTTPFieldIs( value, value_length, "keep-alive" ) ) )
+    {
+      request->persistent = 1;
+    }
+    else if ( Cosm_HTTPFieldIs( value, value_length, "close" ) )
+    {
+      request->persistent = 0;
+    }
   }
 
   /* fixed post data length? */
   if ( ( request->type == COSM_HTTPD_REQUEST_POST )
-    && ( ( tmp = CosmStrStr( request->header.memory, "Content-Length: ",
-    (u32) request->header.data_length ) ) != NULL )
-    && ( ( CosmU32Str( &i, NULL, &tmp[16], 10 ) == COSM_PASS ) ) )
+    && ( Cosm_HTTPHeaderField( &value, &value_length, request->header.memory,
+    length, "Content-Length" ) == COSM_PASS )
+    && ( CosmU32Str( &i, NULL, value, 10 ) == COSM_PASS ) )
   {
     request->post_length = i;
   }
 
-  request->net = net;
   request->state = COSM_HTTPD_REQUEST_START;
 
   return COSM_PASS;
 }
 
+static cosm_HTTPD_ROUTE * Cosm_HTTPDRouteNode( const ascii * label,
+  u32 length )
+{
+  cosm_HTTPD_ROUTE * node;
+
+  if ( ( node = CosmMemAlloc( sizeof( cosm_HTTPD_ROUTE ) ) ) == NULL )
+  {
+    return NULL;
+  }
+  if ( length > 0 )
+  {
+    if ( ( node->label = CosmMemAlloc( length ) ) == NULL )
+    {
+      CosmMemFree( node );
+      return NULL;
+    }
+    CosmMemCopy( node->label, label, length );
+  }
+  node->label_length = length;
+
+  return node;
+}
+
+static u32 Cosm_HTTPDRouteChild( cosm_HTTPD_ROUTE * node, u8 ch )
+{
+  u32 low, high, mid;
+
+  /* binary search for the first child whose label starts >= ch */
+  low = 0;
+  high = node->child_count;
+  while ( low < high )
+  {
+    mid = ( low + high ) / 2;
+    if ( (u8) node->children[mid]->label[0] < ch )
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+/*
+  Changes copy the nodes from the root down to the path, sharing the rest
+  of the trie, and publish the new root in one store so lookups never see
+  a half made change. New nodes are chained on fresh in case a change
+  fails part way, and the nodes they replace on the new root's retired
+  list, to be freed once no lookup can be using them.
+*/
+
+static cosm_HTTPD_ROUTE * Cosm_HTTPDRouteCopy( cosm_HTTPD_ROUTE ** fresh,
+  const cosm_HTTPD_ROUTE * node, const ascii * label, u32 length,
+  u32 extra )
+{
+  cosm_HTTPD_ROUTE * copy;
+  u32 count;
+
+  /* node with a new label, and room for extra more children */
+  if ( ( copy = Cosm_HTTPDRouteNode( label, length ) ) == NULL )
+  {
+    return NULL;
+  }
+  copy->retired = *fresh;
+  *fresh = copy;
+
+  count = ( node != NULL ) ? node->child_count : 0;
+  if ( ( count + extra ) > 0 )
+  {
+    if ( ( copy->children = CosmMemAlloc( sizeof( cosm_HTTPD_ROUTE * )
+      * ( count + extra ) ) ) == NULL )
+    {
+      return NULL;
+    }
+  }
+  if ( node != NULL )
+  {
+    if ( count > 0 )
+    {
+      CosmMemCopy( copy->children, node->children,
+        sizeof( cosm_HTTPD_ROUTE * ) * count );
+    }
+    copy->child_count = count;
+    copy->handler = node->handler;
+    copy->acl = node->acl;
+  }
+
+  return copy;
+}
+
+static void Cosm_HTTPDRouteDrop( cosm_HTTPD_ROUTE * chain )
+{
+  cosm_HTTPD_ROUTE * node;
+
+  /* free nodes on a fresh or retired chain, but not their children */
+  while ( chain != NULL )
+  {
+    node = chain;
+    chain = node->retired;
+    CosmMemFree( node->children );
+    CosmMemFree( node->label );
+    CosmMemFree( node );
+  }
+}
+
+static void Cosm_HTTPDRouteRetire( cosm_HTTPD_ROUTE ** replaced,
+  cosm_HTTPD_ROUTE * node )
+{
+  node->retired = *replaced;
+  *replaced = node;
+}
+
+s32 Cosm_HTTPDRouteInsert( cosm_HTTPD_ROUTE ** root, const ascii * path,
+  s32 (*handler)( cosm_HTTPD_REQUEST * request ), cosm_NET_ACL * acl )
+{
+  cosm_HTTPD_ROUTE * fresh;
+  cosm_HTTPD_ROUTE * replaced;
+  cosm_HTTPD_ROUTE * top;
+  cosm_HTTPD_ROUTE * node;
+  cosm_HTTPD_ROUTE * child;
+  cosm_HTTPD_ROUTE * rest;
+  u32 length, common, i, j;
+
+  if ( ( *root == NULL ) && ( handler == NULL ) )
+  {
+    return COSM_PASS;
+  }
+
+  fresh = NULL;
+  replaced = NULL;
+  if ( ( top = Cosm_HTTPDRouteCopy( &fresh, *root, NULL, 0, 1 ) ) == NULL )
+  {
+    Cosm_HTTPDRouteDrop( fresh );
+    return COSM_FAIL;
+  }
+  if ( *root != NULL )
+  {
+    replaced = ( *root )->retired;
+    Cosm_HTTPDRouteRetire( &replaced, *root );
+  }
+
+  /* every node on the way down is a copy, with room for one more child */
+  node = top;
+  length = CosmStrBytes( path );
+  while ( length > 0 )
+  {
+    i = Cosm_HTTPDRouteChild( node, (u8) path[0] );
+    if ( ( i == node->child_count )
+      || ( node->children[i]->label[0] != path[0] ) )
+    {
+      /* nothing shares this byte, the rest of path is a new leaf */
+      if ( ( handler == NULL ) || ( ( child = Cosm_HTTPDRouteCopy( &fresh,
+        NULL, path, length, 0 ) ) == NULL ) )
+      {
+        /* removing a path that isn't there changes nothing */
+        Cosm_HTTPDRouteDrop( fresh );
+        return ( handler == NULL ) ? COSM_PASS : COSM_FAIL;
+      }
+      for ( j = node->child_count ; j > i ; j-- )
+      {
+        node->children[j] = node->children[j - 1];
+      }
+      node->children[i] = child;
+      node->child_count++;
+      node = child;
+      break;
+    }
+
+    child = node->children[i];
+    common = 1;
+    while ( ( common < child->label_length ) && ( common < length )
+      && ( child->label[common] == path[common] ) )
+    {
+      common++;
+    }
+
+    if ( common < child->label_length )
+    {
+      /* path ends or differs inside the label, split the node there */
+      if ( ( handler == NULL ) || ( ( node->children[i] = Cosm_HTTPDRouteCopy(
+        &fresh, NULL, child->label, common, 2 ) ) == NULL )
+        || ( ( rest = Cosm_HTTPDRouteCopy( &fresh, child,
+        &child->label[common], child->label_length - common, 0 ) ) == NULL ) )
+      {
+        Cosm_HTTPDRouteDrop( fresh );
+        return ( handler == NULL ) ? COSM_PASS : COSM_FAIL;
+      }
+      node->children[i]->children[0] = rest;
+      node->children[i]->child_count = 1;
+    }
+    else if ( ( node->children[i] = Cosm_HTTPDRouteCopy( &fresh, child,
+      child->label, child->label_length, 1 ) ) == NULL )
+    {
+      Cosm_HTTPDRouteDrop( fresh );
+      return COSM_FAIL;
+    }
+    Cosm_HTTPDRouteRetire( &replaced, child );
+
+    node = node->children[i];
+    path = &path[common];
+    length -= common;
+  }
+
+  if ( ( handler == NULL ) && ( node->handler == NULL ) )
+  {
+    Cosm_HTTPDRouteDrop( fresh );
+    return COSM_PASS;
+  }
+  node->handler = handler;
+  node->acl = acl;
+
+  /* the new nodes are now part of the trie */
+  while ( fresh != NULL )
+  {
+    node = fresh;
+    fresh = node->retired;
+    node->retired = NULL;
+  }
+  top->retired = replaced;
+  *root = top;
+
+  return COSM_PASS;
+}
+
+cosm_HTTPD_ROUTE * Cosm_HTTPDRouteFind( cosm_HTTPD_ROUTE * root,
+  const ascii * path )
+{
+  cosm_HTTPD_ROUTE * node;
+  cosm_HTTPD_ROUTE * child;
+  cosm_HTTPD_ROUTE * best;
+  u32 i;
+
+  if ( ( root == NULL ) || ( path == NULL ) )
+  {
+    return NULL;
+  }
+
+  best = ( root->handler != NULL ) ? root : NULL;
+  node = root;
+  while ( *path != 0 )
+  {
+    i = Cosm_HTTPDRouteChild( node, (u8) *path );
+    if ( ( i == node->child_count )
+      || ( node->children[i]->label[0] != *path ) )
+    {
+      break;
+    }
+
+    /* the whole label must match, the 0 at the end of path never does */
+    child = node->children[i];
+    for ( i = 1 ; i < child->label_length ; i++ )
+    {
+      if ( path[i] != child->label[i] )
+      {
+        break;
+      }
+    }
+    if ( i < child->label_length )
+    {
+      break;
+    }
+
+    path = &path[i];
+    node = child;
+    if ( node->handler != NULL )
+    {
+      best = node;
+    }
+  }
+
+  return best;
+}
+
+static void Cosm_HTTPDRouteFreeTrie( cosm_HTTPD_ROUTE * node )
+{
+  u32 i;
+
+  for ( i = 0 ; i < node->child_count ; i++ )
+  {
+    Cosm_HTTPDRouteFreeTrie( node->children[i] );
+  }
+  CosmMemFree( node->children );
+  CosmMemFree( node->label );
+  CosmMemFree( node );
+}
+
+void Cosm_HTTPDRouteReclaim( cosm_HTTPD_ROUTE * root )
+{
+  if ( root != NULL )
+  {
+    Cosm_HTTPDRouteDrop( root->retired );
+    root->retired = NULL;
+  }
+}
+
+void Cosm_HTTPDRouteFree( cosm_HTTPD_ROUTE * root )
+{
+  if ( root == NULL )
+  {
+    return;
+  }
+
+  Cosm_HTTPDRouteDrop( root->retired );
+  Cosm_HTTPDRouteFreeTrie( root );
+}
+
+static s32 Cosm_HTTPDRouteAllow( cosm_HTTPD_THREAD * thread,
+  cosm_HTTPD_ROUTE * route )
+{
+  u32 slot;
+
+  if ( route->acl == NULL )
+  {
+    return COSM_NET_ALLOW;
+  }
+
+  /* the client can't change during a connection, check each route once */
+#if ( defined( CPU_64BIT ) )
+  slot = (u32) ( ( (u64) route >> 4 ) % COSM_HTTPD_ACL_CACHE );
+#else
+  slot = ( (u32) route >> 4 ) % COSM_HTTPD_ACL_CACHE;
+#endif
+  if ( thread->acl_route[slot] != route )
+  {
+    thread->acl_result[slot] = CosmNetACLCheck( route->acl,
+      &thread->net.addr );
+    thread->acl_route[slot] = route;
+  }
+
+  return thread->acl_result[slot];
+}
+
+static u32 Cosm_HTTPDPipelined( cosm_HTTPD_REQUEST * request )
+{
+  cosm_HTTP_INPUT * input;
+  u32 used, line;
+
+  input = request->input;
+  if ( ( request->post_length > 0 ) || ( input->start == input->end ) )
+  {
+    return 0;
+  }
+
+  line = 0;
+  return ( Cosm_HTTPHeaderEnd( &used, &line, &input->data[input->start],
+    input->end - input->start ) == COSM_PASS );
+}
+
 void Cosm_HTTPDThread( void * arg )
 {
   cosm_HTTPD_THREAD * thread;
   cosm_HTTPD * httpd;
   cosm_HTTPD_REQUEST request;
-  u32 i;
+  cosm_HTTPD_ROUTE * route;
+  u64 start;
 
   thread = (cosm_HTTPD_THREAD *) arg;
   httpd = (cosm_HTTPD *) thread->httpd;
@@ -1558,33 +2628,70 @@ void Cosm_HTTPDThread( void * arg )
       we have a network connection, decode the header
       and call the right handlers. repeat until closed.
     */
+    CosmMetricAdd( httpd->active, 1 );
     request.persistent = 0;
-    while ( Cosm_HTTPDParseRequest( &request, &thread->net, httpd->wait_ms )
-      == COSM_PASS )
-    {
+    thread->input.start = 0;
+    thread->input.end = 0;
+    thread->output.length = 0;
+    CosmMemSet( thread->acl_route, sizeof( thread->acl_route ), 0 );
+    while ( Cosm_HTTPDParseRequest( &request, &thread->net, &thread->input,
+      httpd->wait_ms ) == COSM_PASS )
+    {
+      start = CosmClockMono();
       request.thread_number = thread->thread_number;
+      request.output = &thread->output;
       /* call correct handler, no matches means no call */
-      for ( i = 0 ; i < httpd->handler_count ; i++ )
+      route = Cosm_HTTPDRouteFind(
+        (cosm_HTTPD_ROUTE *) CosmAtomicLoadPtr( (void **) &httpd->routes ),
+        request.path );
+      if ( route != NULL )
       {
-        if ( CosmStrCmp( request.path, httpd->paths[i],
-          CosmStrBytes( httpd->paths[i] ) ) == 0 )
+        if ( Cosm_HTTPDRouteAllow( thread, route ) != COSM_NET_ALLOW )
         {
-          if ( ( (*httpd->handlers[i])( &request ) ) != COSM_PASS )
+          if ( ( CosmHTTPDSendInit( &request, 403, "Forbidden",
+            "text/plain" ) != COSM_PASS )
+            || ( CosmHTTPDSend( &request, NULL, 0 ) != COSM_PASS ) )
           {
-            /* failed */
             CosmNetClose( &thread->net );
           }
-          break;
+        }
+        else if ( CosmHTTPDFlush( &request ) != COSM_PASS )
+        {
+          /* send held responses first, a handler may take a while */
+          CosmNetClose( &thread->net );
+        }
+        else if ( ( (*route->handler)( &request ) ) != COSM_PASS )
+        {
+          /* failed, drop what is left of its response */
+          thread->output.length = 0;
+          CosmNetClose( &thread->net );
         }
       }
+      CosmMetricRecord( httpd->latency, CosmClockMono() - start );
 
       if ( request.persistent != 1 )
       {
         /* dont keep connection open for another request */
         break;
       }
+
+      /*
+        if the client has already pipelined the next request, hold this
+        response so it goes out with the next one, otherwise send it now.
+        Anything held is sent before the next handler is called.
+      */
+      if ( !Cosm_HTTPDPipelined( &request ) )
+      {
+        if ( CosmHTTPDFlush( &request ) != COSM_PASS )
+        {
+          CosmNetClose( &thread->net );
+        }
+      }
     }
+    CosmHTTPDFlush( &request );
+    thread->output.length = 0;
     CosmNetClose( &thread->net );
+    CosmMetricAdd( httpd->active, -1 );
 
     /* flag and wait for another SemaphoreUp */
     thread->state = COSM_HTTPD_THREAD_STOPPED;
@@ -1603,8 +2710,8 @@ void Cosm_HTTPDMain( void * arg )
   httpd = (cosm_HTTPD *) arg;
 
   /* open and listen on network */
-  if ( CosmNetListen( &httpd->net, &httpd->host, COSM_NET_MODE_TCP,
-    httpd->thread_count * 2 ) != COSM_PASS )
+  if ( CosmNetListenOptions( &httpd->net, &httpd->host, COSM_NET_MODE_TCP,
+    &httpd->options ) != COSM_PASS )
   {
     return;
   }
@@ -1678,6 +2785,11 @@ void Cosm_HTTPDMain( void * arg )
       {
         /* found an available thread */
         threads[seek].state = COSM_HTTPD_THREAD_RUNNING;
+        if ( httpd->options.flags & COSM_NET_OPTION_QUICKACK )
+        {
+          /* the one option accepted connections do not inherit */
+          CosmNetSetOptions( &tmp_net, &httpd->options );
+        }
         threads[seek].net = tmp_net;
         if ( CosmSemaphoreUp( &threads[seek].semaphore ) != COSM_PASS )
         {
@@ -1685,10 +2797,12 @@ void Cosm_HTTPDMain( void * arg )
         }
         found = seek;
         seek = ( seek + 1 ) % httpd->thread_count;
+        CosmMetricAdd( httpd->accepted, 1 );
       }
       else
       {
         /* send a 503 */
+        CosmMetricAdd( httpd->rejected, 1 );
         CosmNetSend( &tmp_net, &sent,
          "HTTP/1.1 503 Busy\r\nContent-Length: 0\r\n\r\n", 40 );
         CosmNetClose( &tmp_net );
@@ -1733,12 +2847,234 @@ void Cosm_HTTPDMain( void * arg )
     CosmThreadEnd();
     /* !!! need cleanup */
   }
+  /* nothing can be reading the replaced tries now */
+  if ( httpd->routes != NULL )
+  {
+    Cosm_HTTPDRouteReclaim( httpd->routes );
+  }
   httpd->status = COSM_HTTPD_STATUS_STOPPED;
   CosmMutexUnlock( &httpd->lock );
   CosmThreadEnd();
 }
 
+static s32 Cosm_HTTPDTestHandler( cosm_HTTPD_REQUEST * request )
+{
+  return ( request != NULL ) ? COSM_PASS : COSM_FAIL;
+}
+
 s32 Cosm_TestHTTP( void )
 {
+  static const ascii header[] = "HTTP/1.1 200 OK\r\n"
+    "content-LENGTH:  42 \r\n"
+    "X-Colon: a:b\n"
+    "Transfer-Encoding: gzip, chunked\r\n"
+    "\r\n"
+    "body";
+  static const ascii * route_paths[5] = { "/api/users", "/", "/apple",
+    "/api/users/admin", "/api/" };
+  static const ascii * route_finds[7] = { "/x", "/api/users/42", "/apples",
+    "/ap", "/api/users/admin2", "/api/user", "/" };
+  static const u32 route_found[7] = { 1, 0, 2, 1, 3, 4, 1 };
+  static const ascii pipelined[] = "GET / HTTP/1.1\r\n\r\n"
+    "HEAD / HTTP/1.1\r\n\r\n";
+  static cosm_NET_ACL route_tags[5];
+  static cosm_HTTP_INPUT input;
+  static cosm_HTTP_OUTPUT output;
+  cosm_HTTPD_REQUEST request;
+  cosm_HTTPD_ROUTE * routes;
+  cosm_HTTPD_ROUTE * route;
+  cosm_HTTPD_ROUTE * old;
+  cosm_HTTP_POOL pool;
+  cosm_HTTP http;
+  cosm_NET_OPTIONS options;
+  cosm_NET_ADDR addr;
+  cosm_NET net_listen;
+  cosm_NET net_client;
+  cosm_NET net_server;
+  cosm_HTTP * http1;
+  cosm_HTTP * http2;
+  const ascii * value;
+  ascii reply[16];
+  u32 line, used, total, length, value_length, i;
+
+  length = CosmStrBytes( header );
+
+  /* the end is found however the header is split up */
+  for ( i = 1 ; i < length ; i++ )
+  {
+    line = 0;
+    if ( Cosm_HTTPHeaderEnd( &used, &line, header, i ) == COSM_PASS )
+    {
+      if ( ( i < ( length - 4 ) ) || ( used != ( length - 4 ) ) )
+      {
+        return -1;
+      }
+      continue;
+    }
+    total = used;
+    if ( ( total != i )
+      || ( Cosm_HTTPHeaderEnd( &used, &line, &header[i], length - i )
+      != COSM_PASS ) || ( ( total + used ) != ( length - 4 ) ) )
+    {
+      return -2;
+    }
+  }
+
+  /* fields ignore case and whitespace, and stop at the value's end */
+  if ( ( Cosm_HTTPHeaderField( &value, &value_length, header, length,
+    "Content-Length" ) != COSM_PASS ) || ( value_length != 2 )
+    || ( CosmU32Str( &i, NULL, value, 10 ) != COSM_PASS ) || ( i != 42 ) )
+  {
+    return -3;
+  }
+  if ( ( Cosm_HTTPHeaderField( &value, &value_length, header, length,
+    "x-colon" ) != COSM_PASS ) || ( value_length != 3 )
+    || ( CosmStrCmp( value, "a:b", 3 ) != 0 )
+    || ( Cosm_HTTPHeaderField( &value, &value_length, header, length,
+    "Transfer-Encoding" ) != COSM_PASS )
+    || ( Cosm_HTTPFieldIs( value, value_length, "chunked" ) != 1 ) )
+  {
+    return -4;
+  }
+  if ( ( Cosm_HTTPHeaderField( &value, &value_length, header, length,
+    "Content" ) == COSM_PASS )
+    || ( Cosm_HTTPHeaderField( &value, &value_length, header, length,
+    "Host" ) == COSM_PASS ) )
+  {
+    return -5;
+  }
+
+  /* the longest registered prefix wins, in any insert order */
+  routes = NULL;
+  for ( i = 0 ; i < 5 ; i++ )
+  {
+    if ( Cosm_HTTPDRouteInsert( &routes, route_paths[i],
+      Cosm_HTTPDTestHandler, &route_tags[i] ) != COSM_PASS )
+    {
+      Cosm_HTTPDRouteFree( routes );
+      return -6;
+    }
+  }
+  for ( i = 0 ; i < 7 ; i++ )
+  {
+    if ( ( ( route = Cosm_HTTPDRouteFind( routes, route_finds[i] ) )
+      == NULL ) || ( route->acl != &route_tags[route_found[i]] ) )
+    {
+      Cosm_HTTPDRouteFree( routes );
+      return -7;
+    }
+  }
+
+  /* a change leaves the old trie as it was, removing a missing path is free */
+  old = routes;
+  if ( ( Cosm_HTTPDRouteInsert( &routes, "/api/", Cosm_HTTPDTestHandler,
+    &route_tags[0] ) != COSM_PASS ) || ( routes == old )
+    || ( Cosm_HTTPDRouteFind( old, "/api/x" )->acl != &route_tags[4] )
+    || ( Cosm_HTTPDRouteFind( routes, "/api/x" )->acl != &route_tags[0] )
+    || ( ( old = routes ) == NULL )
+    || ( Cosm_HTTPDRouteInsert( &routes, "/apples", NULL, NULL )
+    != COSM_PASS ) || ( routes != old )
+    || ( Cosm_HTTPDRouteInsert( &routes, "/apple", NULL, NULL )
+    != COSM_PASS )
+    || ( Cosm_HTTPDRouteFind( routes, "/apples" )->acl != &route_tags[1] ) )
+  {
+    Cosm_HTTPDRouteFree( routes );
+    return -8;
+  }
+  Cosm_HTTPDRouteFree( routes );
+
+  /* one host entry, one connection out at a time, nothing connects yet */
+  if ( ( CosmHTTPPoolInit( &pool, 1, 1000, 60000 ) != COSM_PASS )
+    || ( CosmHTTPPoolGet( &http1, &pool, "ftp://127.0.0.1/", 0 )
+    != COSM_HTTP_ERROR_URI )
+    || ( CosmHTTPPoolGet( &http1, &pool, "http://127.0.0.1:9/a", 0 )
+    != COSM_PASS ) || ( http1->status != COSM_HTTP_STATUS_CLOSED )
+    || ( http1->host.port != 9 ) )
+  {
+    return -9;
+  }
+  if ( ( CosmHTTPPoolGet( &http2, &pool, "http://127.0.0.1:9/b", 0 )
+    != COSM_HTTP_ERROR_BUSY ) || ( http2 != NULL )
+    || ( CosmHTTPPoolFree( &pool ) != COSM_HTTP_ERROR_ORDER ) )
+  {
+    CosmHTTPPoolPut( &pool, http1 );
+    CosmHTTPPoolFree( &pool );
+    return -10;
+  }
+  if ( ( CosmHTTPPoolPut( &pool, http1 ) != COSM_PASS )
+    || ( CosmHTTPPoolGet( &http2, &pool, "http://127.0.0.1:9", 0 )
+    != COSM_PASS ) || ( pool.host_count != 1 )
+    || ( pool.hosts[0]->idle_count != 0 )
+    || ( CosmHTTPPoolPut( &pool, http2 ) != COSM_PASS )
+    || ( CosmHTTPPoolFree( &pool ) != COSM_PASS ) )
+  {
+    return -11;
+  }
+
+  /* clients default to no Nagle, and options need an opened client */
+  CosmMemSet( &http, sizeof( cosm_HTTP ), 0 );
+  CosmMemSet( &options, sizeof( cosm_NET_OPTIONS ), 0 );
+  if ( ( CosmHTTPSetOptions( &http, &options ) != COSM_HTTP_ERROR_ORDER )
+    || ( _COSM_HTTPOPEN( &http, "http://127.0.0.1:9/" ) != COSM_PASS )
+    || ( http.options.flags != COSM_NET_OPTION_NODELAY )
+    || ( CosmHTTPSetOptions( &http, &options ) != COSM_PASS )
+    || ( http.options.flags != 0 ) )
+  {
+    return -12;
+  }
+  CosmHTTPClose( &http );
+
+  /* a response held for a pipelined request that is bad still goes out */
+  CosmMemSet( &net_listen, sizeof( cosm_NET ), 0 );
+  CosmMemSet( &net_client, sizeof( cosm_NET ), 0 );
+  CosmMemSet( &net_server, sizeof( cosm_NET ), 0 );
+  addr.type = COSM_NET_IPV4;
+  addr.ip.v4 = 0x7F000001;
+  addr.port = 0;
+  if ( CosmNetListen( &net_listen, &addr, COSM_NET_MODE_TCP, 1 )
+    != COSM_PASS )
+  {
+    return -13;
+  }
+  addr.port = net_listen.my_addr.port;
+  if ( ( CosmNetOpen( &net_client, NULL, &addr, COSM_NET_MODE_TCP )
+    != COSM_PASS )
+    || ( CosmNetAccept( &net_server, &net_listen, NULL,
+    COSM_NET_ACCEPT_WAIT ) != COSM_PASS )
+    || ( CosmNetSend( &net_client, &used, pipelined,
+    CosmStrBytes( pipelined ) ) != COSM_PASS ) )
+  {
+    CosmNetClose( &net_client );
+    CosmNetClose( &net_listen );
+    return -13;
+  }
+  CosmNetClose( &net_listen );
+  CosmMemSet( &request, sizeof( cosm_HTTPD_REQUEST ), 0 );
+  request.output = &output;
+  if ( ( Cosm_HTTPDParseRequest( &request, &net_server, &input, 1000 )
+    != COSM_PASS ) || ( request.output != &output )
+    || ( CosmHTTPDSendInit( &request, 200, "OK", "text/plain" )
+    != COSM_PASS ) || ( CosmHTTPDSend( &request, NULL, 0 ) != COSM_PASS )
+    || ( !Cosm_HTTPDPipelined( &request ) ) || ( output.length == 0 )
+    || ( Cosm_HTTPDParseRequest( &request, &net_server, &input, 1000 )
+    == COSM_PASS ) )
+  {
+    CosmNetClose( &net_client );
+    CosmNetClose( &net_server );
+    return -14;
+  }
+  CosmBufferFree( &request.header );
+  total = 0;
+  while ( ( total < 12 ) && ( CosmNetRecv( &reply[total], &used,
+    &net_client, 12 - total, 1000 ) == COSM_PASS ) && ( used > 0 ) )
+  {
+    total += used;
+  }
+  CosmNetClose( &net_client );
+  if ( ( total != 12 ) || ( CosmMemCmp( reply, "HTTP/1.1 200", 12 ) != 0 ) )
+  {
+    return -15;
+  }
+
   return COSM_PASS;
 }
@@ -41,7 +41,8 @@ s32 CosmLogOpen( cosm_LOG * log, ascii * filename, u32 max_level, u32 mode )
     return COSM_LOG_ERROR_NAME;
   }
 
-  if ( ( mode != COSM_LOG_MODE_NUMBER ) && ( mode != COSM_LOG_MODE_BITS ) )
+  if ( ( ( mode & ~COSM_LOG_MODE_SYNC ) != COSM_LOG_MODE_NUMBER )
+    && ( ( mode & ~COSM_LOG_MODE_SYNC ) != COSM_LOG_MODE_BITS ) )
   {
     CosmMutexUnlock( &log->lock );
     return COSM_LOG_ERROR_MODE;
@@ -55,8 +56,17 @@ s32 CosmLogOpen( cosm_LOG * log, ascii * filename, u32 max_level, u32 mode )
     return COSM_LOG_ERROR_ACCESS;
   }
 
-  result = CosmFileOpen( &log->file, filename, COSM_FILE_MODE_CREATE |
-    COSM_FILE_MODE_APPEND, COSM_FILE_LOCK_NONE );
+  if ( ( mode & COSM_LOG_MODE_SYNC ) == COSM_LOG_MODE_SYNC )
+  {
+    /* held open for the group writer */
+    result = CosmFileOpen( &log->file, filename, COSM_FILE_MODE_CREATE |
+      COSM_FILE_MODE_WRITE | COSM_FILE_MODE_NOBUFFER, COSM_FILE_LOCK_NONE );
+  }
+  else
+  {
+    result = CosmFileOpen( &log->file, filename, COSM_FILE_MODE_CREATE |
+      COSM_FILE_MODE_APPEND, COSM_FILE_LOCK_NONE );
+  }
 
   if ( result == COSM_FILE_ERROR_NAME )
   {
@@ -72,13 +82,29 @@ s32 CosmLogOpen( cosm_LOG * log, ascii * filename, u32 max_level, u32 mode )
     return COSM_LOG_ERROR_ACCESS;
   }
 
-  /* We have an open file at this point.  Close it. */
-  CosmFileClose( &log->file );
+  if ( ( mode & COSM_LOG_MODE_SYNC ) == COSM_LOG_MODE_SYNC )
+  {
+    if ( CosmFileGroupInit( &log->group, &log->file ) != COSM_PASS )
+    {
+      CosmFileClose( &log->file );
+      CosmMutexUnlock( &log->lock );
+      return COSM_LOG_ERROR_ACCESS;
+    }
+  }
+  else
+  {
+    /* We have an open file at this point.  Close it. */
+    CosmFileClose( &log->file );
+  }
 
   /* Everything checks out.  Fill in the cosm_LOG structure and return. */
   CosmStrCopy( log->filename, filename, (u64) COSM_FILE_MAX_FILENAME );
   log->mode = mode;
   log->level = max_level;
+  log->queued = CosmMetricCounter( "cosm_log_queued_total",
+    "Log records written, or handed to the group writer." );
+  log->dropped = CosmMetricCounter( "cosm_log_dropped_total",
+    "Log records lost to a file error." );
   log->status = COSM_LOG_STATUS_INIT;
 
   CosmMutexUnlock( &log->lock );
@@ -90,6 +116,8 @@ s32 CosmLog( cosm_LOG * log, u32 level, u32 echo, const utf8 * format, ... )
 {
   va_list ap;
   s32 result;
+  u32 mode, bytes;
+  utf8 line[COSM_LOG_SYNC_LINE];
 
   if ( ( log == NULL ) || ( format == NULL ) )
   {
@@ -102,9 +130,9 @@ s32 CosmLog( cosm_LOG * log, u32 level, u32 echo, const utf8 * format, ... )
   }
 
   /* Sanity checks */
+  mode = log->mode & ~COSM_LOG_MODE_SYNC;
   if ( ( log->filename == NULL ) || ( log->status != COSM_LOG_STATUS_INIT ) ||
-    ( ( log->mode != COSM_LOG_MODE_NUMBER ) &&
-    ( log->mode != COSM_LOG_MODE_BITS ) ) )
+    ( ( mode != COSM_LOG_MODE_NUMBER ) && ( mode != COSM_LOG_MODE_BITS ) ) )
   {
     CosmMutexUnlock( &log->lock );
     return COSM_LOG_ERROR_INIT;
@@ -113,7 +141,7 @@ s32 CosmLog( cosm_LOG * log, u32 level, u32 echo, const utf8 * format, ... )
   /* Bail if we shouldn't write to the log. 0 = always write */
   if ( level != 0 )
   {
-    if ( log->mode == COSM_LOG_MODE_NUMBER )
+    if ( mode == COSM_LOG_MODE_NUMBER )
     {
       /* We're using 'number' */
       if ( level > log->level )
@@ -137,10 +165,35 @@ s32 CosmLog( cosm_LOG * log, u32 level, u32 echo, const utf8 * format, ... )
 
   /* Looks like we're writing a log entry. */
 
+  if ( ( log->mode & COSM_LOG_MODE_SYNC ) == COSM_LOG_MODE_SYNC )
+  {
+    va_start( ap, format );
+    bytes = Cosm_Print( NULL, line, COSM_LOG_SYNC_LINE - 1, format, ap );
+    va_end( ap );
+
+    if ( echo == COSM_LOG_ECHO )
+    {
+      va_start( ap, format );
+      Cosm_Print( NULL, NULL, 0xFFFFFFFF, format, ap );
+      va_end( ap );
+    }
+
+    /* not under the lock, so records from other threads join the flush */
+    CosmMutexUnlock( &log->lock );
+    if ( CosmFileGroupWrite( &log->group, line, (u64) bytes ) != COSM_PASS )
+    {
+      CosmMetricAdd( log->dropped, 1 );
+      return COSM_LOG_ERROR_ACCESS;
+    }
+    CosmMetricAdd( log->queued, 1 );
+    return COSM_PASS;
+  }
+
   result = CosmMemSet( (void *) &log->file, sizeof( cosm_FILE ), 0 );
   if ( result != COSM_PASS )
   {
     /* Something bad has happened */
+    CosmMetricAdd( log->dropped, 1 );
     CosmMutexUnlock( &log->lock );
     return COSM_LOG_ERROR_ACCESS;
   }
@@ -150,6 +203,7 @@ s32 CosmLog( cosm_LOG * log, u32 level, u32 echo, const utf8 * format, ... )
   if ( result != COSM_PASS )
   {
     /* Problem creating or accessing the logfile. */
+    CosmMetricAdd( log->dropped, 1 );
     CosmMutexUnlock( &log->lock );
     return COSM_LOG_ERROR_ACCESS;
   }
@@ -168,6 +222,7 @@ s32 CosmLog( cosm_LOG * log, u32 level, u32 echo, const utf8 * format, ... )
 
   /* Ok. That's it. Close up and go home. */
   CosmFileClose( &log->file );
+  CosmMetricAdd( log->queued, 1 );
   CosmMutexUnlock( &log->lock );
 
   return COSM_PASS;
@@ -179,6 +234,16 @@ s32 CosmLogClose( cosm_LOG * log )
   {
     return COSM_LOG_ERROR_INIT;
   }
+  if ( ( log->status == COSM_LOG_STATUS_INIT )
+    && ( ( log->mode & COSM_LOG_MODE_SYNC ) == COSM_LOG_MODE_SYNC ) )
+  {
+    /* let records still being written finish */
+    while ( CosmFileGroupFree( &log->group ) == COSM_FILE_ERROR_BUSY )
+    {
+      CosmSleep( 1 );
+    }
+    CosmFileClose( &log->file );
+  }
   log->status = COSM_LOG_STATUS_NULL;
   CosmMutexUnlock( &log->lock );
   CosmMutexFree( &log->lock );
@@ -191,7 +256,8 @@ s32 Cosm_TestLog( void )
   cosm_LOG log;
   cosm_FILE file;
   utf8 * correct, buf[512];
-  u64 real_read;
+  u64 real_read, length;
+  s64 queued;
   s32 ret;
 
   /* Tests 1-4 - Clear stuff */
@@ -447,5 +513,57 @@ This should be logged too.\nThis should be the last line.\n";
     return -34;
   }
 
+  /*
+    Create a synced COSM_LOG_MODE_NUMBER log
+    35. Initialise log
+    36. Log a line, a filtered line, and one too long for a record
+    37. Check the contents
+    38. Check the records were counted
+  */
+
+  CosmMemSet( buf, sizeof( buf ), 'x' );
+  if ( ( CosmMemSet( &log, sizeof( cosm_LOG ), 0x00 ) != COSM_PASS )
+    || ( CosmLogOpen( &log, "test.log", 5,
+    COSM_LOG_MODE_NUMBER | COSM_LOG_MODE_SYNC ) != COSM_PASS ) )
+  {
+    return -35;
+  }
+
+  queued = CosmMetricValue( log.queued );
+  if ( ( CosmLog( &log, 5, COSM_LOG_NOECHO, "Synced %u\n", (u32) 1 )
+    != COSM_PASS ) || ( CosmLog( &log, 6, COSM_LOG_NOECHO,
+    "*** This shouldn't be logged ***\n" ) != COSM_PASS )
+    || ( CosmLog( &log, 0, COSM_LOG_NOECHO, "%.500b%.500b%.500b", buf, buf,
+    buf ) != COSM_PASS ) )
+  {
+    return -36;
+  }
+
+  CosmLogClose( &log );
+
+  if ( CosmFileOpen( &file, "test.log", COSM_FILE_MODE_READ,
+    COSM_FILE_LOCK_READ ) != COSM_PASS )
+  {
+    return -37;
+  }
+  CosmFileLength( &length, &file );
+  CosmFileRead( buf, &real_read, &file, 512 );
+  CosmFileClose( &file );
+  if ( ( length != 9 + COSM_LOG_SYNC_LINE - 1 ) || ( real_read != 512 )
+    || ( CosmStrCmp( buf, "Synced 1\n", 9 ) != COSM_PASS ) )
+  {
+    return -37;
+  }
+
+  if ( CosmFileDelete( "test.log" ) != COSM_PASS )
+  {
+    return -37;
+  }
+
+  if ( CosmMetricValue( log.queued ) != queued + 2 )
+  {
+    return -38;
+  }
+
   return COSM_PASS;
 }
@@ -0,0 +1,665 @@
+/*
+  Copyright 1995-2019 Mithral Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+*/
+
+#include "cosm/metrics.h"
+#include "cosm/os_io.h"
+#include "cosm/os_mem.h"
+#include "cosm/os_net.h"
+
+#define COSM_METRIC_LINE 256 /* longest line CosmMetricsDump writes */
+
+/*
+  Every metric ever made, newest first. Readers walk the list without a
+  lock since metrics are never removed, creating one takes the lock so two
+  threads can't add the same name.
+*/
+static cosm_METRIC * __cosm_metrics = NULL;
+static u32 __cosm_metrics_lock = 0;
+
+static s32 Cosm_MetricName( const ascii * name )
+{
+  /*
+    Check name is a valid Prometheus metric name that fits.
+    Returns: COSM_PASS if it is, or COSM_FAIL.
+  */
+  u32 i;
+
+  if ( ( name == NULL ) || ( name[0] == 0 )
+    || ( ( name[0] >= '0' ) && ( name[0] <= '9' ) ) )
+  {
+    return COSM_FAIL;
+  }
+
+  for ( i = 0 ; name[i] != 0 ; i++ )
+  {
+    if ( ( i >= COSM_METRIC_NAME_MAX - 1 )
+      || !( ( ( name[i] >= 'a' ) && ( name[i] <= 'z' ) )
+      || ( ( name[i] >= 'A' ) && ( name[i] <= 'Z' ) )
+      || ( ( name[i] >= '0' ) && ( name[i] <= '9' ) )
+      || ( name[i] == '_' ) || ( name[i] == ':' ) ) )
+    {
+      return COSM_FAIL;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+static cosm_METRIC * Cosm_MetricFind( const ascii * name )
+{
+  /*
+    Look for the metric called name.
+    Returns: The metric, or NULL if there isn't one.
+  */
+  cosm_METRIC * metric;
+
+  metric = (cosm_METRIC *)
+    CosmAtomicLoadPtr( (void * const *) &__cosm_metrics );
+  while ( metric != NULL )
+  {
+    if ( CosmStrCmp( metric->name, name, COSM_METRIC_NAME_MAX ) == 0 )
+    {
+      return metric;
+    }
+    metric = metric->next;
+  }
+
+  return NULL;
+}
+
+static cosm_METRIC * Cosm_MetricCreate( u32 type, const ascii * name,
+  const ascii * help )
+{
+  /*
+    Find the metric called name, or add a new one of type.
+    Returns: The metric, or NULL if name is invalid, is used by another
+      type, or there is not enough memory.
+  */
+  cosm_METRIC * metric;
+  cosm_METRIC * found;
+  u32 i;
+
+  if ( Cosm_MetricName( name ) != COSM_PASS )
+  {
+    return NULL;
+  }
+
+  if ( ( found = Cosm_MetricFind( name ) ) != NULL )
+  {
+    return ( found->type == type ) ? found : NULL;
+  }
+
+  if ( ( metric = CosmMemAlloc( sizeof( cosm_METRIC ) ) ) == NULL )
+  {
+    return NULL;
+  }
+  if ( ( type == COSM_METRIC_HISTOGRAM ) && ( ( metric->buckets =
+    CosmMemAlloc( COSM_METRIC_BUCKETS * sizeof( u64 ) ) ) == NULL ) )
+  {
+    CosmMemFree( metric );
+    return NULL;
+  }
+  metric->type = type;
+  CosmStrCopy( metric->name, name, COSM_METRIC_NAME_MAX );
+
+  /* help is a single line, with no escapes needed when it's written */
+  if ( help != NULL )
+  {
+    for ( i = 0 ; ( help[i] != 0 ) && ( i < COSM_METRIC_HELP_MAX - 1 ) ;
+      i++ )
+    {
+      metric->help[i] = ( ( (u8) help[i] < 0x20 ) || ( help[i] == '\\' ) )
+        ? ' ' : help[i];
+    }
+  }
+
+  /* creating is rare, so spin for the lock */
+  while ( CosmAtomicAdd32( &__cosm_metrics_lock, 1 ) != 1 )
+  {
+    CosmAtomicAdd32( &__cosm_metrics_lock, -1 );
+    CosmYield();
+  }
+
+  /* another thread may have made it while we built ours */
+  if ( ( found = Cosm_MetricFind( name ) ) == NULL )
+  {
+    metric->next = __cosm_metrics;
+    CosmAtomicStorePtr( (void **) &__cosm_metrics, metric );
+  }
+
+  CosmAtomicAdd32( &__cosm_metrics_lock, -1 );
+
+  if ( found != NULL )
+  {
+    CosmMemFree( metric->buckets );
+    CosmMemFree( metric );
+    return ( found->type == type ) ? found : NULL;
+  }
+
+  return metric;
+}
+
+static u32 Cosm_MetricBucket( u64 value )
+{
+  /*
+    Buckets 0-31 hold the values 0-31 exactly. Past that each power of two
+    is split into COSM_METRIC_SUB buckets, found from the top 5 bits.
+    Returns: The bucket for value.
+  */
+  u32 shift;
+
+  if ( value < 2 * COSM_METRIC_SUB )
+  {
+    return (u32) value;
+  }
+
+  shift = 0;
+  while ( ( value >> shift ) >= ( ( 2 * COSM_METRIC_SUB ) << 8 ) )
+  {
+    shift += 8;
+  }
+  while ( ( value >> shift ) >= 2 * COSM_METRIC_SUB )
+  {
+    shift++;
+  }
+
+  return ( shift * COSM_METRIC_SUB ) + (u32) ( value >> shift );
+}
+
+static u64 Cosm_MetricBucketTop( u32 bucket )
+{
+  /*
+    Returns: The largest value that goes in the bucket.
+  */
+  u32 shift;
+
+  if ( bucket < 2 * COSM_METRIC_SUB )
+  {
+    return (u64) bucket;
+  }
+
+  shift = ( bucket / COSM_METRIC_SUB ) - 1;
+
+  return ( (u64) ( ( bucket % COSM_METRIC_SUB ) + COSM_METRIC_SUB )
+    << shift ) + ( ( (u64) 1 << shift ) - 1 );
+}
+
+static u64 Cosm_MetricRank( cosm_METRIC * histogram, u64 * count,
+  u32 per_mille )
+{
+  /*
+    Walk the buckets for the value at per_mille. count is set to the
+    number of values seen, other threads may add more as we go.
+    Returns: The top of the bucket holding the value, or 0 if empty.
+  */
+  u64 total, rank, seen;
+  u32 i;
+
+  total = 0;
+  for ( i = 0 ; i < COSM_METRIC_BUCKETS ; i++ )
+  {
+    total += CosmAtomicLoad64( &histogram->buckets[i] );
+  }
+  *count = total;
+  if ( total == 0 )
+  {
+    return 0;
+  }
+
+  if ( per_mille > 1000 )
+  {
+    per_mille = 1000;
+  }
+  /* ceil( total * per_mille / 1000 ) without overflowing */
+  rank = ( total / 1000 ) * per_mille
+    + ( ( total % 1000 ) * per_mille + 999 ) / 1000;
+  if ( rank == 0 )
+  {
+    rank = 1;
+  }
+
+  seen = 0;
+  for ( i = 0 ; i < COSM_METRIC_BUCKETS ; i++ )
+  {
+    seen += CosmAtomicLoad64( &histogram->buckets[i] );
+    if ( seen >= rank )
+    {
+      return Cosm_MetricBucketTop( i );
+    }
+  }
+
+  return Cosm_MetricBucketTop( COSM_METRIC_BUCKETS - 1 );
+}
+
+cosm_METRIC * CosmMetricCounter( const ascii * name, const ascii * help )
+{
+  return Cosm_MetricCreate( COSM_METRIC_COUNTER, name, help );
+}
+
+cosm_METRIC * CosmMetricGauge( const ascii * name, const ascii * help )
+{
+  return Cosm_MetricCreate( COSM_METRIC_GAUGE, name, help );
+}
+
+cosm_METRIC * CosmMetricHistogram( const ascii * name, const ascii * help )
+{
+  return Cosm_MetricCreate( COSM_METRIC_HISTOGRAM, name, help );
+}
+
+void CosmMetricAdd( cosm_METRIC * metric, s64 add )
+{
+  if ( metric == NULL )
+  {
+    return;
+  }
+
+  if ( metric->type == COSM_METRIC_COUNTER )
+  {
+    CosmCounterAdd( &metric->total, add );
+  }
+  else if ( metric->type == COSM_METRIC_GAUGE )
+  {
+    (void) CosmAtomicAdd64( &metric->gauge, add );
+  }
+}
+
+void CosmMetricSet( cosm_METRIC * gauge, s64 value )
+{
+  if ( ( gauge == NULL ) || ( gauge->type != COSM_METRIC_GAUGE ) )
+  {
+    return;
+  }
+
+  CosmAtomicStore64( &gauge->gauge, (u64) value );
+}
+
+void CosmMetricRecord( cosm_METRIC * histogram, u64 value )
+{
+  if ( ( histogram == NULL ) || ( histogram->type != COSM_METRIC_HISTOGRAM ) )
+  {
+    return;
+  }
+
+  (void) CosmAtomicAdd64( &histogram->buckets[Cosm_MetricBucket( value )],
+    1 );
+  CosmCounterAdd( &histogram->total, (s64) value );
+}
+
+s64 CosmMetricValue( cosm_METRIC * metric )
+{
+  u64 count;
+
+  if ( metric == NULL )
+  {
+    return 0;
+  }
+
+  switch ( metric->type )
+  {
+    case COSM_METRIC_COUNTER:
+      return CosmCounterRead( &metric->total );
+    case COSM_METRIC_GAUGE:
+      return (s64) CosmAtomicLoad64( &metric->gauge );
+    case COSM_METRIC_HISTOGRAM:
+      (void) Cosm_MetricRank( metric, &count, 0 );
+      return (s64) count;
+    default:
+      return 0;
+  }
+}
+
+u64 CosmMetricQuantile( cosm_METRIC * histogram, u32 per_mille )
+{
+  u64 count;
+
+  if ( ( histogram == NULL ) || ( histogram->type != COSM_METRIC_HISTOGRAM ) )
+  {
+    return 0;
+  }
+
+  return Cosm_MetricRank( histogram, &count, per_mille );
+}
+
+static s32 Cosm_MetricLine( cosm_BUFFER * buffer, const ascii * format,
+  ... )
+{
+  /*
+    Print one line of the dump onto the end of the buffer.
+    Returns: COSM_PASS on success, or COSM_FAIL on failure.
+  */
+  ascii line[COSM_METRIC_LINE];
+  va_list args;
+  u32 length;
+
+  va_start( args, format );
+  length = Cosm_Print( NULL, line, sizeof( line ), format, args );
+  va_end( args );
+
+  if ( ( length == 0 ) || ( length >= sizeof( line ) ) )
+  {
+    return COSM_FAIL;
+  }
+
+  return ( CosmBufferPut( buffer, line, length ) == COSM_PASS )
+    ? COSM_PASS : COSM_FAIL;
+}
+
+static s32 Cosm_MetricHead( cosm_BUFFER * buffer, const ascii * name,
+  const ascii * help, const ascii * type )
+{
+  /*
+    Write the HELP and TYPE lines for a metric.
+    Returns: COSM_PASS on success, or COSM_FAIL on failure.
+  */
+  if ( ( help[0] != 0 ) && ( Cosm_MetricLine( buffer, "# HELP %.*s %.*s\n",
+    COSM_METRIC_NAME_MAX, name, COSM_METRIC_HELP_MAX, help ) != COSM_PASS ) )
+  {
+    return COSM_FAIL;
+  }
+
+  return Cosm_MetricLine( buffer, "# TYPE %.*s %.*s\n",
+    COSM_METRIC_NAME_MAX, name, 16, type );
+}
+
+static s32 Cosm_MetricTotal( cosm_BUFFER * buffer, const ascii * name,
+  const ascii * help, s64 value, u32 type )
+{
+  /*
+    Write a whole counter or gauge, only gauges can be negative.
+    Returns: COSM_PASS on success, or COSM_FAIL on failure.
+  */
+  if ( type == COSM_METRIC_GAUGE )
+  {
+    if ( ( Cosm_MetricHead( buffer, name, help, "gauge" ) != COSM_PASS )
+      || ( Cosm_MetricLine( buffer, "%.*s %j\n", COSM_METRIC_NAME_MAX, name,
+      value ) != COSM_PASS ) )
+    {
+      return COSM_FAIL;
+    }
+  }
+  else if ( ( Cosm_MetricHead( buffer, name, help, "counter" ) != COSM_PASS )
+    || ( Cosm_MetricLine( buffer, "%.*s %v\n", COSM_METRIC_NAME_MAX, name,
+    (u64) value ) != COSM_PASS ) )
+  {
+    return COSM_FAIL;
+  }
+
+  return COSM_PASS;
+}
+
+s32 CosmMetricsDump( cosm_BUFFER * buffer )
+{
+  static const u32 quantiles[4] = { 500, 900, 990, 999 };
+  static const ascii * labels[4] = { "0.5", "0.9", "0.99", "0.999" };
+  cosm_METRIC * metric;
+  u64 values[6];
+  u64 count;
+  u32 i;
+
+  if ( buffer == NULL )
+  {
+    return COSM_FAIL;
+  }
+
+  /* the memory and network layers can't use metrics, so ask them */
+  CosmMemCounters( &values[0], &values[1], &values[2] );
+  CosmNetCounters( &values[3], &values[4], &values[5] );
+  if ( ( Cosm_MetricTotal( buffer, "cosm_mem_allocs_total",
+    "Heap allocations made.", (s64) values[0],
+    COSM_METRIC_COUNTER ) != COSM_PASS )
+    || ( Cosm_MetricTotal( buffer, "cosm_mem_frees_total",
+    "Heap allocations freed.", (s64) values[1],
+    COSM_METRIC_COUNTER ) != COSM_PASS )
+    || ( Cosm_MetricTotal( buffer, "cosm_mem_bytes",
+    "Heap bytes allocated now.", (s64) values[2],
+    COSM_METRIC_GAUGE ) != COSM_PASS )
+    || ( Cosm_MetricTotal( buffer, "cosm_net_sent_bytes_total",
+    "Bytes sent on all connections.", (s64) values[3],
+    COSM_METRIC_COUNTER ) != COSM_PASS )
+    || ( Cosm_MetricTotal( buffer, "cosm_net_received_bytes_total",
+    "Bytes received on all connections.", (s64) values[4],
+    COSM_METRIC_COUNTER ) != COSM_PASS )
+    || ( Cosm_MetricTotal( buffer, "cosm_net_syscalls_total",
+    "Socket system calls made.", (s64) values[5],
+    COSM_METRIC_COUNTER ) != COSM_PASS ) )
+  {
+    return COSM_FAIL;
+  }
+
+  metric = (cosm_METRIC *)
+    CosmAtomicLoadPtr( (void * const *) &__cosm_metrics );
+  while ( metric != NULL )
+  {
+    switch ( metric->type )
+    {
+      case COSM_METRIC_COUNTER:
+      case COSM_METRIC_GAUGE:
+        if ( Cosm_MetricTotal( buffer, metric->name, metric->help,
+          CosmMetricValue( metric ), metric->type ) != COSM_PASS )
+        {
+          return COSM_FAIL;
+        }
+        break;
+      case COSM_METRIC_HISTOGRAM:
+        if ( Cosm_MetricHead( buffer, metric->name, metric->help,
+          "summary" ) != COSM_PASS )
+        {
+          return COSM_FAIL;
+        }
+        for ( i = 0 ; i < 4 ; i++ )
+        {
+          if ( Cosm_MetricLine( buffer, "%.*s{quantile=\"%.*s\"} %v\n",
+            COSM_METRIC_NAME_MAX, metric->name, 8, labels[i],
+            Cosm_MetricRank( metric, &count, quantiles[i] ) ) != COSM_PASS )
+          {
+            return COSM_FAIL;
+          }
+        }
+        if ( ( Cosm_MetricLine( buffer, "%.*s_sum %v\n",
+          COSM_METRIC_NAME_MAX, metric->name,
+          (u64) CosmCounterRead( &metric->total ) ) != COSM_PASS )
+          || ( Cosm_MetricLine( buffer, "%.*s_count %v\n",
+          COSM_METRIC_NAME_MAX, metric->name, count ) != COSM_PASS ) )
+        {
+          return COSM_FAIL;
+        }
+        break;
+    }
+    metric = metric->next;
+  }
+
+  return COSM_PASS;
+}
+
+/* testing */
+
+typedef struct cosm_METRIC_TEST
+{
+  cosm_METRIC * counter;
+  u32 done;
+} cosm_METRIC_TEST;
+
+static void Cosm_MetricTestAdd( void * arg )
+{
+  /*
+    Thread for the counter test, adds 1 many times.
+    Returns: nothing.
+  */
+  cosm_METRIC_TEST * test;
+  u32 i;
+
+  test = (cosm_METRIC_TEST *) arg;
+  for ( i = 0 ; i < 100000 ; i++ )
+  {
+    CosmMetricAdd( test->counter, 1 );
+  }
+  CosmAtomicAdd32( &test->done, 1 );
+
+  CosmThreadEnd();
+}
+
+s32 Cosm_TestMetrics( void )
+{
+  cosm_METRIC * counter, * gauge, * histogram, * edges;
+  cosm_METRIC_TEST test;
+  cosm_BUFFER buffer;
+  ascii * dump;
+  u64 thread_id;
+  u64 length;
+  s64 start;
+  u64 value;
+  u32 i;
+
+  /* names */
+  if ( ( CosmMetricCounter( "", NULL ) != NULL )
+    || ( CosmMetricCounter( "1_total", NULL ) != NULL )
+    || ( CosmMetricCounter( "bad-name_total", NULL ) != NULL )
+    || ( CosmMetricCounter( "cosm_test_name_that_is_far_too_long_to_be_"
+    "used_as_a_metric_name_total", NULL ) != NULL ) )
+  {
+    return -1;
+  }
+
+  counter = CosmMetricCounter( "cosm_test_total", "Test counter." );
+  if ( ( counter == NULL )
+    || ( CosmMetricCounter( "cosm_test_total", NULL ) != counter )
+    || ( CosmMetricGauge( "cosm_test_total", NULL ) != NULL ) )
+  {
+    return -2;
+  }
+
+  /* counters and gauges */
+  start = CosmMetricValue( counter );
+  CosmMetricAdd( counter, 5 );
+  CosmMetricAdd( counter, 7 );
+  CosmMetricAdd( NULL, 1 );
+  if ( CosmMetricValue( counter ) != start + 12 )
+  {
+    return -3;
+  }
+
+  gauge = CosmMetricGauge( "cosm_test_level", "Test gauge.\nSecond line." );
+  CosmMetricSet( gauge, 10 );
+  CosmMetricAdd( gauge, -13 );
+  CosmMetricSet( counter, 1 );
+  if ( ( gauge == NULL ) || ( CosmMetricValue( gauge ) != -3 )
+    || ( CosmMetricValue( counter ) != start + 12 ) )
+  {
+    return -4;
+  }
+
+  /* histograms */
+  histogram = CosmMetricHistogram( "cosm_test_nanoseconds",
+    "Test histogram." );
+  if ( ( histogram == NULL ) || ( CosmMetricQuantile( histogram, 500 ) != 0 )
+    || ( CosmMetricValue( histogram ) != 0 ) )
+  {
+    return -5;
+  }
+  for ( i = 1 ; i <= 1000 ; i++ )
+  {
+    CosmMetricRecord( histogram, i * 1000 );
+  }
+  if ( CosmMetricValue( histogram ) != 1000 )
+  {
+    return -6;
+  }
+  value = CosmMetricQuantile( histogram, 500 );
+  if ( ( value < 500000 ) || ( value > 500000 + 500000 / 16 ) )
+  {
+    return -7;
+  }
+  value = CosmMetricQuantile( histogram, 999 );
+  if ( ( value < 999000 ) || ( value > 999000 + 999000 / 16 ) )
+  {
+    return -8;
+  }
+
+  /* every bucket edge goes back to itself */
+  for ( i = 0 ; i < COSM_METRIC_BUCKETS ; i++ )
+  {
+    if ( ( Cosm_MetricBucket( Cosm_MetricBucketTop( i ) ) != i )
+      || ( ( i > 0 ) && ( Cosm_MetricBucket( Cosm_MetricBucketTop( i - 1 )
+      + 1 ) != i ) ) )
+    {
+      return -9;
+    }
+  }
+  edges = CosmMetricHistogram( "cosm_test_edges", NULL );
+  CosmMetricRecord( edges, 0 );
+  CosmMetricRecord( edges, 0xFFFFFFFFFFFFFFFFLL );
+  if ( ( CosmMetricQuantile( edges, 1 ) != 0 )
+    || ( CosmMetricQuantile( edges, 1000 ) != 0xFFFFFFFFFFFFFFFFLL ) )
+  {
+    return -10;
+  }
+
+  /* threads all adding to one counter lose nothing */
+  start = CosmMetricValue( counter );
+  test.counter = counter;
+  test.done = 0;
+  for ( i = 0 ; i < 4 ; i++ )
+  {
+    if ( CosmThreadBegin( &thread_id, Cosm_MetricTestAdd, &test,
+      64 * 1024 ) != COSM_PASS )
+    {
+      return -11;
+    }
+  }
+  while ( CosmAtomicLoad32( &test.done ) < 4 )
+  {
+    CosmSleep( 1 );
+  }
+  if ( CosmMetricValue( counter ) != start + 400000 )
+  {
+    return -12;
+  }
+
+  /* dump */
+  CosmMemSet( &buffer, sizeof( buffer ), 0 );
+  if ( CosmBufferInit( &buffer, 4096, COSM_BUFFER_MODE_QUEUE, 4096,
+    NULL, 0 ) != COSM_PASS )
+  {
+    return -13;
+  }
+  if ( ( CosmMetricsDump( &buffer ) != COSM_PASS )
+    || ( ( length = CosmBufferLength( &buffer ) ) == 0 )
+    || ( ( dump = CosmMemAlloc( length + 1 ) ) == NULL ) )
+  {
+    CosmBufferFree( &buffer );
+    return -14;
+  }
+  CosmBufferGet( dump, length, &buffer );
+  CosmBufferFree( &buffer );
+  if ( ( CosmStrStr( dump, "\n# TYPE cosm_test_total counter\n"
+    "cosm_test_total ", (u32) length + 1 ) == NULL )
+    || ( CosmStrStr( dump, "# HELP cosm_test_level Test gauge. Second line.\n"
+    "# TYPE cosm_test_level gauge\ncosm_test_level -3\n",
+    (u32) length + 1 ) == NULL )
+    || ( CosmStrStr( dump, "\ncosm_test_nanoseconds{quantile=\"0.5\"} ",
+    (u32) length + 1 ) == NULL )
+    || ( CosmStrStr( dump, "\ncosm_test_nanoseconds_sum 500500000\n"
+    "cosm_test_nanoseconds_count 1000\n", (u32) length + 1 ) == NULL )
+    || ( CosmStrStr( dump, "# TYPE cosm_mem_allocs_total counter\n",
+    (u32) length + 1 ) == NULL ) )
+  {
+    CosmMemFree( dump );
+    return -15;
+  }
+  CosmMemFree( dump );
+
+  return COSM_PASS;
+}
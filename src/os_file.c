@@ -41,9 +41,25 @@
 #include <unistd.h>    /* for stat, close, read, write, lseek, ftruncate */
 #include <sys/file.h>  /* for flock */
 #include <sys/mman.h>  /* for mmap, munmap */
+#include <sys/uio.h>   /* for preadv, pwritev */
 #define COSM_FILE_PATHMODE COSM_FILE_PATH_UNIX
 #endif
 
+#if ( OS_TYPE == OS_LINUX )
+#include <sys/syscall.h>  /* for getdents64, io_uring_setup, io_uring_enter */
+#include <sys/inotify.h>
+#include <poll.h>
+#include <time.h>         /* for clock_gettime */
+#endif
+
+#if ( ( OS_TYPE == OS_LINUX ) && defined( __GNUC__ ) && !defined( NO_URING ) )
+#include <linux/io_uring.h>
+#if ( defined( __NR_io_uring_setup ) && defined( IORING_FEAT_RW_CUR_POS ) )
+/* async requests can be handed to the kernel */
+#define COSM_FILE_HAVE_URING
+#endif
+#endif
+
 /* Setup the size of file handle ( not the max size of a file ) */
 #if 0
   /* int, off_t, size_t ans ssize_t are 64 bits */
@@ -82,7 +98,7 @@ s32 CosmFileOpen( cosm_FILE * file, const ascii * filename,
   /* Check if mode is valid */
   if ( mode & ~( COSM_FILE_MODE_EXIST | COSM_FILE_MODE_READ | COSM_FILE_MODE_WRITE |
     COSM_FILE_MODE_APPEND | COSM_FILE_MODE_CREATE | COSM_FILE_MODE_TRUNCATE |
-    COSM_FILE_MODE_SYNC ) )
+    COSM_FILE_MODE_SYNC | COSM_FILE_MODE_NOBUFFER ) )
   {
     return COSM_FILE_ERROR_MODE;
   }
@@ -121,6 +137,15 @@ s32 CosmFileOpen( cosm_FILE * file, const ascii * filename,
   file->mode = mode;
   file->lockmode = lock;
 
+  /* the buffer is only allocated once it's used */
+  file->buffer = NULL;
+  file->buffer_size = ( mode & COSM_FILE_MODE_NOBUFFER ) ? 0
+    : COSM_FILE_BUFFER_SIZE;
+  file->buffer_state = COSM_FILE_BUFFER_EMPTY;
+  file->buffer_start = 0;
+  file->buffer_end = 0;
+  file->buffer_offset = 0;
+
   /* check for existance only */
   if ( ( mode & COSM_FILE_MODE_EXIST ) == COSM_FILE_MODE_EXIST )
   {
@@ -303,8 +328,13 @@ s32 CosmFileOpen( cosm_FILE * file, const ascii * filename,
   return COSM_PASS;
 }
 
-s32 CosmFileRead( void * buffer, u64 * bytes_read, cosm_FILE * file, u64 length )
+static s32 Cosm_FileReadOS( void * buffer, u64 * bytes_read, cosm_FILE * file,
+  u64 length )
 {
+  /*
+    Read straight from the OS, the body of an unbuffered CosmFileRead.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
 #if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
   DWORD this_read, chunk;
   u64 remaining = length, total_read;
@@ -343,16 +373,6 @@ s32 CosmFileRead( void * buffer, u64 * bytes_read, cosm_FILE * file, u64 length
 
   *bytes_read = 0;
 
-  if ( ( file == NULL ) || ( bytes_read == NULL ) )
-  {
-    return COSM_FILE_ERROR_PARAM;
-  }
-
-  if ( file->status != COSM_FILE_STATUS_OPEN )
-  {
-    return COSM_FILE_ERROR_CLOSED;
-  }
-
   error = COSM_PASS;
 
 #if ( defined( COSM_FILE64 ) )
@@ -389,131 +409,322 @@ s32 CosmFileRead( void * buffer, u64 * bytes_read, cosm_FILE * file, u64 length
   return COSM_PASS;
 }
 
-s32 CosmFileWrite( cosm_FILE * file, u64 * bytes_written,
-  const void * const buffer, u64 length )
+static void Cosm_FileBufferDrop( cosm_FILE * file )
 {
-  *bytes_written = (u64) 0;
+  /*
+    Forget what is in the buffer, without touching the file.
+    Returns: nothing.
+  */
+  file->buffer_state = COSM_FILE_BUFFER_EMPTY;
+  file->buffer_start = 0;
+  file->buffer_end = 0;
+}
 
-  if ( ( file == NULL ) || ( bytes_written == NULL ) )
+static s32 Cosm_FileBufferSync( cosm_FILE * file )
+{
+  /*
+    Bring the file in line with the buffer and empty it. Waiting writes are
+    made, and unused read-ahead is given back by seeking to where the
+    caller has read to.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+  u64 done, written;
+  s32 error;
+
+  error = COSM_PASS;
+  if ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
   {
-    return COSM_FILE_ERROR_PARAM;
+    for ( done = 0 ; done < (u64) file->buffer_end ; done += written )
+    {
+      if ( ( error = Cosm_FileWrite( file, &written, &file->buffer[done],
+        (u64) file->buffer_end - done ) ) != COSM_PASS )
+      {
+        break;
+      }
+      if ( written == 0 )
+      {
+        error = COSM_FILE_ERROR_NOSPACE;
+        break;
+      }
+    }
+  }
+  else if ( ( file->buffer_state == COSM_FILE_BUFFER_READ )
+    && ( file->buffer_start < file->buffer_end ) )
+  {
+    error = Cosm_FileSeek( file, file->buffer_offset
+      + (u64) file->buffer_start );
   }
 
-  if ( file->status != COSM_FILE_STATUS_OPEN )
+  /* a failed write is not retried, the data is lost either way */
+  Cosm_FileBufferDrop( file );
+
+  return error;
+}
+
+static u32 Cosm_FileBufferReady( cosm_FILE * file )
+{
+  /*
+    Allocate the buffer if needed. Without the memory for one the file just
+    becomes unbuffered.
+    Returns: The buffer size, 0 if unbuffered.
+  */
+  if ( ( file->buffer == NULL ) && ( file->buffer_size != 0 ) )
   {
-    return COSM_FILE_ERROR_CLOSED;
+    if ( ( file->buffer = CosmMemAlloc( (u64) file->buffer_size ) ) == NULL )
+    {
+      file->buffer_size = 0;
+    }
   }
 
-  return Cosm_FileWrite( file, bytes_written, buffer, length );
+  return file->buffer_size;
 }
 
-s32 CosmFileSeek( cosm_FILE * file, u64 offset )
+static s32 Cosm_FileBufferFill( cosm_FILE * file )
 {
-  if ( file == NULL )
+  /*
+    Refill the empty buffer with read-ahead, noting where it came from.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+  u64 got;
+  s32 error;
+
+  Cosm_FileBufferDrop( file );
+  if ( ( error = Cosm_FileTell( &file->buffer_offset, file ) ) != COSM_PASS )
   {
-    return COSM_FILE_ERROR_NOTFOUND;
+    return error;
   }
 
-  if ( file->status != COSM_FILE_STATUS_OPEN )
+  error = Cosm_FileReadOS( file->buffer, &got, file,
+    (u64) file->buffer_size );
+  if ( got > 0 )
   {
-    return COSM_FILE_ERROR_CLOSED;
+    file->buffer_state = COSM_FILE_BUFFER_READ;
+    file->buffer_end = (u32) got;
   }
 
-  return Cosm_FileSeek( file, offset );
+  return error;
 }
 
-s32 CosmFileTell( u64 * offset, cosm_FILE * file )
+s32 CosmFileRead( void * buffer, u64 * bytes_read, cosm_FILE * file,
+  u64 length )
 {
-  u64 len;
-  s32 result;
+  u8 * data;
+  u64 got, take;
+  s32 error;
 
-  if ( file == NULL )
+  if ( ( file == NULL ) || ( bytes_read == NULL ) )
   {
-    return COSM_FILE_ERROR_NOTFOUND;
+    return COSM_FILE_ERROR_PARAM;
   }
 
+  *bytes_read = 0;
+
   if ( file->status != COSM_FILE_STATUS_OPEN )
   {
     return COSM_FILE_ERROR_CLOSED;
   }
 
-  if ( ( result = Cosm_FileTell( &len, file ) ) == COSM_PASS )
+  if ( ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
+    && ( ( error = Cosm_FileBufferSync( file ) ) != COSM_PASS ) )
   {
-    *(offset) = len;
+    return error;
   }
 
-  return result;
+  if ( Cosm_FileBufferReady( file ) == 0 )
+  {
+    return Cosm_FileReadOS( buffer, bytes_read, file, length );
+  }
+
+  data = (u8 *) buffer;
+  while ( *bytes_read < length )
+  {
+    if ( file->buffer_state == COSM_FILE_BUFFER_READ )
+    {
+      /* take what was read ahead */
+      take = (u64) ( file->buffer_end - file->buffer_start );
+      if ( take > ( length - *bytes_read ) )
+      {
+        take = length - *bytes_read;
+      }
+      CosmMemCopy( &data[*bytes_read], &file->buffer[file->buffer_start],
+        take );
+      file->buffer_start += (u32) take;
+      *bytes_read += take;
+      if ( file->buffer_start == file->buffer_end )
+      {
+        /* used up, the file offset is where the caller is */
+        Cosm_FileBufferDrop( file );
+      }
+      continue;
+    }
+
+    if ( ( length - *bytes_read ) >= (u64) file->buffer_size )
+    {
+      /* big reads would only be copied through the buffer */
+      error = Cosm_FileReadOS( &data[*bytes_read], &got, file,
+        length - *bytes_read );
+      *bytes_read += got;
+      return error;
+    }
+
+    if ( ( error = Cosm_FileBufferFill( file ) ) != COSM_PASS )
+    {
+      return error;
+    }
+    if ( file->buffer_state != COSM_FILE_BUFFER_READ )
+    {
+      /* end of file */
+      break;
+    }
+  }
+
+  return COSM_PASS;
 }
 
-s32 CosmFileEOF( cosm_FILE * file )
+s32 CosmFileReadLine( utf8 * buffer, u64 * bytes_read, cosm_FILE * file,
+  u64 length )
 {
-  u64 current;
-  u64 real;
-  s32 result;
+  u64 got, take, scan;
+  s32 error;
 
-  if ( file == NULL )
+  if ( ( buffer == NULL ) || ( bytes_read == NULL ) || ( file == NULL )
+    || ( length == 0 ) )
   {
-    return COSM_FILE_ERROR_NOTFOUND;
+    return COSM_FILE_ERROR_PARAM;
   }
 
+  *bytes_read = 0;
+  buffer[0] = 0;
+
   if ( file->status != COSM_FILE_STATUS_OPEN )
   {
     return COSM_FILE_ERROR_CLOSED;
   }
 
-  if ( ( result = Cosm_FileTell( &current , file ) ) != COSM_PASS )
+  if ( ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
+    && ( ( error = Cosm_FileBufferSync( file ) ) != COSM_PASS ) )
   {
-    return result;
+    return error;
   }
 
-  if ( ( result = Cosm_FileLength( &real, file ) ) != COSM_PASS )
+  error = COSM_PASS;
+  if ( Cosm_FileBufferReady( file ) == 0 )
   {
-    return result;
+    /* no read-ahead allowed, so a byte at a time */
+    while ( *bytes_read < ( length - 1 ) )
+    {
+      if ( ( ( error = Cosm_FileReadOS( &buffer[*bytes_read], &got, file,
+        1 ) ) != COSM_PASS ) || ( got == 0 ) )
+      {
+        break;
+      }
+      if ( buffer[(*bytes_read)++] == '\n' )
+      {
+        break;
+      }
+    }
+  }
+  else
+  {
+    while ( *bytes_read < ( length - 1 ) )
+    {
+      if ( ( file->buffer_state != COSM_FILE_BUFFER_READ )
+        && ( ( ( error = Cosm_FileBufferFill( file ) ) != COSM_PASS )
+        || ( file->buffer_state != COSM_FILE_BUFFER_READ ) ) )
+      {
+        break;
+      }
+      take = (u64) ( file->buffer_end - file->buffer_start );
+      if ( take > ( length - 1 - *bytes_read ) )
+      {
+        take = length - 1 - *bytes_read;
+      }
+      scan = Cosm_MemScan( &file->buffer[file->buffer_start], '\n', '\n',
+        take );
+      if ( scan < take )
+      {
+        take = scan + 1;
+      }
+      CosmMemCopy( &buffer[*bytes_read], &file->buffer[file->buffer_start],
+        take );
+      file->buffer_start += (u32) take;
+      *bytes_read += take;
+      if ( file->buffer_start == file->buffer_end )
+      {
+        Cosm_FileBufferDrop( file );
+      }
+      if ( scan < take )
+      {
+        break;
+      }
+    }
   }
+  buffer[*bytes_read] = 0;
 
-  /* We compare file size and current position to know if we are at EOF */
-  if ( current == real )
+  if ( error != COSM_PASS )
+  {
+    return error;
+  }
+
+  if ( ( *bytes_read == 0 ) && ( length > 1 ) )
   {
     return COSM_FILE_ERROR_EOF;
   }
 
-  /* not EOF */
   return COSM_PASS;
 }
 
-s32 CosmFileLength( u64 * length, cosm_FILE * file )
+s32 CosmFileWrite( cosm_FILE * file, u64 * bytes_written,
+  const void * const buffer, u64 length )
 {
-  s32 result;
-  u64 len;
+  s32 error;
 
-  if ( file == NULL )
+  if ( ( file == NULL ) || ( bytes_written == NULL ) )
   {
-    return COSM_FILE_ERROR_NOTFOUND;
+    return COSM_FILE_ERROR_PARAM;
   }
 
+  *bytes_written = (u64) 0;
+
   if ( file->status != COSM_FILE_STATUS_OPEN )
   {
     return COSM_FILE_ERROR_CLOSED;
   }
 
-  if ( ( result = Cosm_FileLength( &len, file ) ) != COSM_PASS )
+  /* writes go where the caller has read to, not past the read-ahead */
+  if ( ( file->buffer_state == COSM_FILE_BUFFER_READ )
+    && ( ( error = Cosm_FileBufferSync( file ) ) != COSM_PASS ) )
   {
-    return result;
+    return error;
   }
 
-  *(length) = len;
+  if ( ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
+    && ( ( (u64) file->buffer_end + length ) > (u64) file->buffer_size )
+    && ( ( error = Cosm_FileBufferSync( file ) ) != COSM_PASS ) )
+  {
+    return error;
+  }
 
+  if ( ( file->mode & COSM_FILE_MODE_SYNC )
+    || ( length >= (u64) file->buffer_size )
+    || ( Cosm_FileBufferReady( file ) == 0 ) )
+  {
+    return Cosm_FileWrite( file, bytes_written, buffer, length );
+  }
+
+  CosmMemCopy( &file->buffer[file->buffer_end], buffer, length );
+  file->buffer_end += (u32) length;
+  file->buffer_state = COSM_FILE_BUFFER_WRITE;
+  *bytes_written = length;
 
   return COSM_PASS;
 }
 
-s32 CosmFileTruncate( cosm_FILE * file, u64 length )
+s32 CosmFileFlush( cosm_FILE * file )
 {
-  s32 result;
-
   if ( file == NULL )
   {
-    return COSM_FILE_ERROR_NOTFOUND;
+    return COSM_FILE_ERROR_PARAM;
   }
 
   if ( file->status != COSM_FILE_STATUS_OPEN )
@@ -521,296 +732,2442 @@ s32 CosmFileTruncate( cosm_FILE * file, u64 length )
     return COSM_FILE_ERROR_CLOSED;
   }
 
-  if ( ( result = Cosm_FileTruncate( file, length ) ) != COSM_PASS )
+  if ( file->buffer_state != COSM_FILE_BUFFER_WRITE )
   {
-    return result;
+    return COSM_PASS;
   }
 
-  return COSM_PASS;
+  return Cosm_FileBufferSync( file );
 }
 
-s32 CosmFileDelete( const ascii * filename )
+s32 CosmFileBuffer( cosm_FILE * file, u32 size )
 {
-  cosm_FILENAME native_filename;
-  cosm_FILE wipe_file;
   s32 error;
 
-  /* Convert slashs to native format and put it into native_filename */
-  if ( Cosm_FileNativePath( native_filename, filename ) != COSM_PASS )
+  if ( file == NULL )
   {
-    return COSM_FILE_ERROR_NAME;
+    return COSM_FILE_ERROR_PARAM;
   }
 
-  /* open the file for write only, exclusive access, and zero out */
-  CosmMemSet( &wipe_file, sizeof( cosm_FILE ), 0 );
-  error = CosmFileOpen( &wipe_file, filename, COSM_FILE_MODE_WRITE |
-    COSM_FILE_MODE_SYNC, COSM_FILE_LOCK_WRITE );
-  if ( error != COSM_PASS )
+  if ( file->status != COSM_FILE_STATUS_OPEN )
   {
-    if ( error == COSM_FILE_ERROR_NOTFOUND )
-    {
-      /* no such file */
-      return COSM_PASS;
-    }
-    else
-    {
-      return error;
-    }
+    return COSM_FILE_ERROR_CLOSED;
   }
 
-  if ( ( error = Cosm_FileWipe( &wipe_file, 0 ) ) != COSM_PASS )
+  if ( ( error = Cosm_FileBufferSync( file ) ) != COSM_PASS )
   {
     return error;
   }
 
-  CosmFileClose( &wipe_file );
+  CosmMemFree( file->buffer );
+  file->buffer = NULL;
+  file->buffer_size = size;
 
-  if ( remove( (const char *) native_filename ) != 0 )
+  return COSM_PASS;
+}
+
+static s32 Cosm_FileCheckAt( u64 * total, cosm_FILE * file,
+  const cosm_FILE_VECTOR * vector, u32 count, u64 offset, u32 write )
+{
+  /*
+    Check the parameters and file for the positional calls, total up the
+    bytes in vector, and bring the file in line with its buffer so the
+    positional call sees and keeps the order of earlier writes. A write
+    also drops the read-ahead, which it may make stale.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+  u32 i;
+
+  if ( ( file == NULL ) || ( vector == NULL ) || ( count == 0 ) )
   {
-    if ( errno == ENOENT )
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  *total = 0;
+  for ( i = 0 ; i < count ; i++ )
+  {
+    if ( ( vector[i].data == NULL ) && ( vector[i].length > 0 ) )
     {
-      /* this should have been cought above */
-      return COSM_PASS;
+      return COSM_FILE_ERROR_PARAM;
     }
-    else /* EACCES */
+    *total += vector[i].length;
+  }
+
+  if ( file->status != COSM_FILE_STATUS_OPEN )
+  {
+    return COSM_FILE_ERROR_CLOSED;
+  }
+
+  if ( write )
+  {
+    if ( file->mode & COSM_FILE_MODE_APPEND )
     {
+      /* the OS would put every write at the end */
       return COSM_FILE_ERROR_DENIED;
     }
+    if ( ( file->mode & COSM_FILE_MODE_WRITE ) == 0 )
+    {
+      return COSM_FILE_ERROR_WRITEMODE;
+    }
+  }
+  else if ( ( file->mode & COSM_FILE_MODE_READ ) == 0 )
+  {
+    return COSM_FILE_ERROR_READMODE;
+  }
+
+#if ( !( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) ) \
+  && !defined( COSM_FILE64 ) )
+  if ( ( offset > 0x7FFFFFFFLL ) || ( *total > 0x7FFFFFFFLL - offset ) )
+  {
+    return COSM_FILE_ERROR_SEEK;
+  }
+#endif
+
+  if ( ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
+    || ( write && ( file->buffer_state == COSM_FILE_BUFFER_READ ) ) )
+  {
+    return Cosm_FileBufferSync( file );
   }
 
   return COSM_PASS;
 }
 
-s32 CosmFileInfo( cosm_FILE_INFO * info, const ascii * filename )
+static s32 Cosm_FileVectorAt( u64 * bytes, cosm_FILE * file,
+  const cosm_FILE_VECTOR * vector, u32 count, u64 offset, u32 write )
 {
+  /*
+    Read or write the buffers in vector at offset, looping until all of
+    them are done, the end of the file is reached, or there is an error.
+    Each OS call moves at most 1GiB.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
 #if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-  struct __stat64 buf;
+  OVERLAPPED position;
+  DWORD chunk, moved;
+  BOOL result;
 #else
-#if ( ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) ) \
-  && defined( __USE_LARGEFILE64 ) )
-#define _STAT stat64
+  struct iovec buffers[COSM_FILE_VECTORS];
+  ssize_t moved;
+  u64 from;
+  u32 used, last;
+  int handle;
+#endif
+  u64 length, skip;
+  u32 first;
+  s32 error;
+
+  *bytes = 0;
+  error = COSM_PASS;
+#if ( !( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) ) )
+#if ( defined( COSM_FILE64 ) )
+  handle = (int) file->handle;
 #else
-#define _STAT stat
+  handle = (int) (u32) file->handle;
 #endif
-  struct _STAT buf;
 #endif
+
+  /* skip is how much of vector[first] is done */
+  first = 0;
+  skip = 0;
+  while ( first < count )
+  {
+    if ( vector[first].length <= skip )
+    {
+      first++;
+      skip = 0;
+      continue;
+    }
+
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+    /* no scatter/gather for plain files, one buffer at a time */
+    length = vector[first].length - skip;
+    chunk = ( length > 0x40000000LL ) ? 0x40000000 : (DWORD) length;
+    CosmMemSet( &position, sizeof( position ), 0 );
+    position.Offset = (DWORD) ( offset + *bytes );
+    position.OffsetHigh = (DWORD) ( ( offset + *bytes ) >> 32 );
+    if ( write )
+    {
+      result = WriteFile( file->handle, (u8 *) vector[first].data + skip,
+        chunk, &moved, &position );
+    }
+    else
+    {
+      result = ReadFile( file->handle, (u8 *) vector[first].data + skip,
+        chunk, &moved, &position );
+    }
+    if ( result == 0 )
+    {
+      if ( write || ( GetLastError() != ERROR_HANDLE_EOF ) )
+      {
+        error = COSM_FILE_ERROR_DENIED;
+        break;
+      }
+      moved = 0;
+    }
+#else
+    for ( used = 0, last = first, from = skip ; ( last < count )
+      && ( used < COSM_FILE_VECTORS ) ; last++, from = 0 )
+    {
+      if ( ( length = vector[last].length - from ) == 0 )
+      {
+        continue;
+      }
+      buffers[used].iov_base = (u8 *) vector[last].data + from;
+      if ( length > 0x40000000LL )
+      {
+        /* nothing after a cut short buffer */
+        buffers[used++].iov_len = (size_t) 0x40000000;
+        break;
+      }
+      buffers[used++].iov_len = (size_t) length;
+    }
+
+    if ( write )
+    {
+      moved = pwritev( handle, buffers, (int) used,
+        (off_t) ( offset + *bytes ) );
+    }
+    else
+    {
+      moved = preadv( handle, buffers, (int) used,
+        (off_t) ( offset + *bytes ) );
+    }
+    if ( moved == -1 )
+    {
+      if ( errno == EINTR )
+      {
+        continue;
+      }
+      if ( errno == EACCES )
+      {
+        error = COSM_FILE_ERROR_DENIED;
+      }
+      else if ( ( errno == ENOSPC ) || ( errno == EFBIG ) )
+      {
+        error = COSM_FILE_ERROR_NOSPACE;
+      }
+      else
+      {
+        error = COSM_FILE_ERROR_NOTFOUND;
+      }
+      break;
+    }
+#endif /* OS */
+
+    if ( moved == 0 )
+    {
+      if ( write )
+      {
+        error = COSM_FILE_ERROR_NOSPACE;
+      }
+      break;
+    }
+
+    /* step past the finished buffers */
+    *bytes += (u64) moved;
+    length = (u64) moved + skip;
+    while ( ( first < count ) && ( length >= vector[first].length ) )
+    {
+      length -= vector[first].length;
+      first++;
+    }
+    skip = length;
+  }
+
+#if ( !( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) ) )
+  if ( write && ( *bytes > 0 )
+    && ( ( file->mode & COSM_FILE_MODE_SYNC ) == COSM_FILE_MODE_SYNC ) )
+  {
+    fsync( handle );
+  }
+#endif
+
+  return error;
+}
+
+s32 CosmFileReadAt( void * buffer, u64 * bytes_read, cosm_FILE * file,
+  u64 length, u64 offset )
+{
+  cosm_FILE_VECTOR vector;
+
+  if ( bytes_read == NULL )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  vector.data = buffer;
+  vector.length = length;
+
+  return CosmFileReadAtV( &vector, bytes_read, file, 1, offset );
+}
+
+s32 CosmFileWriteAt( cosm_FILE * file, u64 * bytes_written,
+  const void * const buffer, u64 length, u64 offset )
+{
+  cosm_FILE_VECTOR vector;
+
+  if ( bytes_written == NULL )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  vector.data = (void *) buffer;
+  vector.length = length;
+
+  return CosmFileWriteAtV( file, bytes_written, &vector, 1, offset );
+}
+
+s32 CosmFileReadAtV( const cosm_FILE_VECTOR * vector, u64 * bytes_read,
+  cosm_FILE * file, u32 count, u64 offset )
+{
+  u64 total;
+  s32 error;
+
+  if ( bytes_read == NULL )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  *bytes_read = 0;
+
+  if ( ( error = Cosm_FileCheckAt( &total, file, vector, count, offset, 0 ) )
+    != COSM_PASS )
+  {
+    return error;
+  }
+
+  if ( ( ( error = Cosm_FileVectorAt( bytes_read, file, vector, count,
+    offset, 0 ) ) == COSM_PASS ) && ( total > 0 ) && ( *bytes_read == 0 ) )
+  {
+    return COSM_FILE_ERROR_EOF;
+  }
+
+  return error;
+}
+
+s32 CosmFileWriteAtV( cosm_FILE * file, u64 * bytes_written,
+  const cosm_FILE_VECTOR * vector, u32 count, u64 offset )
+{
+  u64 total;
+  s32 error;
+
+  if ( bytes_written == NULL )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  *bytes_written = 0;
+
+  if ( ( error = Cosm_FileCheckAt( &total, file, vector, count, offset, 1 ) )
+    != COSM_PASS )
+  {
+    return error;
+  }
+
+  return Cosm_FileVectorAt( bytes_written, file, vector, count, offset, 1 );
+}
+
+s32 CosmFileAdvise( cosm_FILE * file, u64 offset, u64 length, u32 advice )
+{
+#if ( !( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) ) \
+  && defined( POSIX_FADV_NORMAL ) )
+  static const int hints[5] =
+  {
+    POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM,
+    POSIX_FADV_WILLNEED, POSIX_FADV_DONTNEED
+  };
+  int result;
+#endif
+  s32 error;
+
+  if ( ( file == NULL ) || ( advice > COSM_FILE_ADVISE_DONTNEED ) )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  if ( file->status != COSM_FILE_STATUS_OPEN )
+  {
+    return COSM_FILE_ERROR_CLOSED;
+  }
+
+  /* the OS can only drop what has been written */
+  if ( ( advice == COSM_FILE_ADVISE_DONTNEED )
+    && ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
+    && ( ( error = Cosm_FileBufferSync( file ) ) != COSM_PASS ) )
+  {
+    return error;
+  }
+
+#if ( !( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) ) \
+  && defined( POSIX_FADV_NORMAL ) )
+#if ( defined( COSM_FILE64 ) )
+  result = posix_fadvise( (int) file->handle, (off_t) offset,
+    (off_t) length, hints[advice] );
+#else
+  if ( ( offset > 0x7FFFFFFFLL ) || ( length > 0x7FFFFFFFLL ) )
+  {
+    return COSM_FILE_ERROR_SEEK;
+  }
+  result = posix_fadvise( (int) (u32) file->handle, (off_t) (u32) offset,
+    (off_t) (u32) length, hints[advice] );
+#endif
+  if ( result != 0 )
+  {
+    return ( result == EBADF ) ? COSM_FILE_ERROR_NOTFOUND
+      : COSM_FILE_ERROR_PARAM;
+  }
+#else
+  /* only hints, nothing to do without them */
+#endif
+
+  return COSM_PASS;
+}
+
+s32 CosmFileSeek( cosm_FILE * file, u64 offset )
+{
+  s32 error;
+
+  if ( file == NULL )
+  {
+    return COSM_FILE_ERROR_NOTFOUND;
+  }
+
+  if ( file->status != COSM_FILE_STATUS_OPEN )
+  {
+    return COSM_FILE_ERROR_CLOSED;
+  }
+
+  if ( file->buffer_state == COSM_FILE_BUFFER_READ )
+  {
+    if ( ( offset >= file->buffer_offset )
+      && ( offset < ( file->buffer_offset + (u64) file->buffer_end ) ) )
+    {
+      /* still inside the read-ahead */
+      file->buffer_start = (u32) ( offset - file->buffer_offset );
+      return COSM_PASS;
+    }
+    Cosm_FileBufferDrop( file );
+  }
+  else if ( ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
+    && ( ( error = Cosm_FileBufferSync( file ) ) != COSM_PASS ) )
+  {
+    return error;
+  }
+
+  return Cosm_FileSeek( file, offset );
+}
+
+s32 CosmFileTell( u64 * offset, cosm_FILE * file )
+{
+  u64 len;
+  s32 result;
+
+  if ( file == NULL )
+  {
+    return COSM_FILE_ERROR_NOTFOUND;
+  }
+
+  if ( file->status != COSM_FILE_STATUS_OPEN )
+  {
+    return COSM_FILE_ERROR_CLOSED;
+  }
+
+  if ( file->buffer_state == COSM_FILE_BUFFER_READ )
+  {
+    *offset = file->buffer_offset + (u64) file->buffer_start;
+    return COSM_PASS;
+  }
+
+  if ( ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
+    && ( ( result = Cosm_FileBufferSync( file ) ) != COSM_PASS ) )
+  {
+    return result;
+  }
+
+  if ( ( result = Cosm_FileTell( &len, file ) ) == COSM_PASS )
+  {
+    *(offset) = len;
+  }
+
+  return result;
+}
+
+s32 CosmFileEOF( cosm_FILE * file )
+{
+  u64 current;
+  u64 real;
+  s32 result;
+
+  if ( file == NULL )
+  {
+    return COSM_FILE_ERROR_NOTFOUND;
+  }
+
+  if ( file->status != COSM_FILE_STATUS_OPEN )
+  {
+    return COSM_FILE_ERROR_CLOSED;
+  }
+
+  if ( file->buffer_state == COSM_FILE_BUFFER_READ )
+  {
+    /* there is read-ahead left */
+    return COSM_PASS;
+  }
+
+  if ( ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
+    && ( ( result = Cosm_FileBufferSync( file ) ) != COSM_PASS ) )
+  {
+    return result;
+  }
+
+  if ( ( result = Cosm_FileTell( &current , file ) ) != COSM_PASS )
+  {
+    return result;
+  }
+
+  if ( ( result = Cosm_FileLength( &real, file ) ) != COSM_PASS )
+  {
+    return result;
+  }
+
+  /* We compare file size and current position to know if we are at EOF */
+  if ( current == real )
+  {
+    return COSM_FILE_ERROR_EOF;
+  }
+
+  /* not EOF */
+  return COSM_PASS;
+}
+
+s32 CosmFileLength( u64 * length, cosm_FILE * file )
+{
+  s32 result;
+  u64 len;
+
+  if ( file == NULL )
+  {
+    return COSM_FILE_ERROR_NOTFOUND;
+  }
+
+  if ( file->status != COSM_FILE_STATUS_OPEN )
+  {
+    return COSM_FILE_ERROR_CLOSED;
+  }
+
+  if ( ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
+    && ( ( result = Cosm_FileBufferSync( file ) ) != COSM_PASS ) )
+  {
+    return result;
+  }
+
+  if ( ( result = Cosm_FileLength( &len, file ) ) != COSM_PASS )
+  {
+    return result;
+  }
+
+  *(length) = len;
+
+
+  return COSM_PASS;
+}
+
+s32 CosmFileTruncate( cosm_FILE * file, u64 length )
+{
+  s32 result;
+
+  if ( file == NULL )
+  {
+    return COSM_FILE_ERROR_NOTFOUND;
+  }
+
+  if ( file->status != COSM_FILE_STATUS_OPEN )
+  {
+    return COSM_FILE_ERROR_CLOSED;
+  }
+
+  /* truncating moves the offset, so read-ahead is just dropped */
+  if ( file->buffer_state == COSM_FILE_BUFFER_READ )
+  {
+    Cosm_FileBufferDrop( file );
+  }
+  else if ( ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
+    && ( ( result = Cosm_FileBufferSync( file ) ) != COSM_PASS ) )
+  {
+    return result;
+  }
+
+  if ( ( result = Cosm_FileTruncate( file, length ) ) != COSM_PASS )
+  {
+    return result;
+  }
+
+  return COSM_PASS;
+}
+
+s32 CosmFileDelete( const ascii * filename )
+{
   cosm_FILENAME native_filename;
+  cosm_FILE wipe_file;
+  s32 error;
+
+  /* Convert slashs to native format and put it into native_filename */
+  if ( Cosm_FileNativePath( native_filename, filename ) != COSM_PASS )
+  {
+    return COSM_FILE_ERROR_NAME;
+  }
+
+  /* open the file for write only, exclusive access, and zero out */
+  CosmMemSet( &wipe_file, sizeof( cosm_FILE ), 0 );
+  error = CosmFileOpen( &wipe_file, filename, COSM_FILE_MODE_WRITE |
+    COSM_FILE_MODE_SYNC, COSM_FILE_LOCK_WRITE );
+  if ( error != COSM_PASS )
+  {
+    if ( error == COSM_FILE_ERROR_NOTFOUND )
+    {
+      /* no such file */
+      return COSM_PASS;
+    }
+    else
+    {
+      return error;
+    }
+  }
+
+  if ( ( error = Cosm_FileWipe( &wipe_file, 0 ) ) != COSM_PASS )
+  {
+    return error;
+  }
+
+  CosmFileClose( &wipe_file );
+
+  if ( remove( (const char *) native_filename ) != 0 )
+  {
+    if ( errno == ENOENT )
+    {
+      /* this should have been cought above */
+      return COSM_PASS;
+    }
+    else /* EACCES */
+    {
+      return COSM_FILE_ERROR_DENIED;
+    }
+  }
+
+  return COSM_PASS;
+}
+
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+#define _STAT __stat64
+#else
+#if ( ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) ) \
+  && defined( __USE_LARGEFILE64 ) )
+#define _STAT stat64
+#define _FSTATAT fstatat64
+#else
+#define _STAT stat
+#define _FSTATAT fstatat
+#endif
+#endif
+
+static s32 Cosm_FileInfoStat( cosm_FILE_INFO * info,
+  const struct _STAT * buf )
+{
+  /*
+    Fill in info from the stat results in buf.
+    Returns: COSM_PASS.
+  */
   cosmtime unix_epoc;
 
-  if ( ( info == NULL ) || ( filename == NULL ) )
+  /* length */
+  info->length = buf->st_size;
+
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  /* type */
+  if ( ( buf->st_mode & _S_IFREG ) == _S_IFREG )
+  {
+    info->type = COSM_FILE_TYPE_FILE;
+  }
+  else if ( ( buf->st_mode & _S_IFDIR ) == _S_IFDIR )
+  {
+    info->type = COSM_FILE_TYPE_DIR;
+  }
+  else if ( ( buf->st_mode & _S_IFCHR ) == _S_IFCHR )
+  {
+    info->type = COSM_FILE_TYPE_DEVICE;
+  }
+  else
+  {
+    info->type = COSM_FILE_TYPE_SPECIAL;
+  }
+
+  /* rights */
+  info->rights = 0;
+  if ( ( buf->st_mode & _S_IREAD ) == _S_IREAD )
+  {
+    info->rights += COSM_FILE_RIGHTS_READ;
+  }
+  if ( ( buf->st_mode & _S_IWRITE ) == _S_IWRITE )
+  {
+    info->rights += COSM_FILE_RIGHTS_WRITE;
+    info->rights += COSM_FILE_RIGHTS_APPEND;
+  }
+  if ( ( buf->st_mode & _S_IEXEC ) == _S_IEXEC )
+  {
+    info->rights += COSM_FILE_RIGHTS_EXEC;
+  }
+#else /* OS */
+  /* type */
+  if ( ( buf->st_mode & S_IFMT ) == S_IFREG )
+  {
+    info->type = COSM_FILE_TYPE_FILE;
+  }
+  else if ( ( buf->st_mode & S_IFMT ) == S_IFDIR )
+  {
+    info->type = COSM_FILE_TYPE_DIR;
+  }
+  else if ( ( ( buf->st_mode & S_IFMT ) == S_IFCHR ) ||
+    ( ( buf->st_mode & S_IFMT ) == S_IFBLK ) )
+  {
+    info->type = COSM_FILE_TYPE_DEVICE;
+  }
+  else
+  {
+    info->type = COSM_FILE_TYPE_SPECIAL;
+  }
+
+  /* rights */
+  info->rights = 0;
+  if ( ( buf->st_mode & S_IRUSR ) == S_IRUSR )
+  {
+    info->rights += COSM_FILE_RIGHTS_READ;
+  }
+  if ( ( buf->st_mode & S_IWUSR ) == S_IWUSR )
+  {
+    info->rights += COSM_FILE_RIGHTS_WRITE;
+    info->rights += COSM_FILE_RIGHTS_APPEND;
+  }
+  if ( ( buf->st_mode & S_IXUSR ) == S_IXUSR )
+  {
+    info->rights += COSM_FILE_RIGHTS_EXEC;
+  }
+#endif /* OS */
+
+  /* times */
+  _COSM_SET128( unix_epoc, 00000000386D4380, 0000000000000000 );
+
+  info->create.hi = (s64) buf->st_mtime;
+  info->create.lo = 0x0000000000000000LL;
+  info->create = CosmS128Sub( info->create, unix_epoc );
+
+  info->modify.hi = (s64) buf->st_ctime;
+  info->modify.lo = 0x0000000000000000LL;
+  info->modify = CosmS128Sub( info->modify, unix_epoc );
+
+  info->access.hi = (s64) buf->st_atime;
+  info->access.lo = 0x0000000000000000LL;
+  info->access = CosmS128Sub( info->access, unix_epoc );
+
+  return COSM_PASS;
+}
+
+s32 CosmFileInfo( cosm_FILE_INFO * info, const ascii * filename )
+{
+  struct _STAT buf;
+  cosm_FILENAME native_filename;
+
+  if ( ( info == NULL ) || ( filename == NULL ) )
+  {
+    return COSM_FILE_ERROR_DENIED;
+  }
+
+  /* translate filename */
+  if ( Cosm_FileNativePath( native_filename, filename ) != COSM_PASS )
+  {
+    return COSM_FILE_ERROR_NAME;
+  }
+
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  if ( _stat64( (const char *) native_filename, &buf ) != 0 )
+#else
+  if ( _STAT( (const char *) native_filename, &buf ) != 0 )
+#endif
+  {
+    switch( errno )
+    {
+      case ENOENT:
+        return COSM_FILE_ERROR_NOTFOUND;
+        break;
+      case EACCES:
+      default:
+        return COSM_FILE_ERROR_DENIED;
+    }
+  }
+
+  return Cosm_FileInfoStat( info, &buf );
+}
+
+#if ( defined( COSM_FILE_HAVE_URING ) )
+typedef struct cosm_FILE_RING
+{
+  int fd;
+  u8 * sq_map;
+  size_t sq_size;
+  u8 * cq_map;
+  size_t cq_size;
+  struct io_uring_sqe * sqes;
+  size_t sqes_size;
+  u32 * sq_tail;
+  u32 * sq_mask;
+  u32 * sq_array;
+  u32 * cq_head;
+  u32 * cq_tail;
+  u32 * cq_mask;
+  struct io_uring_cqe * cqes;
+} cosm_FILE_RING;
+
+static void Cosm_FileRingClose( cosm_FILE_RING * ring )
+{
+  /*
+    Unmap and close the ring, and free it.
+    Returns: nothing.
+  */
+  if ( ring->sqes != NULL )
+  {
+    munmap( ring->sqes, ring->sqes_size );
+  }
+  if ( ( ring->cq_map != NULL ) && ( ring->cq_map != ring->sq_map ) )
+  {
+    munmap( ring->cq_map, ring->cq_size );
+  }
+  if ( ring->sq_map != NULL )
+  {
+    munmap( ring->sq_map, ring->sq_size );
+  }
+  close( ring->fd );
+  CosmMemFree( ring );
+}
+
+static cosm_FILE_RING * Cosm_FileRingOpen( u32 depth )
+{
+  /*
+    Set up an io_uring with room for depth requests. Kernels before 5.6
+    are left to the pool, they have no plain read and write operations.
+    Returns: The ring, or NULL if io_uring can't be used.
+  */
+  struct io_uring_params params;
+  cosm_FILE_RING * ring;
+  void * map;
+  int fd;
+
+  CosmMemSet( &params, sizeof( params ), 0 );
+  if ( ( fd = (int) syscall( __NR_io_uring_setup, depth, &params ) ) < 0 )
+  {
+    return NULL;
+  }
+  if ( ( ( params.features & IORING_FEAT_RW_CUR_POS ) == 0 )
+    || ( ( ring = CosmMemAlloc( sizeof( cosm_FILE_RING ) ) ) == NULL ) )
+  {
+    close( fd );
+    return NULL;
+  }
+  ring->fd = fd;
+
+  ring->sq_size = params.sq_off.array + params.sq_entries * sizeof( u32 );
+  ring->cq_size = params.cq_off.cqes
+    + params.cq_entries * sizeof( struct io_uring_cqe );
+  if ( params.features & IORING_FEAT_SINGLE_MMAP )
+  {
+    /* both rings share one mapping */
+    if ( ring->cq_size > ring->sq_size )
+    {
+      ring->sq_size = ring->cq_size;
+    }
+    ring->cq_size = ring->sq_size;
+  }
+
+  map = mmap( NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+  if ( map == MAP_FAILED )
+  {
+    Cosm_FileRingClose( ring );
+    return NULL;
+  }
+  ring->sq_map = (u8 *) map;
+
+  if ( params.features & IORING_FEAT_SINGLE_MMAP )
+  {
+    ring->cq_map = ring->sq_map;
+  }
+  else
+  {
+    map = mmap( NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+    if ( map == MAP_FAILED )
+    {
+      Cosm_FileRingClose( ring );
+      return NULL;
+    }
+    ring->cq_map = (u8 *) map;
+  }
+
+  ring->sqes_size = params.sq_entries * sizeof( struct io_uring_sqe );
+  map = mmap( NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+  if ( map == MAP_FAILED )
+  {
+    Cosm_FileRingClose( ring );
+    return NULL;
+  }
+  ring->sqes = (struct io_uring_sqe *) map;
+
+  ring->sq_tail = (u32 *) ( ring->sq_map + params.sq_off.tail );
+  ring->sq_mask = (u32 *) ( ring->sq_map + params.sq_off.ring_mask );
+  ring->sq_array = (u32 *) ( ring->sq_map + params.sq_off.array );
+  ring->cq_head = (u32 *) ( ring->cq_map + params.cq_off.head );
+  ring->cq_tail = (u32 *) ( ring->cq_map + params.cq_off.tail );
+  ring->cq_mask = (u32 *) ( ring->cq_map + params.cq_off.ring_mask );
+  ring->cqes = (struct io_uring_cqe *) ( ring->cq_map + params.cq_off.cqes );
+
+  return ring;
+}
+
+static void Cosm_FileRingPut( cosm_FILE_RING * ring, u32 * tail,
+  cosm_FILE_REQUEST * request )
+{
+  /*
+    Fill in the submission queue entry at tail for request and move tail
+    on, Cosm_FileRingEnter then hands them to the kernel. A NULL request
+    is a NOP, used to wake the completion thread.
+    Returns: nothing.
+  */
+  struct io_uring_sqe * sqe;
+  u32 index;
+
+  index = *tail & *ring->sq_mask;
+  sqe = &ring->sqes[index];
+  CosmMemSet( sqe, sizeof( struct io_uring_sqe ), 0 );
+  ring->sq_array[index] = index;
+  (*tail)++;
+
+  if ( request == NULL )
+  {
+    sqe->opcode = IORING_OP_NOP;
+    return;
+  }
+
+  sqe->fd = (int) (u32) request->file->handle;
+  sqe->user_data = (u64) (size_t) request;
+  if ( request->type == COSM_FILE_ASYNC_SYNC )
+  {
+    sqe->opcode = IORING_OP_FSYNC;
+    return;
+  }
+
+  sqe->off = request->offset;
+  sqe->addr = (u64) (size_t) request->data;
+  sqe->len = request->length;
+  if ( request->buffer != 0 )
+  {
+    sqe->opcode = ( request->type == COSM_FILE_ASYNC_READ )
+      ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+    sqe->buf_index = (u16) ( request->buffer - 1 );
+  }
+  else
+  {
+    sqe->opcode = ( request->type == COSM_FILE_ASYNC_READ )
+      ? IORING_OP_READ : IORING_OP_WRITE;
+  }
+}
+
+static u32 Cosm_FileRingEnter( cosm_FILE_RING * ring, u32 count,
+  u32 tail )
+{
+  /*
+    Publish the count entries before tail and have the kernel take them.
+    If it stops part way, the tail is put back so the rest never run.
+    Returns: The number of entries the kernel took, count on success.
+  */
+  u32 old, total;
+  int taken;
+
+  old = tail - count;
+  total = 0;
+  __atomic_store_n( ring->sq_tail, tail, __ATOMIC_RELEASE );
+  while ( total < count )
+  {
+    taken = (int) syscall( __NR_io_uring_enter, ring->fd, count - total, 0,
+      0, NULL, 0 );
+    if ( taken > 0 )
+    {
+      total += (u32) taken;
+    }
+    else if ( ( taken == 0 ) || ( ( errno != EINTR ) && ( errno != EAGAIN )
+      && ( errno != EBUSY ) ) )
+    {
+      __atomic_store_n( ring->sq_tail, old + total, __ATOMIC_RELEASE );
+      break;
+    }
+  }
+
+  return total;
+}
+#endif /* COSM_FILE_HAVE_URING */
+
+static s32 Cosm_FileSyncOS( cosm_FILE * file )
+{
+  /*
+    Force the file's writes to disk.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  if ( FlushFileBuffers( file->handle ) == 0 )
+  {
+    return COSM_FILE_ERROR_DENIED;
+  }
+#else
+#if ( defined( COSM_FILE64 ) )
+  if ( fsync( (int) file->handle ) == -1 )
+#else
+  if ( fsync( (int) (u32) file->handle ) == -1 )
+#endif
+  {
+    return ( errno == ENOSPC ) ? COSM_FILE_ERROR_NOSPACE
+      : COSM_FILE_ERROR_DENIED;
+  }
+#endif
+
+  return COSM_PASS;
+}
+
+static s32 Cosm_FileSyncData( cosm_FILE * file )
+{
+  /*
+    Force the file's data to disk, skipping metadata like the access time
+    where the OS can.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+#if ( OS_TYPE == OS_LINUX )
+#if ( defined( COSM_FILE64 ) )
+  if ( fdatasync( (int) file->handle ) == -1 )
+#else
+  if ( fdatasync( (int) (u32) file->handle ) == -1 )
+#endif
+  {
+    return ( errno == ENOSPC ) ? COSM_FILE_ERROR_NOSPACE
+      : COSM_FILE_ERROR_DENIED;
+  }
+  return COSM_PASS;
+#else
+  return Cosm_FileSyncOS( file );
+#endif
+}
+
+static void Cosm_FileAsyncDone( cosm_FILE_ASYNC * async,
+  cosm_FILE_REQUEST * request )
+{
+  /*
+    Hand a finished request to its callback, or to the done list for
+    CosmFileAsyncReap.
+    Returns: nothing.
+  */
+  if ( request->callback != NULL )
+  {
+    request->callback( request->arg, request );
+    CosmMutexLock( &async->lock, COSM_MUTEX_WAIT );
+    async->pending--;
+    CosmMutexUnlock( &async->lock );
+    return;
+  }
+
+  request->next = NULL;
+  CosmMutexLock( &async->lock, COSM_MUTEX_WAIT );
+  if ( async->done_tail == NULL )
+  {
+    async->done = request;
+  }
+  else
+  {
+    async->done_tail->next = request;
+  }
+  async->done_tail = request;
+  async->pending--;
+  CosmMutexUnlock( &async->lock );
+  CosmSemaphoreUp( &async->ready );
+}
+
+static void Cosm_FileAsyncRun( cosm_FILE_REQUEST * request )
+{
+  /*
+    Make the call for a request, on a pool thread.
+    Returns: nothing.
+  */
+  cosm_FILE_VECTOR vector;
+  u64 bytes;
+
+  request->bytes = 0;
+  if ( request->type == COSM_FILE_ASYNC_SYNC )
+  {
+    request->status = Cosm_FileSyncOS( request->file );
+    return;
+  }
+
+  /* the buffer was brought in line when it was submitted */
+  vector.data = request->data;
+  vector.length = (u64) request->length;
+  request->status = Cosm_FileVectorAt( &bytes, request->file, &vector, 1,
+    request->offset, ( request->type == COSM_FILE_ASYNC_WRITE ) );
+  request->bytes = (u32) bytes;
+  if ( ( request->status == COSM_PASS ) && ( request->length > 0 )
+    && ( bytes == 0 ) )
+  {
+    request->status = COSM_FILE_ERROR_EOF;
+  }
+}
+
+void Cosm_FileAsyncWorker( void * arg )
+{
+  cosm_FILE_ASYNC * async;
+  cosm_FILE_REQUEST * request;
+#if ( defined( COSM_FILE_HAVE_URING ) )
+  cosm_FILE_RING * ring;
+  struct io_uring_cqe * cqe;
+  u32 head, tail, stop;
+  s32 result;
+#endif
+
+  async = (cosm_FILE_ASYNC *) arg;
+
+#if ( defined( COSM_FILE_HAVE_URING ) )
+  if ( ( ring = (cosm_FILE_RING *) async->ring ) != NULL )
+  {
+    for ( stop = 0 ; stop == 0 ; )
+    {
+      syscall( __NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS,
+        NULL, 0 );
+
+      /* only this thread reads completions */
+      head = *ring->cq_head;
+      tail = __atomic_load_n( ring->cq_tail, __ATOMIC_ACQUIRE );
+      while ( head != tail )
+      {
+        cqe = &ring->cqes[head & *ring->cq_mask];
+        request = (cosm_FILE_REQUEST *) (size_t) cqe->user_data;
+        result = cqe->res;
+        __atomic_store_n( ring->cq_head, ++head, __ATOMIC_RELEASE );
+
+        if ( request == NULL )
+        {
+          stop = 1;
+          continue;
+        }
+
+        request->bytes = ( result > 0 ) ? (u32) result : 0;
+        if ( result == -EACCES )
+        {
+          request->status = COSM_FILE_ERROR_DENIED;
+        }
+        else if ( ( result == -ENOSPC ) || ( result == -EFBIG ) )
+        {
+          request->status = COSM_FILE_ERROR_NOSPACE;
+        }
+        else if ( result < 0 )
+        {
+          request->status = COSM_FILE_ERROR_NOTFOUND;
+        }
+        else if ( ( request->type == COSM_FILE_ASYNC_READ )
+          && ( result == 0 ) && ( request->length > 0 ) )
+        {
+          request->status = COSM_FILE_ERROR_EOF;
+        }
+        else if ( ( request->type == COSM_FILE_ASYNC_WRITE )
+          && ( (u32) result < request->length ) )
+        {
+          request->status = COSM_FILE_ERROR_NOSPACE;
+        }
+        else
+        {
+          request->status = COSM_PASS;
+        }
+        Cosm_FileAsyncDone( async, request );
+      }
+    }
+
+    CosmMutexLock( &async->lock, COSM_MUTEX_WAIT );
+    async->threads--;
+    CosmMutexUnlock( &async->lock );
+    return;
+  }
+#endif
+
+  for ( ; ; )
+  {
+    CosmSemaphoreDown( &async->work, COSM_SEMAPHORE_WAIT );
+    CosmMutexLock( &async->lock, COSM_MUTEX_WAIT );
+    if ( async->stop )
+    {
+      async->threads--;
+      CosmMutexUnlock( &async->lock );
+      return;
+    }
+    if ( ( request = async->queue ) == NULL )
+    {
+      CosmMutexUnlock( &async->lock );
+      continue;
+    }
+    if ( ( async->queue = request->next ) == NULL )
+    {
+      async->queue_tail = NULL;
+    }
+    CosmMutexUnlock( &async->lock );
+
+    Cosm_FileAsyncRun( request );
+    Cosm_FileAsyncDone( async, request );
+  }
+}
+
+s32 CosmFileAsyncInit( cosm_FILE_ASYNC * async, u32 depth, u32 threads,
+  u32 flags )
+{
+  u64 thread_id;
+  u32 i, count;
+
+  if ( ( async == NULL ) || ( depth == 0 ) || ( depth > 32768 ) )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  CosmMemSet( async, sizeof( cosm_FILE_ASYNC ), 0 );
+  if ( CosmMutexInit( &async->lock ) != COSM_PASS )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+  if ( CosmSemaphoreInit( &async->work, 0 ) != COSM_PASS )
+  {
+    CosmMutexFree( &async->lock );
+    return COSM_FILE_ERROR_PARAM;
+  }
+  if ( CosmSemaphoreInit( &async->ready, 0 ) != COSM_PASS )
+  {
+    CosmSemaphoreFree( &async->work );
+    CosmMutexFree( &async->lock );
+    return COSM_FILE_ERROR_PARAM;
+  }
+  async->depth = depth;
+
+#if ( defined( COSM_FILE_HAVE_URING ) )
+  if ( ( flags & COSM_FILE_ASYNC_THREADS ) == 0 )
+  {
+    async->ring = Cosm_FileRingOpen( depth );
+  }
+#endif
+  if ( async->ring != NULL )
+  {
+    async->engine = COSM_FILE_ASYNC_URING;
+    count = 1;
+  }
+  else
+  {
+    async->engine = COSM_FILE_ASYNC_POOL;
+    count = threads;
+  }
+
+  CosmMutexLock( &async->lock, COSM_MUTEX_WAIT );
+  for ( i = 0 ; i < count ; i++ )
+  {
+    if ( CosmThreadBegin( &thread_id, Cosm_FileAsyncWorker, async,
+      64 * 1024 ) != COSM_PASS )
+    {
+      break;
+    }
+    async->threads++;
+  }
+  CosmMutexUnlock( &async->lock );
+
+  if ( i == 0 )
+  {
+#if ( defined( COSM_FILE_HAVE_URING ) )
+    if ( async->ring != NULL )
+    {
+      Cosm_FileRingClose( (cosm_FILE_RING *) async->ring );
+    }
+#endif
+    CosmSemaphoreFree( &async->ready );
+    CosmSemaphoreFree( &async->work );
+    CosmMutexFree( &async->lock );
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  return COSM_PASS;
+}
+
+s32 CosmFileAsyncBuffers( cosm_FILE_ASYNC * async,
+  const cosm_FILE_VECTOR * buffers, u32 count )
+{
+#if ( defined( COSM_FILE_HAVE_URING ) )
+  struct iovec vectors[COSM_FILE_ASYNC_BUFFERS];
+  cosm_FILE_RING * ring;
+  int result;
+#endif
+  u32 i;
+  s32 error;
+
+  if ( ( async == NULL ) || ( count > COSM_FILE_ASYNC_BUFFERS )
+    || ( ( count > 0 ) && ( buffers == NULL ) ) )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+  for ( i = 0 ; i < count ; i++ )
+  {
+    if ( ( buffers[i].data == NULL ) || ( buffers[i].length == 0 )
+      || ( buffers[i].length > 0x40000000LL ) )
+    {
+      return COSM_FILE_ERROR_PARAM;
+    }
+  }
+
+  if ( CosmMutexLock( &async->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+  if ( async->pending > 0 )
+  {
+    CosmMutexUnlock( &async->lock );
+    return COSM_FILE_ERROR_BUSY;
+  }
+
+  error = COSM_PASS;
+#if ( defined( COSM_FILE_HAVE_URING ) )
+  if ( ( ring = (cosm_FILE_RING *) async->ring ) != NULL )
+  {
+    if ( async->buffer_count > 0 )
+    {
+      syscall( __NR_io_uring_register, ring->fd, IORING_UNREGISTER_BUFFERS,
+        NULL, 0 );
+    }
+    if ( count > 0 )
+    {
+      for ( i = 0 ; i < count ; i++ )
+      {
+        vectors[i].iov_base = buffers[i].data;
+        vectors[i].iov_len = (size_t) buffers[i].length;
+      }
+      result = (int) syscall( __NR_io_uring_register, ring->fd,
+        IORING_REGISTER_BUFFERS, vectors, count );
+      if ( result < 0 )
+      {
+        /* usually RLIMIT_MEMLOCK, which pinned buffers count against */
+        error = COSM_FILE_ERROR_DENIED;
+        count = 0;
+      }
+    }
+  }
+#endif
+
+  for ( i = 0 ; i < count ; i++ )
+  {
+    async->buffers[i] = buffers[i];
+  }
+  async->buffer_count = count;
+  CosmMutexUnlock( &async->lock );
+
+  return error;
+}
+
+s32 CosmFileAsyncSubmit( cosm_FILE_ASYNC * async, u32 * started,
+  cosm_FILE_REQUEST ** requests, u32 count )
+{
+  cosm_FILE_REQUEST * request;
+  cosm_FILE_VECTOR vector;
+  cosm_FILE_VECTOR * buffer;
+#if ( defined( COSM_FILE_HAVE_URING ) )
+  cosm_FILE_RING * ring;
+  u32 tail;
+#endif
+  u64 total;
+  u32 i;
+  s32 error;
+
+  if ( ( async == NULL ) || ( started == NULL ) || ( requests == NULL )
+    || ( count == 0 ) )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+  *started = 0;
+
+  /* check them all, and make any buffered writes, before starting any */
+  for ( i = 0 ; i < count ; i++ )
+  {
+    if ( ( ( request = requests[i] ) == NULL ) || ( request->file == NULL ) )
+    {
+      return COSM_FILE_ERROR_PARAM;
+    }
+    if ( request->type == COSM_FILE_ASYNC_SYNC )
+    {
+      if ( request->file->status != COSM_FILE_STATUS_OPEN )
+      {
+        return COSM_FILE_ERROR_CLOSED;
+      }
+      if ( ( request->file->mode
+        & ( COSM_FILE_MODE_WRITE | COSM_FILE_MODE_APPEND ) ) == 0 )
+      {
+        return COSM_FILE_ERROR_WRITEMODE;
+      }
+      if ( ( request->file->buffer_state == COSM_FILE_BUFFER_WRITE )
+        && ( ( error = Cosm_FileBufferSync( request->file ) ) != COSM_PASS ) )
+      {
+        return error;
+      }
+      continue;
+    }
+    if ( ( request->type != COSM_FILE_ASYNC_READ )
+      && ( request->type != COSM_FILE_ASYNC_WRITE ) )
+    {
+      return COSM_FILE_ERROR_PARAM;
+    }
+    if ( request->buffer != 0 )
+    {
+      if ( request->buffer > async->buffer_count )
+      {
+        return COSM_FILE_ERROR_PARAM;
+      }
+      buffer = &async->buffers[request->buffer - 1];
+      if ( ( (u8 *) request->data < (u8 *) buffer->data )
+        || ( (u64) ( (u8 *) request->data - (u8 *) buffer->data )
+        + (u64) request->length > buffer->length ) )
+      {
+        return COSM_FILE_ERROR_PARAM;
+      }
+    }
+    vector.data = request->data;
+    vector.length = (u64) request->length;
+    if ( ( error = Cosm_FileCheckAt( &total, request->file, &vector, 1,
+      request->offset, ( request->type == COSM_FILE_ASYNC_WRITE ) ) )
+      != COSM_PASS )
+    {
+      return error;
+    }
+  }
+
+  if ( CosmMutexLock( &async->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+  if ( async->stop || ( count > async->depth - async->pending ) )
+  {
+    CosmMutexUnlock( &async->lock );
+    return COSM_FILE_ERROR_BUSY;
+  }
+  for ( i = 0 ; i < count ; i++ )
+  {
+    requests[i]->bytes = 0;
+    requests[i]->status = COSM_PASS;
+    requests[i]->next = NULL;
+  }
+
+#if ( defined( COSM_FILE_HAVE_URING ) )
+  if ( ( ring = (cosm_FILE_RING *) async->ring ) != NULL )
+  {
+    /* only submitters move the tail, and they hold the lock */
+    tail = *ring->sq_tail;
+    for ( i = 0 ; i < count ; i++ )
+    {
+      Cosm_FileRingPut( ring, &tail, requests[i] );
+    }
+    /* the ones the kernel took will finish even if the rest can't start */
+    *started = Cosm_FileRingEnter( ring, count, tail );
+    async->pending += *started;
+    CosmMutexUnlock( &async->lock );
+    return ( *started == count ) ? COSM_PASS : COSM_FILE_ERROR_BUSY;
+  }
+#endif
+
+  for ( i = 0 ; i < count ; i++ )
+  {
+    if ( async->queue_tail == NULL )
+    {
+      async->queue = requests[i];
+    }
+    else
+    {
+      async->queue_tail->next = requests[i];
+    }
+    async->queue_tail = requests[i];
+  }
+  async->pending += count;
+  *started = count;
+  CosmMutexUnlock( &async->lock );
+
+  for ( i = 0 ; i < count ; i++ )
+  {
+    CosmSemaphoreUp( &async->work );
+  }
+
+  return COSM_PASS;
+}
+
+u32 CosmFileAsyncReap( cosm_FILE_REQUEST ** requests, u32 max,
+  cosm_FILE_ASYNC * async, u32 wait )
+{
+  u32 count;
+
+  if ( ( requests == NULL ) || ( max == 0 ) || ( async == NULL ) )
+  {
+    return 0;
+  }
+
+  for ( ; ; )
+  {
+    /* ready may run ahead of done when one call takes several */
+    if ( ( wait == COSM_FILE_ASYNC_WAIT )
+      && ( CosmSemaphoreDown( &async->ready, COSM_SEMAPHORE_WAIT )
+      != COSM_PASS ) )
+    {
+      return 0;
+    }
+
+    CosmMutexLock( &async->lock, COSM_MUTEX_WAIT );
+    for ( count = 0 ; ( count < max ) && ( async->done != NULL ) ; count++ )
+    {
+      requests[count] = async->done;
+      async->done = async->done->next;
+    }
+    if ( async->done == NULL )
+    {
+      async->done_tail = NULL;
+    }
+    CosmMutexUnlock( &async->lock );
+
+    if ( ( count > 0 ) || ( wait != COSM_FILE_ASYNC_WAIT ) )
+    {
+      return count;
+    }
+  }
+}
+
+s32 CosmFileAsyncFree( cosm_FILE_ASYNC * async )
+{
+  u32 i, pending, threads;
+
+  if ( async == NULL )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  threads = 0;
+
+  /* let what is in flight finish */
+  do
+  {
+    CosmMutexLock( &async->lock, COSM_MUTEX_WAIT );
+    pending = async->pending;
+    if ( pending == 0 )
+    {
+      async->stop = 1;
+      threads = async->threads;
+    }
+    CosmMutexUnlock( &async->lock );
+    if ( pending > 0 )
+    {
+      CosmSleep( 1 );
+    }
+  } while ( pending > 0 );
+
+#if ( defined( COSM_FILE_HAVE_URING ) )
+  if ( async->ring != NULL )
+  {
+    /* a NOP wakes the completion thread to see the stop */
+    CosmMutexLock( &async->lock, COSM_MUTEX_WAIT );
+    i = *( (cosm_FILE_RING *) async->ring )->sq_tail;
+    Cosm_FileRingPut( (cosm_FILE_RING *) async->ring, &i, NULL );
+    Cosm_FileRingEnter( (cosm_FILE_RING *) async->ring, 1, i );
+    CosmMutexUnlock( &async->lock );
+  }
+  else
+#endif
+  {
+    for ( i = 0 ; i < threads ; i++ )
+    {
+      CosmSemaphoreUp( &async->work );
+    }
+  }
+  while ( threads > 0 )
+  {
+    CosmSleep( 1 );
+    CosmMutexLock( &async->lock, COSM_MUTEX_WAIT );
+    threads = async->threads;
+    CosmMutexUnlock( &async->lock );
+  }
+
+#if ( defined( COSM_FILE_HAVE_URING ) )
+  if ( async->ring != NULL )
+  {
+    Cosm_FileRingClose( (cosm_FILE_RING *) async->ring );
+  }
+#endif
+  CosmSemaphoreFree( &async->ready );
+  CosmSemaphoreFree( &async->work );
+  CosmMutexFree( &async->lock );
+  CosmMemSet( async, sizeof( cosm_FILE_ASYNC ), 0 );
+
+  return COSM_PASS;
+}
+
+typedef struct cosm_FILE_GROUP_WAITER
+{
+  struct cosm_FILE_GROUP_WAITER * next;
+  const void * data;
+  u64 length;
+  cosm_SEMAPHORE wake;   /* up when done, or when it is to lead */
+  s32 status;
+  u32 done;
+} cosm_FILE_GROUP_WAITER;
+
+s32 CosmFileGroupInit( cosm_FILE_GROUP * group, cosm_FILE * file )
+{
+  u64 length;
+  s32 error;
+
+  if ( ( group == NULL ) || ( file == NULL ) )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+  if ( file->status != COSM_FILE_STATUS_OPEN )
+  {
+    return COSM_FILE_ERROR_CLOSED;
+  }
+  if ( ( file->mode & COSM_FILE_MODE_WRITE ) != COSM_FILE_MODE_WRITE )
+  {
+    return COSM_FILE_ERROR_WRITEMODE;
+  }
+  if ( ( file->mode & COSM_FILE_MODE_APPEND ) == COSM_FILE_MODE_APPEND )
+  {
+    return COSM_FILE_ERROR_DENIED;
+  }
+  if ( ( error = CosmFileLength( &length, file ) ) != COSM_PASS )
+  {
+    return error;
+  }
+
+  CosmMemSet( group, sizeof( cosm_FILE_GROUP ), 0 );
+  if ( CosmMutexInit( &group->lock ) != COSM_PASS )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+  group->file = file;
+  group->offset = length;
+
+  return COSM_PASS;
+}
+
+s32 CosmFileGroupWrite( cosm_FILE_GROUP * group, const void * data,
+  u64 length )
+{
+  cosm_FILE_GROUP_WAITER me;
+  cosm_FILE_GROUP_WAITER * batch[COSM_FILE_VECTORS];
+  cosm_FILE_VECTOR vectors[COSM_FILE_VECTORS];
+  u64 bytes;
+  u32 count, led, i;
+  s32 error;
+
+  if ( ( group == NULL ) || ( group->file == NULL )
+    || ( ( data == NULL ) && ( length > 0 ) ) )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  CosmMemSet( &me, sizeof( me ), 0 );
+  me.data = data;
+  me.length = length;
+  if ( CosmSemaphoreInit( &me.wake, 0 ) != COSM_PASS )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  CosmMutexLock( &group->lock, COSM_MUTEX_WAIT );
+  group->writers++;
+  if ( group->queue_tail == NULL )
+  {
+    group->queue = &me;
+  }
+  else
+  {
+    group->queue_tail->next = &me;
+  }
+  group->queue_tail = &me;
+
+  if ( group->leader )
+  {
+    /* wait for our record to be written, or to be handed the lead */
+    CosmMutexUnlock( &group->lock );
+    CosmSemaphoreDown( &me.wake, COSM_SEMAPHORE_WAIT );
+    CosmMutexLock( &group->lock, COSM_MUTEX_WAIT );
+  }
+  else
+  {
+    group->leader = 1;
+  }
+
+  led = 0;
+  while ( me.done == 0 )
+  {
+    /* we are the leader, write out the head of the queue */
+    led = 1;
+    for ( count = 0 ; ( count < COSM_FILE_VECTORS )
+      && ( group->queue != NULL ) ; count++ )
+    {
+      batch[count] = group->queue;
+      vectors[count].data = (void *) group->queue->data;
+      vectors[count].length = group->queue->length;
+      group->queue = group->queue->next;
+    }
+    if ( group->queue == NULL )
+    {
+      group->queue_tail = NULL;
+    }
+    CosmMutexUnlock( &group->lock );
+
+    error = CosmFileWriteAtV( group->file, &bytes, vectors, count,
+      group->offset );
+    if ( ( error == COSM_PASS ) && ( ( group->file->mode
+      & COSM_FILE_MODE_SYNC ) != COSM_FILE_MODE_SYNC ) )
+    {
+      error = Cosm_FileSyncData( group->file );
+    }
+
+    CosmMutexLock( &group->lock, COSM_MUTEX_WAIT );
+    group->offset += bytes;
+    group->batches++;
+    group->records += count;
+    for ( i = 0 ; i < count ; i++ )
+    {
+      batch[i]->status = error;
+      batch[i]->done = 1;
+      if ( batch[i] != &me )
+      {
+        /* the waiter may be gone as soon as this is up */
+        CosmSemaphoreUp( &batch[i]->wake );
+      }
+    }
+  }
+
+  if ( led )
+  {
+    if ( group->queue != NULL )
+    {
+      /* hand the lead to the oldest waiter */
+      CosmSemaphoreUp( &group->queue->wake );
+    }
+    else
+    {
+      group->leader = 0;
+    }
+  }
+  group->writers--;
+  CosmMutexUnlock( &group->lock );
+
+  CosmSemaphoreFree( &me.wake );
+
+  return me.status;
+}
+
+s32 CosmFileGroupFree( cosm_FILE_GROUP * group )
+{
+  if ( group == NULL )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  if ( CosmMutexLock( &group->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+  if ( group->writers > 0 )
+  {
+    CosmMutexUnlock( &group->lock );
+    return COSM_FILE_ERROR_BUSY;
+  }
+  CosmMutexUnlock( &group->lock );
+
+  CosmMutexFree( &group->lock );
+  CosmMemSet( group, sizeof( cosm_FILE_GROUP ), 0 );
+
+  return COSM_PASS;
+}
+
+s32 CosmFileWatchInit( cosm_FILE_WATCH * watch, const ascii * filename )
+{
+  cosm_FILENAME native;
+#if ( OS_TYPE == OS_LINUX )
+  ascii * name, * dir;
+  int fd;
+#endif
+
+  if ( ( watch == NULL ) || ( filename == NULL ) )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+  CosmMemSet( watch, sizeof( cosm_FILE_WATCH ), 0 );
+  watch->handle = -1;
+
+  if ( ( CosmStrCopy( watch->filename, filename, COSM_FILE_MAX_FILENAME )
+    != COSM_PASS ) || ( Cosm_FileNativePath( native, filename ) != COSM_PASS ) )
+  {
+    return COSM_FILE_ERROR_NAME;
+  }
+
+  /* it does not have to exist yet */
+  (void) CosmFileInfo( &watch->info, filename );
+
+#if ( OS_TYPE == OS_LINUX )
+  /* split the directory from the name */
+  name = NULL;
+  for ( dir = native ; *dir != 0 ; dir++ )
+  {
+    if ( *dir == '/' )
+    {
+      name = dir;
+    }
+  }
+  if ( name == NULL )
+  {
+    name = native;
+    dir = ".";
+  }
+  else if ( name == native )
+  {
+    name++;
+    dir = "/";
+  }
+  else
+  {
+    *name++ = 0;
+    dir = native;
+  }
+  if ( *name == 0 )
+  {
+    return COSM_FILE_ERROR_NAME;
+  }
+  CosmStrCopy( watch->name, name, COSM_FILE_MAX_FILENAME );
+
+  if ( ( fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC ) ) < 0 )
+  {
+    return COSM_FILE_ERROR_DENIED;
+  }
+  if ( inotify_add_watch( fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO ) < 0 )
+  {
+    close( fd );
+    return ( ( errno == ENOENT ) ? COSM_FILE_ERROR_NOTFOUND
+      : COSM_FILE_ERROR_DENIED );
+  }
+  watch->handle = (s32) fd;
+#endif
+
+  return COSM_PASS;
+}
+
+s32 CosmFileWatchWait( cosm_FILE_WATCH * watch, u32 millisec )
+{
+#if ( OS_TYPE == OS_LINUX )
+  u64 buffer[512]; /* aligned for struct inotify_event */
+  struct inotify_event * event;
+  struct pollfd poll_fd;
+  struct timespec now;
+  u64 deadline, current;
+  ssize_t bytes, offset;
+  u32 changed;
+  int result;
+#endif
+  cosm_FILE_INFO info;
+  u32 waited, step;
+
+  if ( watch == NULL )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+#if ( OS_TYPE == OS_LINUX )
+  if ( watch->handle >= 0 )
+  {
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    current = (u64) now.tv_sec * 1000 + (u64) ( now.tv_nsec / 1000000 );
+    deadline = current + millisec;
+    for ( ; ; )
+    {
+      poll_fd.fd = (int) watch->handle;
+      poll_fd.events = POLLIN;
+      poll_fd.revents = 0;
+      result = poll( &poll_fd, 1, (int) ( deadline - current ) );
+      if ( result < 0 )
+      {
+        if ( errno != EINTR )
+        {
+          return COSM_FILE_ERROR_DENIED;
+        }
+      }
+      else if ( result == 0 )
+      {
+        return COSM_FILE_ERROR_TIMEOUT;
+      }
+
+      /* the directory is watched, look for our name */
+      changed = 0;
+      while ( ( bytes = read( (int) watch->handle, buffer,
+        sizeof( buffer ) ) ) > 0 )
+      {
+        for ( offset = 0 ; offset < bytes ;
+          offset += sizeof( struct inotify_event ) + event->len )
+        {
+          event = (struct inotify_event *) ( (u8 *) buffer + offset );
+          if ( ( event->len > 0 ) && ( CosmStrCmp( event->name, watch->name,
+            COSM_FILE_MAX_FILENAME ) == 0 ) )
+          {
+            changed = 1;
+          }
+        }
+      }
+      if ( changed )
+      {
+        return COSM_PASS;
+      }
+
+      clock_gettime( CLOCK_MONOTONIC, &now );
+      current = (u64) now.tv_sec * 1000 + (u64) ( now.tv_nsec / 1000000 );
+      if ( current >= deadline )
+      {
+        return COSM_FILE_ERROR_TIMEOUT;
+      }
+    }
+  }
+#endif
+
+  /* poll the length and modify time */
+  for ( waited = 0 ; ; waited += step )
+  {
+    if ( ( CosmFileInfo( &info, watch->filename ) == COSM_PASS )
+      && ( ( info.length != watch->info.length )
+      || ( CosmMemCmp( &info.modify, &watch->info.modify,
+        sizeof( cosmtime ) ) != 0 ) ) )
+    {
+      watch->info = info;
+      return COSM_PASS;
+    }
+    if ( waited >= millisec )
+    {
+      return COSM_FILE_ERROR_TIMEOUT;
+    }
+    step = ( ( millisec - waited ) < 100 ) ? ( millisec - waited ) : 100;
+    CosmSleep( step );
+  }
+}
+
+s32 CosmFileWatchFree( cosm_FILE_WATCH * watch )
+{
+  if ( watch == NULL )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
+
+#if ( OS_TYPE == OS_LINUX )
+  if ( watch->handle >= 0 )
+  {
+    close( (int) watch->handle );
+  }
+#endif
+  CosmMemSet( watch, sizeof( cosm_FILE_WATCH ), 0 );
+  watch->handle = -1;
+
+  return COSM_PASS;
+}
+
+u64 CosmFileMapPageSize( void )
+{
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  SYSTEM_INFO info;
+
+  GetSystemInfo( &info );
+  return (u64) info.dwPageSize;
+#else
+  return (u64) getpagesize();
+#endif
+}
+
+static void * Cosm_FileMapOS( cosm_FILE_MEMORY_MAP * map, cosm_FILE * file,
+  u64 length, u64 offset, u32 populate )
+{
+  /*
+    Map the region, with the page tables filled in up front if populate
+    is set and the OS can, instead of a fault on each page.
+    Returns: Address of mapped file on success, NULL on failure.
+  */
+  void * addr;
+  int access;
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  int map_mode;
+
+  if ( ( file->mode & COSM_FILE_MODE_READ )
+    && ( file->mode & COSM_FILE_MODE_WRITE ) )
+  {
+    access = PAGE_READWRITE;
+    map_mode = FILE_MAP_WRITE;
+  }
+  else if ( file->mode & COSM_FILE_MODE_READ )
+  {
+    access = PAGE_READONLY;
+    map_mode = FILE_MAP_READ;
+  }
+  else
+  {
+    /* not a valid mode for the open file */
+    return NULL;
+  }
+
+  if ( NULL == ( map->file_mapping = CreateFileMapping(
+    file->handle, NULL, access, 0xFFFFFFFF, 0xFFFFFFFF, NULL ) ) )
+  {
+    /* bad failure */
+    return NULL;
+  }
+
+  if ( NULL == ( addr = MapViewOfFile( map->file_mapping,
+    map_mode, (u32) ( offset >> 32 ), (u32) offset, (SIZE_T) length ) ) )
+  {
+    CloseHandle( map->file_mapping );
+    return NULL;
+  }
+#else
+  int flags;
+
+  if ( ( file->mode & COSM_FILE_MODE_READ ) == 0 )
+  {
+    /* not a valid mode for the open file */
+    return NULL;
+  }
+  access = PROT_READ
+    | ( ( file->mode & COSM_FILE_MODE_WRITE ) ? PROT_WRITE : 0 );
+
+  flags = MAP_SHARED;
+#if ( defined( MAP_POPULATE ) )
+  if ( populate )
+  {
+    flags |= MAP_POPULATE;
+  }
+#endif
+
+  if ( MAP_FAILED == ( addr = mmap( NULL, (size_t) length, access, flags,
+    (int) (u32) file->handle, (off_t) offset ) ) )
+  {
+    return NULL;
+  }
+#endif
+
+  map->memory = addr;
+  map->length = length;
+  return addr;
+}
+
+void * CosmFileMap( cosm_FILE_MEMORY_MAP * map, cosm_FILE * file,
+  u64 length, u64 offset )
+{
+  if ( ( NULL == map ) || ( NULL == file ) || ( 0 == length ) )
+  {
+    return NULL;
+  }
+
+  /* the mapping should see every write made so far */
+  if ( CosmFileFlush( file ) != COSM_PASS )
+  {
+    return NULL;
+  }
+
+  return Cosm_FileMapOS( map, file, length, offset, 0 );
+}
+
+s32 CosmFileUnmap( cosm_FILE_MEMORY_MAP * map )
+{
+ if ( ( NULL == map ) || ( NULL == map->memory ) )
+ {
+   return COSM_FAIL;
+ }
+
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  UnmapViewOfFile( map->memory );
+  CloseHandle( map->file_mapping );
+#else
+  munmap( map->memory, map->length );
+#endif
+
+  return COSM_PASS;
+}
+
+static u64 Cosm_FileMapGranule( void )
+{
+  /*
+    Mappings made by the readers and writers start on a multiple of this,
+    64KiB also covers the Windows allocation granularity.
+    Returns: The granule in bytes.
+  */
+  u64 page;
+
+  page = CosmFileMapPageSize();
+
+  return ( page > 0x10000 ) ? page : 0x10000;
+}
+
+static s32 Cosm_FileMapSlide( cosm_FILE_MAP_READER * reader )
+{
+  /*
+    Replace the reader's window with the one holding reader->offset, and
+    have the OS start reading in the one after it.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+  u64 length;
+
+  if ( reader->map.memory != NULL )
   {
-    return COSM_FILE_ERROR_DENIED;
+    CosmFileUnmap( &reader->map );
+    reader->map.memory = NULL;
   }
 
-  /* translate filename */
-  if ( Cosm_FileNativePath( native_filename, filename ) != COSM_PASS )
+  reader->map_offset = reader->offset - ( reader->offset % reader->window );
+  length = reader->length - reader->map_offset;
+  if ( length > reader->window )
   {
-    return COSM_FILE_ERROR_NAME;
+    length = reader->window;
   }
 
-#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-  if ( _stat64( (const char *) native_filename, &buf ) != 0 )
-#else
-  if ( _STAT( (const char *) native_filename, &buf ) != 0 )
+  if ( Cosm_FileMapOS( &reader->map, reader->file, length,
+    reader->map_offset, 1 ) == NULL )
+  {
+    reader->map.memory = NULL;
+    return COSM_FILE_ERROR_DENIED;
+  }
+#if ( defined( MADV_SEQUENTIAL ) )
+  madvise( reader->map.memory, (size_t) length, MADV_SEQUENTIAL );
 #endif
+
+  if ( ( reader->map_offset + length ) < reader->length )
   {
-    switch( errno )
-    {
-      case ENOENT:
-        return COSM_FILE_ERROR_NOTFOUND;
-        break;
-      case EACCES:
-      default:
-        return COSM_FILE_ERROR_DENIED;
-    }
+    CosmFileAdvise( reader->file, reader->map_offset + length,
+      reader->window, COSM_FILE_ADVISE_WILLNEED );
   }
 
-  /* length */
-  info->length = buf.st_size;
+  return COSM_PASS;
+}
 
-#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-  /* type */
-  if ( ( buf.st_mode & _S_IFREG ) == _S_IFREG )
+s32 CosmFileMapReadOpen( cosm_FILE_MAP_READER * reader, cosm_FILE * file,
+  u64 offset, u64 window )
+{
+  u64 granule;
+  s32 error;
+
+  if ( ( reader == NULL ) || ( file == NULL ) )
   {
-    info->type = COSM_FILE_TYPE_FILE;
+    return COSM_FILE_ERROR_PARAM;
   }
-  else if ( ( buf.st_mode & _S_IFDIR ) == _S_IFDIR )
+
+  if ( file->status != COSM_FILE_STATUS_OPEN )
   {
-    info->type = COSM_FILE_TYPE_DIR;
+    return COSM_FILE_ERROR_CLOSED;
   }
-  else if ( ( buf.st_mode & _S_IFCHR ) == _S_IFCHR )
+
+  if ( ( file->mode & COSM_FILE_MODE_READ ) == 0 )
   {
-    info->type = COSM_FILE_TYPE_DEVICE;
+    return COSM_FILE_ERROR_READMODE;
   }
-  else
+
+  CosmMemSet( reader, sizeof( cosm_FILE_MAP_READER ), 0 );
+
+  /* the mapping sees everything written so far */
+  if ( ( error = CosmFileLength( &reader->length, file ) ) != COSM_PASS )
   {
-    info->type = COSM_FILE_TYPE_SPECIAL;
+    return error;
   }
 
-  /* rights */
-  info->rights = 0;
-  if ( ( buf.st_mode & _S_IREAD ) == _S_IREAD )
+  granule = Cosm_FileMapGranule();
+  if ( window == 0 )
   {
-    info->rights += COSM_FILE_RIGHTS_READ;
+    window = COSM_FILE_MAP_WINDOW;
   }
-  if ( ( buf.st_mode & _S_IWRITE ) == _S_IWRITE )
+  reader->window = ( ( window + granule - 1 ) / granule ) * granule;
+  reader->file = file;
+  reader->offset = ( offset < reader->length ) ? offset : reader->length;
+
+  return COSM_PASS;
+}
+
+s32 CosmFileMapRead( const void ** data, u64 * bytes,
+  cosm_FILE_MAP_READER * reader, u64 max )
+{
+  u64 left;
+  s32 error;
+
+  if ( ( data == NULL ) || ( bytes == NULL ) || ( reader == NULL )
+    || ( reader->file == NULL ) )
   {
-    info->rights += COSM_FILE_RIGHTS_WRITE;
-    info->rights += COSM_FILE_RIGHTS_APPEND;
+    return COSM_FILE_ERROR_PARAM;
   }
-  if ( ( buf.st_mode & _S_IEXEC ) == _S_IEXEC )
+
+  *data = NULL;
+  *bytes = 0;
+
+  if ( reader->offset >= reader->length )
   {
-    info->rights += COSM_FILE_RIGHTS_EXEC;
+    return COSM_FILE_ERROR_EOF;
   }
-#else /* OS */
-  /* type */
-  if ( ( buf.st_mode & S_IFREG ) == S_IFREG )
+
+  if ( ( reader->map.memory == NULL ) || ( reader->offset
+    >= ( reader->map_offset + reader->map.length ) ) )
   {
-    info->type = COSM_FILE_TYPE_FILE;
+    if ( ( error = Cosm_FileMapSlide( reader ) ) != COSM_PASS )
+    {
+      return error;
+    }
   }
-  else if ( ( buf.st_mode & S_IFDIR ) == S_IFDIR )
+
+  left = reader->map_offset + reader->map.length - reader->offset;
+  if ( ( max > 0 ) && ( left > max ) )
   {
-    info->type = COSM_FILE_TYPE_DIR;
+    left = max;
   }
-  else if ( ( ( buf.st_mode & S_IFCHR ) == S_IFCHR ) ||
-    ( ( buf.st_mode & S_IFBLK ) == S_IFBLK ) )
+  *data = CosmMemOffset( reader->map.memory,
+    reader->offset - reader->map_offset );
+  *bytes = left;
+  reader->offset += left;
+
+  return COSM_PASS;
+}
+
+s32 CosmFileMapReadClose( cosm_FILE_MAP_READER * reader )
+{
+  if ( reader == NULL )
   {
-    info->type = COSM_FILE_TYPE_DEVICE;
+    return COSM_FILE_ERROR_PARAM;
   }
-  else
+
+  if ( reader->map.memory != NULL )
   {
-    info->type = COSM_FILE_TYPE_SPECIAL;
+    CosmFileUnmap( &reader->map );
   }
+  CosmMemSet( reader, sizeof( cosm_FILE_MAP_READER ), 0 );
 
-  /* rights */
-  info->rights = 0;
-  if ( ( buf.st_mode & S_IRUSR ) == S_IRUSR )
+  return COSM_PASS;
+}
+
+static s32 Cosm_FileResize( cosm_FILE * file, u64 length )
+{
+  /*
+    Set the file's length, the space added reads as zeros. Unlike
+    Cosm_FileTruncate there is no wipe, the writers only cut off space
+    they reserved and never wrote.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  s32 error;
+
+  if ( ( error = Cosm_FileSeek( file, length ) ) != COSM_PASS )
   {
-    info->rights += COSM_FILE_RIGHTS_READ;
+    return error;
   }
-  if ( ( buf.st_mode & S_IWUSR ) == S_IWUSR )
+  if ( SetEndOfFile( file->handle ) == 0 )
   {
-    info->rights += COSM_FILE_RIGHTS_WRITE;
-    info->rights += COSM_FILE_RIGHTS_APPEND;
+    return COSM_FILE_ERROR_DENIED;
   }
-  if ( ( buf.st_mode & S_IXUSR ) == S_IXUSR )
+#else
+  if ( ftruncate( (int) (u32) file->handle, (off_t) length ) != 0 )
   {
-    info->rights += COSM_FILE_RIGHTS_EXEC;
+    return ( ( errno == ENOSPC ) || ( errno == EFBIG ) )
+      ? COSM_FILE_ERROR_NOSPACE : COSM_FILE_ERROR_DENIED;
   }
-#endif /* OS */
+#endif
 
-  /* times */
-  _COSM_SET128( unix_epoc, 00000000386D4380, 0000000000000000 );
+  return COSM_PASS;
+}
 
-  info->create.hi = (s64) buf.st_mtime;
-  info->create.lo = 0x0000000000000000LL;
-  info->create = CosmS128Sub( info->create, unix_epoc );
+static s32 Cosm_FileMapGrow( cosm_FILE_MAP_WRITER * writer, u64 need )
+{
+  /*
+    Make room for need more bytes. The file is extended by whole steps,
+    with the disk space allocated up front where the OS can so the writes
+    through the mapping can't fail for space, and mapped again from the
+    start of the last part written.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+  u64 reserve, granule;
+  s32 error;
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_FREEBSD ) )
+  int result;
+#endif
 
-  info->modify.hi = (s64) buf.st_ctime;
-  info->modify.lo = 0x0000000000000000LL;
-  info->modify = CosmS128Sub( info->modify, unix_epoc );
+  if ( writer->map.memory != NULL )
+  {
+    CosmFileUnmap( &writer->map );
+    writer->map.memory = NULL;
+  }
 
-  info->access.hi = (s64) buf.st_atime;
-  info->access.lo = 0x0000000000000000LL;
-  info->access = CosmS128Sub( info->access, unix_epoc );
+  reserve = ( ( writer->length + need + writer->step - 1 ) / writer->step )
+    * writer->step;
+  if ( reserve > writer->reserved )
+  {
+    error = COSM_FAIL;
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_FREEBSD ) )
+    if ( ( result = posix_fallocate( (int) (u32) writer->file->handle,
+      (off_t) writer->reserved, (off_t) ( reserve - writer->reserved ) ) )
+      == 0 )
+    {
+      error = COSM_PASS;
+    }
+    else if ( result == ENOSPC )
+    {
+      return COSM_FILE_ERROR_NOSPACE;
+    }
+#endif
+    /* without fallocate the file is just made longer */
+    if ( ( error != COSM_PASS ) && ( ( error = Cosm_FileResize(
+      writer->file, reserve ) ) != COSM_PASS ) )
+    {
+      return error;
+    }
+    writer->reserved = reserve;
+  }
+
+  granule = Cosm_FileMapGranule();
+  writer->map_offset = writer->length - ( writer->length % granule );
+  if ( Cosm_FileMapOS( &writer->map, writer->file,
+    writer->reserved - writer->map_offset, writer->map_offset, 0 ) == NULL )
+  {
+    writer->map.memory = NULL;
+    return COSM_FILE_ERROR_DENIED;
+  }
 
   return COSM_PASS;
 }
 
-u64 CosmFileMapPageSize( void )
+s32 CosmFileMapWriteOpen( cosm_FILE_MAP_WRITER * writer, cosm_FILE * file,
+  u64 step )
 {
-#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-  SYSTEM_INFO info;
+  u64 granule;
+  s32 error;
 
-  GetSystemInfo( &info );
-  return (u64) info.dwPageSize;
-#else
-  return (u64) getpagesize();
-#endif
-}
+  if ( ( writer == NULL ) || ( file == NULL ) )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
 
-void * CosmFileMap( cosm_FILE_MEMORY_MAP * map, cosm_FILE * file,
-  u64 length, u64 offset )
-{
-  void * addr;
-  int access;
-#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-  int map_mode;
-#endif
+  if ( file->status != COSM_FILE_STATUS_OPEN )
+  {
+    return COSM_FILE_ERROR_CLOSED;
+  }
 
-  if ( ( NULL == map ) || ( NULL == file ) || ( 0 == length ) )
+  if ( ( file->mode & COSM_FILE_MODE_READ ) == 0 )
   {
-    return NULL;
+    return COSM_FILE_ERROR_READMODE;
   }
 
-#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-  if ( ( file->mode & COSM_FILE_MODE_READ )
-    && ( file->mode & COSM_FILE_MODE_WRITE ) )
+  if ( ( ( file->mode & COSM_FILE_MODE_WRITE ) == 0 )
+    || ( file->mode & COSM_FILE_MODE_APPEND ) )
   {
-    access = PAGE_READWRITE;
-    map_mode = FILE_MAP_WRITE;
+    return COSM_FILE_ERROR_WRITEMODE;
   }
-  else if ( file->mode & COSM_FILE_MODE_READ )
+
+  CosmMemSet( writer, sizeof( cosm_FILE_MAP_WRITER ), 0 );
+
+  if ( ( error = CosmFileLength( &writer->length, file ) ) != COSM_PASS )
   {
-    access = PAGE_READONLY;
-    map_mode = FILE_MAP_READ;
+    return error;
   }
-  else
+
+  granule = Cosm_FileMapGranule();
+  if ( step == 0 )
   {
-    /* not a valid mode for the open file */
-    return NULL;
+    step = COSM_FILE_MAP_STEP;
   }
+  writer->step = ( ( step + granule - 1 ) / granule ) * granule;
+  writer->file = file;
+  writer->reserved = writer->length;
 
-  if ( NULL == ( map->file_mapping = CreateFileMapping(
-    file->handle, NULL, access, 0xFFFFFFFF, 0xFFFFFFFF, NULL ) ) )
+  return COSM_PASS;
+}
+
+s32 CosmFileMapWrite( cosm_FILE_MAP_WRITER * writer, const void * data,
+  u64 length )
+{
+  s32 error;
+
+  if ( ( writer == NULL ) || ( writer->file == NULL )
+    || ( ( data == NULL ) && ( length > 0 ) ) )
   {
-    /* bad failure */
-    return NULL;
+    return COSM_FILE_ERROR_PARAM;
   }
 
-  if ( NULL == ( addr = MapViewOfFile( map->file_mapping,
-    map_mode, (u32) ( offset >> 32 ), (u32) offset, (SIZE_T) length ) ) )
+  if ( length == 0 )
   {
-    CloseHandle( map->file_mapping );
-    return NULL;
+    return COSM_PASS;
   }
-#else
-  access = ( ( file->mode & COSM_FILE_LOCK_READ ) ? PROT_READ : 0 )
-    | ( ( file->mode & COSM_FILE_LOCK_WRITE ) ? PROT_WRITE : 0 )
-    | ( ( file->mode & COSM_FILE_MODE_APPEND ) ? PROT_WRITE : 0 );
 
-  if ( NULL == ( addr = mmap( NULL, length, access, MAP_SHARED,
-    file->handle, offset ) ) )
+  if ( ( writer->map.memory == NULL )
+    || ( ( writer->length + length ) > writer->reserved ) )
   {
-    return NULL;
+    if ( ( error = Cosm_FileMapGrow( writer, length ) ) != COSM_PASS )
+    {
+      return error;
+    }
   }
-#endif
 
-  map->memory = addr;
-  map->length = length;
-  return addr;
+  CosmMemCopy( CosmMemOffset( writer->map.memory,
+    writer->length - writer->map_offset ), data, length );
+  writer->length += length;
+
+  return COSM_PASS;
 }
 
-s32 CosmFileUnmap( cosm_FILE_MEMORY_MAP * map )
+s32 CosmFileMapWriteClose( cosm_FILE_MAP_WRITER * writer )
 {
- if ( ( NULL == map ) || ( NULL == map->memory ) )
- {
-   return COSM_FAIL;
- }
+  s32 error;
+
+  if ( ( writer == NULL ) || ( writer->file == NULL ) )
+  {
+    return COSM_FILE_ERROR_PARAM;
+  }
 
+  error = COSM_PASS;
+  if ( writer->map.memory != NULL )
+  {
 #if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-  UnmapViewOfFile( map->memory );
-  CloseHandle( map->file_mapping );
-#else
-  munmap( map->memory, map->length );
+    if ( writer->file->mode & COSM_FILE_MODE_SYNC )
+    {
+      FlushViewOfFile( writer->map.memory, 0 );
+    }
 #endif
+    CosmFileUnmap( &writer->map );
+  }
+
+  /* give back the space past what was written, later writes follow on */
+  if ( writer->reserved != writer->length )
+  {
+    error = Cosm_FileResize( writer->file, writer->length );
+  }
+  if ( error == COSM_PASS )
+  {
+    error = Cosm_FileSeek( writer->file, writer->length );
+  }
+
+  if ( ( error == COSM_PASS )
+    && ( writer->file->mode & COSM_FILE_MODE_SYNC ) )
+  {
+    error = Cosm_FileSyncOS( writer->file );
+  }
+  CosmMemSet( writer, sizeof( cosm_FILE_MAP_WRITER ), 0 );
 
-  return COSM_PASS;
+  return error;
 }
 
 
 s32 CosmFileClose( cosm_FILE * file )
 {
+  s32 error;
+
   if ( file == NULL )
   {
     return COSM_FILE_ERROR_NOTFOUND;
@@ -822,6 +3179,13 @@ s32 CosmFileClose( cosm_FILE * file )
     return COSM_FILE_ERROR_CLOSED;
   }
 
+  /* make waiting writes while still holding any lock */
+  error = ( file->buffer_state == COSM_FILE_BUFFER_WRITE )
+    ? Cosm_FileBufferSync( file ) : COSM_PASS;
+  CosmMemFree( file->buffer );
+  file->buffer = NULL;
+  Cosm_FileBufferDrop( file );
+
   /* Release lock */
   Cosm_FileUnLock( file );
   /* !!! deal with failed case, not good, very very not good */
@@ -841,8 +3205,7 @@ s32 CosmFileClose( cosm_FILE * file )
 
   file->status = COSM_FILE_STATUS_CLOSED;
 
-
-  return COSM_PASS;
+  return error;
 }
 
 /* Directory functions. */
@@ -1193,35 +3556,562 @@ s32 CosmDirRead( cosm_FILENAME * buffer, u64 * names_read, u64 length,
       }
     }
   }
-#endif /* OS */
-
-  return COSM_PASS;
-}
+#endif /* OS */
+
+  return COSM_PASS;
+}
+
+s32 CosmDirClose( cosm_DIR * dir )
+{
+  if ( dir == NULL )
+  {
+    return COSM_DIR_ERROR_NOTFOUND;
+  }
+
+  if ( dir->status != COSM_DIR_STATUS_OPEN )
+  {
+    return COSM_DIR_ERROR_CLOSED;
+  }
+
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  if ( FindClose( dir->handle ) == 0 )
+#else
+  if ( closedir( dir->handle ) != 0 )
+#endif
+  {
+    return COSM_DIR_ERROR_NOTFOUND;
+  }
+
+  dir->status = COSM_DIR_STATUS_CLOSED;
+
+  return COSM_PASS;
+}
+
+#if ( COSM_FILE_PATHMODE == COSM_FILE_PATH_DOS )
+#define COSM_DIR_WALK_SLASH '\\'
+#elif ( COSM_FILE_PATHMODE == COSM_FILE_PATH_MAC )
+#define COSM_DIR_WALK_SLASH ':'
+#else
+#define COSM_DIR_WALK_SLASH '/'
+#endif
+
+#define COSM_DIR_WALK_BATCH 0x20000 /* bytes of names read at a time */
+
+typedef struct cosm_DIR_JOB
+{
+  struct cosm_DIR_JOB * next;
+  u32 depth;
+  cosm_FILENAME path;      /* native path of a directory to read */
+} cosm_DIR_JOB;
+
+typedef struct cosm_DIR_WALK
+{
+  cosm_MUTEX lock;
+  cosm_SEMAPHORE work;     /* one up for each job pushed while idle > 0 */
+  cosm_DIR_JOB * jobs;     /* directories still to read, newest first */
+  cosm_DIR_FILTER filter;
+  cosm_DIR_CALLBACK callback;
+  void * arg;
+  u32 flags;
+  u32 active;              /* directories being read */
+  u32 idle;                /* threads waiting for a job */
+  u32 threads;             /* worker threads running */
+  u32 stop;
+  s32 error;
+} cosm_DIR_WALK;
+
+#if ( OS_TYPE == OS_LINUX )
+typedef struct cosm_DIR_DIRENT64
+{
+  u64 d_ino;
+  s64 d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+} cosm_DIR_DIRENT64;
+#endif
+
+static void Cosm_DirWalkError( cosm_DIR_WALK * walk, s32 error )
+{
+  /*
+    Record the first error of the walk, COSM_DIR_ERROR_ABORT replaces any
+    other and stops the walk.
+    Returns: nothing.
+  */
+  u32 i;
+
+  CosmMutexLock( &walk->lock, COSM_MUTEX_WAIT );
+  if ( walk->error == COSM_PASS )
+  {
+    walk->error = error;
+  }
+  if ( error == COSM_DIR_ERROR_ABORT )
+  {
+    walk->error = error;
+    walk->stop = 1;
+    for ( i = 0 ; i < walk->idle ; i++ )
+    {
+      CosmSemaphoreUp( &walk->work );
+    }
+  }
+  CosmMutexUnlock( &walk->lock );
+}
+
+static s32 Cosm_DirWalkPush( cosm_DIR_WALK * walk, const ascii * path,
+  u32 depth )
+{
+  /*
+    Queue the directory path to be read, waking a thread if one is idle.
+    Returns: COSM_PASS on success, or COSM_DIR_ERROR_DENIED if out of
+      memory.
+  */
+  cosm_DIR_JOB * job;
+
+  if ( ( job = CosmMemAlloc( sizeof( cosm_DIR_JOB ) ) ) == NULL )
+  {
+    return COSM_DIR_ERROR_DENIED;
+  }
+  CosmStrCopy( job->path, path, (u64) COSM_FILE_MAX_FILENAME );
+  job->depth = depth;
+
+  CosmMutexLock( &walk->lock, COSM_MUTEX_WAIT );
+  job->next = walk->jobs;
+  walk->jobs = job;
+  if ( walk->idle > 0 )
+  {
+    CosmSemaphoreUp( &walk->work );
+  }
+  CosmMutexUnlock( &walk->lock );
+
+  return COSM_PASS;
+}
+
+#if ( defined( DT_DIR ) )
+static u32 Cosm_DirWalkType( u32 d_type )
+{
+  /*
+    Map a directory entry type to a COSM_FILE_TYPE.
+    Returns: The type, COSM_FILE_TYPE_UNKNOWN if it takes a stat to tell.
+  */
+  switch ( d_type )
+  {
+    case DT_REG:
+      return COSM_FILE_TYPE_FILE;
+    case DT_DIR:
+      return COSM_FILE_TYPE_DIR;
+    case DT_CHR:
+    case DT_BLK:
+      return COSM_FILE_TYPE_DEVICE;
+    case DT_UNKNOWN:
+      return COSM_FILE_TYPE_UNKNOWN;
+    default:
+      return COSM_FILE_TYPE_SPECIAL;
+  }
+}
+#endif
+
+static s32 Cosm_DirWalkStat( cosm_FILE_INFO * info, int dir_fd,
+  const ascii * name, const ascii * path )
+{
+  /*
+    Fill in info for name in the open directory dir_fd, or for path on
+    systems without fstatat. Links are not followed.
+    Returns: COSM_PASS on success, or COSM_DIR_ERROR_NOTFOUND if the entry
+      is gone.
+  */
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  if ( CosmFileInfo( info, path ) != COSM_PASS )
+  {
+    return COSM_DIR_ERROR_NOTFOUND;
+  }
+  return COSM_PASS;
+#else
+  struct _STAT buf;
+
+  if ( _FSTATAT( dir_fd, (const char *) name, &buf,
+    AT_SYMLINK_NOFOLLOW ) != 0 )
+  {
+    return COSM_DIR_ERROR_NOTFOUND;
+  }
+  return Cosm_FileInfoStat( info, &buf );
+#endif
+}
+
+static s32 Cosm_DirWalkEntry( cosm_DIR_WALK * walk, cosm_DIR_JOB * job,
+  int dir_fd, const ascii * name, u32 type )
+{
+  /*
+    Filter, report, and queue the entry name of the directory in job, type
+    is COSM_FILE_TYPE_UNKNOWN when the directory didn't give it.
+    Returns: COSM_PASS, or COSM_DIR_ERROR_ABORT to stop the walk.
+  */
+  cosm_FILENAME path;
+  cosm_DIR_ENTRY entry;
+  u64 base, bytes;
+  u32 have_info;
+  s32 result;
+
+  if ( ( name[0] == '.' ) && ( ( name[1] == 0 )
+    || ( ( name[1] == '.' ) && ( name[2] == 0 ) ) ) )
+  {
+    return COSM_PASS;
+  }
+
+  base = CosmStrBytes( job->path );
+  bytes = CosmStrBytes( name );
+  if ( ( base + bytes + 2 ) > (u64) COSM_FILE_MAX_FILENAME )
+  {
+    Cosm_DirWalkError( walk, COSM_DIR_ERROR_NAME );
+    return COSM_PASS;
+  }
+  CosmMemCopy( path, job->path, base );
+  if ( ( base > 0 ) && ( path[base - 1] != COSM_DIR_WALK_SLASH ) )
+  {
+    path[base++] = COSM_DIR_WALK_SLASH;
+  }
+  CosmMemCopy( &path[base], name, bytes + 1 );
+
+  CosmMemSet( &entry, sizeof( cosm_DIR_ENTRY ), 0 );
+  entry.path = path;
+  entry.name = &path[base];
+  entry.depth = job->depth + 1;
+
+  /* only stat when the directory doesn't say what it is */
+  have_info = 0;
+  if ( type == COSM_FILE_TYPE_UNKNOWN )
+  {
+    if ( Cosm_DirWalkStat( &entry.info, dir_fd, name, path ) != COSM_PASS )
+    {
+      /* gone since the directory was read */
+      return COSM_PASS;
+    }
+    have_info = 1;
+  }
+  else
+  {
+    entry.info.type = type;
+  }
+
+  result = COSM_DIR_FILTER_PASS;
+  if ( walk->filter != NULL )
+  {
+    result = walk->filter( walk->arg, &entry );
+    if ( result == COSM_DIR_FILTER_SKIP )
+    {
+      return COSM_PASS;
+    }
+  }
+
+  if ( ( ( walk->flags & COSM_DIR_WALK_INFO ) != 0 ) && ( have_info == 0 ) )
+  {
+    if ( Cosm_DirWalkStat( &entry.info, dir_fd, name, path ) != COSM_PASS )
+    {
+      return COSM_PASS;
+    }
+  }
+
+  if ( walk->callback( walk->arg, &entry ) != COSM_PASS )
+  {
+    return COSM_DIR_ERROR_ABORT;
+  }
+
+  if ( ( entry.info.type == COSM_FILE_TYPE_DIR )
+    && ( result != COSM_DIR_FILTER_PRUNE ) )
+  {
+    if ( Cosm_DirWalkPush( walk, path, entry.depth ) != COSM_PASS )
+    {
+      Cosm_DirWalkError( walk, COSM_DIR_ERROR_DENIED );
+    }
+  }
+
+  return COSM_PASS;
+}
+
+static void Cosm_DirWalkList( cosm_DIR_WALK * walk, cosm_DIR_JOB * job,
+  u8 * batch )
+{
+  /*
+    Read the directory in job, passing each entry to Cosm_DirWalkEntry.
+    batch is COSM_DIR_WALK_BATCH bytes of space for the names.
+    Returns: nothing, errors are recorded in the walk.
+  */
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  HANDLE handle;
+  WIN32_FIND_DATA find_data;
+  cosm_FILENAME pattern;
+  u64 length;
+#elif ( OS_TYPE == OS_LINUX )
+  cosm_DIR_DIRENT64 * dirent;
+  long bytes, offset;
+  int fd;
+#else
+  DIR * handle;
+  struct dirent * dirent;
+#endif
+  u32 type;
+  s32 error;
+
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  length = CosmStrBytes( job->path );
+  if ( ( length + 3 ) > (u64) COSM_FILE_MAX_FILENAME )
+  {
+    Cosm_DirWalkError( walk, COSM_DIR_ERROR_NAME );
+    return;
+  }
+  CosmMemCopy( pattern, job->path, length );
+  if ( ( length > 0 ) && ( pattern[length - 1] != '\\' ) )
+  {
+    pattern[length++] = '\\';
+  }
+  pattern[length++] = '*';
+  pattern[length] = 0;
+
+  if ( ( handle = FindFirstFile( (LPCTSTR) pattern, &find_data ) )
+    == INVALID_HANDLE_VALUE )
+  {
+    Cosm_DirWalkError( walk, COSM_DIR_ERROR_DENIED );
+    return;
+  }
+  do
+  {
+    /* junctions and links are not followed */
+    if ( find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT )
+    {
+      type = COSM_FILE_TYPE_SPECIAL;
+    }
+    else if ( find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+    {
+      type = COSM_FILE_TYPE_DIR;
+    }
+    else
+    {
+      type = COSM_FILE_TYPE_FILE;
+    }
+    error = Cosm_DirWalkEntry( walk, job, -1,
+      (const ascii *) find_data.cFileName, type );
+  } while ( ( error == COSM_PASS ) && ( walk->stop == 0 )
+    && ( FindNextFile( handle, &find_data ) != 0 ) );
+  FindClose( handle );
+#elif ( OS_TYPE == OS_LINUX )
+  do
+  {
+    fd = open( (const char *) job->path, O_RDONLY | O_DIRECTORY
+      | O_CLOEXEC );
+  } while ( ( fd == -1 ) && ( errno == EINTR ) );
+  if ( fd == -1 )
+  {
+    Cosm_DirWalkError( walk, ( errno == ENOENT )
+      ? COSM_DIR_ERROR_NOTFOUND : COSM_DIR_ERROR_DENIED );
+    return;
+  }
+
+  /* a whole batch of names and types per system call */
+  error = COSM_PASS;
+  while ( ( error == COSM_PASS ) && ( walk->stop == 0 ) )
+  {
+    bytes = syscall( SYS_getdents64, fd, batch, COSM_DIR_WALK_BATCH );
+    if ( bytes <= 0 )
+    {
+      if ( ( bytes == -1 ) && ( errno == EINTR ) )
+      {
+        continue;
+      }
+      if ( bytes == -1 )
+      {
+        Cosm_DirWalkError( walk, COSM_DIR_ERROR_DENIED );
+      }
+      break;
+    }
+    for ( offset = 0 ; ( offset < bytes ) && ( error == COSM_PASS ) ;
+      offset += dirent->d_reclen )
+    {
+      dirent = (cosm_DIR_DIRENT64 *) &batch[offset];
+      type = Cosm_DirWalkType( dirent->d_type );
+      error = Cosm_DirWalkEntry( walk, job, fd,
+        (const ascii *) dirent->d_name, type );
+    }
+  }
+  close( fd );
+#else
+  if ( ( handle = opendir( (const char *) job->path ) ) == NULL )
+  {
+    Cosm_DirWalkError( walk, ( errno == ENOENT )
+      ? COSM_DIR_ERROR_NOTFOUND : COSM_DIR_ERROR_DENIED );
+    return;
+  }
+  error = COSM_PASS;
+  while ( ( error == COSM_PASS ) && ( walk->stop == 0 )
+    && ( ( dirent = readdir( handle ) ) != NULL ) )
+  {
+#if ( defined( DT_DIR ) )
+    type = Cosm_DirWalkType( dirent->d_type );
+#else
+    type = COSM_FILE_TYPE_UNKNOWN;
+#endif
+    error = Cosm_DirWalkEntry( walk, job, dirfd( handle ),
+      (const ascii *) dirent->d_name, type );
+  }
+  closedir( handle );
+#endif
+
+  if ( error != COSM_PASS )
+  {
+    Cosm_DirWalkError( walk, error );
+  }
+}
+
+static void Cosm_DirWalkRun( cosm_DIR_WALK * walk, u8 * batch )
+{
+  /*
+    Read directories off the walk's stack until the tree is done, or the
+    walk is stopped. Run by the caller and each worker thread.
+    Returns: nothing.
+  */
+  cosm_DIR_JOB * job;
+  u32 i;
+
+  CosmMutexLock( &walk->lock, COSM_MUTEX_WAIT );
+  while ( walk->stop == 0 )
+  {
+    if ( ( job = walk->jobs ) == NULL )
+    {
+      if ( walk->active == 0 )
+      {
+        /* nothing queued and nothing being read, the tree is done */
+        walk->stop = 1;
+        for ( i = 0 ; i < walk->idle ; i++ )
+        {
+          CosmSemaphoreUp( &walk->work );
+        }
+        break;
+      }
+      walk->idle++;
+      CosmMutexUnlock( &walk->lock );
+      CosmSemaphoreDown( &walk->work, COSM_SEMAPHORE_WAIT );
+      CosmMutexLock( &walk->lock, COSM_MUTEX_WAIT );
+      walk->idle--;
+      continue;
+    }
+    walk->jobs = job->next;
+    walk->active++;
+    CosmMutexUnlock( &walk->lock );
+
+    Cosm_DirWalkList( walk, job, batch );
+    CosmMemFree( job );
+
+    CosmMutexLock( &walk->lock, COSM_MUTEX_WAIT );
+    walk->active--;
+  }
+  CosmMutexUnlock( &walk->lock );
+}
+
+static void Cosm_DirWalkWorker( void * arg )
+{
+  /*
+    Worker thread for CosmDirWalk, arg is the cosm_DIR_WALK.
+    Returns: nothing.
+  */
+  cosm_DIR_WALK * walk;
+  u8 * batch;
+
+  walk = (cosm_DIR_WALK *) arg;
+  if ( ( batch = CosmMemAlloc( COSM_DIR_WALK_BATCH ) ) != NULL )
+  {
+    Cosm_DirWalkRun( walk, batch );
+    CosmMemFree( batch );
+  }
+
+  CosmMutexLock( &walk->lock, COSM_MUTEX_WAIT );
+  walk->threads--;
+  CosmMutexUnlock( &walk->lock );
+}
+
+s32 CosmDirWalk( const ascii * dirname, u32 threads, u32 flags,
+  cosm_DIR_FILTER filter, cosm_DIR_CALLBACK callback, void * arg )
+{
+  cosm_DIR_WALK walk;
+  cosm_DIR_JOB * job;
+  cosm_FILENAME native_dirname;
+  u64 thread_id;
+  u8 * batch;
+  u32 i, running;
+
+  if ( ( dirname == NULL ) || ( callback == NULL ) )
+  {
+    return COSM_DIR_ERROR_PARAM;
+  }
+  if ( flags & ~COSM_DIR_WALK_INFO )
+  {
+    return COSM_DIR_ERROR_MODE;
+  }
+  if ( Cosm_FileNativePath( native_dirname, dirname ) != COSM_PASS )
+  {
+    return COSM_DIR_ERROR_NAME;
+  }
+
+  CosmMemSet( &walk, sizeof( cosm_DIR_WALK ), 0 );
+  walk.filter = filter;
+  walk.callback = callback;
+  walk.arg = arg;
+  walk.flags = flags;
+  walk.error = COSM_PASS;
+
+  if ( CosmMutexInit( &walk.lock ) != COSM_PASS )
+  {
+    return COSM_DIR_ERROR_PARAM;
+  }
+  if ( CosmSemaphoreInit( &walk.work, 0 ) != COSM_PASS )
+  {
+    CosmMutexFree( &walk.lock );
+    return COSM_DIR_ERROR_PARAM;
+  }
+  if ( ( ( batch = CosmMemAlloc( COSM_DIR_WALK_BATCH ) ) == NULL )
+    || ( Cosm_DirWalkPush( &walk, native_dirname, 0 ) != COSM_PASS ) )
+  {
+    CosmMemFree( batch );
+    CosmSemaphoreFree( &walk.work );
+    CosmMutexFree( &walk.lock );
+    return COSM_DIR_ERROR_PARAM;
+  }
 
-s32 CosmDirClose( cosm_DIR * dir )
-{
-  if ( dir == NULL )
+  CosmMutexLock( &walk.lock, COSM_MUTEX_WAIT );
+  for ( i = 1 ; i < threads ; i++ )
   {
-    return COSM_DIR_ERROR_NOTFOUND;
+    if ( CosmThreadBegin( &thread_id, Cosm_DirWalkWorker, &walk,
+      64 * 1024 ) != COSM_PASS )
+    {
+      break;
+    }
+    walk.threads++;
   }
+  CosmMutexUnlock( &walk.lock );
 
-  if ( dir->status != COSM_DIR_STATUS_OPEN )
+  Cosm_DirWalkRun( &walk, batch );
+
+  /* walk is on our stack, so wait for the workers to leave */
+  do
   {
-    return COSM_DIR_ERROR_CLOSED;
-  }
+    CosmMutexLock( &walk.lock, COSM_MUTEX_WAIT );
+    running = walk.threads;
+    CosmMutexUnlock( &walk.lock );
+    if ( running > 0 )
+    {
+      CosmSleep( 1 );
+    }
+  } while ( running > 0 );
 
-#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-  if ( FindClose( dir->handle ) == 0 )
-#else
-  if ( closedir( dir->handle ) != 0 )
-#endif
+  /* anything left after a stop */
+  while ( ( job = walk.jobs ) != NULL )
   {
-    return COSM_DIR_ERROR_NOTFOUND;
+    walk.jobs = job->next;
+    CosmMemFree( job );
   }
 
-  dir->status = COSM_DIR_STATUS_CLOSED;
+  CosmMemFree( batch );
+  CosmSemaphoreFree( &walk.work );
+  CosmMutexFree( &walk.lock );
 
-  return COSM_PASS;
+  return walk.error;
 }
 
 s32 CosmDirDelete( const ascii * dirname )
@@ -1933,6 +4823,80 @@ s32 Cosm_FileWipe( cosm_FILE * file, u64 length )
 
 /* testing */
 
+static void Cosm_FileTestAsync( void * arg, cosm_FILE_REQUEST * request )
+{
+  /*
+    Callback for the async tests, counts good requests in arg.
+    Returns: nothing.
+  */
+  if ( ( request->status == COSM_PASS ) && ( request->bytes == 8 ) )
+  {
+    CosmAtomicAdd32( (u32 *) arg, 1 );
+  }
+}
+
+static void Cosm_FileTestGroup( void * arg )
+{
+  /*
+    Thread for the group tests, writes 50 records to the group in arg.
+    Returns: nothing.
+  */
+  u32 i;
+
+  for ( i = 0 ; i < 50 ; i++ )
+  {
+    CosmFileGroupWrite( (cosm_FILE_GROUP *) arg, "0123456789ABCDE\n", 16 );
+  }
+}
+
+static s32 Cosm_FileTestWalk( void * arg, const cosm_DIR_ENTRY * entry )
+{
+  /*
+    Callback for the walk tests, arg is u32[3] counting the files, the
+    directories, and the bytes in the files.
+    Returns: COSM_PASS.
+  */
+  u32 * counts;
+
+  counts = (u32 *) arg;
+  if ( entry->info.type == COSM_FILE_TYPE_FILE )
+  {
+    CosmAtomicAdd32( &counts[0], 1 );
+    CosmAtomicAdd32( &counts[2], (u32) entry->info.length );
+  }
+  else if ( entry->info.type == COSM_FILE_TYPE_DIR )
+  {
+    CosmAtomicAdd32( &counts[1], 1 );
+  }
+  return COSM_PASS;
+}
+
+static s32 Cosm_FileTestFilter( void * arg, const cosm_DIR_ENTRY * entry )
+{
+  /*
+    Filter for the walk tests, skips "skip" and does not enter "sub".
+    Returns: A COSM_DIR_FILTER result.
+  */
+  if ( CosmStrCmp( entry->name, "skip", 5 ) == 0 )
+  {
+    return COSM_DIR_FILTER_SKIP;
+  }
+  if ( CosmStrCmp( entry->name, "sub", 4 ) == 0 )
+  {
+    return COSM_DIR_FILTER_PRUNE;
+  }
+  return COSM_DIR_FILTER_PASS;
+}
+
+static s32 Cosm_FileTestStop( void * arg, const cosm_DIR_ENTRY * entry )
+{
+  /*
+    Callback for the walk tests that stops the walk.
+    Returns: COSM_FAIL.
+  */
+  return COSM_FAIL;
+}
+
 s32 Cosm_TestOSFile( void )
 {
   cosm_DIR * testdir;
@@ -1940,6 +4904,7 @@ s32 Cosm_TestOSFile( void )
   u8 * testfileimg;  /* Image of the file as it is wrote */
   u8   testpattern1[31] = "1234568790\nabcdefghi\nABCDEFGHI";
   u8   buffer[100];
+  utf8 line[100];
   s32  i, j;
   u64  token_len;  /* len of the tokens we are reading/writting */
   u64  real_write;
@@ -1948,6 +4913,21 @@ s32 Cosm_TestOSFile( void )
   u64  real_offset;
   u8 * hello = (u8*) "Hello World !";
   cosm_FILENAME testfilenames [16];
+  cosm_FILE_ASYNC async;
+  cosm_FILE_REQUEST requests[9];
+  cosm_FILE_REQUEST * list[9];
+  cosm_FILE_VECTOR vector;
+  cosm_FILE_MAP_READER reader;
+  cosm_FILE_MAP_WRITER writer;
+  const void * mapped;
+  const ascii * walk_files[5] = { "testwalk.tmp/a.tmp", "testwalk.tmp/b.tmp",
+    "testwalk.tmp/sub/c.tmp", "testwalk.tmp/sub/deep/d.tmp",
+    "testwalk.tmp/skip/e.tmp" };
+  u32 counts[3];
+  cosm_FILE_GROUP group;
+  cosm_FILE_WATCH watch;
+  u64 thread_id;
+  u32 count, started;
   s32 error;
 
   const u8 bytes1[16] = /* the number 0x0102030405060708090A0B0C0D0E0F10 */
@@ -2485,6 +5465,541 @@ bcdefg
     return -52;
   }
 
+/*
+  Test functions : CosmFileReadLine, CosmFileBuffer, and buffered reads
+  and writes mixed with seeks
+*/
+
+  if ( CosmFileOpen( testfile, "os_file.tst", COSM_FILE_MODE_CREATE
+    | COSM_FILE_MODE_READ | COSM_FILE_MODE_WRITE | COSM_FILE_MODE_TRUNCATE,
+    COSM_FILE_LOCK_NONE ) != COSM_PASS )
+  {
+    return -61;
+  }
+
+  for ( i = 0 ; i < 100 ; i++ )
+  {
+    CosmPrintStr( line, 100, "line %i\n", i );
+    if ( CosmFileWrite( testfile, &real_write, line, CosmStrBytes( line ) )
+      != COSM_PASS )
+    {
+      return -61;
+    }
+  }
+
+  /* 10 lines of 7 bytes and 90 of 8 */
+  if ( ( CosmFileLength( &real_length, testfile ) != COSM_PASS )
+    || ( real_length != 790 ) || ( CosmFileSeek( testfile, 0 ) != COSM_PASS ) )
+  {
+    return -62;
+  }
+
+  for ( i = 0 ; i < 100 ; i++ )
+  {
+    CosmPrintStr( line, 100, "line %i\n", i );
+    if ( ( CosmFileReadLine( (utf8 *) buffer, &real_read, testfile, 100 )
+      != COSM_PASS ) || ( real_read != CosmStrBytes( line ) )
+      || ( CosmStrCmp( (utf8 *) buffer, line, 100 ) != 0 ) )
+    {
+      return -63;
+    }
+  }
+  if ( ( CosmFileReadLine( (utf8 *) buffer, &real_read, testfile, 100 )
+    != COSM_FILE_ERROR_EOF ) || ( real_read != 0 ) || ( buffer[0] != 0 )
+    || ( CosmFileTell( &real_offset, testfile ) != COSM_PASS )
+    || ( real_offset != 790 ) )
+  {
+    return -64;
+  }
+
+  /* a write after a short read lands where the read stopped */
+  if ( ( CosmFileSeek( testfile, 0 ) != COSM_PASS )
+    || ( CosmFileReadLine( (utf8 *) buffer, &real_read, testfile, 100 )
+    != COSM_PASS ) || ( CosmFileTell( &real_offset, testfile ) != COSM_PASS )
+    || ( real_offset != 7 )
+    || ( CosmFileWrite( testfile, &real_write, "LINE", 4 ) != COSM_PASS )
+    || ( CosmFileSeek( testfile, 7 ) != COSM_PASS )
+    || ( CosmFileReadLine( (utf8 *) buffer, &real_read, testfile, 100 )
+    != COSM_PASS ) || ( CosmStrCmp( (utf8 *) buffer, "LINE 1\n", 100 ) ) )
+  {
+    return -65;
+  }
+
+  /* lines longer than the space are split */
+  if ( ( CosmFileSeek( testfile, 0 ) != COSM_PASS )
+    || ( CosmFileReadLine( (utf8 *) buffer, &real_read, testfile, 5 )
+    != COSM_PASS ) || ( real_read != 4 )
+    || ( CosmStrCmp( (utf8 *) buffer, "line", 100 ) )
+    || ( CosmFileReadLine( (utf8 *) buffer, &real_read, testfile, 100 )
+    != COSM_PASS ) || ( CosmStrCmp( (utf8 *) buffer, " 0\n", 100 ) ) )
+  {
+    return -66;
+  }
+
+  /* and without a buffer */
+  if ( ( CosmFileBuffer( testfile, 0 ) != COSM_PASS )
+    || ( CosmFileReadLine( (utf8 *) buffer, &real_read, testfile, 100 )
+    != COSM_PASS ) || ( CosmStrCmp( (utf8 *) buffer, "LINE 1\n", 100 ) )
+    || ( CosmFileClose( testfile ) != COSM_PASS ) )
+  {
+    return -67;
+  }
+
+  if ( ( CosmFileOpen( testfile, "os_file.tst", COSM_FILE_MODE_READ
+    | COSM_FILE_MODE_NOBUFFER, COSM_FILE_LOCK_NONE ) != COSM_PASS )
+    || ( CosmFileReadLine( (utf8 *) buffer, &real_read, testfile, 100 )
+    != COSM_PASS ) || ( CosmStrCmp( (utf8 *) buffer, "line 0\n", 100 ) )
+    || ( CosmFileClose( testfile ) != COSM_PASS )
+    || ( CosmFileDelete( "os_file.tst" ) != COSM_PASS ) )
+  {
+    return -68;
+  }
+
+/*
+  Test functions : CosmFileReadAt, CosmFileWriteAt, CosmFileReadAtV,
+    CosmFileWriteAtV, CosmFileAdvise
+*/
+
+  if ( ( CosmFileOpen( testfile, "os_file.tst", COSM_FILE_MODE_CREATE
+    | COSM_FILE_MODE_READ | COSM_FILE_MODE_WRITE | COSM_FILE_MODE_TRUNCATE,
+    COSM_FILE_LOCK_NONE ) != COSM_PASS )
+    || ( CosmFileWriteAt( testfile, &real_write, hello, 13, 10 )
+    != COSM_PASS ) || ( real_write != 13 )
+    || ( CosmFileTell( &real_offset, testfile ) != COSM_PASS )
+    || ( real_offset != 0 )
+    || ( CosmFileLength( &real_length, testfile ) != COSM_PASS )
+    || ( real_length != 23 ) )
+  {
+    return -69;
+  }
+
+  /* positional reads see buffered writes, writes drop stale read-ahead */
+  if ( ( CosmFileWrite( testfile, &real_write, "0123456789", 10 )
+    != COSM_PASS )
+    || ( CosmFileReadAt( buffer, &real_read, testfile, 100, 0 )
+    != COSM_PASS ) || ( real_read != 23 )
+    || ( CosmMemCmp( buffer, "0123456789Hello World !", 23 ) != 0 )
+    || ( CosmFileSeek( testfile, 0 ) != COSM_PASS )
+    || ( CosmFileRead( buffer, &real_read, testfile, 1 ) != COSM_PASS )
+    || ( CosmFileWriteAt( testfile, &real_write, "Z", 1, 1 ) != COSM_PASS )
+    || ( CosmFileRead( buffer, &real_read, testfile, 1 ) != COSM_PASS )
+    || ( buffer[0] != 'Z' )
+    || ( CosmFileReadAt( buffer, &real_read, testfile, 10, 23 )
+    != COSM_FILE_ERROR_EOF ) || ( real_read != 0 ) )
+  {
+    return -70;
+  }
+
+  {
+    cosm_FILE_VECTOR vector[3];
+
+    vector[0].data = testpattern1;
+    vector[0].length = 11;
+    vector[1].data = NULL;
+    vector[1].length = 0;
+    vector[2].data = &testpattern1[21];
+    vector[2].length = 10;
+    if ( ( CosmFileWriteAtV( testfile, &real_write, vector, 3, 30 )
+      != COSM_PASS ) || ( real_write != 21 ) )
+    {
+      return -71;
+    }
+
+    CosmMemSet( buffer, 100, 0 );
+    vector[0].data = buffer;
+    vector[0].length = 3;
+    vector[1].data = &buffer[50];
+    vector[1].length = 30;
+    if ( ( CosmFileReadAtV( vector, &real_read, testfile, 2, 30 )
+      != COSM_PASS ) || ( real_read != 21 )
+      || ( CosmMemCmp( buffer, "123", 3 ) != 0 )
+      || ( CosmMemCmp( &buffer[50], "4568790\nABCDEFGHI", 18 ) != 0 ) )
+    {
+      return -71;
+    }
+  }
+
+  if ( ( CosmFileAdvise( testfile, 0, 0, COSM_FILE_ADVISE_SEQUENTIAL )
+    != COSM_PASS )
+    || ( CosmFileAdvise( testfile, 0, 4096, COSM_FILE_ADVISE_WILLNEED )
+    != COSM_PASS )
+    || ( CosmFileAdvise( testfile, 0, 0, 99 ) != COSM_FILE_ERROR_PARAM )
+    || ( CosmFileClose( testfile ) != COSM_PASS ) )
+  {
+    return -72;
+  }
+
+  if ( ( CosmFileOpen( testfile, "os_file.tst", COSM_FILE_MODE_APPEND,
+    COSM_FILE_LOCK_NONE ) != COSM_PASS )
+    || ( CosmFileWriteAt( testfile, &real_write, "x", 1, 0 )
+    != COSM_FILE_ERROR_DENIED )
+    || ( CosmFileReadAt( buffer, &real_read, testfile, 1, 0 )
+    != COSM_FILE_ERROR_READMODE )
+    || ( CosmFileClose( testfile ) != COSM_PASS )
+    || ( CosmFileDelete( "os_file.tst" ) != COSM_PASS ) )
+  {
+    return -73;
+  }
+
+/*
+  Test functions : CosmFileAsyncInit, CosmFileAsyncBuffers,
+    CosmFileAsyncSubmit, CosmFileAsyncReap, CosmFileAsyncFree
+*/
+
+  /* io_uring if there is one, then the pool */
+  for ( j = 0 ; j < 2 ; j++ )
+  {
+    if ( ( CosmFileOpen( testfile, "os_file.tst", COSM_FILE_MODE_CREATE
+      | COSM_FILE_MODE_READ | COSM_FILE_MODE_WRITE | COSM_FILE_MODE_TRUNCATE,
+      COSM_FILE_LOCK_NONE ) != COSM_PASS )
+      || ( CosmFileAsyncInit( &async, 8, 2,
+      ( j == 0 ) ? 0 : COSM_FILE_ASYNC_THREADS ) != COSM_PASS )
+      || ( ( j == 1 ) && ( async.engine != COSM_FILE_ASYNC_POOL ) ) )
+    {
+      return -74;
+    }
+
+    /* 8 writes, the odd ones with callbacks, and a buffered write first */
+    count = 0;
+    CosmMemSet( requests, sizeof( requests ), 0 );
+    for ( i = 0 ; i < 9 ; i++ )
+    {
+      requests[i].file = testfile;
+      requests[i].type = COSM_FILE_ASYNC_WRITE;
+      requests[i].data = &testpattern1[i];
+      requests[i].length = 8;
+      requests[i].offset = (u64) ( i * 8 + 4 );
+      if ( i & 1 )
+      {
+        requests[i].callback = Cosm_FileTestAsync;
+        requests[i].arg = &count;
+      }
+      list[i] = &requests[i];
+    }
+    if ( ( CosmFileWrite( testfile, &real_write, "head", 4 ) != COSM_PASS )
+      || ( CosmFileAsyncSubmit( &async, &started, list, 9 )
+      != COSM_FILE_ERROR_BUSY ) || ( started != 0 )
+      || ( CosmFileAsyncSubmit( &async, &started, list, 8 ) != COSM_PASS )
+      || ( started != 8 ) )
+    {
+      return -75;
+    }
+    for ( i = 0 ; i < 4 ; )
+    {
+      i += CosmFileAsyncReap( &list[i], 8, &async, COSM_FILE_ASYNC_WAIT );
+    }
+    while ( CosmAtomicLoad32( &count ) != 4 )
+    {
+      CosmYield();
+    }
+    for ( i = 0 ; i < 4 ; i++ )
+    {
+      if ( ( list[i]->status != COSM_PASS ) || ( list[i]->bytes != 8 )
+        || ( list[i]->callback != NULL ) )
+      {
+        return -75;
+      }
+    }
+
+    /* read them back into a registered buffer, then sync */
+    vector.data = buffer;
+    vector.length = 100;
+    CosmMemSet( buffer, 100, 0 );
+    CosmMemSet( requests, sizeof( requests ), 0 );
+    requests[0].file = testfile;
+    requests[0].type = COSM_FILE_ASYNC_READ;
+    requests[0].buffer = 1;
+    requests[0].data = &buffer[10];
+    requests[0].length = 80;
+    requests[0].offset = 0;
+    requests[1].file = testfile;
+    requests[1].type = COSM_FILE_ASYNC_READ;
+    requests[1].data = &buffer[95];
+    requests[1].length = 1;
+    requests[1].offset = 68;
+    requests[2].file = testfile;
+    requests[2].type = COSM_FILE_ASYNC_SYNC;
+    list[0] = &requests[0];
+    list[1] = &requests[1];
+    list[2] = &requests[2];
+    if ( ( CosmFileAsyncBuffers( &async, &vector, 1 ) != COSM_PASS )
+      || ( CosmFileAsyncSubmit( &async, &started, list, 3 ) != COSM_PASS ) )
+    {
+      return -76;
+    }
+    for ( i = 0 ; i < 3 ; )
+    {
+      i += CosmFileAsyncReap( &list[i], 8, &async, COSM_FILE_ASYNC_WAIT );
+    }
+    if ( ( requests[0].status != COSM_PASS ) || ( requests[0].bytes != 68 )
+      || ( CosmMemCmp( &buffer[10], "head", 4 ) != 0 )
+      || ( CosmMemCmp( &buffer[14], testpattern1, 8 ) != 0 )
+      || ( CosmMemCmp( &buffer[70], &testpattern1[7], 8 ) != 0 )
+      || ( requests[1].status != COSM_FILE_ERROR_EOF )
+      || ( requests[2].status != COSM_PASS )
+      || ( CosmFileAsyncReap( list, 8, &async, COSM_FILE_ASYNC_NOWAIT )
+      != 0 ) )
+    {
+      return -76;
+    }
+
+    /* registered buffers are checked */
+    requests[0].data = &buffer[50];
+    if ( ( CosmFileAsyncSubmit( &async, &started, list, 1 )
+      != COSM_FILE_ERROR_PARAM )
+      || ( CosmFileAsyncFree( &async ) != COSM_PASS )
+      || ( CosmFileClose( testfile ) != COSM_PASS )
+      || ( CosmFileDelete( "os_file.tst" ) != COSM_PASS ) )
+    {
+      return -77;
+    }
+  }
+
+/*
+  Test functions : CosmFileMapWriteOpen, CosmFileMapWrite,
+    CosmFileMapWriteClose, CosmFileMapReadOpen, CosmFileMapRead,
+    CosmFileMapReadClose
+*/
+
+  /* 300000 bytes through a writer growing 64KiB at a time */
+  if ( ( CosmFileOpen( testfile, "os_file.tst", COSM_FILE_MODE_CREATE
+    | COSM_FILE_MODE_READ | COSM_FILE_MODE_WRITE | COSM_FILE_MODE_TRUNCATE,
+    COSM_FILE_LOCK_NONE ) != COSM_PASS )
+    || ( CosmFileWrite( testfile, &real_write, "head", 4 ) != COSM_PASS )
+    || ( CosmFileMapWriteOpen( &writer, testfile, 1 ) != COSM_PASS )
+    || ( writer.length != 4 ) )
+  {
+    return -78;
+  }
+  for ( i = 0 ; i < 100 ; i++ )
+  {
+    for ( j = 0 ; j < 100 ; j++ )
+    {
+      buffer[j] = (u8) ( i + j );
+    }
+    if ( CosmFileMapWrite( &writer, buffer, 100 )
+      != COSM_PASS )
+    {
+      return -78;
+    }
+  }
+  for ( i = 0 ; i < 2900 ; i++ )
+  {
+    if ( CosmFileMapWrite( &writer, testfileimg, 100 ) != COSM_PASS )
+    {
+      return -78;
+    }
+  }
+  if ( ( CosmFileMapWriteClose( &writer ) != COSM_PASS )
+    || ( CosmFileLength( &real_length, testfile ) != COSM_PASS )
+    || ( real_length != 300004 )
+    || ( CosmFileWrite( testfile, &real_write, "tail", 4 ) != COSM_PASS ) )
+  {
+    return -79;
+  }
+
+  /* read it back through 64KiB windows */
+  if ( CosmFileMapReadOpen( &reader, testfile, 2, 65536 ) != COSM_PASS )
+  {
+    return -80;
+  }
+  real_read = 0;
+  real_offset = 2;
+  while ( ( error = CosmFileMapRead( &mapped, &token_len, &reader,
+    ( real_offset < 10000 ) ? 97 : 0 ) ) == COSM_PASS )
+  {
+    if ( ( token_len == 0 ) || ( ( real_offset < 10000 )
+      && ( token_len > 97 ) ) )
+    {
+      return -80;
+    }
+    /* windows break on 64KiB file offsets */
+    if ( ( ( real_offset + token_len ) % 65536 != 0 )
+      && ( ( real_offset + token_len ) != 300008 )
+      && ( real_offset >= 10000 ) )
+    {
+      return -80;
+    }
+    if ( real_offset == 2 )
+    {
+      if ( CosmMemCmp( mapped, "ad", 2 ) != 0 )
+      {
+        return -80;
+      }
+    }
+    else if ( ( real_offset + token_len ) == 300008 )
+    {
+      if ( CosmMemCmp( (u8 *) mapped + token_len - 4, "tail", 4 ) != 0 )
+      {
+        return -80;
+      }
+    }
+    real_offset += token_len;
+    real_read += token_len;
+  }
+  if ( ( error != COSM_FILE_ERROR_EOF ) || ( real_read != 300006 )
+    || ( CosmFileMapReadClose( &reader ) != COSM_PASS ) )
+  {
+    return -81;
+  }
+
+  if ( ( CosmFileReadAt( buffer, &real_read, testfile, 100, 9904 )
+    != COSM_PASS ) || ( buffer[0] != 99 ) || ( buffer[99] != 198 )
+    || ( CosmFileClose( testfile ) != COSM_PASS )
+    || ( CosmFileDelete( "os_file.tst" ) != COSM_PASS ) )
+  {
+    return -82;
+  }
+
+/*
+  Test functions : CosmDirWalk
+*/
+
+  if ( ( CosmDirOpen( testdir, "testwalk.tmp/sub/deep", COSM_DIR_MODE_CREATE )
+    != COSM_PASS ) || ( CosmDirOpen( testdir, "testwalk.tmp/skip",
+    COSM_DIR_MODE_CREATE ) != COSM_PASS ) )
+  {
+    return -83;
+  }
+  for ( i = 0 ; i < 5 ; i++ )
+  {
+    if ( ( CosmFileOpen( testfile, walk_files[i], COSM_FILE_MODE_CREATE
+      | COSM_FILE_MODE_WRITE | COSM_FILE_MODE_TRUNCATE, COSM_FILE_LOCK_NONE )
+      != COSM_PASS ) || ( CosmFileWrite( testfile, &real_write,
+      testpattern1, 8 ) != COSM_PASS ) || ( CosmFileClose( testfile )
+      != COSM_PASS ) )
+    {
+      return -83;
+    }
+  }
+
+  /* one thread, types from the directory only */
+  CosmMemSet( counts, sizeof( counts ), 0 );
+  if ( ( CosmDirWalk( "testwalk.tmp", 1, 0, NULL, Cosm_FileTestWalk,
+    counts ) != COSM_PASS ) || ( counts[0] != 5 ) || ( counts[1] != 3 ) )
+  {
+    return -84;
+  }
+
+  /* a pool, with the lengths */
+  CosmMemSet( counts, sizeof( counts ), 0 );
+  if ( ( CosmDirWalk( "testwalk.tmp/", 4, COSM_DIR_WALK_INFO, NULL,
+    Cosm_FileTestWalk, counts ) != COSM_PASS ) || ( counts[0] != 5 )
+    || ( counts[1] != 3 ) || ( counts[2] != 40 ) )
+  {
+    return -85;
+  }
+
+  /* skip and prune */
+  CosmMemSet( counts, sizeof( counts ), 0 );
+  if ( ( CosmDirWalk( "testwalk.tmp", 2, 0, Cosm_FileTestFilter,
+    Cosm_FileTestWalk, counts ) != COSM_PASS ) || ( counts[0] != 2 )
+    || ( counts[1] != 1 ) )
+  {
+    return -86;
+  }
+
+  if ( ( CosmDirWalk( "testwalk.tmp", 4, 0, NULL, Cosm_FileTestStop,
+    NULL ) != COSM_DIR_ERROR_ABORT ) || ( CosmDirWalk( "testwalk.tmp/none",
+    1, 0, NULL, Cosm_FileTestWalk, counts ) != COSM_DIR_ERROR_NOTFOUND ) )
+  {
+    return -87;
+  }
+
+  for ( i = 0 ; i < 5 ; i++ )
+  {
+    CosmFileDelete( walk_files[i] );
+  }
+  if ( ( CosmDirDelete( "testwalk.tmp/sub/deep" ) != COSM_PASS )
+    || ( CosmDirDelete( "testwalk.tmp/sub" ) != COSM_PASS )
+    || ( CosmDirDelete( "testwalk.tmp/skip" ) != COSM_PASS )
+    || ( CosmDirDelete( "testwalk.tmp" ) != COSM_PASS ) )
+  {
+    return -87;
+  }
+
+/*
+  Test functions : CosmFileGroupInit, CosmFileGroupWrite, CosmFileGroupFree
+*/
+
+  if ( ( CosmFileOpen( testfile, "os_file.tst", COSM_FILE_MODE_CREATE
+    | COSM_FILE_MODE_READ | COSM_FILE_MODE_WRITE | COSM_FILE_MODE_TRUNCATE,
+    COSM_FILE_LOCK_NONE ) != COSM_PASS )
+    || ( CosmFileWrite( testfile, &real_write, testpattern1, 10 )
+    != COSM_PASS ) || ( CosmFileGroupInit( &group, testfile ) != COSM_PASS ) )
+  {
+    return -88;
+  }
+
+  for ( i = 0 ; i < 4 ; i++ )
+  {
+    if ( CosmThreadBegin( &thread_id, Cosm_FileTestGroup, &group,
+      64 * 1024 ) != COSM_PASS )
+    {
+      return -89;
+    }
+  }
+  if ( ( CosmFileGroupWrite( &group, "0123456789ABCDE\n", 16 ) != COSM_PASS )
+    || ( CosmFileGroupWrite( NULL, "x", 1 ) != COSM_FILE_ERROR_PARAM ) )
+  {
+    return -89;
+  }
+
+  /* wait for the threads, then for the last of them to leave */
+  for ( i = 0 ; ( i < 10000 ) && ( group.records < 201 ) ; i++ )
+  {
+    CosmSleep( 1 );
+  }
+  while ( ( error = CosmFileGroupFree( &group ) ) == COSM_FILE_ERROR_BUSY )
+  {
+    CosmSleep( 1 );
+  }
+  if ( error != COSM_PASS )
+  {
+    return -90;
+  }
+
+  if ( ( CosmFileLength( &real_length, testfile ) != COSM_PASS )
+    || ( real_length != 3226 ) )
+  {
+    return -91;
+  }
+  CosmFileSeek( testfile, 10 );
+  for ( i = 0 ; i < 201 ; i++ )
+  {
+    if ( ( CosmFileRead( buffer, &real_read, testfile, 16 ) != COSM_PASS )
+      || ( real_read != 16 )
+      || ( CosmMemCmp( buffer, "0123456789ABCDE\n", 16 ) != 0 ) )
+    {
+      return -92;
+    }
+  }
+  CosmFileClose( testfile );
+  CosmFileDelete( "os_file.tst" );
+
+  /* watch a file that does not exist yet */
+  CosmFileDelete( "testwatch.tmp" );
+  if ( ( CosmFileWatchInit( &watch, "testwatch.tmp" ) != COSM_PASS )
+    || ( CosmFileWatchWait( &watch, 20 ) != COSM_FILE_ERROR_TIMEOUT ) )
+  {
+    return -93;
+  }
+  if ( ( CosmFileOpen( testfile, "testwatch.tmp", COSM_FILE_MODE_WRITE
+    | COSM_FILE_MODE_CREATE, COSM_FILE_LOCK_NONE ) != COSM_PASS )
+    || ( CosmFileWrite( testfile, &real_write, hello, 13 ) != COSM_PASS )
+    || ( CosmFileClose( testfile ) != COSM_PASS )
+    || ( CosmFileWatchWait( &watch, 5000 ) != COSM_PASS ) )
+  {
+    return -94;
+  }
+  if ( ( CosmFileWatchWait( &watch, 20 ) != COSM_FILE_ERROR_TIMEOUT )
+    || ( CosmFileWatchFree( &watch ) != COSM_PASS )
+    || ( CosmFileWatchWait( NULL, 0 ) != COSM_FILE_ERROR_PARAM ) )
+  {
+    return -95;
+  }
+  CosmFileDelete( "testwatch.tmp" );
+
   CosmMemFree( testdir );
   CosmMemFree( testfile );
   CosmMemFree( testfileimg );
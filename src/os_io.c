@@ -20,6 +20,11 @@
 #include "cosm/os_io.h"
 #include <stdio.h>
 
+#if ( defined( COSM_SIMD_X64 ) )
+#include <string.h> /* for strlen */
+#include <immintrin.h>
+#endif
+
 #if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
 #  include <io.h>
 #  include <conio.h>
@@ -37,17 +42,14 @@
 #  define fmodl fmod
 #endif
 
-/* states for the print state machine */
-enum COSM_IO_STATES
+/* what a cosm_PRINT_SPEC holds */
+enum COSM_IO_SPECS
 {
+  COSM_IO_END,
   COSM_IO_TEXT,
-  COSM_IO_PERCENT,
-  COSM_IO_WIDTH,
-  COSM_IO_PREC,
   COSM_IO_SINGLE_CHAR,
   COSM_IO_STRING,
   COSM_IO_BUFFER,
-  COSM_IO_TMP_STRING,
   COSM_IO_U32_DEC,
   COSM_IO_U64_DEC,
   COSM_IO_U128_DEC,
@@ -62,12 +64,57 @@ enum COSM_IO_STATES
   COSM_IO_POINTER
 };
 
-static const ascii hex_table[16] =
+/* states for the format parser */
+enum COSM_IO_STATES
 {
-  '0', '1', '2', '3', '4', '5', '6', '7',
-  '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+  COSM_IO_PERCENT,
+  COSM_IO_WIDTH,
+  COSM_IO_PREC
 };
 
+/* cosm_PRINT_SPEC flags */
+#define COSM_IO_WIDTH_SET  0x01
+#define COSM_IO_PAD_LEFT   0x02
+#define COSM_IO_PAD_ZERO   0x04
+#define COSM_IO_PREC_SET   0x08
+#define COSM_IO_WIDTH_ARG  0x10
+#define COSM_IO_PREC_ARG   0x20
+
+/* bytes Cosm_Print collects before writing to a file or stdout */
+#define COSM_IO_PRINT_BUFFER 2048
+/* room for the longest number, a f64 with 309 whole digits */
+#define COSM_IO_PRINT_DIGITS 400
+
+typedef struct cosm_PRINT_OUT
+{
+  cosm_FILE * file;
+  utf8 * string;
+  u32 max_bytes;
+  u32 count;
+  u32 used;
+  u32 stop;
+  utf8 buffer[COSM_IO_PRINT_BUFFER];
+} cosm_PRINT_OUT;
+
+static void Cosm_PrintParse( cosm_PRINT_SPEC * spec, const utf8 ** format );
+
+static const ascii dec_pair_table[201] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static const ascii hex_pair_table[513] =
+  "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+  "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+  "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+  "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+  "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+  "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+  "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+  "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
 #define COSM_IO_NO 0
 #define COSM_IO_YES 1
 
@@ -278,23 +325,244 @@ u32 CosmInput( utf8 * buffer, u32 max_bytes, u32 echo )
   return chars_read;
 }
 
-u32 CosmStrBytes( const utf8 * string )
+#if ( defined( COSM_SIMD_X64 ) )
+/*
+  The scans read aligned 64 byte groups, so they never touch a page that
+  does not hold at least one byte of the string. Bytes before the start
+  are masked off, groups past the end of the string are never read.
+*/
+
+static u64 Cosm_StrMaskSSE2( const utf8 * group, __m128i want, u32 full )
 {
-  u32 length;
+  const __m128i * block;
+  __m128i zero, a, b, c, d;
+
+  /* a bit for each of the 64 bytes that is 0 or the wanted byte */
+  block = (const __m128i *) group;
+  zero = _mm_setzero_si128();
+  a = _mm_load_si128( &block[0] );
+  b = _mm_load_si128( &block[1] );
+  c = _mm_load_si128( &block[2] );
+  d = _mm_load_si128( &block[3] );
+  a = _mm_or_si128( _mm_cmpeq_epi8( a, zero ), _mm_cmpeq_epi8( a, want ) );
+  b = _mm_or_si128( _mm_cmpeq_epi8( b, zero ), _mm_cmpeq_epi8( b, want ) );
+  c = _mm_or_si128( _mm_cmpeq_epi8( c, zero ), _mm_cmpeq_epi8( c, want ) );
+  d = _mm_or_si128( _mm_cmpeq_epi8( d, zero ), _mm_cmpeq_epi8( d, want ) );
+
+  if ( ( full == 0 ) && ( _mm_movemask_epi8(
+    _mm_or_si128( _mm_or_si128( a, b ), _mm_or_si128( c, d ) ) ) == 0 ) )
+  {
+    return 0;
+  }
 
-  length = 0;
+  return (u64) (u32) _mm_movemask_epi8( a )
+    | ( (u64) (u32) _mm_movemask_epi8( b ) << 16 )
+    | ( (u64) (u32) _mm_movemask_epi8( c ) << 32 )
+    | ( (u64) (u32) _mm_movemask_epi8( d ) << 48 );
+}
 
-  if ( string == NULL )
+__attribute__(( target( "avx2" ) ))
+static u64 Cosm_StrMaskAVX2( const utf8 * group, __m256i want, u32 full )
+{
+  const __m256i * block;
+  __m256i zero, a, b;
+
+  block = (const __m256i *) group;
+  zero = _mm256_setzero_si256();
+  a = _mm256_load_si256( &block[0] );
+  b = _mm256_load_si256( &block[1] );
+  a = _mm256_or_si256( _mm256_cmpeq_epi8( a, zero ),
+    _mm256_cmpeq_epi8( a, want ) );
+  b = _mm256_or_si256( _mm256_cmpeq_epi8( b, zero ),
+    _mm256_cmpeq_epi8( b, want ) );
+
+  if ( ( full == 0 ) && _mm256_testz_si256( _mm256_or_si256( a, b ),
+    _mm256_or_si256( a, b ) ) )
   {
-    return length;
+    return 0;
   }
 
-  while ( *(string)++ != 0 )
+  return (u64) (u32) _mm256_movemask_epi8( a )
+    | ( (u64) (u32) _mm256_movemask_epi8( b ) << 32 );
+}
+
+static u32 Cosm_StrScanSSE2( const utf8 * string, utf8 ch, u32 max_bytes )
+{
+  const utf8 * group;
+  __m128i want;
+  u64 mask;
+  u32 offset, step, i;
+
+  /* index of the first 0 or ch in max_bytes, or max_bytes */
+  offset = (u32) ( (u64) string & 63 );
+  group = string - offset;
+  want = _mm_set1_epi8( (char) ch );
+  mask = Cosm_StrMaskSSE2( group, want, 1 ) >> offset;
+  i = 0;
+
+  for ( ; ; )
   {
-    length++;
+    if ( mask != 0 )
+    {
+      i += (u32) __builtin_ctzll( mask );
+      return ( i < max_bytes ) ? i : max_bytes;
+    }
+    /* i moves to where the next group starts */
+    step = ( i == 0 ) ? ( 64 - offset ) : 64;
+    if ( ( max_bytes - i ) <= step )
+    {
+      return max_bytes;
+    }
+    i += step;
+    group += 64;
+    mask = Cosm_StrMaskSSE2( group, want, 0 );
   }
+}
 
-  return length;
+__attribute__(( target( "avx2" ) ))
+static u32 Cosm_StrScanAVX2( const utf8 * string, utf8 ch, u32 max_bytes )
+{
+  const utf8 * group;
+  __m256i want;
+  u64 mask;
+  u32 offset, step, i;
+
+  offset = (u32) ( (u64) string & 63 );
+  group = string - offset;
+  want = _mm256_set1_epi8( (char) ch );
+  mask = Cosm_StrMaskAVX2( group, want, 1 ) >> offset;
+  i = 0;
+
+  for ( ; ; )
+  {
+    if ( mask != 0 )
+    {
+      i += (u32) __builtin_ctzll( mask );
+      return ( i < max_bytes ) ? i : max_bytes;
+    }
+    step = ( i == 0 ) ? ( 64 - offset ) : 64;
+    if ( ( max_bytes - i ) <= step )
+    {
+      return max_bytes;
+    }
+    i += step;
+    group += 64;
+    mask = Cosm_StrMaskAVX2( group, want, 0 );
+  }
+}
+
+static u32 Cosm_StrScan( const utf8 * string, utf8 ch, u32 max_bytes )
+{
+  if ( Cosm_MemSIMD() == COSM_MEM_SIMD_AVX2 )
+  {
+    return Cosm_StrScanAVX2( string, ch, max_bytes );
+  }
+  return Cosm_StrScanSSE2( string, ch, max_bytes );
+}
+
+static u32 Cosm_StrFindTail( const utf8 * string, u32 pos, u32 length,
+  const utf8 * substring, u32 sub_len )
+{
+  u32 i;
+
+  /* check every start from pos to length - sub_len one at a time */
+  for ( ; ( pos + sub_len ) <= length ; pos++ )
+  {
+    for ( i = 0 ; ( i < sub_len ) && ( string[pos + i] == substring[i] ) ;
+      i++ )
+    {
+    }
+    if ( i == sub_len )
+    {
+      return pos;
+    }
+  }
+
+  return 0xFFFFFFFF;
+}
+
+static u32 Cosm_StrFindSSE2( const utf8 * string, u32 length,
+  const utf8 * substring, u32 sub_len )
+{
+  __m128i first, last;
+  u32 pos, mask, bit;
+
+  /*
+    Test 16 starting positions at once on the first and last byte of
+    substring, then check the middle of the candidates. Both loads stay
+    inside the length bytes of string.
+  */
+  first = _mm_set1_epi8( (char) substring[0] );
+  last = _mm_set1_epi8( (char) substring[sub_len - 1] );
+
+  for ( pos = 0 ; ( pos + sub_len + 15 ) <= length ; pos += 16 )
+  {
+    mask = (u32) _mm_movemask_epi8( _mm_and_si128(
+      _mm_cmpeq_epi8( first,
+        _mm_loadu_si128( (const __m128i *) &string[pos] ) ),
+      _mm_cmpeq_epi8( last,
+        _mm_loadu_si128( (const __m128i *) &string[pos + sub_len - 1] ) ) ) );
+    while ( mask != 0 )
+    {
+      bit = (u32) __builtin_ctz( mask );
+      if ( ( sub_len <= 2 ) || ( CosmMemCmp( &string[pos + bit + 1],
+        &substring[1], sub_len - 2 ) == 0 ) )
+      {
+        return pos + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  return Cosm_StrFindTail( string, pos, length, substring, sub_len );
+}
+
+__attribute__(( target( "avx2" ) ))
+static u32 Cosm_StrFindAVX2( const utf8 * string, u32 length,
+  const utf8 * substring, u32 sub_len )
+{
+  __m256i first, last;
+  u32 pos, mask, bit;
+
+  first = _mm256_set1_epi8( (char) substring[0] );
+  last = _mm256_set1_epi8( (char) substring[sub_len - 1] );
+
+  for ( pos = 0 ; ( pos + sub_len + 31 ) <= length ; pos += 32 )
+  {
+    mask = (u32) _mm256_movemask_epi8( _mm256_and_si256(
+      _mm256_cmpeq_epi8( first,
+        _mm256_loadu_si256( (const __m256i *) &string[pos] ) ),
+      _mm256_cmpeq_epi8( last, _mm256_loadu_si256(
+        (const __m256i *) &string[pos + sub_len - 1] ) ) ) );
+    while ( mask != 0 )
+    {
+      bit = (u32) __builtin_ctz( mask );
+      if ( ( sub_len <= 2 ) || ( CosmMemCmp( &string[pos + bit + 1],
+        &substring[1], sub_len - 2 ) == 0 ) )
+      {
+        return pos + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  return Cosm_StrFindTail( string, pos, length, substring, sub_len );
+}
+#endif /* COSM_SIMD_X64 */
+
+u32 CosmStrBytes( const utf8 * string )
+{
+  if ( string == NULL )
+  {
+    return 0;
+  }
+
+#if ( defined( COSM_SIMD_X64 ) )
+  /* the C library strlen is already vectorized */
+  return (u32) strlen( string );
+#else
+  return Cosm_StrBytesScalar( string );
+#endif
 }
 
 s32 CosmStrCopy( utf8 * dest, const utf8 * src, u32 max_bytes )
@@ -394,12 +662,32 @@ utf8 * CosmStrChar( const utf8 * string, utf8char character, u32 max_bytes )
 {
   utf8 array[8];
   u32 bytes;
+#if ( defined( COSM_SIMD_X64 ) )
+  u32 pos;
+#endif
 
   if ( ( string == NULL ) || ( max_bytes == 0 ) )
   {
     return NULL;
   }
 
+#if ( defined( COSM_SIMD_X64 ) )
+  /* single byte characters are a plain scan */
+  if ( ( character > 0 ) && ( character < 0x80 ) )
+  {
+    if ( max_bytes < 2 )
+    {
+      return NULL;
+    }
+    pos = Cosm_StrScan( string, (utf8) character, max_bytes );
+    if ( ( pos < max_bytes ) && ( string[pos] != 0 ) )
+    {
+      return (utf8 *) &string[pos];
+    }
+    return NULL;
+  }
+#endif
+
   if ( Cosm_EncodeUTF8( array, &bytes, character ) == COSM_FAIL )
   {
     return NULL;
@@ -411,9 +699,8 @@ utf8 * CosmStrChar( const utf8 * string, utf8char character, u32 max_bytes )
 
 utf8 * CosmStrStr( const utf8 * string, const utf8 * substring, u32 max_bytes )
 {
-  utf8 * first, * end, * str, * sub;
-  utf8 ch;
-  u32 len;
+#if ( defined( COSM_SIMD_X64 ) )
+  u32 len, length, pos;
 
   /* check for bad or trivial parameters */
   if ( ( string == NULL ) || ( substring == NULL ) ||
@@ -428,52 +715,32 @@ utf8 * CosmStrStr( const utf8 * string, const utf8 * substring, u32 max_bytes )
     return NULL;
   }
 
-  /*
-    end is set to the last character substring could safely start at.
-    makes it safe and saves some iterations too.
-  */
-  end = (utf8 *) CosmMemOffset( string, max_bytes - len );
-  first = (utf8 *) string;
-  ch = substring[0];
-
-  for ( ; ; )
+  /* the part of string a match has to fit in */
+  length = Cosm_StrScan( string, 0,
+    ( max_bytes == 0 ) ? 0xFFFFFFFF : max_bytes );
+  if ( len > length )
   {
-    /* find a matching first character in string */
-    while ( *first != ch )
-    {
-      if ( *first == 0 )
-      {
-        return NULL;
-      }
-      first++;
-      if ( first > end )
-      {
-        return NULL;
-      }
-    }
-
-    str = first;
-    sub = (utf8 *) substring;
-
-    /* match up the strings */
-    while ( ( *str == *sub ) && ( *sub != 0 ) )
-    {
-      str++;
-      sub++;
-    }
+    return NULL;
+  }
 
-    /* if we got safely to the end of sub, then we found it */
-    if ( *sub == 0 )
-    {
-      return first;
-    }
+  if ( Cosm_MemSIMD() == COSM_MEM_SIMD_AVX2 )
+  {
+    pos = Cosm_StrFindAVX2( string, length, substring, len );
+  }
+  else
+  {
+    pos = Cosm_StrFindSSE2( string, length, substring, len );
+  }
 
-    first++;
-    if ( first > end )
-    {
-      return NULL;
-    }
+  if ( pos == 0xFFFFFFFF )
+  {
+    return NULL;
   }
+
+  return (utf8 *) &string[pos];
+#else
+  return Cosm_StrStrScalar( string, substring, max_bytes );
+#endif
 }
 
 u32 CosmPrint( const utf8 * format, ... )
@@ -534,6 +801,115 @@ u32 CosmPrintFile( cosm_FILE * file, const utf8 * format, ... )
   return chars_output;
 }
 
+s32 CosmPrintCompile( cosm_PRINT_FORMAT * compiled, const utf8 * format )
+{
+  cosm_PRINT_SPEC spec;
+  const utf8 * fmt;
+  u32 count, i;
+
+  if ( ( compiled == NULL ) || ( format == NULL ) )
+  {
+    return COSM_FAIL;
+  }
+
+  /* count the pieces, then parse again to keep them */
+  count = 0;
+  fmt = format;
+  do
+  {
+    Cosm_PrintParse( &spec, &fmt );
+    count++;
+  } while ( spec.type != COSM_IO_END );
+
+  compiled->count = 0;
+  if ( ( compiled->specs = (cosm_PRINT_SPEC *) CosmMemAlloc(
+    (u64) count * sizeof( cosm_PRINT_SPEC ) ) ) == NULL )
+  {
+    return COSM_FAIL;
+  }
+
+  fmt = format;
+  for ( i = 0 ; i < count ; i++ )
+  {
+    Cosm_PrintParse( &compiled->specs[i], &fmt );
+  }
+  compiled->count = count;
+
+  return COSM_PASS;
+}
+
+u32 CosmPrintCompiled( const cosm_PRINT_FORMAT * compiled, ... )
+{
+  u32 chars_output;
+  va_list ap;
+
+  if ( compiled == NULL )
+  {
+    return 0;
+  }
+
+  va_start( ap, compiled );
+  chars_output = Cosm_PrintCompiled( NULL, NULL, 0xFFFFFFFF, compiled, ap );
+  va_end( ap );
+
+  fflush( NULL );
+
+  return chars_output;
+}
+
+u32 CosmPrintStrCompiled( utf8 * string, u32 max_bytes,
+  const cosm_PRINT_FORMAT * compiled, ... )
+{
+  u32 chars_output;
+  va_list ap;
+
+  if ( ( string == NULL ) || ( max_bytes == 0 ) )
+  {
+    return 0;
+  }
+
+  max_bytes--;
+
+  va_start( ap, compiled );
+  chars_output = Cosm_PrintCompiled( NULL, string, max_bytes, compiled, ap );
+  va_end( ap );
+
+  /* terminate string */
+  *( (utf8 *) CosmMemOffset( string, (u64) chars_output ) ) = 0;
+
+  return chars_output;
+}
+
+u32 CosmPrintFileCompiled( cosm_FILE * file,
+  const cosm_PRINT_FORMAT * compiled, ... )
+{
+  u32 chars_output;
+  va_list ap;
+
+  if ( file == NULL )
+  {
+    return 0;
+  }
+
+  va_start( ap, compiled );
+  chars_output = Cosm_PrintCompiled( file, NULL, 0xFFFFFFFF, compiled, ap );
+  va_end( ap );
+
+  return chars_output;
+}
+
+void CosmPrintFree( cosm_PRINT_FORMAT * compiled )
+{
+  if ( compiled == NULL )
+  {
+    return;
+  }
+
+  CosmMemFree( compiled->specs );
+  compiled->specs = NULL;
+  compiled->count = 0;
+}
+
 /* Low level functions */
 
 s32 Cosm_DecodeUTF8( utf8char * codepoint, utf8 ** next, utf8 * stream )
@@ -1399,788 +1775,894 @@ s32 Cosm_GetCharType( utf8char ch )
   }
 }
 
-/* temp macro to reset tmp variables in Cosm_Print */
-#define _COSM_IO_CLEARTMP() { \
-  state = COSM_IO_TEXT; \
-  width = 0; \
-  width_set = COSM_IO_NO; \
-  pad_left = COSM_IO_NO; \
-  pad_zero = COSM_IO_NO; \
-  precision = 6; \
-  precision_set = COSM_IO_NO; \
-  tmp_count = 0; \
-  tmp_sign = 0; \
-  ptr_ascii = &tmp_ascii[0]; }
-
-/* temp macro for making sure we don't print too much */
-#define _COSM_IO_CHECKMAX() { \
-  max_bytes -= bytes; \
-  chars_output += bytes; \
-  if ( max_bytes == 0 ) \
-    return chars_output; \
-  if ( string != NULL ) \
-  { \
-    output_str += bytes; \
-  } }
-
-/* temp macro for fecthing the next UTF8 character */
-#define _COSM_IO_FETCHCHAR() { \
-  if ( Cosm_DecodeUTF8( &character, &format_str, format_str ) != COSM_PASS ) \
-  { \
-    return chars_output; \
-  } }
+/* print engine */
 
-u32 Cosm_Print( cosm_FILE * file, void * string, u32 max_bytes,
-  const void * format, va_list args )
+static void Cosm_PrintParse( cosm_PRINT_SPEC * spec, const utf8 ** format )
 {
-  enum COSM_IO_STATES state;
-  u32  chars_output;
-  utf8char  character;
-  u32 bytes;
+  const utf8 * fmt;
+  utf8 * next;
+  utf8char character;
+  u32 state;
+  u32 skip;
 
-  utf8 * format_str;
-  utf8 * output_str;
+  fmt = *format;
 
-  u32  tmp_u32;
-  s32  tmp_s32;
-  u64  tmp_u64;
-  s64  tmp_s64;
-  u128 tmp_u128;
-  s128 tmp_s128;
-  f64  tmp_f64;
-  f64  whole_f64;
-  f64  tmp_whole_f64;
+  for ( ; ; )
+  {
+    spec->type = COSM_IO_END;
+    spec->flags = 0;
+    spec->width = 0;
+    spec->precision = 6;
+    spec->text = fmt;
+    spec->length = 0;
 
-  ascii * ptr_ascii;
-  utf8 * ptr_utf8;
-  ascii tmp_ascii[64]; /* longest is s128 at 40+sign */
-  u32 tmp_count;
-  s32 tmp_sign;
-  s32 i;
-  u32 u;
-  u8 * ptr_u8;
+    /* literal text up to the next %, it has to be valid UTF-8 */
+    while ( ( *fmt != '%' ) && ( *fmt != 0 ) )
+    {
+      if ( ( *fmt & 0x80 ) == 0 )
+      {
+        fmt++;
+      }
+      else if ( Cosm_DecodeUTF8( &character, &next, (utf8 *) fmt )
+        == COSM_PASS )
+      {
+        fmt = next;
+      }
+      else
+      {
+        /* output ends at the bad character */
+        break;
+      }
+    }
 
-  u32 width;
-  u32 width_set;
-  u32 pad_left;
-  u32 pad_zero;
-  u32 precision;
-  u32 precision_set;
-  u32 done;
+    if ( fmt != spec->text )
+    {
+      spec->type = COSM_IO_TEXT;
+      spec->length = (u32) ( fmt - spec->text );
+      *format = fmt;
+      return;
+    }
 
-  done = COSM_IO_NO;
-  chars_output = 0;
+    if ( *fmt != '%' )
+    {
+      *format = fmt;
+      return;
+    }
 
-  /* check for valid parameters */
-  if ( ( max_bytes == chars_output ) || ( format == NULL ) )
+    /* %[width][.prec]type_char */
+    fmt++;
+    state = COSM_IO_PERCENT;
+    skip = 0;
+    while ( ( spec->type == COSM_IO_END ) && ( skip == 0 ) )
+    {
+      character = (utf8char) (u8) *fmt;
+      if ( character == 0 )
+      {
+        *format = fmt;
+        return;
+      }
+
+      if ( state == COSM_IO_WIDTH )
+      {
+        if ( ( character >= '0' ) && ( character <= '9' ) )
+        {
+          spec->width = spec->width * 10 + ( character - '0' );
+          fmt++;
+        }
+        else
+        {
+          state = COSM_IO_PERCENT;
+        }
+        continue;
+      }
+
+      if ( state == COSM_IO_PREC )
+      {
+        if ( character == '*' )
+        {
+          spec->flags |= ( COSM_IO_PREC_ARG | COSM_IO_PREC_SET );
+          state = COSM_IO_PERCENT;
+          fmt++;
+        }
+        else if ( ( character >= '0' ) && ( character <= '9' ) )
+        {
+          spec->precision = spec->precision * 10 + ( character - '0' );
+          spec->flags |= COSM_IO_PREC_SET;
+          fmt++;
+        }
+        else
+        {
+          state = COSM_IO_PERCENT;
+        }
+        continue;
+      }
+
+      if ( ( character >= '1' ) && ( character <= '9' ) )
+      {
+        /* We are defining the width */
+        spec->flags |= COSM_IO_WIDTH_SET;
+        state = COSM_IO_WIDTH;
+        continue;
+      }
+
+      switch ( character )
+      {
+        case '%':
+          spec->type = COSM_IO_TEXT;
+          spec->text = fmt;
+          spec->length = 1;
+          break;
+        case '0':
+          spec->flags |= ( COSM_IO_PAD_ZERO | COSM_IO_WIDTH_SET );
+          state = COSM_IO_WIDTH;
+          break;
+        case '-':
+          spec->flags |= ( COSM_IO_PAD_LEFT | COSM_IO_WIDTH_SET );
+          state = COSM_IO_WIDTH;
+          break;
+        case '*':
+          spec->flags |= COSM_IO_WIDTH_ARG;
+          break;
+        case '.':
+          spec->precision = 0;
+          state = COSM_IO_PREC;
+          break;
+        case 'c':
+          spec->type = COSM_IO_SINGLE_CHAR;
+          break;
+        case 's':
+          spec->type = COSM_IO_STRING;
+          break;
+        case 'b':
+          spec->type = COSM_IO_BUFFER;
+          break;
+        case 'i':
+          spec->type = COSM_IO_S32_DEC;
+          break;
+        case 'j':
+          spec->type = COSM_IO_S64_DEC;
+          break;
+        case 'k':
+          spec->type = COSM_IO_S128_DEC;
+          break;
+        case 'u':
+          spec->type = COSM_IO_U32_DEC;
+          break;
+        case 'v':
+          spec->type = COSM_IO_U64_DEC;
+          break;
+        case 'w':
+          spec->type = COSM_IO_U128_DEC;
+          break;
+        case 'f':
+          spec->type = COSM_IO_F64;
+          break;
+        case 'F':
+          spec->type = COSM_IO_F64_SCI;
+          break;
+        case 'X':
+          spec->type = COSM_IO_U32_HEX;
+          break;
+        case 'Y':
+          spec->type = COSM_IO_U64_HEX;
+          break;
+        case 'Z':
+          spec->type = COSM_IO_U128_HEX;
+          break;
+        case 'p':
+          spec->type = COSM_IO_POINTER;
+          break;
+        default:
+          /* unknown type, print nothing for it and go on */
+          if ( ( character & 0x80 ) != 0 )
+          {
+            if ( Cosm_DecodeUTF8( &character, &next, (utf8 *) fmt )
+              != COSM_PASS )
+            {
+              *format = fmt;
+              return;
+            }
+            fmt = next - 1;
+          }
+          skip = 1;
+          break;
+      }
+      fmt++;
+    }
+
+    if ( spec->type != COSM_IO_END )
+    {
+      *format = fmt;
+      return;
+    }
+  }
+}
+
+static s32 Cosm_PrintWrite( cosm_PRINT_OUT * out, const void * data,
+  u32 length )
+{
+  u64 written;
+
+  if ( out->file != NULL )
   {
-    return chars_output;
+    if ( ( CosmFileWrite( out->file, &written, data, length ) != COSM_PASS )
+      || ( written != length ) )
+    {
+      out->stop = COSM_IO_YES;
+      return COSM_FAIL;
+    }
+  }
+  else /* standard output */
+  {
+    if ( fwrite( data, 1, length, stdout ) != length )
+    {
+      out->stop = COSM_IO_YES;
+      return COSM_FAIL;
+    }
   }
 
-  format_str = (utf8 *) format;
-  output_str = (utf8 *) string;
+  return COSM_PASS;
+}
 
-  _COSM_IO_CLEARTMP();
-  _COSM_IO_FETCHCHAR();
+static s32 Cosm_PrintFlush( cosm_PRINT_OUT * out )
+{
+  u32 used;
 
-  if ( character == 0 )
+  used = out->used;
+  out->used = 0;
+  if ( ( used > 0 ) && ( Cosm_PrintWrite( out, out->buffer, used )
+    != COSM_PASS ) )
   {
-    return chars_output;
+    /* those bytes never made it out */
+    out->count -= used;
+    return COSM_FAIL;
   }
 
-  while ( done == COSM_IO_NO )
+  return COSM_PASS;
+}
+
+static s32 Cosm_PrintOut( cosm_PRINT_OUT * out, const void * data,
+  u32 length )
+{
+  const utf8 * bytes;
+
+  if ( out->stop != COSM_IO_NO )
   {
-    switch ( state )
+    return COSM_FAIL;
+  }
+
+  bytes = (const utf8 *) data;
+  if ( length > out->max_bytes )
+  {
+    /* only whole characters, then stop */
+    length = out->max_bytes;
+    while ( ( length > 0 ) && ( ( bytes[length] & 0xC0 ) == 0x80 ) )
     {
-      case COSM_IO_TEXT:
-        switch ( character )
-        {
-          case '%':
-            state = COSM_IO_PERCENT;
-            break;
-          case 0:
-            return chars_output;
-          default:
-            if ( Cosm_PrintChar( &bytes, file, output_str, max_bytes,
-              character ) == COSM_FAIL )
-            {
-              return chars_output;
-            }
-            _COSM_IO_CHECKMAX();
-            break;
-        }
-        _COSM_IO_FETCHCHAR();
-        break;
-      case COSM_IO_PERCENT:
-        if ( character == '%' )
-        {
-          if ( Cosm_PrintChar( &bytes, file, output_str, max_bytes,
-            character ) == COSM_FAIL )
-          {
-            return chars_output;
-          }
-          _COSM_IO_CHECKMAX();
-          _COSM_IO_FETCHCHAR();
-          _COSM_IO_CLEARTMP();
-        }
-        else
+      length--;
+    }
+    out->stop = COSM_IO_YES;
+  }
+
+  if ( out->string != NULL )
+  {
+    CosmMemCopy( out->string, bytes, length );
+    out->string += length;
+  }
+  else if ( ( out->used + length ) <= COSM_IO_PRINT_BUFFER )
+  {
+    CosmMemCopy( &out->buffer[out->used], bytes, length );
+    out->used += length;
+  }
+  else
+  {
+    if ( Cosm_PrintFlush( out ) != COSM_PASS )
+    {
+      return COSM_FAIL;
+    }
+    if ( length > ( COSM_IO_PRINT_BUFFER / 2 ) )
+    {
+      /* big pieces go straight out */
+      if ( Cosm_PrintWrite( out, bytes, length ) != COSM_PASS )
+      {
+        return COSM_FAIL;
+      }
+    }
+    else
+    {
+      CosmMemCopy( out->buffer, bytes, length );
+      out->used = length;
+    }
+  }
+
+  out->max_bytes -= length;
+  out->count += length;
+  if ( out->max_bytes == 0 )
+  {
+    out->stop = COSM_IO_YES;
+  }
+
+  return ( out->stop == COSM_IO_NO ) ? COSM_PASS : COSM_FAIL;
+}
+
+static void Cosm_PrintPad( cosm_PRINT_OUT * out, ascii pad, u32 count )
+{
+  ascii array[32];
+  u32 length;
+
+  CosmMemSet( array, sizeof( array ), (u8) pad );
+  while ( count > 0 )
+  {
+    length = ( count > sizeof( array ) ) ? sizeof( array ) : count;
+    if ( Cosm_PrintOut( out, array, length ) != COSM_PASS )
+    {
+      return;
+    }
+    count -= length;
+  }
+}
+
+static void Cosm_PrintNumber( cosm_PRINT_OUT * out, const ascii * digits,
+  u32 count, u32 sign, u32 width, u32 flags )
+{
+  /* the sign is part of the width */
+  if ( ( sign ) && ( width > 0 ) )
+  {
+    width--;
+  }
+
+  if ( ( flags & COSM_IO_WIDTH_SET ) && ( width > count )
+    && !( flags & COSM_IO_PAD_LEFT ) )
+  {
+    if ( flags & COSM_IO_PAD_ZERO )
+    {
+      if ( sign )
+      {
+        Cosm_PrintOut( out, "-", 1 );
+      }
+      Cosm_PrintPad( out, '0', width - count );
+    }
+    else
+    {
+      Cosm_PrintPad( out, ' ', width - count );
+      if ( sign )
+      {
+        Cosm_PrintOut( out, "-", 1 );
+      }
+    }
+  }
+  else if ( sign )
+  {
+    Cosm_PrintOut( out, "-", 1 );
+  }
+
+  Cosm_PrintOut( out, digits, count );
+
+  if ( ( flags & COSM_IO_WIDTH_SET ) && ( width > count )
+    && ( flags & COSM_IO_PAD_LEFT ) )
+  {
+    Cosm_PrintPad( out, ' ', width - count );
+  }
+}
+
+static u32 Cosm_PrintF64( ascii * end, f64 number, u32 scientific,
+  u32 precision, u32 flags, u32 * sign )
+{
+  ascii tmp_ascii[COSM_IO_PRINT_DIGITS];
+  ascii * ptr_ascii;
+  f64 tmp_f64;
+  f64 whole_f64;
+  f64 tmp_whole_f64;
+  u32 tmp_count;
+  u32 tmp_u32;
+  s32 tmp_s32;
+  s32 i;
+
+  /* the digits are made last digit first, then turned around */
+  ptr_ascii = &tmp_ascii[0];
+  tmp_count = 0;
+  tmp_f64 = number;
+
+  if ( CosmFloatNaN( tmp_f64 ) )
+  {
+    *ptr_ascii++ = (ascii) 'N';
+    *ptr_ascii++ = (ascii) 'a';
+    *ptr_ascii++ = (ascii) 'N';
+    tmp_count += 3;
+  }
+  else
+  {
+    if ( tmp_f64 < 0 )
+    {
+      *sign = 1;
+      tmp_f64 = -tmp_f64;
+    }
+
+    /* Set precision to "6" if not set (From os_io.h)  */
+    if ( flags & COSM_IO_PREC_SET )
+    {
+      if ( precision > 40 )
+      {
+        precision = 40;
+      }
+    }
+    else
+    {
+      precision = 6;
+    }
+
+    if ( ( i = CosmFloatInf( tmp_f64 ) ) != 0 )
+    {
+      *ptr_ascii++ = (ascii) 'f';
+      *ptr_ascii++ = (ascii) 'n';
+      *ptr_ascii++ = (ascii) 'I';
+      if ( i > 0 )
+      {
+        *ptr_ascii++ = (ascii) '+';
+      }
+      else
+      {
+        *ptr_ascii++ = (ascii) '-';
+      }
+      tmp_count += 4;
+    }
+    else if ( !scientific )
+    {
+      /* Get whole/fraction part using casts. */
+      whole_f64 = floor( tmp_f64 );
+      tmp_f64 = tmp_f64 - whole_f64;
+      if ( precision == 0 )
+      {
+        tmp_f64 = 0.0;
+      }
+
+      if ( tmp_f64 > 0 || precision )
+      {
+        for ( i = precision - 1 ; i >= 0 ; i-- )
         {
-          if ( ( character >= '1' ) && ( character <= '9' ) )
+          if ( tmp_f64 > 0 )
           {
-            /* We are defining the width */
-            width_set = COSM_IO_YES;
-            state = COSM_IO_WIDTH;
+            tmp_f64 = tmp_f64 * 10.0;
+            tmp_whole_f64 = floor( tmp_f64 );
+            tmp_f64 = tmp_f64 - tmp_whole_f64;
           }
           else
           {
-            switch ( character )
-            {
-              case '0':
-                pad_zero = COSM_IO_YES;
-                width_set = COSM_IO_YES;
-                state = COSM_IO_WIDTH;
-                break;
-              case '-':
-                pad_left = COSM_IO_YES;
-                width_set = COSM_IO_YES;
-                state = COSM_IO_WIDTH;
-                break;
-              case '*':
-                width = va_arg( args, u32 );
-                if ( width > 0 ) /* avoid nasty bug */
-                  width_set = COSM_IO_YES;
-                break;
-              case '.':
-                precision = 0;
-                state = COSM_IO_PREC;
-                break;
-              case 'c':
-                state = COSM_IO_SINGLE_CHAR;
-                break;
-              case 's':
-                state = COSM_IO_STRING;
-                break;
-              case 'b':
-                state = COSM_IO_BUFFER;
-                break;
-              case 'i':
-                state = COSM_IO_S32_DEC;
-                break;
-              case 'j':
-                state = COSM_IO_S64_DEC;
-                break;
-              case 'k':
-                state = COSM_IO_S128_DEC;
-                break;
-              case 'u':
-                state = COSM_IO_U32_DEC;
-                break;
-              case 'v':
-                state = COSM_IO_U64_DEC;
-                break;
-              case 'w':
-                state = COSM_IO_U128_DEC;
-                break;
-              case 'f':
-                state = COSM_IO_F64;
-                break;
-              case 'F':
-                state = COSM_IO_F64_SCI;
-                break;
-              case 'X':
-                state = COSM_IO_U32_HEX;
-                break;
-              case 'Y':
-                state = COSM_IO_U64_HEX;
-                break;
-              case 'Z':
-                state = COSM_IO_U128_HEX;
-                break;
-              case 'p':
-                state = COSM_IO_POINTER;
-                break;
-              case 0:
-                return chars_output;
-              default:
-                state = COSM_IO_TEXT;
-                break;
-            }
-            _COSM_IO_FETCHCHAR();
+            tmp_whole_f64 = 0;
           }
+
+          *(ptr_ascii+i) = (ascii) ( '0' + tmp_whole_f64 );
         }
-        break;
-      case COSM_IO_WIDTH:
-        switch ( character )
+
+        ptr_ascii += precision;
+        tmp_count += precision;
+
+        *ptr_ascii++ = (ascii) '.';
+        tmp_count++;
+      }
+
+      /* print whole */
+      do
+      {
+        *ptr_ascii++ = (ascii) ( '0' + fmod( whole_f64, 10.0 ) );
+        whole_f64 = whole_f64 / 10;
+        whole_f64 = floor( whole_f64 );
+        tmp_count++;
+      } while ( whole_f64 > 0 );
+    }
+    else
+    {
+      /* Count "E" digits */
+      tmp_s32 = 0;
+      if ( tmp_f64 != 0 )
+      {
+        while ( tmp_f64 < 1.0 )
         {
-          case '0':
-          case '1':
-          case '2':
-          case '3':
-          case '4':
-          case '5':
-          case '6':
-          case '7':
-          case '8':
-          case '9':
-            width = width * 10 + ( character - '0' );
-            _COSM_IO_FETCHCHAR();
-            break;
-          case 0:
-            return chars_output;
-          default:
-            state = COSM_IO_PERCENT;
-            break;
-         }
-         break;
-      case COSM_IO_PREC:
-        switch ( character )
+          tmp_s32--;
+          tmp_f64 = tmp_f64 * 10.0;
+        }
+        while ( tmp_f64 >= 10.0 )
         {
-          case '*':
-            precision = va_arg( args, u32 );
-            precision_set = COSM_IO_YES;
-            _COSM_IO_FETCHCHAR();
-            state = COSM_IO_PERCENT;
-            break;
-          case '0':
-          case '1':
-          case '2':
-          case '3':
-          case '4':
-          case '5':
-          case '6':
-          case '7':
-          case '8':
-          case '9':
-            precision = precision * 10 + ( character - '0' );
-            precision_set = COSM_IO_YES;
-            _COSM_IO_FETCHCHAR();
-            break;
-          case 0:
-            return chars_output;
-          default:
-            state = COSM_IO_PERCENT;
-            break;
+          tmp_s32++;
+          tmp_f64 = tmp_f64 / 10.0;
         }
-        break;
-      case COSM_IO_SINGLE_CHAR:
-        if ( Cosm_PrintChar( &bytes, file, output_str, max_bytes,
-          va_arg( args, u32 ) ) == COSM_FAIL )
+      }
+
+      if ( tmp_s32 )
+      {
+        if ( tmp_s32 < 0 )
         {
-          return chars_output;
+          tmp_u32 = -tmp_s32;
         }
-        _COSM_IO_CHECKMAX();
-        _COSM_IO_CLEARTMP();
-        break;
-      case COSM_IO_STRING:
-        ptr_utf8 = (utf8 *) va_arg( args, utf8 * );
-        if ( ( precision_set ) && ( ptr_utf8 != NULL ) )
+        else
         {
-          u = 0;
-          while ( ( u < precision ) && ( ptr_utf8[u] != 0 ) )
-          {
-            if ( Cosm_PrintChar( &bytes, file, output_str, max_bytes,
-              ptr_utf8[u] ) == COSM_FAIL )
-            {
-              return chars_output;
-            }
-            _COSM_IO_CHECKMAX();
-            u++;
-          }
+          tmp_u32 = tmp_s32;
         }
-        _COSM_IO_CLEARTMP();
-        break;
-      case COSM_IO_BUFFER:
-        ptr_u8 = va_arg( args, u8 * );
-        if ( ( precision_set ) && ( ptr_u8 != NULL ) )
+
+        do
         {
-          for ( u = 0 ; u < precision ; u++ )
-          {
-            if ( Cosm_PrintChar( &bytes, file, output_str, max_bytes,
-              ptr_u8[u] ) == COSM_FAIL )
-            {
-              return chars_output;
-            }
-            _COSM_IO_CHECKMAX();
-          }
+          *ptr_ascii++ = (ascii) ( '0' + ( tmp_u32 % 10 ) );
+          tmp_u32 = tmp_u32 / 10;
+          tmp_count++;
+        } while ( tmp_u32 > 0 );
+
+        if ( tmp_s32 < 0 )
+        {
+          *ptr_ascii++ = (ascii) '-';
+          tmp_count++;
         }
-        _COSM_IO_CLEARTMP();
-        break;
-      case COSM_IO_TMP_STRING:
-        /*
-          print tmp_string backwards
-          using tmp_count, width, pad_left, pad_zero
-        */
-        if ( ( tmp_sign ) && ( width_set ) )
+
+        *ptr_ascii++ = (ascii) 'E';
+        tmp_count++;
+      }
+
+      whole_f64 = floor( tmp_f64 );
+      tmp_f64 = tmp_f64 - whole_f64;
+      if ( precision == 0 )
+      {
+        tmp_f64 = 0.0;
+      }
+
+      for ( i = precision - 1 ; i >= 0 ; i-- )
+      {
+        if ( tmp_f64 > 0 )
         {
-          width--;
+          tmp_f64 = tmp_f64 * 10.0;
+          tmp_whole_f64 = floor( tmp_f64 );
+          tmp_f64 = tmp_f64 - tmp_whole_f64;
         }
-        /* First pad as necessary (zero pad or left pad ) */
-        if ( ( width_set ) && ( width > tmp_count ) &&
-          ( pad_left == COSM_IO_NO ) )
+        else
         {
-          for ( u = 0 ; u < ( width - tmp_count ) ; u++ )
-          {
-            if ( pad_zero == COSM_IO_YES )
-            {
-              if ( Cosm_PrintChar( &bytes, file, output_str, max_bytes,
-                '0' ) == COSM_FAIL )
-              {
-                return chars_output;
-              }
-            }
-            else
-            {
-              if ( Cosm_PrintChar( &bytes, file, output_str, max_bytes,
-                ' ' ) == COSM_FAIL )
-              {
-                return chars_output;
-              }
-            }
-            _COSM_IO_CHECKMAX();
-          }
+          tmp_whole_f64 = 0;
         }
-        if ( tmp_sign )
+
+        *(ptr_ascii+i) = (ascii) ( '0' + tmp_whole_f64 );
+      }
+      ptr_ascii += precision;
+      tmp_count += precision;
+
+      *ptr_ascii++ = (ascii) '.';
+      *ptr_ascii++ = (ascii) ( '0' + whole_f64 );
+      tmp_count += 2;
+    }
+  }
+
+  for ( tmp_u32 = 0 ; tmp_u32 < tmp_count ; tmp_u32++ )
+  {
+    end[-1 - (s32) tmp_u32] = tmp_ascii[tmp_u32];
+  }
+
+  return tmp_count;
+}
+
+static u32 Cosm_PrintRun( cosm_FILE * file, void * string, u32 max_bytes,
+  const utf8 * format, const cosm_PRINT_FORMAT * compiled, va_list args )
+{
+  cosm_PRINT_OUT out;
+  cosm_PRINT_SPEC parsed;
+  const cosm_PRINT_SPEC * spec;
+  ascii digits[COSM_IO_PRINT_DIGITS];
+  ascii * end;
+  utf8 array[8];
+  const utf8 * ptr_utf8;
+  const u8 * ptr_u8;
+  u32 next;
+  u32 flags;
+  u32 width;
+  u32 precision;
+  u32 count;
+  u32 sign;
+  u32 u;
+  s32 tmp_s32;
+  s64 tmp_s64;
+  u64 tmp_u64;
+  u128 tmp_u128;
+  s128 tmp_s128;
+
+  out.file = file;
+  out.string = (utf8 *) string;
+  out.max_bytes = max_bytes;
+  out.count = 0;
+  out.used = 0;
+  out.stop = COSM_IO_NO;
+
+  /* numbers are made right to left ending at end */
+  end = &digits[COSM_IO_PRINT_DIGITS];
+  next = 0;
+
+  while ( out.stop == COSM_IO_NO )
+  {
+    if ( compiled != NULL )
+    {
+      if ( next >= compiled->count )
+      {
+        break;
+      }
+      spec = &compiled->specs[next++];
+    }
+    else
+    {
+      Cosm_PrintParse( &parsed, &format );
+      spec = &parsed;
+    }
+
+    flags = spec->flags;
+    width = spec->width;
+    precision = spec->precision;
+    if ( flags & COSM_IO_WIDTH_ARG )
+    {
+      width = va_arg( args, u32 );
+      if ( width > 0 ) /* avoid nasty bug */
+      {
+        flags |= COSM_IO_WIDTH_SET;
+      }
+    }
+    if ( flags & COSM_IO_PREC_ARG )
+    {
+      precision = va_arg( args, u32 );
+    }
+
+    count = 0;
+    sign = 0;
+
+    switch ( spec->type )
+    {
+      case COSM_IO_TEXT:
+        Cosm_PrintOut( &out, spec->text, spec->length );
+        break;
+      case COSM_IO_SINGLE_CHAR:
+        if ( Cosm_EncodeUTF8( array, &u, va_arg( args, u32 ) )
+          == COSM_FAIL )
         {
-          if ( Cosm_PrintChar( &bytes, file, output_str, max_bytes,
-            '-' ) == COSM_FAIL )
-          {
-            return chars_output;
-          }
-          _COSM_IO_CHECKMAX();
+          out.stop = COSM_IO_YES;
+          break;
         }
-        for ( i = ( tmp_count - 1 ) ; i > -1 ; i-- )
+        Cosm_PrintOut( &out, array, u );
+        break;
+      case COSM_IO_STRING:
+        ptr_utf8 = va_arg( args, const utf8 * );
+        if ( ( flags & COSM_IO_PREC_SET ) && ( ptr_utf8 != NULL ) )
         {
-          if ( Cosm_PrintChar( &bytes, file, output_str, max_bytes,
-            tmp_ascii[i] ) == COSM_FAIL )
+          for ( u = 0 ; ( u < precision ) && ( ptr_utf8[u] != 0 ) ; u++ )
           {
-            return chars_output;
           }
-          _COSM_IO_CHECKMAX();
+          Cosm_PrintOut( &out, ptr_utf8, u );
         }
-        if ( ( width_set ) && ( width > tmp_count ) &&
-          ( pad_left == COSM_IO_YES ) )
+        break;
+      case COSM_IO_BUFFER:
+        ptr_u8 = va_arg( args, const u8 * );
+        if ( ( flags & COSM_IO_PREC_SET ) && ( ptr_u8 != NULL ) )
         {
-          for ( u = 0 ; u < ( width - tmp_count ) ; u++ )
-          {
-            if ( Cosm_PrintChar( &bytes, file, output_str, max_bytes,
-              ' ' ) == COSM_FAIL )
-            {
-              return chars_output;
-            }
-            _COSM_IO_CHECKMAX();
-          }
+          Cosm_PrintOut( &out, ptr_u8, precision );
         }
-        _COSM_IO_CLEARTMP();
         break;
       case COSM_IO_U32_DEC:
-        tmp_u32 = va_arg( args, u32 );
-
-        do
-        {
-          *ptr_ascii++ = (ascii) ( '0' + ( tmp_u32 % 10 ) );
-          tmp_u32 = tmp_u32 / 10;
-          tmp_count++;
-        } while ( tmp_u32 > 0 );
-
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
+        count = Cosm_PrintU64Dec( end, (u64) va_arg( args, u32 ) );
         break;
       case COSM_IO_U64_DEC:
-        tmp_u64 = va_arg( args, u64 );
-
-        do
-        {
-          *ptr_ascii++ = (ascii) ( '0' + (u32) ( tmp_u64 % 10LL ) );
-          tmp_u64 = ( tmp_u64 / 10LL );
-          tmp_count++;
-        } while ( ( tmp_u64 > 0 ) );
-
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
+        count = Cosm_PrintU64Dec( end, va_arg( args, u64 ) );
         break;
       case COSM_IO_U128_DEC:
-        tmp_u128 = va_arg( args, u128 );
-
-        do
-        {
-          *ptr_ascii++ = (ascii) ( '0' + (u32) CosmU64U128(
-            CosmU128Mod( tmp_u128, CosmU128U32( (u32) 10 ) ) ) );
-          tmp_u128 = CosmU128Div( tmp_u128, CosmU128U32( (u32) 10 ) );
-          tmp_count++;
-        } while ( CosmU128Gt( tmp_u128, CosmU128U32( (u32) 0 ) ) );
-
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
+        count = Cosm_PrintU128Dec( end, va_arg( args, u128 ) );
         break;
       case COSM_IO_S32_DEC:
         tmp_s32 = va_arg( args, s32 );
-
         if ( tmp_s32 < 0 )
         {
-          tmp_sign = -1;
-          tmp_s32 = -tmp_s32;
+          sign = 1;
+          count = Cosm_PrintU64Dec( end, (u64) ( 0 - (u32) tmp_s32 ) );
         }
-
-        do
+        else
         {
-          *ptr_ascii++ = (ascii) ( '0' + ( tmp_s32 % 10 ) );
-          tmp_s32 = tmp_s32 / 10;
-          tmp_count++;
-        } while ( tmp_s32 > 0 );
-
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
+          count = Cosm_PrintU64Dec( end, (u64) tmp_s32 );
+        }
         break;
       case COSM_IO_S64_DEC:
         tmp_s64 = va_arg( args, s64 );
-
-        if ( ( tmp_s64 < 0 ) )
+        if ( tmp_s64 < 0 )
         {
-          tmp_sign = -1;
-          tmp_s64 = ( 0 - tmp_s64 );
+          sign = 1;
+          count = Cosm_PrintU64Dec( end, 0 - (u64) tmp_s64 );
         }
-
-        do
+        else
         {
-          *ptr_ascii++ = (ascii) ( '0' + (s32) ( tmp_s64 % 10LL ) );
-          tmp_s64 = ( tmp_s64 / 10LL );
-          tmp_count++;
-        } while ( ( tmp_s64 > 0 ) );
-
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
+          count = Cosm_PrintU64Dec( end, (u64) tmp_s64 );
+        }
         break;
       case COSM_IO_S128_DEC:
         tmp_s128 = va_arg( args, s128 );
-
         if ( CosmS128Lt( tmp_s128, CosmS128S32( 0 ) ) )
         {
-          tmp_sign = -1;
+          sign = 1;
           tmp_s128 = CosmS128Sub( CosmS128S32( 0 ), tmp_s128 );
         }
-
-        do
-        {
-          *ptr_ascii++ = (ascii) ( '0' + (u32) CosmS64S128(
-            CosmS128Mod( tmp_s128, CosmS128S32( 10 ) ) ) );
-          tmp_s128 = CosmS128Div( tmp_s128, CosmS128S32( 10 ) );
-          tmp_count++;
-        } while ( CosmS128Gt( tmp_s128, CosmS128S32( 0 ) ) );
-
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
+        tmp_u128.hi = (u64) tmp_s128.hi;
+        tmp_u128.lo = tmp_s128.lo;
+        count = Cosm_PrintU128Dec( end, tmp_u128 );
         break;
       case COSM_IO_U32_HEX:
-       tmp_u32 = va_arg( args, u32 );
-
-        do
-        {
-          *ptr_ascii++ = hex_table[ tmp_u32 & 0xF ];
-          tmp_u32 = tmp_u32 >> 4;
-          tmp_count++;
-        } while ( tmp_u32 > 0 );
-
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
+        count = Cosm_PrintU64Hex( end, (u64) va_arg( args, u32 ) );
         break;
       case COSM_IO_U64_HEX:
-        tmp_u64 = va_arg( args, u64 );
-
-        do
-        {
-          *ptr_ascii++ = hex_table[ (u32) ( tmp_u64 & 15LL ) ];
-          tmp_u64 = ( tmp_u64 >> 4 );
-          tmp_count++;
-        } while ( ( tmp_u64 > 0 ) );
-
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
+        count = Cosm_PrintU64Hex( end, va_arg( args, u64 ) );
         break;
       case COSM_IO_U128_HEX:
-        tmp_u128 = va_arg( args, u128 );
-
-        do
-        {
-          *ptr_ascii++ = hex_table[ (u32) CosmU64U128(
-            CosmU128And( tmp_u128, CosmU128U32( (u32) 15 ) ) ) ];
-          tmp_u128 = CosmU128Rsh( tmp_u128, 4 );
-          tmp_count++;
-        } while ( CosmU128Gt( tmp_u128, CosmU128U32( 0 ) ) );
-
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
+        count = Cosm_PrintU128Hex( end, va_arg( args, u128 ) );
         break;
       case COSM_IO_F64:
-        tmp_f64 = (f64) va_arg( args, f64 );
-
-        if ( CosmFloatNaN( tmp_f64 ) )
+      case COSM_IO_F64_SCI:
+        count = Cosm_PrintF64( end, (f64) va_arg( args, f64 ),
+          ( spec->type == COSM_IO_F64_SCI ), precision, flags, &sign );
+        break;
+      case COSM_IO_POINTER:
+        /* always all the digits */
+        if ( sizeof( void * ) == 8 )
         {
-          *ptr_ascii++ = (ascii) 'N';
-          *ptr_ascii++ = (ascii) 'a';
-          *ptr_ascii++ = (ascii) 'N';
-          *ptr_ascii++ = 0;
-          tmp_count += 3;
-          state = COSM_IO_TMP_STRING;
-          break;
+          tmp_u64 = va_arg( args, u64 );
         }
-
-        if ( tmp_f64 < 0 )
+        else
         {
-          tmp_sign = -1;
-          tmp_f64 = -tmp_f64;
+          tmp_u64 = (u64) va_arg( args, u32 );
         }
-
-        if ( ( i = CosmFloatInf( tmp_f64 ) ) != 0 )
+        count = Cosm_PrintU64Hex( end, tmp_u64 );
+        while ( count < ( sizeof( void * ) * 2 ) )
         {
-          *ptr_ascii++ = (ascii) 'f';
-          *ptr_ascii++ = (ascii) 'n';
-          *ptr_ascii++ = (ascii) 'I';
-          if ( i > 0 )
-          {
-            *ptr_ascii++ = (ascii) '+';
-          }
-          else
-          {
-            *ptr_ascii++ = (ascii) '-';
-          }
-          *ptr_ascii++ = 0;
-          tmp_count += 4;
-          state = COSM_IO_TMP_STRING;
-          break;
+          count++;
+          end[-(s32) count] = '0';
         }
+        break;
+      default: /* COSM_IO_END */
+        out.stop = COSM_IO_YES;
+        break;
+    }
 
-        /* Get whole/fraction part using casts. */
-        whole_f64 = floor( tmp_f64 );
-        tmp_f64 = tmp_f64 - whole_f64;
+    if ( count > 0 )
+    {
+      Cosm_PrintNumber( &out, end - count, count, sign, width, flags );
+    }
+  }
 
-        /* Set precision to "6" if not set (From os_io.h)  */
-        if ( precision_set )
-        {
-          if ( precision == 0 )
-          {
-            tmp_f64 = 0.0;
-          }
-          if ( precision > 40 )
-          {
-            precision = 40;
-          }
-        }
-        else
-        {
-          precision = 6;
-        }
+  if ( out.string == NULL )
+  {
+    Cosm_PrintFlush( &out );
+  }
 
-        if ( tmp_f64 > 0 || precision )
-        {
-          for ( i = precision - 1 ; i >= 0 ; i-- )
-          {
-            if ( tmp_f64 > 0 )
-            {
-              tmp_f64 = tmp_f64 * 10.0;
-              tmp_whole_f64 = floor( tmp_f64 );
-              tmp_f64 = tmp_f64 - tmp_whole_f64;
-            }
-            else tmp_whole_f64 = 0;
+  return out.count;
+}
+
+u32 Cosm_Print( cosm_FILE * file, void * string, u32 max_bytes,
+  const void * format, va_list args )
+{
+  /* check for valid parameters */
+  if ( ( max_bytes == 0 ) || ( format == NULL ) )
+  {
+    return 0;
+  }
 
-            *(ptr_ascii+i) = (ascii) ( '0' + tmp_whole_f64 );
-          }
+  return Cosm_PrintRun( file, string, max_bytes, (const utf8 *) format,
+    NULL, args );
+}
 
-          ptr_ascii += precision;
-          tmp_count += precision;
+u32 Cosm_PrintCompiled( cosm_FILE * file, void * string, u32 max_bytes,
+  const cosm_PRINT_FORMAT * compiled, va_list args )
+{
+  if ( ( max_bytes == 0 ) || ( compiled == NULL )
+    || ( compiled->specs == NULL ) )
+  {
+    return 0;
+  }
 
-          *ptr_ascii++ = (ascii) '.';
-          tmp_count++;
-        }
+  return Cosm_PrintRun( file, string, max_bytes, NULL, compiled, args );
+}
 
-        /* print whole */
-        do
-        {
-          *ptr_ascii++ = (ascii) ( '0' + fmod( whole_f64, 10.0 ) );
-          whole_f64 = whole_f64 / 10;
-          whole_f64 = floor( whole_f64 );
-          tmp_count++;
-        } while ( whole_f64 > 0 );
+u32 Cosm_PrintU64Dec( ascii * end, u64 number )
+{
+  ascii * ptr;
+  u32 small;
+  u32 pair;
 
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
-        break;
-      case COSM_IO_F64_SCI:
-        tmp_f64 = (f64) va_arg( args, f64 );
+  ptr = end;
 
-        if ( CosmFloatNaN( tmp_f64 ) )
-        {
-          *ptr_ascii++ = (ascii) 'N';
-          *ptr_ascii++ = (ascii) 'a';
-          *ptr_ascii++ = (ascii) 'N';
-          *ptr_ascii++ = 0;
-          tmp_count += 3;
-          state = COSM_IO_TMP_STRING;
-          break;
-        }
+  /* two digits at a time, in 32 bits as soon as the number fits */
+  while ( ( number >> 32 ) != 0 )
+  {
+    pair = (u32) ( number % 100 ) * 2;
+    number = number / 100;
+    ptr -= 2;
+    ptr[0] = dec_pair_table[pair];
+    ptr[1] = dec_pair_table[pair + 1];
+  }
 
-        if ( tmp_f64 < 0 )
-        {
-          tmp_sign = -1;
-          tmp_f64 = -tmp_f64;
-        }
+  small = (u32) number;
+  while ( small >= 100 )
+  {
+    pair = ( small % 100 ) * 2;
+    small = small / 100;
+    ptr -= 2;
+    ptr[0] = dec_pair_table[pair];
+    ptr[1] = dec_pair_table[pair + 1];
+  }
 
-        if ( ( i = CosmFloatInf( tmp_f64 ) ) != 0 )
-        {
-          *ptr_ascii++ = (ascii) 'f';
-          *ptr_ascii++ = (ascii) 'n';
-          *ptr_ascii++ = (ascii) 'I';
-          if ( i > 0 )
-          {
-            *ptr_ascii++ = (ascii) '+';
-          }
-          else
-          {
-            *ptr_ascii++ = (ascii) '-';
-          }
-          *ptr_ascii++ = 0;
-          tmp_count += 4;
-          state = COSM_IO_TMP_STRING;
-          break;
-        }
+  if ( small >= 10 )
+  {
+    ptr -= 2;
+    ptr[0] = dec_pair_table[small * 2];
+    ptr[1] = dec_pair_table[small * 2 + 1];
+  }
+  else
+  {
+    *--ptr = (ascii) ( '0' + small );
+  }
 
-        /* Count "E" digits */
-        tmp_s32 = 0;
-        if ( tmp_f64 != 0 )
-        {
-          while ( tmp_f64 < 1.0 )
-          {
-            tmp_s32--;
-            tmp_f64 = tmp_f64 * 10.0;
-          }
-          while ( tmp_f64 >= 10.0 )
-          {
-            tmp_s32++;
-            tmp_f64 = tmp_f64 / 10.0;
-          }
-        }
+  return (u32) ( end - ptr );
+}
 
-        if ( tmp_s32 )
-        {
-          if ( tmp_s32 < 0 )
-          {
-            tmp_u32 = -tmp_s32;
-          }
-          else
-          {
-            tmp_u32 = tmp_s32;
-          }
+u32 Cosm_PrintU64Hex( ascii * end, u64 number )
+{
+  ascii * ptr;
+  u32 pair;
 
-          do
-          {
-            *ptr_ascii++ = (ascii) ( '0' + ( tmp_u32 % 10 ) );
-            tmp_u32 = tmp_u32 / 10;
-            tmp_count++;
-          } while ( tmp_u32 > 0 );
+  ptr = end;
 
-          if ( tmp_s32 < 0 )
-          {
-            *ptr_ascii++ = (ascii) '-';
-            tmp_count++;
-          }
+  while ( number > 0xFF )
+  {
+    pair = (u32) ( number & 0xFF ) * 2;
+    number = number >> 8;
+    ptr -= 2;
+    ptr[0] = hex_pair_table[pair];
+    ptr[1] = hex_pair_table[pair + 1];
+  }
 
-          *ptr_ascii++ = (ascii) 'E';
-          tmp_count++;
-        }
+  pair = (u32) number * 2;
+  *--ptr = hex_pair_table[pair + 1];
+  if ( number > 0xF )
+  {
+    *--ptr = hex_pair_table[pair];
+  }
 
-        whole_f64 = floor( tmp_f64 );
-        tmp_f64 = tmp_f64 - whole_f64;
+  return (u32) ( end - ptr );
+}
 
-        /* Set precision to "6" if not set (From os_io.h)  */
-        if ( precision_set )
-        {
-          if ( precision == 0 )
-          {
-            tmp_f64 = 0.0;
-          }
-          if ( precision > 40 )
-          {
-            precision = 40;
-          }
-        }
-        else
-        {
-          precision = 6;
-        }
+u32 Cosm_PrintU128Dec( ascii * end, u128 number )
+{
+  u128 rest;
+  u32 count;
 
-        for ( i = precision - 1 ; i >= 0 ; i-- )
-        {
-          if ( tmp_f64 > 0 )
-          {
-            tmp_f64 = tmp_f64 * 10.0;
-            tmp_whole_f64 = floor( tmp_f64 );
-            tmp_f64 = tmp_f64 - tmp_whole_f64;
-          }
-          else
-          {
-            tmp_whole_f64 = 0;
-          }
+  if ( number.hi == 0 )
+  {
+    return Cosm_PrintU64Dec( end, number.lo );
+  }
 
-          *(ptr_ascii+i) = (ascii) ( '0' + tmp_whole_f64 );
-        }
-        ptr_ascii += precision;
-        tmp_count += precision;
+  /* 19 digits at a time, the most that always fit in a u64 */
+  CosmU128DivMod( number, CosmU128U64( 0x8AC7230489E80000LL ), &number,
+    &rest );
+  count = Cosm_PrintU64Dec( end, rest.lo );
+  while ( count < 19 )
+  {
+    count++;
+    end[-(s32) count] = '0';
+  }
 
-        *ptr_ascii++ = (ascii) '.';
-        *ptr_ascii++ = (ascii) ( '0' + whole_f64 );
-        tmp_count += 2;
+  return count + Cosm_PrintU128Dec( end - count, number );
+}
 
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
-        break;
-      case COSM_IO_POINTER:
-        switch ( sizeof( void * ) )
-        {
-          case 4:
-            tmp_u32 = (u32) va_arg( args, u32 );
+u32 Cosm_PrintU128Hex( ascii * end, u128 number )
+{
+  u32 count;
 
-            for ( u = 0 ; u < 8 ; u++ )
-            {
-              *ptr_ascii++ = hex_table[ tmp_u32 & 0x0F ];
-              tmp_u32 = tmp_u32 >> 4;
-              tmp_count++;
-            }
-            break;
-          case 8:
-            /*
-              this will be wrong on little endian system with
-              fake u64's and 64bit pointers, unlikely to exist.
-            */
-            tmp_u64 = va_arg( args, u64 );
-
-            for ( u = 0 ; u < 16 ; u++ )
-            {
-              *ptr_ascii++ = hex_table[ (u32) ( tmp_u64 % 16LL ) ];
-              tmp_u64 = ( tmp_u64 >> 4 );
-              tmp_count++;
-            }
-            break;
-          case 2:
-            tmp_u32 = (u32) va_arg( args, u32 );
+  if ( number.hi == 0 )
+  {
+    return Cosm_PrintU64Hex( end, number.lo );
+  }
 
-            for ( u = 0 ; u < 4 ; u++ )
-            {
-              *ptr_ascii++ = hex_table[ tmp_u32 & 0x0F ];
-              tmp_u32 = tmp_u32 >> 4;
-              tmp_count++;
-            }
-            break;
-        }
-        *ptr_ascii++ = 0;
-        state = COSM_IO_TMP_STRING;
-        break;
-    }
+  count = Cosm_PrintU64Hex( end, number.lo );
+  while ( count < 16 )
+  {
+    count++;
+    end[-(s32) count] = '0';
   }
-  return (u64) 0;
-}
 
-#undef _COSM_IO_CLEARTMP
-#undef _COSM_IO_CHECKMAX
-#undef _COSM_IO_FETCHCHAR
+  return count + Cosm_PrintU64Hex( end - count, number.hi );
+}
 
 s32 Cosm_PrintChar( u32 * bytes, cosm_FILE * file, void * string, u32 max_bytes,
   utf8char character )
@@ -2225,6 +2707,113 @@ s32 Cosm_PrintChar( u32 * bytes, cosm_FILE * file, void * string, u32 max_bytes,
   return COSM_PASS;
 }
 
+u32 Cosm_StrBytesScalar( const utf8 * string )
+{
+  u32 length;
+
+  length = 0;
+
+  if ( string == NULL )
+  {
+    return length;
+  }
+
+  while ( *(string)++ != 0 )
+  {
+    length++;
+  }
+
+  return length;
+}
+
+utf8 * Cosm_StrCharScalar( const utf8 * string, utf8char character,
+  u32 max_bytes )
+{
+  utf8 array[8];
+  u32 bytes;
+
+  if ( ( string == NULL ) || ( max_bytes == 0 ) )
+  {
+    return NULL;
+  }
+
+  if ( Cosm_EncodeUTF8( array, &bytes, character ) == COSM_FAIL )
+  {
+    return NULL;
+  }
+  array[bytes] = 0;
+
+  return Cosm_StrStrScalar( string, array, max_bytes );
+}
+
+utf8 * Cosm_StrStrScalar( const utf8 * string, const utf8 * substring,
+  u32 max_bytes )
+{
+  utf8 * first, * end, * str, * sub;
+  utf8 ch;
+  u32 len;
+
+  /* check for bad or trivial parameters */
+  if ( ( string == NULL ) || ( substring == NULL ) ||
+    ( string[0] == 0 ) || ( substring[0] == 0 ) )
+  {
+    return NULL;
+  }
+
+  /* substring too long? */
+  if ( ( len = CosmStrBytes( substring ) ) > ( max_bytes - 1 ) )
+  {
+    return NULL;
+  }
+
+  /*
+    end is set to the last character substring could safely start at.
+    makes it safe and saves some iterations too.
+  */
+  end = (utf8 *) CosmMemOffset( string, max_bytes - len );
+  first = (utf8 *) string;
+  ch = substring[0];
+
+  for ( ; ; )
+  {
+    /* find a matching first character in string */
+    while ( *first != ch )
+    {
+      if ( *first == 0 )
+      {
+        return NULL;
+      }
+      first++;
+      if ( first > end )
+      {
+        return NULL;
+      }
+    }
+
+    str = first;
+    sub = (utf8 *) substring;
+
+    /* match up the strings */
+    while ( ( *str == *sub ) && ( *sub != 0 ) )
+    {
+      str++;
+      sub++;
+    }
+
+    /* if we got safely to the end of sub, then we found it */
+    if ( *sub == 0 )
+    {
+      return first;
+    }
+
+    first++;
+    if ( first > end )
+    {
+      return NULL;
+    }
+  }
+}
+
 /* testing */
 
 #if 0 /* unused */
@@ -2289,6 +2878,10 @@ s32 Cosm_TestOSIO( void )
   f32 tmpf32;
   s32 status;
   utf8 * pos;
+  utf8 scan[160];
+  u32 j, k;
+  u128 big;
+  cosm_PRINT_FORMAT compiled;
 
   /* ASCII tests */
 
@@ -2652,5 +3245,102 @@ s32 Cosm_TestOSIO( void )
     return -47;
   }
 
+  /*
+    The vector string functions must agree with the byte versions for
+    every alignment, length, and limit.
+  */
+  for ( i = 0 ; i < 159 ; i++ )
+  {
+    scan[i] = (utf8) ( 'a' + ( ( i * 7 ) % 23 ) );
+  }
+  scan[159] = 0;
+  for ( i = 0 ; i < 40 ; i++ )
+  {
+    for ( j = 0 ; j < 120 ; j += 3 )
+    {
+      scan[i + j] = 0;
+      if ( CosmStrBytes( &scan[i] ) != Cosm_StrBytesScalar( &scan[i] ) )
+      {
+        return -48;
+      }
+      for ( k = 0 ; k < 130 ; k += 7 )
+      {
+        if ( ( CosmStrChar( &scan[i], 'w', k )
+          != Cosm_StrCharScalar( &scan[i], 'w', k ) )
+          || ( CosmStrChar( &scan[i], scan[i + ( j / 2 )], k )
+          != Cosm_StrCharScalar( &scan[i], scan[i + ( j / 2 )], k ) ) )
+        {
+          return -49;
+        }
+      }
+      scan[i + j] = (utf8) ( 'a' + ( ( ( i + j ) * 7 ) % 23 ) );
+    }
+  }
+  for ( i = 0 ; i < 40 ; i++ )
+  {
+    for ( j = 1 ; j < 40 ; j += 2 )
+    {
+      /* substring taken out of the scan string, then the same unterminated */
+      CosmMemCopy( a_str2, &scan[i + 50], j );
+      a_str2[j] = 0;
+      for ( k = 0 ; k < 120 ; k += 5 )
+      {
+        if ( CosmStrStr( &scan[i], a_str2, k )
+          != Cosm_StrStrScalar( &scan[i], a_str2, k ) )
+        {
+          return -50;
+        }
+      }
+      a_str2[j - 1] = '!';
+      if ( CosmStrStr( &scan[i], a_str2, 0 )
+        != Cosm_StrStrScalar( &scan[i], a_str2, 0 ) )
+      {
+        return -50;
+      }
+    }
+  }
+
+  /* number conversions and padding */
+  big.hi = 0xFFFFFFFFFFFFFFFFLL;
+  big.lo = 0xFFFFFFFFFFFFFFFFLL;
+  CosmPrintStr( a_str2, sizeof( a_str2 ),
+    "%u|%05u|%-4u|%i|%05i|%X|%v|%j|%Y|%w|%Z|%.3s|%c%%",
+    4294967295U, 42, 7, -2147483647 - 1, -42, 0xBEEF,
+    0xFFFFFFFFFFFFFFFFLL, (s64) -1000000000000LL, 0xABCLL, big, big,
+    "abcdef", 'z' );
+  if ( CosmStrCmp( a_str2, "4294967295|00042|7   |-2147483648|-0042|BEEF|"
+    "18446744073709551615|-1000000000000|ABC|"
+    "340282366920938463463374607431768211455|"
+    "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF|abc|z%", sizeof( a_str2 ) ) != 0 )
+  {
+    return -51;
+  }
+
+  /* compiled formats print the same */
+  if ( CosmPrintCompile( &compiled, "%u|%05u|%-4u|%i|%05i|%X|%v|%j|%Y|%w|%Z|"
+    "%.3s|%c%%" ) != COSM_PASS )
+  {
+    return -52;
+  }
+  CosmPrintStrCompiled( a_str1, sizeof( a_str1 ), &compiled,
+    4294967295U, 42, 7, -2147483647 - 1, -42, 0xBEEF,
+    0xFFFFFFFFFFFFFFFFLL, (s64) -1000000000000LL, 0xABCLL, big, big,
+    "abcdef", 'z' );
+  CosmPrintFree( &compiled );
+  if ( CosmStrCmp( a_str1, a_str2, sizeof( a_str2 ) ) != 0 )
+  {
+    return -52;
+  }
+
+  /* strings only get whole UTF-8 characters */
+  if ( ( CosmPrintStr( a_str2, 5, "ab\xC3\xA9%u", 7 ) != 4 )
+    || ( CosmPrintStr( a_str2, 4, "ab\xC3\xA9%u", 7 ) != 2 )
+    || ( CosmStrCmp( a_str2, "ab", 3 ) != 0 )
+    || ( CosmPrintStr( a_str2, sizeof( a_str2 ), "%.8s", "\xC3\xA9t\xC3\xA9" )
+    != 5 ) )
+  {
+    return -53;
+  }
+
   return COSM_PASS;
 }
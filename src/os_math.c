@@ -19,6 +19,44 @@
 #include "cosm/os_math.h"
 #include "cosm/os_mem.h"
 
+/*
+  The software versions are always built here. Undo the native inline
+  mappings from os_math.h so the definitions below get their real names.
+*/
+#if ( defined( COSM_NATIVE_128 ) )
+#undef CosmU128U64
+#undef CosmS128S64
+#undef CosmU128U32
+#undef CosmS128S32
+#undef CosmU128Add
+#undef CosmU128Sub
+#undef CosmU128Mul
+#undef CosmU128Div
+#undef CosmU128Mod
+#undef CosmU128DivMod
+#undef CosmU128Inc
+#undef CosmU128Dec
+#undef CosmU128Lsh
+#undef CosmU128Rsh
+#undef CosmU128And
+#undef CosmU128Or
+#undef CosmU128Xor
+#undef CosmU128Not
+#undef CosmU128Eq
+#undef CosmU128Gt
+#undef CosmU128Lt
+#undef CosmS128Add
+#undef CosmS128Sub
+#undef CosmS128Mul
+#undef CosmS128Div
+#undef CosmS128Mod
+#undef CosmS128Inc
+#undef CosmS128Dec
+#undef CosmS128Eq
+#undef CosmS128Gt
+#undef CosmS128Lt
+#endif
+
 /* bigger */
 
 u128 CosmU128U64( u64 a )
@@ -301,6 +339,12 @@ u128 CosmU128Lsh( u128 a, u32 x )
   if ( x > 127 )
     return CosmU128U32( 0 );
 
+  /* a shift of 0 would shift the other half by 64 */
+  if ( x == 0 )
+  {
+    return a;
+  }
+
   /* Take care of shifts by offset > 63 */
   if ( x <= 64 )
   {
@@ -333,6 +377,12 @@ u128 CosmU128Rsh( u128 a, u32 x )
     return CosmU128U32( 0 );
   }
 
+  /* a shift of 0 would shift the other half by 64 */
+  if ( x == 0 )
+  {
+    return a;
+  }
+
   /* Take care of shifts by offset > 63 */
   if ( x <= 64 )
   {
@@ -564,6 +614,14 @@ void CosmU128DivMod( u128 a, u128 b, u128 * div, u128 * mod )
     return;
   }
 
+  /* Both fit in 64 bits, let the compiler do it */
+  if ( ( a.hi == 0 ) && ( b.hi == 0 ) )
+  {
+    *(div) = CosmU128U64( a.lo / b.lo );
+    *(mod) = CosmU128U64( a.lo % b.lo );
+    return;
+  }
+
   /* First left shift the 'b' so it have the same number of bit then 'a' */
 
   /* while ( ( a > mask ) && ( ( 64th bit of mask ) == 0 ) */
@@ -1708,5 +1766,74 @@ s32 Cosm_TestOSMath( void )
     return -178;
   }
 
+#if ( defined( COSM_NATIVE_128 ) )
+  /* The native inline versions must match the software ones exactly */
+  {
+    u128 vals[8];
+    u128 div, mod, div2, mod2;
+    s128 sa, sb;
+    u32 i, j;
+
+    _COSM_SET128( vals[0], 0000000000000000, 0000000000000000 );
+    _COSM_SET128( vals[1], 0000000000000000, 0000000000000007 );
+    _COSM_SET128( vals[2], 0000000000000000, FEDC89AB76543210 );
+    _COSM_SET128( vals[3], 0123456789ABCDEF, 45670123CDEF89AB );
+    _COSM_SET128( vals[4], FEDC89AB76543210, 89ABFEDC32107654 );
+    _COSM_SET128( vals[5], FFFFFFFFFFFFFFFF, FFFFFFFFFFFFFFFD );
+    _COSM_SET128( vals[6], 8000000000000000, 0000000000000000 );
+    _COSM_SET128( vals[7], 0000000000000001, 0000000000000000 );
+
+    for ( i = 0 ; i < 8 ; i++ )
+    {
+      for ( j = 0 ; j < 8 ; j++ )
+      {
+        sa = CosmS128U128( vals[i] );
+        sb = CosmS128U128( vals[j] );
+
+        if ( !CosmU128Eq( Cosm_U128MulNative( vals[i], vals[j] ),
+          CosmU128Mul( vals[i], vals[j] ) ) )
+        {
+          return -179;
+        }
+        CosmU128DivMod( vals[i], vals[j], &div, &mod );
+        Cosm_U128DivModNative( vals[i], vals[j], &div2, &mod2 );
+        if ( !CosmU128Eq( div, div2 ) || !CosmU128Eq( mod, mod2 ) )
+        {
+          return -180;
+        }
+        if ( !CosmS128Eq( Cosm_S128MulNative( sa, sb ),
+          CosmS128Mul( sa, sb ) ) )
+        {
+          return -181;
+        }
+        if ( !CosmS128Eq( Cosm_S128DivNative( sa, sb ),
+          CosmS128Div( sa, sb ) ) )
+        {
+          return -182;
+        }
+        if ( !CosmS128Eq( Cosm_S128ModNative( sa, sb ),
+          CosmS128Mod( sa, sb ) ) )
+        {
+          return -183;
+        }
+        if ( ( Cosm_S128GtNative( sa, sb ) != CosmS128Gt( sa, sb ) )
+          || ( Cosm_S128LtNative( sa, sb ) != CosmS128Lt( sa, sb ) )
+          || ( Cosm_U128GtNative( vals[i], vals[j] )
+            != CosmU128Gt( vals[i], vals[j] ) ) )
+        {
+          return -184;
+        }
+        if ( !CosmU128Eq( Cosm_U128LshNative( vals[i], j * 19 ),
+          CosmU128Lsh( vals[i], j * 19 ) )
+          || !CosmU128Eq( Cosm_U128RshNative( vals[i], j * 19 ),
+          CosmU128Rsh( vals[i], j * 19 ) ) )
+        {
+          return -185;
+        }
+      }
+    }
+  }
+#endif
+
   return COSM_PASS;
 }
@@ -20,17 +20,26 @@
 #include "cosm/os_mem.h"
 #include "cosm/os_math.h"
 #include "cosm/os_io.h"
+#include "cosm/os_task.h"
 
 #include <stdlib.h>
 #include <string.h> /* for memmove */
 
+#if ( defined( COSM_SIMD_X64 ) )
+#include <immintrin.h>
+#endif
+
 #if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
 #include <sys/sysinfo.h>
+#include <malloc.h>
 #elif ( ( OS_TYPE == OS_OSX ) || ( OS_TYPE == OS_IOS ) \
   || ( OS_TYPE == OS_OPENBSD ) || ( OS_TYPE == OS_NETBSD ) )
 #include <sys/param.h>
 #include <sys/sysctl.h>
 #endif
+#if ( ( OS_TYPE == OS_OSX ) || ( OS_TYPE == OS_IOS ) )
+#include <malloc/malloc.h>
+#endif
 
 /* Memory leak related defines */
 #include "cosm/os_file.h"
@@ -55,6 +64,28 @@ cosm_MEMORY_LEAK * memory_leaks = NULL;
 u32 memory_leak_count = 0;
 u32 memory_leak_alloc = 0;
 
+/* allocation counters for CosmMemCounters */
+static cosm_COUNTER memory_allocs;
+static cosm_COUNTER memory_frees;
+static cosm_COUNTER memory_bytes;
+
+static s64 Cosm_MemUsable( void * memory )
+{
+  /* the size the heap really gave us, 0 if the OS will not say */
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  return (s64) malloc_usable_size( memory );
+#elif ( ( OS_TYPE == OS_OSX ) || ( OS_TYPE == OS_IOS ) )
+  return (s64) malloc_size( memory );
+#elif ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  return (s64) _msize( memory );
+#else
+  return 0;
+#endif
+}
+
+/* detected vector instructions, 0xFF until Cosm_MemSIMD runs */
+u32 __cosm_mem_simd = 0xFF;
+
 s32 CosmMemCopy( void * dest, const void * src, u64 length )
 {
   /* Fail if either dest or src is NULL */
@@ -102,7 +133,141 @@ s32 CosmMemSet( void * memory, u64 length, u8 value )
   return COSM_PASS;
 }
 
+#if ( defined( COSM_SIMD_X64 ) )
+static s32 Cosm_MemCmpSSE2( const u8 * pA, const u8 * pB, u64 max_bytes )
+{
+  u64 i;
+  u32 mask;
+
+  /* 16 bytes at a time, then find the first byte that differs */
+  for ( i = 0 ; ( i + 16 ) <= max_bytes ; i += 16 )
+  {
+    mask = (u32) _mm_movemask_epi8( _mm_cmpeq_epi8(
+      _mm_loadu_si128( (const __m128i *) &pA[i] ),
+      _mm_loadu_si128( (const __m128i *) &pB[i] ) ) );
+    if ( mask != 0xFFFF )
+    {
+      i += (u64) __builtin_ctz( ~mask );
+      return (s32) pA[i] - (s32) pB[i];
+    }
+  }
+
+  for ( ; i < max_bytes ; i++ )
+  {
+    if ( pA[i] != pB[i] )
+    {
+      return (s32) pA[i] - (s32) pB[i];
+    }
+  }
+
+  return 0;
+}
+
+__attribute__(( target( "avx2" ) ))
+static s32 Cosm_MemCmpAVX2( const u8 * pA, const u8 * pB, u64 max_bytes )
+{
+  u64 i;
+  u32 mask;
+
+  for ( i = 0 ; ( i + 32 ) <= max_bytes ; i += 32 )
+  {
+    mask = (u32) _mm256_movemask_epi8( _mm256_cmpeq_epi8(
+      _mm256_loadu_si256( (const __m256i *) &pA[i] ),
+      _mm256_loadu_si256( (const __m256i *) &pB[i] ) ) );
+    if ( mask != 0xFFFFFFFF )
+    {
+      i += (u64) __builtin_ctz( ~mask );
+      return (s32) pA[i] - (s32) pB[i];
+    }
+  }
+
+  /* the rest is less then 32 bytes */
+  return Cosm_MemCmpSSE2( &pA[i], &pB[i], max_bytes - i );
+}
+
+static u64 Cosm_MemScanSSE2( const u8 * mem, u8 a, u8 b, u64 length )
+{
+  __m128i want_a, want_b, block;
+  u64 i;
+  u32 mask;
+
+  want_a = _mm_set1_epi8( (char) a );
+  want_b = _mm_set1_epi8( (char) b );
+  for ( i = 0 ; ( i + 16 ) <= length ; i += 16 )
+  {
+    block = _mm_loadu_si128( (const __m128i *) &mem[i] );
+    mask = (u32) _mm_movemask_epi8( _mm_or_si128(
+      _mm_cmpeq_epi8( block, want_a ), _mm_cmpeq_epi8( block, want_b ) ) );
+    if ( mask != 0 )
+    {
+      return i + (u64) __builtin_ctz( mask );
+    }
+  }
+
+  for ( ; i < length ; i++ )
+  {
+    if ( ( mem[i] == a ) || ( mem[i] == b ) )
+    {
+      break;
+    }
+  }
+
+  return i;
+}
+
+__attribute__(( target( "avx2" ) ))
+static u64 Cosm_MemScanAVX2( const u8 * mem, u8 a, u8 b, u64 length )
+{
+  __m256i want_a, want_b, block;
+  u64 i;
+  u32 mask;
+
+  want_a = _mm256_set1_epi8( (char) a );
+  want_b = _mm256_set1_epi8( (char) b );
+  for ( i = 0 ; ( i + 32 ) <= length ; i += 32 )
+  {
+    block = _mm256_loadu_si256( (const __m256i *) &mem[i] );
+    mask = (u32) _mm256_movemask_epi8( _mm256_or_si256(
+      _mm256_cmpeq_epi8( block, want_a ),
+      _mm256_cmpeq_epi8( block, want_b ) ) );
+    if ( mask != 0 )
+    {
+      return i + (u64) __builtin_ctz( mask );
+    }
+  }
+
+  return i + Cosm_MemScanSSE2( &mem[i], a, b, length - i );
+}
+#endif /* COSM_SIMD_X64 */
+
 s32 CosmMemCmp( const void * blockA, const void * blockB, u64 max_bytes )
+{
+  if ( ( blockA == NULL ) || ( blockB == NULL )
+    || ( ( max_bytes ==  0 ) ) )
+  {
+    if ( blockA != blockB )
+    {
+      return -1;
+    }
+
+    return 0;
+  }
+
+#if ( defined( COSM_SIMD_X64 ) )
+  if ( Cosm_MemSIMD() == COSM_MEM_SIMD_AVX2 )
+  {
+    return Cosm_MemCmpAVX2( (const u8 *) blockA, (const u8 *) blockB,
+      max_bytes );
+  }
+  return Cosm_MemCmpSSE2( (const u8 *) blockA, (const u8 *) blockB,
+    max_bytes );
+#else
+  return Cosm_MemCmpScalar( blockA, blockB, max_bytes );
+#endif
+}
+
+s32 Cosm_MemCmpScalar( const void * blockA, const void * blockB,
+  u64 max_bytes )
 {
   u64 i;
   s32 a, b;
@@ -132,6 +297,38 @@ s32 CosmMemCmp( const void * blockA, const void * blockB, u64 max_bytes )
   return a - b;
 }
 
+u64 Cosm_MemScan( const void * memory, u8 a, u8 b, u64 length )
+{
+  const u8 * mem;
+#if ( !defined( COSM_SIMD_X64 ) )
+  u64 i;
+#endif
+
+  if ( memory == NULL )
+  {
+    return 0;
+  }
+
+  mem = (const u8 *) memory;
+#if ( defined( COSM_SIMD_X64 ) )
+  if ( Cosm_MemSIMD() == COSM_MEM_SIMD_AVX2 )
+  {
+    return Cosm_MemScanAVX2( mem, a, b, length );
+  }
+  return Cosm_MemScanSSE2( mem, a, b, length );
+#else
+  for ( i = 0 ; i < length ; i++ )
+  {
+    if ( ( mem[i] == a ) || ( mem[i] == b ) )
+    {
+      break;
+    }
+  }
+
+  return i;
+#endif
+}
+
 void * CosmMemOffset( const void * memory, u64 offset )
 {
   u8 * tmp;
@@ -243,12 +440,29 @@ s32 CosmMemSystem( u64 * amount )
   return COSM_FAIL;
 }
 
+void CosmMemCounters( u64 * allocs, u64 * frees, u64 * bytes )
+{
+  if ( allocs != NULL )
+  {
+    *allocs = (u64) CosmCounterRead( &memory_allocs );
+  }
+  if ( frees != NULL )
+  {
+    *frees = (u64) CosmCounterRead( &memory_frees );
+  }
+  if ( bytes != NULL )
+  {
+    *bytes = (u64) CosmCounterRead( &memory_bytes );
+  }
+}
+
 /* low level */
 
 void * Cosm_MemAlloc( u64 bytes )
 {
   u64 align;
   u64 request;
+  void * memory;
 
   /* Return NULL if bytes is 0 */
   if ( bytes == 0 )
@@ -273,14 +487,22 @@ void * Cosm_MemAlloc( u64 bytes )
   }
 
 #if ( defined( CPU_64BIT ) )
-  return calloc( 1, request );
+  memory = calloc( 1, request );
 #else /* 32bits */
   if ( bytes > 0xFFFFFFFFLL )
   {
     return NULL;
   }
-  return calloc( 1, (u32) request );
+  memory = calloc( 1, (u32) request );
 #endif
+
+  if ( memory != NULL )
+  {
+    CosmCounterAdd( &memory_allocs, 1 );
+    CosmCounterAdd( &memory_bytes, Cosm_MemUsable( memory ) );
+  }
+
+  return memory;
 }
 
 void * Cosm_MemAllocSecure( u64 bytes )
@@ -301,6 +523,8 @@ void * Cosm_MemRealloc( void * memory, u64 bytes )
 {
   u64 align;
   u64 request;
+  void * result;
+  s64 old_size;
 
   /* Free memory and return NULL if bytes is 0 and 'memory' is not NULL */
   if ( ( bytes == 0 ) && ( memory != NULL ) )
@@ -323,21 +547,31 @@ void * Cosm_MemRealloc( void * memory, u64 bytes )
     request = ( request + align );
   }
 
+  old_size = Cosm_MemUsable( memory );
 #if ( defined( CPU_64BIT ) )
-  return realloc( memory, request );
+  result = realloc( memory, request );
 #else /* 32bits */
   if ( bytes > 0xFFFFFFFFLL )
   {
     return NULL;
   }
-  return realloc( memory, (u32) request );
+  result = realloc( memory, (u32) request );
 #endif
+
+  if ( result != NULL )
+  {
+    CosmCounterAdd( &memory_bytes, Cosm_MemUsable( result ) - old_size );
+  }
+
+  return result;
 }
 
 void Cosm_MemFree( void * memory )
 {
   if ( memory != NULL )
   {
+    CosmCounterAdd( &memory_frees, 1 );
+    CosmCounterAdd( &memory_bytes, -Cosm_MemUsable( memory ) );
     free( memory );
   }
 }
@@ -616,6 +850,29 @@ s32 Cosm_MemDumpLeaks( const ascii * filename, const ascii * file, u32 line )
   return COSM_PASS;
 }
 
+u32 Cosm_MemSIMD( void )
+{
+  if ( __cosm_mem_simd == 0xFF )
+  {
+#if ( defined( COSM_SIMD_X64 ) )
+    /* every x64 CPU has SSE2 */
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+      __cosm_mem_simd = COSM_MEM_SIMD_AVX2;
+    }
+    else
+    {
+      __cosm_mem_simd = COSM_MEM_SIMD_SSE2;
+    }
+#else
+    __cosm_mem_simd = COSM_MEM_SIMD_NONE;
+#endif
+  }
+
+  return __cosm_mem_simd;
+}
+
 /* testing */
 
 s32 Cosm_TestOSMem( void )
@@ -623,8 +880,9 @@ s32 Cosm_TestOSMem( void )
   u8 * ptr1, * ptr2;
   u8 * mem;
   u8 * offset;
-  u32 i;
+  u32 i, j;
   u64 size;
+  u64 allocs, frees, bytes, allocs_after, frees_after, bytes_after;
 
   /* First be sure our COSM_MEM_SIZE is correct - set at the top of os_mem.c */
 #if ( defined( CPU_64BIT ) )
@@ -825,5 +1083,83 @@ s32 Cosm_TestOSMem( void )
   CosmMemFree( ptr1 );
   CosmMemFree( ptr2 );
 
+  /* vector CosmMemCmp must match the byte version at every length */
+  size = 0x0000000000000083LL;
+  ptr1 = (u8 *) CosmMemAlloc( size );
+  ptr2 = (u8 *) CosmMemAlloc( size );
+  if ( ( ptr1 == NULL ) || ( ptr2 == NULL ) )
+  {
+    CosmMemFree( ptr1 );
+    CosmMemFree( ptr2 );
+    return -20;
+  }
+  for ( i = 0 ; i < 0x83 ; i++ )
+  {
+    ptr1[i] = (u8) ( i * 7 );
+    ptr2[i] = (u8) ( i * 7 );
+  }
+  for ( i = 0 ; i < 0x80 ; i++ )
+  {
+    for ( j = 0 ; j < 4 ; j++ )
+    {
+      /* difference at i, compared from offset j for length 0-0x7F */
+      ptr2[i] = (u8) ( ptr1[i] ^ ( 0x81 >> j ) );
+      if ( ( j <= i ) && ( CosmMemCmp( &ptr1[j], &ptr2[j], i + 3 - j )
+        != Cosm_MemCmpScalar( &ptr1[j], &ptr2[j], i + 3 - j ) ) )
+      {
+        CosmMemFree( ptr1 );
+        CosmMemFree( ptr2 );
+        return -21;
+      }
+      if ( ( j < i ) && ( CosmMemCmp( &ptr1[j], &ptr2[j], i - j ) != 0 ) )
+      {
+        CosmMemFree( ptr1 );
+        CosmMemFree( ptr2 );
+        return -22;
+      }
+      ptr2[i] = ptr1[i];
+    }
+  }
+
+  /* Cosm_MemScan finds either byte at any offset, and passes over 0s */
+  CosmMemSet( ptr1, size, 0 );
+  for ( i = 0 ; i < 0x80 ; i++ )
+  {
+    ptr1[i] = ( ( i & 1 ) == 0 ) ? '\n' : ':';
+    for ( j = 0 ; ( j <= i ) && ( j < 4 ) ; j++ )
+    {
+      if ( ( Cosm_MemScan( &ptr1[j], '\n', ':', 0x83 - j ) != i - j )
+        || ( Cosm_MemScan( &ptr1[j], 'x', 'y', i - j ) != i - j ) )
+      {
+        CosmMemFree( ptr1 );
+        CosmMemFree( ptr2 );
+        return -23;
+      }
+    }
+    ptr1[i] = 0;
+  }
+  CosmMemFree( ptr1 );
+  CosmMemFree( ptr2 );
+
+  /* counters */
+  CosmMemCounters( &allocs, &frees, &bytes );
+  if ( ( ptr1 = CosmMemAlloc( 4096 ) ) == NULL )
+  {
+    return -24;
+  }
+  CosmMemCounters( &allocs_after, NULL, &bytes_after );
+  CosmMemFree( ptr1 );
+  CosmMemCounters( NULL, &frees_after, NULL );
+  if ( ( allocs_after <= allocs ) || ( frees_after <= frees ) )
+  {
+    return -25;
+  }
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  if ( bytes_after < bytes + 4096 )
+  {
+    return -26;
+  }
+#endif
+
   return COSM_PASS;
 }
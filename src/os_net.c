@@ -16,6 +16,11 @@
 
 /* CPU/OS Layer - CPU and OS specific code is allowed */
 
+#if ( defined( __linux__ ) && !defined( _GNU_SOURCE ) )
+/* for recvmmsg and sendmmsg */
+#  define _GNU_SOURCE
+#endif
+
 #include "cosm/os_net.h"
 #include "cosm/os_mem.h"
 #include "cosm/os_io.h"
@@ -25,6 +30,7 @@
 #  include <ws2tcpip.h>
 #  include <wspiapi.h>
 #  include <iphlpapi.h>
+#  include <ntsecapi.h>
 #  define close closesocket
 #else
 #  define SOCKET int
@@ -36,9 +42,12 @@
 #  include <sys/time.h>
 #  include <sys/types.h>
 #  include <sys/socket.h>
+#  include <sys/uio.h>
 #  include <netinet/in.h>
+#  include <netinet/tcp.h>
 #  include <arpa/inet.h>
 #  include <signal.h>
+#  include <poll.h>
 #endif
 
 #if ( ( OS_TYPE == OS_OSX ) || ( OS_TYPE == OS_IOS ) \
@@ -47,13 +56,200 @@
 #  include <ifaddrs.h>
 #elif ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
 #  include <linux/rtnetlink.h>
+#  include <sys/sendfile.h>
+#  include <sys/epoll.h>
+#  include <linux/errqueue.h>
+#endif
+
+#if ( defined( MSG_ZEROCOPY ) && defined( SO_ZEROCOPY ) \
+  && defined( SO_EE_ORIGIN_ZEROCOPY ) )
+/* sends can be made from our buffers, with notices when they're done */
+#  define COSM_NET_HAVE_ZEROCOPY
+#endif
+
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+typedef WSABUF cosm_NET_IOVEC;
+#else
+typedef struct iovec cosm_NET_IOVEC;
 #endif
 
 /* global networking initialization and mutex if no IPv6 */
 u32 __cosm_net_global_init = 0;
 
+/* the resolver CosmNetDNS uses, started by the first lookup of a name */
+cosm_NET_RESOLVER * __cosm_net_dns = NULL;
+u32 __cosm_net_dns_claim = 0;
+u32 __cosm_net_dns_failed = 0;
+
+/* traffic counters for CosmNetCounters */
+static cosm_COUNTER __cosm_net_sent;
+static cosm_COUNTER __cosm_net_received;
+static cosm_COUNTER __cosm_net_calls;
+
+/* when Cosm_NetApplyOptions is called */
+#define COSM_NET_APPLY_OPEN    0 /* new connection, before connect */
+#define COSM_NET_APPLY_LISTEN  1 /* new listener, before bind */
+#define COSM_NET_APPLY_LATER   2 /* already open or listening */
+
+static void Cosm_NetCount( u32 calls, s64 sent, s64 received )
+{
+  /* failed calls report -1, only count bytes that moved */
+  if ( calls > 0 )
+  {
+    CosmCounterAdd( &__cosm_net_calls, (s64) calls );
+  }
+  if ( sent > 0 )
+  {
+    CosmCounterAdd( &__cosm_net_sent, sent );
+  }
+  if ( received > 0 )
+  {
+    CosmCounterAdd( &__cosm_net_received, received );
+  }
+}
+
+static void Cosm_NetSetOption( SOCKET socket_descriptor, int level,
+  int name, u32 value )
+{
+  int option;
+
+  /* options are hints, the OS is free to refuse them */
+  option = (int) value;
+  setsockopt( socket_descriptor, level, name, (const char *) &option,
+    sizeof( option ) );
+}
+
+static u32 Cosm_NetGetOption( SOCKET socket_descriptor, int level,
+  int name )
+{
+  int option;
+  socklen_t length;
+
+  option = 0;
+  length = sizeof( option );
+  if ( getsockopt( socket_descriptor, level, name, (char *) &option,
+    &length ) == -1 )
+  {
+    /* not supported, report it as off */
+    return 0;
+  }
+
+  return (u32) option;
+}
+
+static void Cosm_NetApplyOptions( SOCKET socket_descriptor,
+  const cosm_NET_OPTIONS * options, u32 backlog, u32 stage )
+{
+  if ( options == NULL )
+  {
+    return;
+  }
+
+  if ( ( stage == COSM_NET_APPLY_LISTEN )
+    && ( options->flags & COSM_NET_OPTION_REUSEADDR ) )
+  {
+    Cosm_NetSetOption( socket_descriptor, SOL_SOCKET, SO_REUSEADDR, 1 );
+  }
+
+  if ( options->flags & COSM_NET_OPTION_NODELAY )
+  {
+    Cosm_NetSetOption( socket_descriptor, IPPROTO_TCP, TCP_NODELAY, 1 );
+  }
+
+#if ( defined( TCP_QUICKACK ) )
+  if ( options->flags & COSM_NET_OPTION_QUICKACK )
+  {
+    Cosm_NetSetOption( socket_descriptor, IPPROTO_TCP, TCP_QUICKACK, 1 );
+  }
+#endif
+
+  if ( options->send_buffer != 0 )
+  {
+    Cosm_NetSetOption( socket_descriptor, SOL_SOCKET, SO_SNDBUF,
+      options->send_buffer );
+  }
+
+  if ( options->recv_buffer != 0 )
+  {
+    Cosm_NetSetOption( socket_descriptor, SOL_SOCKET, SO_RCVBUF,
+      options->recv_buffer );
+  }
+
+  if ( options->flags & COSM_NET_OPTION_KEEPALIVE )
+  {
+    Cosm_NetSetOption( socket_descriptor, SOL_SOCKET, SO_KEEPALIVE, 1 );
+#if ( defined( TCP_KEEPIDLE ) )
+    if ( options->keepalive_idle != 0 )
+    {
+      Cosm_NetSetOption( socket_descriptor, IPPROTO_TCP, TCP_KEEPIDLE,
+        options->keepalive_idle );
+    }
+#elif ( defined( TCP_KEEPALIVE ) )
+    if ( options->keepalive_idle != 0 )
+    {
+      Cosm_NetSetOption( socket_descriptor, IPPROTO_TCP, TCP_KEEPALIVE,
+        options->keepalive_idle );
+    }
+#endif
+#if ( defined( TCP_KEEPINTVL ) )
+    if ( options->keepalive_interval != 0 )
+    {
+      Cosm_NetSetOption( socket_descriptor, IPPROTO_TCP, TCP_KEEPINTVL,
+        options->keepalive_interval );
+    }
+#endif
+#if ( defined( TCP_KEEPCNT ) )
+    if ( options->keepalive_count != 0 )
+    {
+      Cosm_NetSetOption( socket_descriptor, IPPROTO_TCP, TCP_KEEPCNT,
+        options->keepalive_count );
+    }
+#endif
+  }
+
+#if ( defined( SO_ZEROCOPY ) )
+  if ( options->flags & COSM_NET_OPTION_ZEROCOPY )
+  {
+    Cosm_NetSetOption( socket_descriptor, SOL_SOCKET, SO_ZEROCOPY, 1 );
+  }
+#endif
+
+#if ( defined( SO_BUSY_POLL ) )
+  if ( options->busy_poll != 0 )
+  {
+    Cosm_NetSetOption( socket_descriptor, SOL_SOCKET, SO_BUSY_POLL,
+      options->busy_poll );
+  }
+#endif
+
+  if ( options->flags & COSM_NET_OPTION_FASTOPEN )
+  {
+#if ( defined( TCP_FASTOPEN ) )
+    if ( stage == COSM_NET_APPLY_LISTEN )
+    {
+      /* the value is the queue of pending fast opens */
+      Cosm_NetSetOption( socket_descriptor, IPPROTO_TCP, TCP_FASTOPEN,
+        backlog );
+    }
+#endif
+#if ( defined( TCP_FASTOPEN_CONNECT ) )
+    if ( stage == COSM_NET_APPLY_OPEN )
+    {
+      Cosm_NetSetOption( socket_descriptor, IPPROTO_TCP,
+        TCP_FASTOPEN_CONNECT, 1 );
+    }
+#endif
+  }
+}
+
 s32 CosmNetOpen( cosm_NET * net, cosm_NET_ADDR * my_addr,
   const cosm_NET_ADDR * addr, u32 mode )
+{
+  return CosmNetOpenOptions( net, my_addr, addr, mode, NULL );
+}
+
+s32 CosmNetOpenOptions( cosm_NET * net, cosm_NET_ADDR * my_addr,
+  const cosm_NET_ADDR * addr, u32 mode, const cosm_NET_OPTIONS * options )
 {
   int socket_descriptor, option;
   unsigned int local_addr_length, remote_addr_length;
@@ -117,6 +313,9 @@ s32 CosmNetOpen( cosm_NET * net, cosm_NET_ADDR * my_addr,
 
   net->handle = (u64) socket_descriptor;
 
+  Cosm_NetApplyOptions( socket_descriptor, options, 0,
+    COSM_NET_APPLY_OPEN );
+
   if ( NULL != my_addr )
   {
     if ( COSM_NET_IPV4 == my_addr->type  )
@@ -191,6 +390,7 @@ s32 CosmNetOpen( cosm_NET * net, cosm_NET_ADDR * my_addr,
       remote_addr4.sin_addr.s_addr = htonl( addr->ip.v4 );
       remote_addr4.sin_port = htons( (u16) addr->port );
 
+      Cosm_NetCount( 1, 0, 0 );
       if ( -1 == connect( socket_descriptor, (struct sockaddr *) &remote_addr4,
         remote_addr_length ) )
       {
@@ -229,6 +429,7 @@ s32 CosmNetOpen( cosm_NET * net, cosm_NET_ADDR * my_addr,
       remote_addr6.sin6_port = htons( (u16) my_addr->port );
       CosmU128Save( &local_addr6.sin6_addr.s6_addr, &my_addr->ip.v6 );
 
+      Cosm_NetCount( 1, 0, 0 );
       if ( -1 == connect( socket_descriptor, (struct sockaddr *) &remote_addr6,
         remote_addr_length ) )
       {
@@ -542,6 +743,74 @@ s32 CosmNetOpenSocks( cosm_NET * net, const cosm_NET_ADDR * host,
   return COSM_PASS;
 }
 
+static int Cosm_NetWait( SOCKET socket_descriptor, u32 events,
+  u64 deadline )
+{
+  /*
+    Wait until the socket has the COSM_NET_POLL_READ/WRITE events or the
+    CosmClockMono deadline passes, with no events wait for an error or
+    queued zerocopy notice only.
+    poll() works for any descriptor, where select breaks past FD_SETSIZE.
+    Windows select limits the count in a set, not the values, so is kept.
+    Returns 1 if ready, 0 on timeout, or -1 on error.
+  */
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  struct timeval select_time;
+  fd_set readable, writable;
+#else
+  struct pollfd descriptor;
+#endif
+  u64 time_now, remaining;
+  int result;
+
+  for ( ; ; )
+  {
+    time_now = CosmClockMono();
+    remaining = ( time_now < deadline ) ? ( deadline - time_now ) : 0;
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+    select_time.tv_sec = (long) ( remaining / 1000000000LL );
+    select_time.tv_usec = (long) ( ( remaining % 1000000000LL ) / 1000LL );
+    FD_ZERO( &readable );
+    FD_ZERO( &writable );
+    if ( events & COSM_NET_POLL_READ )
+    {
+      FD_SET( socket_descriptor, &readable );
+    }
+    if ( events & COSM_NET_POLL_WRITE )
+    {
+      FD_SET( socket_descriptor, &writable );
+    }
+    result = select( (int) socket_descriptor + 1, &readable, &writable,
+      (fd_set *) NULL, &select_time );
+    Cosm_NetCount( 1, 0, 0 );
+#else
+    descriptor.fd = socket_descriptor;
+    descriptor.events = ( ( events & COSM_NET_POLL_READ ) ? POLLIN : 0 )
+      | ( ( events & COSM_NET_POLL_WRITE ) ? POLLOUT : 0 );
+    descriptor.revents = 0;
+    /* round up, waking just before the deadline would be a wasted pass */
+    result = poll( &descriptor, 1,
+      ( remaining >= 0x7FFFFFFFLL * 1000000LL ) ? 0x7FFFFFFF
+      : (int) ( ( remaining + 999999LL ) / 1000000LL ) );
+    Cosm_NetCount( 1, 0, 0 );
+    if ( ( result == -1 ) && ( errno == EINTR ) )
+    {
+      continue;
+    }
+#endif
+    return ( result > 0 ) ? 1 : result;
+  }
+}
+
+static int Cosm_NetReadable( SOCKET socket_descriptor, u64 deadline )
+{
+  /*
+    Wait until the socket can be read or the CosmClockMono deadline passes.
+    Returns 1 if readable, 0 on timeout, or -1 on error.
+  */
+  return Cosm_NetWait( socket_descriptor, COSM_NET_POLL_READ, deadline );
+}
+
 s32 CosmNetSend( cosm_NET * net, u32 * bytes_sent, const void * data,
   u32 length )
 {
@@ -573,6 +842,7 @@ s32 CosmNetSend( cosm_NET * net, u32 * bytes_sent, const void * data,
 #endif
 
   result = send( socket_descriptor, (const char *) data, length, 0 );
+  Cosm_NetCount( 1, (s64) result, 0 );
 
   if ( result == -1 )
   {
@@ -589,156 +859,169 @@ s32 CosmNetSend( cosm_NET * net, u32 * bytes_sent, const void * data,
   return COSM_PASS;
 }
 
-s32 CosmNetRecv( void * buffer, u32 * bytes_received, cosm_NET * net,
-  u32 length, u32 wait_ms )
+static u32 Cosm_NetVectorLoad( cosm_NET_IOVEC * buffers,
+  const cosm_NET_VECTOR * vector, u32 count, u32 first, u32 skip )
 {
-  SOCKET socket_descriptor;
-  int flags, result;
-  struct timeval select_time;
-  fd_set descriptors_settings;
-  u8 * data;
-  cosmtime time_called, time_now, time_elapsed;
-  u64 tmp_u64;
-  s32 error;
-
-  *bytes_received = 0;
+  /*
+    Fill in up to COSM_NET_VECTORS OS buffers from vector, starting skip
+    bytes into vector[first] and leaving out empty buffers.
+    Returns: number of buffers filled in.
+  */
+  u32 used;
 
-  if ( ( net == NULL ) || ( bytes_received == NULL )
-    || ( buffer == NULL ) || ( length == 0 ) )
+  for ( used = 0 ; ( first < count ) && ( used < COSM_NET_VECTORS ) ;
+    first++, skip = 0 )
   {
-    return COSM_NET_ERROR_PARAM;
+    if ( vector[first].length <= skip )
+    {
+      continue;
+    }
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+    buffers[used].buf = (char *) vector[first].data + skip;
+    buffers[used].len = (u_long) ( vector[first].length - skip );
+#else
+    buffers[used].iov_base = (u8 *) vector[first].data + skip;
+    buffers[used].iov_len = (size_t) ( vector[first].length - skip );
+#endif
+    used++;
   }
 
-  if ( net->status != COSM_NET_STATUS_OPEN )
-  {
-    return COSM_NET_ERROR_CLOSED;
-  }
+  return used;
+}
 
-  if ( net->mode != COSM_NET_MODE_TCP )
+static void Cosm_NetVectorSkip( u32 * first, u32 * skip,
+  const cosm_NET_VECTOR * vector, u32 count, u64 bytes )
+{
+  /*
+    Move first and skip past bytes that were just sent or received.
+    Returns: nothing.
+  */
+  bytes += *skip;
+  while ( ( *first < count ) && ( bytes >= vector[*first].length ) )
   {
-    return COSM_NET_ERROR_MODE;
+    bytes -= vector[*first].length;
+    (*first)++;
   }
+  *skip = (u32) bytes;
+}
 
-#if ( defined( CPU_64BIT ) )
-  socket_descriptor = net->handle;
-#else
-  socket_descriptor = (u32) net->handle;
-#endif
-
-  data = (u8 *) buffer;
-  flags = 0;
-  FD_ZERO( &descriptors_settings );
-  FD_SET( socket_descriptor, &descriptors_settings );
+static s32 Cosm_NetVectorCheck( u64 * total, cosm_NET * net,
+  const cosm_NET_VECTOR * vector, u32 count )
+{
+  /*
+    Check the parameters and connection for the vectored calls, and total
+    up the bytes in vector.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
+  u32 i;
 
-  /* The timeval struct gets modified by select, so must be reset each time */
-  if ( CosmSystemClock( &time_called ) != COSM_PASS )
+  if ( ( net == NULL ) || ( vector == NULL ) || ( count == 0 ) )
   {
-    /* Can't get local time */
-    return COSM_NET_ERROR_FATAL;
+    return COSM_NET_ERROR_PARAM;
   }
 
-  while ( *bytes_received < length )
+  *total = 0;
+  for ( i = 0 ; i < count ; i++ )
   {
-    if ( CosmSystemClock( &time_now ) != COSM_PASS )
+    if ( ( vector[i].data == NULL ) && ( vector[i].length > 0 ) )
     {
-      /* Can't get local time */
-      return COSM_NET_ERROR_FATAL;
+      return COSM_NET_ERROR_PARAM;
     }
+    *total += (u64) vector[i].length;
+  }
+  if ( *total == 0 )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
 
-    /* Lets fill that select_time for the remaining time to wait */
-    time_elapsed = CosmS128Sub( time_now, time_called );
-    tmp_u64 = 0x000010C6F7A0B5EDLL;
-    select_time.tv_sec = ( wait_ms / 1000 ) - (s32) time_elapsed.hi;
-    select_time.tv_usec = ( ( wait_ms % 1000 ) * 1000 ) -
-      (u32) ( time_elapsed.lo / tmp_u64 );
+  if ( net->status != COSM_NET_STATUS_OPEN )
+  {
+    return COSM_NET_ERROR_CLOSED;
+  }
 
-    if ( select_time.tv_usec < 0 )
-    {
-      select_time.tv_usec = select_time.tv_usec + 1000000;
-      select_time.tv_sec--;
-    }
-    if ( select_time.tv_sec < 0 )
-    {
-      /* Time is now elapsed, just take what's in the buffer and exit */
-      select_time.tv_sec = 0;
-      select_time.tv_usec = 0;
-    }
+  if ( net->mode != COSM_NET_MODE_TCP )
+  {
+    return COSM_NET_ERROR_MODE;
+  }
 
-    result = select( (int) socket_descriptor + 1, &descriptors_settings,
-      (fd_set *) NULL, (fd_set *) NULL, &select_time );
-    if ( result < 1 )
+  return COSM_PASS;
+}
+
+#if ( defined( COSM_NET_HAVE_ZEROCOPY ) )
+static s32 Cosm_NetZeroCopyDone( SOCKET socket_descriptor, u32 * done )
+{
+  /*
+    Add the zerocopy sends the OS is finished with to done, from the
+    notices queued on the socket's error queue, without waiting.
+    Returns: COSM_PASS on success, or COSM_NET_ERROR_SOCKET on failure.
+  */
+  struct msghdr message;
+  struct cmsghdr * header;
+  struct sock_extended_err * notice;
+  u64 control[16];
+
+  for ( ; ; )
+  {
+    CosmMemSet( &message, sizeof( message ), 0 );
+    message.msg_control = control;
+    message.msg_controllen = sizeof( control );
+    Cosm_NetCount( 1, 0, 0 );
+    if ( recvmsg( socket_descriptor, &message,
+      MSG_ERRQUEUE | MSG_DONTWAIT ) == -1 )
     {
-      if ( result == -1 )
-      {
-        /* Error with select */
-        Cosm_NetClose( net );
-        return COSM_NET_ERROR_SOCKET;
-      }
-      else
+      if ( errno == EINTR )
       {
-        /* Timeout */
-        return COSM_PASS;
+        continue;
       }
-      return error;
+      return ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) )
+        ? COSM_PASS : COSM_NET_ERROR_SOCKET;
     }
-    result = recv( socket_descriptor, (char *) &data[*bytes_received],
-      length - *bytes_received, flags );
-    if ( result < 1 )
+    for ( header = CMSG_FIRSTHDR( &message ) ; header != NULL ;
+      header = CMSG_NXTHDR( &message, header ) )
     {
-      if ( result == 0 )
-      {
-        /* Connection terminated gracefully */
-        Cosm_NetClose( net );
-        error = COSM_NET_ERROR_CLOSED;
-      }
-      else
+      notice = (struct sock_extended_err *) CMSG_DATA( header );
+      if ( notice->ee_origin == SO_EE_ORIGIN_ZEROCOPY )
       {
-        /* Error while receiving data, connection dead */
-        Cosm_NetClose( net );
-        error = COSM_NET_ERROR_SOCKET;
+        /* sends are numbered, each notice covers a range of them */
+        *done += notice->ee_data - notice->ee_info + 1;
       }
-      return error;
     }
-#if ( defined( NET_LOG_PACKETS ) )
-    Cosm_NetLogPacket( &net->host, "TCP Recv:",
-      &data[*bytes_received], result );
-#endif
-    *bytes_received += result;
   }
-
-  /* Received full buffer */
-  return COSM_PASS;
 }
+#endif
 
-s32 CosmNetSendUDP( cosm_NET * net, const cosm_NET_ADDR * addr,
-  const void * data, u32 length )
+static s32 Cosm_NetSendVector( cosm_NET * net, u64 * bytes_sent,
+  const cosm_NET_VECTOR * vector, u32 count, u32 all, u64 deadline )
 {
+  /*
+    The body of CosmNetSendV, or CosmNetSendAll if all is set, sending
+    until everything is sent or the CosmClockMono deadline passes.
+    Returns: COSM_PASS on success, or an error code on failure.
+  */
   SOCKET socket_descriptor;
-  int result;
-  int addr_length;
-  struct sockaddr_in addr4;
-  struct sockaddr_in6 addr6;
-
-  if ( Cosm_NetGlobalInit() != COSM_PASS )
-  {
-    return COSM_NET_ERROR_NO_NET;
-  }
+  cosm_NET_IOVEC buffers[COSM_NET_VECTORS];
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  DWORD sent;
+#else
+  struct msghdr message;
+  ssize_t sent;
+#endif
+  u64 total;
+  u32 used, first, skip, zerocopy, done;
+  int flags, result;
+  s32 error;
 
-  if ( ( net == NULL ) || ( addr == NULL )
-    || ( ( data == NULL ) && ( length > 0 ) ) )
+  if ( bytes_sent == NULL )
   {
     return COSM_NET_ERROR_PARAM;
   }
 
-  if ( ( net->status != COSM_NET_STATUS_LISTEN )
-    && ( net->status != COSM_NET_STATUS_OPEN ) )
-  {
-    return COSM_NET_ERROR_CLOSED;
-  }
+  *bytes_sent = 0;
 
-  if ( net->mode != COSM_NET_MODE_UDP )
+  if ( ( error = Cosm_NetVectorCheck( &total, net, vector, count ) )
+    != COSM_PASS )
   {
-    return COSM_NET_ERROR_MODE;
+    return error;
   }
 
 #if ( defined( CPU_64BIT ) )
@@ -747,97 +1030,211 @@ s32 CosmNetSendUDP( cosm_NET * net, const cosm_NET_ADDR * addr,
   socket_descriptor = (u32) net->handle;
 #endif
 
-  if ( addr->type == COSM_NET_IPV4 )
+  flags = 0;
+  zerocopy = 0;
+  done = 0;
+#if ( defined( COSM_NET_HAVE_ZEROCOPY ) )
+  /* pinning pages costs more than copying small sends */
+  if ( all && ( total >= COSM_NET_ZEROCOPY )
+    && Cosm_NetGetOption( socket_descriptor, SOL_SOCKET, SO_ZEROCOPY ) )
   {
-    addr_length = sizeof( addr4 );
-    CosmMemSet( &addr4, sizeof( addr4 ), 0 );
-
-    /* set destination */
-    addr4.sin_family = AF_INET;
-    addr4.sin_port = htons( (u16) addr->port );
-    CosmU32Save( &addr4.sin_addr, &addr->ip.v4 );
-
-    /* send the UDP packet, cross fingers :) */
-    result = sendto( socket_descriptor, (const char *) data, length, 0,
-      (struct sockaddr *) &addr4, addr_length );
-  }
-  else if ( addr->type == COSM_NET_IPV6 )
-  {
-    addr_length = sizeof( addr6 );
-    CosmMemSet( &addr6, sizeof( addr6 ), 0 );
-
-    /* set destination */
-    addr6.sin6_family = AF_INET6;
-    addr6.sin6_port = htons( (u16) addr->port );
-    CosmU128Save( &addr6.sin6_addr, &addr->ip.v6 );
-
-    /* send the UDP packet, cross fingers :) */
-    result = sendto( socket_descriptor, (const char *) data, length, 0,
-      (struct sockaddr *) &addr6, addr_length );
+    flags |= MSG_ZEROCOPY;
   }
-  else
+#endif
+#if ( defined( MSG_DONTWAIT ) )
+  /* never block past the deadline, wait in Cosm_NetWait instead */
+  if ( all )
   {
-    return COSM_NET_ERROR_ADDRTYPE;
+    flags |= MSG_DONTWAIT;
   }
+#endif
 
+  error = COSM_PASS;
+  first = 0;
+  skip = 0;
+  while ( *bytes_sent < total )
+  {
+    used = Cosm_NetVectorLoad( buffers, vector, count, first, skip );
 #if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-  /*
-    Windows can generate WSAECONNRESET errors
-    http://support.microsoft.com/kb/263823/en-us
-  */
-  if ( ( result == -1 ) && ( WSAGetLastError() != WSAECONNRESET ) )
+    if ( all )
+    {
+      result = Cosm_NetWait( socket_descriptor, COSM_NET_POLL_WRITE,
+        deadline );
+      if ( result < 1 )
+      {
+        if ( result == -1 )
+        {
+          Cosm_NetClose( net );
+          return COSM_NET_ERROR_SOCKET;
+        }
+        error = COSM_NET_ERROR_TIMEOUT;
+        break;
+      }
+    }
+    if ( WSASend( socket_descriptor, buffers, (DWORD) used, &sent,
+      (DWORD) flags, NULL, NULL ) != 0 )
+    {
+      /* Connection has been closed, or other fatal error */
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_CLOSED;
+    }
 #else
-  if ( result == -1 )
+    CosmMemSet( &message, sizeof( message ), 0 );
+    message.msg_iov = buffers;
+    message.msg_iovlen = used;
+    sent = sendmsg( socket_descriptor, &message, flags );
+    Cosm_NetCount( 1, (s64) sent, 0 );
+    if ( sent == -1 )
+    {
+      if ( errno == EINTR )
+      {
+        continue;
+      }
+      if ( all && ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) )
+      {
+#if ( defined( COSM_NET_HAVE_ZEROCOPY ) )
+        /* queued notices would wake the wait at once, take them now */
+        if ( ( zerocopy > 0 )
+          && ( Cosm_NetZeroCopyDone( socket_descriptor, &done )
+          != COSM_PASS ) )
+        {
+          Cosm_NetClose( net );
+          return COSM_NET_ERROR_SOCKET;
+        }
 #endif
-  {
-    /* connection has been closed, or other error */
-    Cosm_NetClose( net );
-    return COSM_NET_ERROR_SOCKET;
+        result = Cosm_NetWait( socket_descriptor, COSM_NET_POLL_WRITE,
+          deadline );
+        if ( result < 1 )
+        {
+          if ( result == -1 )
+          {
+            Cosm_NetClose( net );
+            return COSM_NET_ERROR_SOCKET;
+          }
+          error = COSM_NET_ERROR_TIMEOUT;
+          break;
+        }
+        continue;
+      }
+#if ( defined( COSM_NET_HAVE_ZEROCOPY ) )
+      if ( ( flags & MSG_ZEROCOPY ) && ( errno == ENOBUFS ) )
+      {
+        /* over the locked memory limit, copy the rest */
+        flags &= ~MSG_ZEROCOPY;
+        continue;
+      }
+#endif
+      /* Connection has been closed, or other fatal error */
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_CLOSED;
+    }
+#if ( defined( COSM_NET_HAVE_ZEROCOPY ) )
+    if ( flags & MSG_ZEROCOPY )
+    {
+      zerocopy++;
+    }
+#endif
+#endif
+    *bytes_sent += (u64) sent;
+    Cosm_NetVectorSkip( &first, &skip, vector, count, (u64) sent );
+    if ( !all )
+    {
+      break;
+    }
   }
 
-#if ( defined( NET_LOG_PACKETS ) )
-  Cosm_NetLogPacket( &net->host, "UDP Send:", (u8 *) data, result );
+#if ( defined( COSM_NET_HAVE_ZEROCOPY ) )
+  /* the caller can only reuse the buffers once the OS is done with them */
+  while ( done < zerocopy )
+  {
+    if ( Cosm_NetZeroCopyDone( socket_descriptor, &done ) != COSM_PASS )
+    {
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_SOCKET;
+    }
+    if ( ( done < zerocopy )
+      && ( Cosm_NetWait( socket_descriptor, 0, deadline ) < 1 ) )
+    {
+      return COSM_NET_ERROR_TIMEOUT;
+    }
+  }
 #endif
 
-  return COSM_PASS;
+  return error;
 }
 
-s32 CosmNetRecvUDP( void * buffer, u32 * bytes_read, cosm_NET_ADDR * from,
-  cosm_NET * net, u32 length, cosm_NET_ACL * acl, u32 wait_ms )
+s32 CosmNetSendV( cosm_NET * net, u64 * bytes_sent,
+  const cosm_NET_VECTOR * vector, u32 count )
 {
-  SOCKET socket_descriptor;
-  int received;
-  s32 result;
-  struct timeval select_time;
-  fd_set descriptors;
-  cosmtime time_called, time_now, time_elapsed;
-  u64 tmp_u64;
-  struct sockaddr_in client_addr;
-  unsigned int client_addr_len;
+  return Cosm_NetSendVector( net, bytes_sent, vector, count, 0, 0 );
+}
 
-  *bytes_read = 0;
+s32 CosmNetSendAll( cosm_NET * net, u64 * bytes_sent,
+  const cosm_NET_VECTOR * vector, u32 count, u32 wait_ms )
+{
+  u64 deadline;
 
-  if ( ( buffer == NULL ) || ( bytes_read == NULL )
-    || ( from == NULL ) || ( net == NULL ) || ( length == 0 ) )
+  if ( ( deadline = CosmClockMono() ) == 0 )
+  {
+    /* Can't get local time */
+    return COSM_NET_ERROR_FATAL;
+  }
+  if ( wait_ms == COSM_NET_WAIT_FOREVER )
+  {
+    deadline = (u64) -1;
+  }
+  else
+  {
+    deadline += (u64) wait_ms * 1000000LL;
+  }
+
+  return Cosm_NetSendVector( net, bytes_sent, vector, count, 1, deadline );
+}
+
+s32 CosmNetSendFile( cosm_NET * net, u64 * bytes_sent, cosm_FILE * file,
+  u64 offset, u64 length, const void * header, u32 header_length )
+{
+  SOCKET socket_descriptor;
+  const u8 * head;
+  u32 sent;
+  int flags, result;
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  off_t file_offset;
+  ssize_t file_sent;
+#else
+  u8 * block;
+  u64 position, got;
+  u32 get;
+  s32 error;
+#endif
+
+  if ( ( net == NULL ) || ( bytes_sent == NULL ) || ( file == NULL )
+    || ( ( header == NULL ) && ( header_length > 0 ) ) )
   {
     return COSM_NET_ERROR_PARAM;
   }
 
-  if ( ( net->status != COSM_NET_STATUS_LISTEN )
-    && ( net->status != COSM_NET_STATUS_OPEN ) )
+  *bytes_sent = 0;
+
+  if ( net->status != COSM_NET_STATUS_OPEN )
   {
     return COSM_NET_ERROR_CLOSED;
   }
 
-  if ( net->mode != COSM_NET_MODE_UDP )
+  if ( net->mode != COSM_NET_MODE_TCP )
   {
     return COSM_NET_ERROR_MODE;
   }
 
-  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  if ( file->status != COSM_FILE_STATUS_OPEN )
   {
-    net->status = COSM_NET_STATUS_CLOSED;
-    return COSM_NET_ERROR_NO_NET;
+    return COSM_NET_ERROR_FILE;
+  }
+
+  /* writes still in the file's buffer have to reach the file first */
+  if ( CosmFileFlush( file ) != COSM_PASS )
+  {
+    return COSM_NET_ERROR_FILE;
   }
 
 #if ( defined( CPU_64BIT ) )
@@ -846,545 +1243,2632 @@ s32 CosmNetRecvUDP( void * buffer, u32 * bytes_read, cosm_NET_ADDR * from,
   socket_descriptor = (u32) net->handle;
 #endif
 
-  if ( CosmSystemClock( &time_called ) != COSM_PASS )
+  /* the header, all of it, held back for the file data if we can */
+  head = (const u8 *) header;
+  sent = 0;
+  flags = 0;
+#if ( defined( MSG_MORE ) )
+  if ( length > 0 )
   {
-    /* can't get local time */
-    return COSM_NET_ERROR_FATAL;
+    flags = MSG_MORE;
   }
-
-  received = 0;
-  client_addr_len = sizeof( client_addr );
-
-  while ( received == 0 )
+#endif
+  while ( sent < header_length )
   {
-    /* timeval struct must be reset each time we fail to match the ACL */
-    if ( CosmSystemClock( &time_now ) != COSM_PASS )
-    {
-      /* can't get local time */
-      return COSM_NET_ERROR_TIMEOUT;
-    }
-
-    /* fill that select_time for the remaining time to wait */
-    time_elapsed = CosmS128Sub( time_now, time_called );
-    tmp_u64 = 0x000010C6F7A0B5EDLL;
-    select_time.tv_sec = ( wait_ms / 1000 ) - (s32) time_elapsed.hi;
-    select_time.tv_usec = ( ( wait_ms % 1000 ) * 1000 ) -
-      (u32) ( time_elapsed.lo / tmp_u64 );
-
-    if ( select_time.tv_usec < 0 )
-    {
-      select_time.tv_usec = select_time.tv_usec + 1000000;
-      select_time.tv_sec--;
-    }
-    if ( select_time.tv_sec < 0 )
+    result = send( socket_descriptor, (const char *) &head[sent],
+      header_length - sent, flags );
+    Cosm_NetCount( 1, (s64) result, 0 );
+    if ( result < 1 )
     {
-      /* time is now elapsed, just take what's in the buffer and exit */
-      select_time.tv_sec = 0;
-      select_time.tv_usec = 0;
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_CLOSED;
     }
+    sent += (u32) result;
+    *bytes_sent += (u64) result;
+  }
 
-    FD_ZERO( &descriptors );
-    FD_SET( socket_descriptor, &descriptors );
-    result = select( (int) socket_descriptor + 1, &descriptors,
-      (fd_set *) NULL, (fd_set *) NULL, &select_time );
-    if ( result < 1 )
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  /* sendfile moves our offset, not the file's */
+  file_offset = (off_t) offset;
+  while ( length > 0 )
+  {
+    file_sent = sendfile( socket_descriptor, (int) file->handle,
+      &file_offset, ( length > 0x40000000LL ) ? 0x40000000 : (size_t) length );
+    Cosm_NetCount( 1, (s64) file_sent, 0 );
+    if ( file_sent < 1 )
     {
-      if ( result == -1 )
+      if ( ( file_sent == -1 ) && ( errno == EINTR ) )
       {
-        /* error with select */
-        Cosm_NetClose( net );
-        return COSM_NET_ERROR_SOCKET;
+        continue;
       }
-      else
+      if ( file_sent == 0 )
       {
-        /* timeout */
-        return COSM_PASS;
+        /* the file is shorter than we were told */
+        return COSM_NET_ERROR_FILE;
       }
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_CLOSED;
     }
+    length -= (u64) file_sent;
+    *bytes_sent += (u64) file_sent;
+  }
+#else
+  if ( length == 0 )
+  {
+    return COSM_PASS;
+  }
 
-    received = recvfrom( socket_descriptor, (char *) buffer,
-      length - received, 0, (struct sockaddr *) &client_addr,
-      &client_addr_len );
+  if ( ( block = CosmMemAlloc( 65536LL ) ) == NULL )
+  {
+    return COSM_NET_ERROR_FATAL;
+  }
 
-#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-    /*
-      Windows can generate WSAECONNRESET errors
-      http://support.microsoft.com/kb/263823/en-us
-    */
-    if ( ( received == -1 ) && ( WSAGetLastError() != WSAECONNRESET ) )
-#else
-    if ( received == -1 )
-#endif
+  /* read through the file's offset, and put it back after */
+  error = COSM_PASS;
+  if ( ( CosmFileTell( &position, file ) != COSM_PASS )
+    || ( CosmFileSeek( file, offset ) != COSM_PASS ) )
+  {
+    CosmMemFree( block );
+    return COSM_NET_ERROR_FILE;
+  }
+  while ( ( length > 0 ) && ( error == COSM_PASS ) )
+  {
+    get = ( length > 65536LL ) ? 65536 : (u32) length;
+    if ( ( CosmFileRead( block, &got, file, (u64) get ) != COSM_PASS )
+      && ( got == 0 ) )
     {
-      /* error while receiving data */
-      Cosm_NetClose( net );
-      return COSM_NET_ERROR_SOCKET;
+      error = COSM_NET_ERROR_FILE;
+      break;
     }
-
-    /* have data, set from */
-    from->type = COSM_NET_IPV4;
-    from->port = ntohs( client_addr.sin_port );
-    from->ip.v4 = ntohl( client_addr.sin_addr.s_addr );
-
-    /* only accept this data if host passes acl masks, otherwise discard */
-    if ( CosmNetACLCheck( acl, from ) != COSM_NET_ALLOW )
+    for ( sent = 0 ; sent < (u32) got ; sent += get )
     {
-      received = 0;
+      if ( ( error = CosmNetSend( net, &get, &block[sent],
+        (u32) got - sent ) ) != COSM_PASS )
+      {
+        break;
+      }
+      *bytes_sent += (u64) get;
     }
-#if ( defined( NET_LOG_PACKETS ) )
-    Cosm_NetLogPacket( &net->host, "UDP Recv:", buffer, received );
-#endif
+    length -= got;
   }
+  CosmFileSeek( file, position );
+  CosmMemFree( block );
 
-  *bytes_read = received;
+  if ( error != COSM_PASS )
+  {
+    return error;
+  }
+#endif
 
   return COSM_PASS;
 }
 
-s32 CosmNetListen( cosm_NET * net, const cosm_NET_ADDR * addr, u32 mode,
-  u32 queue )
+s32 CosmNetRecv( void * buffer, u32 * bytes_received, cosm_NET * net,
+  u32 length, u32 wait_ms )
 {
-  int socket_descriptor;
-  unsigned int addr_length;
-  struct sockaddr_in addr4;
-  struct sockaddr_in6 addr6;
+  SOCKET socket_descriptor;
+  int flags, result;
+  u8 * data;
+  u64 deadline;
+  s32 error;
 
-  if ( net == NULL )
+  *bytes_received = 0;
+
+  if ( ( net == NULL ) || ( bytes_received == NULL )
+    || ( buffer == NULL ) || ( length == 0 ) )
   {
     return COSM_NET_ERROR_PARAM;
   }
 
-  if ( ( mode != COSM_NET_MODE_TCP ) && ( mode != COSM_NET_MODE_UDP ) )
+  if ( net->status != COSM_NET_STATUS_OPEN )
   {
-    return COSM_NET_ERROR_MODE;
+    return COSM_NET_ERROR_CLOSED;
   }
 
-  if ( net->status != COSM_NET_STATUS_CLOSED )
+  if ( net->mode != COSM_NET_MODE_TCP )
   {
-    return COSM_NET_ERROR_ORDER;
+    return COSM_NET_ERROR_MODE;
   }
 
-  if ( Cosm_NetGlobalInit() != COSM_PASS )
+#if ( defined( CPU_64BIT ) )
+  socket_descriptor = net->handle;
+#else
+  socket_descriptor = (u32) net->handle;
+#endif
+
+  data = (u8 *) buffer;
+  flags = 0;
+
+  if ( ( deadline = CosmClockMono() ) == 0 )
   {
-    net->status = COSM_NET_STATUS_CLOSED;
-    return COSM_NET_ERROR_NO_NET;
+    /* Can't get local time */
+    return COSM_NET_ERROR_FATAL;
   }
+  deadline += (u64) wait_ms * 1000000LL;
 
-  if ( addr->type == COSM_NET_IPV4 )
+  while ( *bytes_received < length )
   {
-    if ( mode == COSM_NET_MODE_UDP )
+    /* when time is elapsed, just take what's in the buffer and exit */
+    result = Cosm_NetReadable( socket_descriptor, deadline );
+    if ( result < 1 )
     {
-      socket_descriptor = (int) socket( PF_INET, SOCK_DGRAM, 0 );
-    }
+      if ( result == -1 )
+      {
+        /* Error while waiting */
+        Cosm_NetClose( net );
+        return COSM_NET_ERROR_SOCKET;
+      }
+      else
+      {
+        /* Timeout */
+        return COSM_PASS;
+      }
+      return error;
+    }
+    result = recv( socket_descriptor, (char *) &data[*bytes_received],
+      length - *bytes_received, flags );
+    Cosm_NetCount( 1, 0, (s64) result );
+    if ( result < 1 )
+    {
+      if ( result == 0 )
+      {
+        /* Connection terminated gracefully */
+        Cosm_NetClose( net );
+        error = COSM_NET_ERROR_CLOSED;
+      }
+      else
+      {
+        /* Error while receiving data, connection dead */
+        Cosm_NetClose( net );
+        error = COSM_NET_ERROR_SOCKET;
+      }
+      return error;
+    }
+#if ( defined( NET_LOG_PACKETS ) )
+    Cosm_NetLogPacket( &net->host, "TCP Recv:",
+      &data[*bytes_received], result );
+#endif
+    *bytes_received += result;
+  }
+
+  /* Received full buffer */
+  return COSM_PASS;
+}
+
+s32 CosmNetRecvV( const cosm_NET_VECTOR * vector, u64 * bytes_received,
+  cosm_NET * net, u32 count, u32 wait_ms )
+{
+  SOCKET socket_descriptor;
+  cosm_NET_IOVEC buffers[COSM_NET_VECTORS];
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  DWORD received, flags;
+#else
+  struct msghdr message;
+  ssize_t received;
+#endif
+  u64 total, deadline;
+  u32 used, first, skip;
+  int result;
+  s32 error;
+
+  if ( bytes_received == NULL )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  *bytes_received = 0;
+
+  if ( ( error = Cosm_NetVectorCheck( &total, net, vector, count ) )
+    != COSM_PASS )
+  {
+    return error;
+  }
+
+#if ( defined( CPU_64BIT ) )
+  socket_descriptor = net->handle;
+#else
+  socket_descriptor = (u32) net->handle;
+#endif
+
+  if ( ( deadline = CosmClockMono() ) == 0 )
+  {
+    /* Can't get local time */
+    return COSM_NET_ERROR_FATAL;
+  }
+  deadline += (u64) wait_ms * 1000000LL;
+
+  first = 0;
+  skip = 0;
+  while ( *bytes_received < total )
+  {
+    /* when time is elapsed, just take what's in the buffer and exit */
+    result = Cosm_NetReadable( socket_descriptor, deadline );
+    if ( result < 1 )
+    {
+      if ( result == -1 )
+      {
+        /* Error while waiting */
+        Cosm_NetClose( net );
+        return COSM_NET_ERROR_SOCKET;
+      }
+      /* Timeout */
+      return COSM_PASS;
+    }
+    used = Cosm_NetVectorLoad( buffers, vector, count, first, skip );
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+    flags = 0;
+    if ( WSARecv( socket_descriptor, buffers, (DWORD) used, &received,
+      &flags, NULL, NULL ) != 0 )
+    {
+      /* Error while receiving data, connection dead */
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_SOCKET;
+    }
+#else
+    CosmMemSet( &message, sizeof( message ), 0 );
+    message.msg_iov = buffers;
+    message.msg_iovlen = used;
+    received = recvmsg( socket_descriptor, &message, 0 );
+    Cosm_NetCount( 1, 0, (s64) received );
+    if ( ( received == -1 ) && ( errno == EINTR ) )
+    {
+      continue;
+    }
+    if ( received == -1 )
+    {
+      /* Error while receiving data, connection dead */
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_SOCKET;
+    }
+#endif
+    if ( received == 0 )
+    {
+      /* Connection terminated gracefully */
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_CLOSED;
+    }
+    *bytes_received += (u64) received;
+    Cosm_NetVectorSkip( &first, &skip, vector, count, (u64) received );
+  }
+
+  /* Received full buffers */
+  return COSM_PASS;
+}
+
+s32 CosmNetSendUDP( cosm_NET * net, const cosm_NET_ADDR * addr,
+  const void * data, u32 length )
+{
+  SOCKET socket_descriptor;
+  int result;
+  int addr_length;
+  struct sockaddr_in addr4;
+  struct sockaddr_in6 addr6;
+
+  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  {
+    return COSM_NET_ERROR_NO_NET;
+  }
+
+  if ( ( net == NULL ) || ( addr == NULL )
+    || ( ( data == NULL ) && ( length > 0 ) ) )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  if ( ( net->status != COSM_NET_STATUS_LISTEN )
+    && ( net->status != COSM_NET_STATUS_OPEN ) )
+  {
+    return COSM_NET_ERROR_CLOSED;
+  }
+
+  if ( net->mode != COSM_NET_MODE_UDP )
+  {
+    return COSM_NET_ERROR_MODE;
+  }
+
+#if ( defined( CPU_64BIT ) )
+  socket_descriptor = net->handle;
+#else
+  socket_descriptor = (u32) net->handle;
+#endif
+
+  if ( addr->type == COSM_NET_IPV4 )
+  {
+    addr_length = sizeof( addr4 );
+    CosmMemSet( &addr4, sizeof( addr4 ), 0 );
+
+    /* set destination */
+    addr4.sin_family = AF_INET;
+    addr4.sin_port = htons( (u16) addr->port );
+    CosmU32Save( &addr4.sin_addr, &addr->ip.v4 );
+
+    /* send the UDP packet, cross fingers :) */
+    result = sendto( socket_descriptor, (const char *) data, length, 0,
+      (struct sockaddr *) &addr4, addr_length );
+    Cosm_NetCount( 1, (s64) result, 0 );
+  }
+  else if ( addr->type == COSM_NET_IPV6 )
+  {
+    addr_length = sizeof( addr6 );
+    CosmMemSet( &addr6, sizeof( addr6 ), 0 );
+
+    /* set destination */
+    addr6.sin6_family = AF_INET6;
+    addr6.sin6_port = htons( (u16) addr->port );
+    CosmU128Save( &addr6.sin6_addr, &addr->ip.v6 );
+
+    /* send the UDP packet, cross fingers :) */
+    result = sendto( socket_descriptor, (const char *) data, length, 0,
+      (struct sockaddr *) &addr6, addr_length );
+    Cosm_NetCount( 1, (s64) result, 0 );
+  }
+  else
+  {
+    return COSM_NET_ERROR_ADDRTYPE;
+  }
+
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  /*
+    Windows can generate WSAECONNRESET errors
+    http://support.microsoft.com/kb/263823/en-us
+  */
+  if ( ( result == -1 ) && ( WSAGetLastError() != WSAECONNRESET ) )
+#else
+  if ( result == -1 )
+#endif
+  {
+    /* connection has been closed, or other error */
+    Cosm_NetClose( net );
+    return COSM_NET_ERROR_SOCKET;
+  }
+
+#if ( defined( NET_LOG_PACKETS ) )
+  Cosm_NetLogPacket( &net->host, "UDP Send:", (u8 *) data, result );
+#endif
+
+  return COSM_PASS;
+}
+
+s32 CosmNetRecvUDP( void * buffer, u32 * bytes_read, cosm_NET_ADDR * from,
+  cosm_NET * net, u32 length, cosm_NET_ACL * acl, u32 wait_ms )
+{
+  SOCKET socket_descriptor;
+  int received;
+  s32 result;
+  u64 deadline;
+  struct sockaddr_in client_addr;
+  unsigned int client_addr_len;
+
+  *bytes_read = 0;
+
+  if ( ( buffer == NULL ) || ( bytes_read == NULL )
+    || ( from == NULL ) || ( net == NULL ) || ( length == 0 ) )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  if ( ( net->status != COSM_NET_STATUS_LISTEN )
+    && ( net->status != COSM_NET_STATUS_OPEN ) )
+  {
+    return COSM_NET_ERROR_CLOSED;
+  }
+
+  if ( net->mode != COSM_NET_MODE_UDP )
+  {
+    return COSM_NET_ERROR_MODE;
+  }
+
+  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  {
+    net->status = COSM_NET_STATUS_CLOSED;
+    return COSM_NET_ERROR_NO_NET;
+  }
+
+#if ( defined( CPU_64BIT ) )
+  socket_descriptor = net->handle;
+#else
+  socket_descriptor = (u32) net->handle;
+#endif
+
+  if ( ( deadline = CosmClockMono() ) == 0 )
+  {
+    /* can't get local time */
+    return COSM_NET_ERROR_FATAL;
+  }
+  deadline += (u64) wait_ms * 1000000LL;
+
+  received = 0;
+  client_addr_len = sizeof( client_addr );
+
+  while ( received == 0 )
+  {
+    /* when time is elapsed, just take what's in the buffer and exit */
+    result = Cosm_NetReadable( socket_descriptor, deadline );
+    if ( result < 1 )
+    {
+      if ( result == -1 )
+      {
+        /* error while waiting */
+        Cosm_NetClose( net );
+        return COSM_NET_ERROR_SOCKET;
+      }
+      else
+      {
+        /* timeout */
+        return COSM_PASS;
+      }
+    }
+
+    received = recvfrom( socket_descriptor, (char *) buffer,
+      length - received, 0, (struct sockaddr *) &client_addr,
+      &client_addr_len );
+    Cosm_NetCount( 1, 0, (s64) received );
+
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+    /*
+      Windows can generate WSAECONNRESET errors
+      http://support.microsoft.com/kb/263823/en-us
+    */
+    if ( ( received == -1 ) && ( WSAGetLastError() != WSAECONNRESET ) )
+#else
+    if ( received == -1 )
+#endif
+    {
+      /* error while receiving data */
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_SOCKET;
+    }
+
+    /* have data, set from */
+    from->type = COSM_NET_IPV4;
+    from->port = ntohs( client_addr.sin_port );
+    from->ip.v4 = ntohl( client_addr.sin_addr.s_addr );
+
+    /* only accept this data if host passes acl masks, otherwise discard */
+    if ( CosmNetACLCheck( acl, from ) != COSM_NET_ALLOW )
+    {
+      received = 0;
+    }
+#if ( defined( NET_LOG_PACKETS ) )
+    Cosm_NetLogPacket( &net->host, "UDP Recv:", buffer, received );
+#endif
+  }
+
+  *bytes_read = received;
+
+  return COSM_PASS;
+}
+
+#define COSM_NET_BATCH 32 /* packets per recvmmsg/sendmmsg call */
+
+static int Cosm_NetAddrOS( struct sockaddr_storage * os_addr,
+  const cosm_NET_ADDR * addr )
+{
+  /* fill in os_addr from addr, returns its length or 0 for a bad type */
+  struct sockaddr_in * addr4;
+  struct sockaddr_in6 * addr6;
+
+  CosmMemSet( os_addr, sizeof( struct sockaddr_storage ), 0 );
+
+  if ( addr->type == COSM_NET_IPV4 )
+  {
+    addr4 = (struct sockaddr_in *) os_addr;
+    addr4->sin_family = AF_INET;
+    addr4->sin_port = htons( (u16) addr->port );
+    CosmU32Save( &addr4->sin_addr, &addr->ip.v4 );
+    return sizeof( struct sockaddr_in );
+  }
+  else if ( addr->type == COSM_NET_IPV6 )
+  {
+    addr6 = (struct sockaddr_in6 *) os_addr;
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = htons( (u16) addr->port );
+    CosmU128Save( &addr6->sin6_addr, &addr->ip.v6 );
+    return sizeof( struct sockaddr_in6 );
+  }
+
+  return 0;
+}
+
+static void Cosm_NetAddrCosm( cosm_NET_ADDR * addr,
+  const struct sockaddr_storage * os_addr )
+{
+  const struct sockaddr_in * addr4;
+  const struct sockaddr_in6 * addr6;
+
+  if ( os_addr->ss_family == AF_INET6 )
+  {
+    addr6 = (const struct sockaddr_in6 *) os_addr;
+    addr->type = COSM_NET_IPV6;
+    addr->port = ntohs( addr6->sin6_port );
+    CosmU128Load( &addr->ip.v6, &addr6->sin6_addr.s6_addr );
+  }
+  else
+  {
+    addr4 = (const struct sockaddr_in *) os_addr;
+    addr->type = COSM_NET_IPV4;
+    addr->port = ntohs( addr4->sin_port );
+    addr->ip.v4 = ntohl( addr4->sin_addr.s_addr );
+  }
+}
+
+s32 CosmNetSendUDPBatch( u32 * sent, cosm_NET * net,
+  const cosm_NET_PACKET * packets, u32 count )
+{
+  SOCKET socket_descriptor;
+  struct sockaddr_storage os_addrs[COSM_NET_BATCH];
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  struct mmsghdr messages[COSM_NET_BATCH];
+  struct iovec vectors[COSM_NET_BATCH];
+#endif
+  const cosm_NET_PACKET * packet;
+  int addr_lengths[COSM_NET_BATCH];
+  int result;
+  u32 chunk, i;
+
+  if ( sent == NULL )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+  *sent = 0;
+
+  if ( ( net == NULL ) || ( ( packets == NULL ) && ( count > 0 ) ) )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  {
+    return COSM_NET_ERROR_NO_NET;
+  }
+
+  if ( ( net->status != COSM_NET_STATUS_LISTEN )
+    && ( net->status != COSM_NET_STATUS_OPEN ) )
+  {
+    return COSM_NET_ERROR_CLOSED;
+  }
+
+  if ( net->mode != COSM_NET_MODE_UDP )
+  {
+    return COSM_NET_ERROR_MODE;
+  }
+
+#if ( defined( CPU_64BIT ) )
+  socket_descriptor = net->handle;
+#else
+  socket_descriptor = (u32) net->handle;
+#endif
+
+  while ( *sent < count )
+  {
+    chunk = count - *sent;
+    if ( chunk > COSM_NET_BATCH )
+    {
+      chunk = COSM_NET_BATCH;
+    }
+
+    for ( i = 0 ; i < chunk ; i++ )
+    {
+      packet = &packets[*sent + i];
+      if ( ( packet->data == NULL ) && ( packet->length > 0 ) )
+      {
+        return COSM_NET_ERROR_PARAM;
+      }
+      if ( ( addr_lengths[i] = Cosm_NetAddrOS( &os_addrs[i],
+        &packet->addr ) ) == 0 )
+      {
+        return COSM_NET_ERROR_ADDRTYPE;
+      }
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+      CosmMemSet( &messages[i], sizeof( struct mmsghdr ), 0 );
+      vectors[i].iov_base = packet->data;
+      vectors[i].iov_len = packet->length;
+      messages[i].msg_hdr.msg_name = &os_addrs[i];
+      messages[i].msg_hdr.msg_namelen = addr_lengths[i];
+      messages[i].msg_hdr.msg_iov = &vectors[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+#endif
+    }
+
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+    /* the whole chunk in one call, may stop early */
+    result = sendmmsg( socket_descriptor, messages, chunk, 0 );
+    Cosm_NetCount( 1, 0, 0 );
+    if ( result == -1 )
+    {
+      if ( errno == EINTR )
+      {
+        continue;
+      }
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_SOCKET;
+    }
+    for ( i = 0 ; i < (u32) result ; i++ )
+    {
+      Cosm_NetCount( 0, (s64) packets[*sent + i].length, 0 );
+#  if ( defined( NET_LOG_PACKETS ) )
+      Cosm_NetLogPacket( &net->host, "UDP Send:",
+        (u8 *) packets[*sent + i].data, packets[*sent + i].length );
+#  endif
+    }
+    *sent += result;
+#else
+    for ( i = 0 ; i < chunk ; i++ )
+    {
+      packet = &packets[*sent];
+      result = sendto( socket_descriptor, (const char *) packet->data,
+        packet->length, 0, (struct sockaddr *) &os_addrs[i],
+        addr_lengths[i] );
+      Cosm_NetCount( 1, (s64) result, 0 );
+#  if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+      /*
+        Windows can generate WSAECONNRESET errors
+        http://support.microsoft.com/kb/263823/en-us
+      */
+      if ( ( result == -1 ) && ( WSAGetLastError() != WSAECONNRESET ) )
+#  else
+      if ( result == -1 )
+#  endif
+      {
+        /* connection has been closed, or other error */
+        Cosm_NetClose( net );
+        return COSM_NET_ERROR_SOCKET;
+      }
+#  if ( defined( NET_LOG_PACKETS ) )
+      Cosm_NetLogPacket( &net->host, "UDP Send:", (u8 *) packet->data,
+        packet->length );
+#  endif
+      (*sent)++;
+    }
+#endif
+  }
+
+  return COSM_PASS;
+}
+
+s32 CosmNetRecvUDPBatch( u32 * count, cosm_NET_PACKET * packets,
+  cosm_NET * net, u32 max, cosm_NET_ACL * acl, u32 wait_ms )
+{
+  SOCKET socket_descriptor;
+  struct sockaddr_storage os_addrs[COSM_NET_BATCH];
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  struct mmsghdr messages[COSM_NET_BATCH];
+  struct iovec vectors[COSM_NET_BATCH];
+#else
+  socklen_t addr_length;
+#endif
+  cosm_NET_PACKET * packet;
+  cosm_NET_PACKET swap;
+  cosm_NET_ADDR from;
+  int received;
+  s32 result;
+  u64 deadline;
+  u32 chunk, got, i;
+
+  if ( count == NULL )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+  *count = 0;
+
+  if ( ( packets == NULL ) || ( net == NULL ) || ( max == 0 ) )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  for ( i = 0 ; i < max ; i++ )
+  {
+    if ( ( packets[i].data == NULL ) || ( packets[i].size == 0 ) )
+    {
+      return COSM_NET_ERROR_PARAM;
+    }
+  }
+
+  if ( ( net->status != COSM_NET_STATUS_LISTEN )
+    && ( net->status != COSM_NET_STATUS_OPEN ) )
+  {
+    return COSM_NET_ERROR_CLOSED;
+  }
+
+  if ( net->mode != COSM_NET_MODE_UDP )
+  {
+    return COSM_NET_ERROR_MODE;
+  }
+
+  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  {
+    net->status = COSM_NET_STATUS_CLOSED;
+    return COSM_NET_ERROR_NO_NET;
+  }
+
+#if ( defined( CPU_64BIT ) )
+  socket_descriptor = net->handle;
+#else
+  socket_descriptor = (u32) net->handle;
+#endif
+
+  if ( ( deadline = CosmClockMono() ) == 0 )
+  {
+    /* can't get local time */
+    return COSM_NET_ERROR_FATAL;
+  }
+  deadline += (u64) wait_ms * 1000000LL;
+
+  while ( *count == 0 )
+  {
+    /* block only for the first packet */
+    result = Cosm_NetReadable( socket_descriptor, deadline );
+    if ( result < 1 )
+    {
+      if ( result == -1 )
+      {
+        /* error while waiting */
+        Cosm_NetClose( net );
+        return COSM_NET_ERROR_SOCKET;
+      }
+      else
+      {
+        /* timeout */
+        return COSM_PASS;
+      }
+    }
+
+    /* then drain whatever is already queued, up to max */
+    do
+    {
+      chunk = max - *count;
+      if ( chunk > COSM_NET_BATCH )
+      {
+        chunk = COSM_NET_BATCH;
+      }
+
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+      for ( i = 0 ; i < chunk ; i++ )
+      {
+        packet = &packets[*count + i];
+        CosmMemSet( &messages[i], sizeof( struct mmsghdr ), 0 );
+        vectors[i].iov_base = packet->data;
+        vectors[i].iov_len = packet->size;
+        messages[i].msg_hdr.msg_name = &os_addrs[i];
+        messages[i].msg_hdr.msg_namelen = sizeof( os_addrs[i] );
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+      }
+
+      received = recvmmsg( socket_descriptor, messages, chunk,
+        MSG_DONTWAIT, NULL );
+      Cosm_NetCount( 1, 0, 0 );
+      if ( received == -1 )
+      {
+        if ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK )
+          || ( errno == EINTR ) )
+        {
+          /* nothing more queued */
+          break;
+        }
+        /* error while receiving data */
+        Cosm_NetClose( net );
+        return COSM_NET_ERROR_SOCKET;
+      }
+
+      for ( i = 0 ; i < (u32) received ; i++ )
+      {
+        packets[*count + i].length = messages[i].msg_len;
+        Cosm_NetCount( 0, 0, (s64) messages[i].msg_len );
+      }
+#else
+      received = 0;
+      while ( ( received < (int) chunk ) && ( 1 ==
+        Cosm_NetReadable( socket_descriptor, CosmClockMono() ) ) )
+      {
+        packet = &packets[*count + received];
+        addr_length = sizeof( os_addrs[received] );
+        result = recvfrom( socket_descriptor, (char *) packet->data,
+          packet->size, 0, (struct sockaddr *) &os_addrs[received],
+          &addr_length );
+        Cosm_NetCount( 1, 0, (s64) result );
+        if ( result == -1 )
+        {
+#  if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+          /*
+            Windows can generate WSAECONNRESET errors
+            http://support.microsoft.com/kb/263823/en-us
+          */
+          if ( WSAGetLastError() == WSAECONNRESET )
+          {
+            break;
+          }
+#  endif
+          /* error while receiving data */
+          Cosm_NetClose( net );
+          return COSM_NET_ERROR_SOCKET;
+        }
+        packet->length = result;
+        received++;
+      }
+#endif
+
+      /* set the senders, only keep packets from hosts passing the acl */
+      got = 0;
+      for ( i = 0 ; i < (u32) received ; i++ )
+      {
+        Cosm_NetAddrCosm( &from, &os_addrs[i] );
+        if ( CosmNetACLCheck( acl, &from ) != COSM_NET_ALLOW )
+        {
+          continue;
+        }
+        if ( i != got )
+        {
+          /* swap the whole entry so the dropped buffer is not lost */
+          swap = packets[*count + got];
+          packets[*count + got] = packets[*count + i];
+          packets[*count + i] = swap;
+        }
+        packet = &packets[*count + got];
+        packet->addr = from;
+#if ( defined( NET_LOG_PACKETS ) )
+        Cosm_NetLogPacket( &net->host, "UDP Recv:", packet->data,
+          packet->length );
+#endif
+        got++;
+      }
+      *count += got;
+    } while ( ( received == (int) chunk ) && ( *count < max ) );
+  }
+
+  return COSM_PASS;
+}
+
+s32 CosmNetListen( cosm_NET * net, const cosm_NET_ADDR * addr, u32 mode,
+  u32 queue )
+{
+  cosm_NET_OPTIONS options;
+
+  CosmMemSet( &options, sizeof( options ), 0 );
+  options.backlog = queue;
+
+  return CosmNetListenOptions( net, addr, mode, &options );
+}
+
+s32 CosmNetListenOptions( cosm_NET * net, const cosm_NET_ADDR * addr,
+  u32 mode, const cosm_NET_OPTIONS * options )
+{
+  int socket_descriptor;
+  unsigned int addr_length;
+  struct sockaddr_in addr4;
+  struct sockaddr_in6 addr6;
+  u32 shared, backlog;
+#if ( defined( SO_REUSEPORT ) )
+  int on;
+#endif
+
+  if ( ( net == NULL ) || ( addr == NULL ) )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  backlog = SOMAXCONN;
+  if ( ( options != NULL ) && ( options->backlog != 0 ) )
+  {
+    backlog = options->backlog;
+  }
+
+  shared = mode & COSM_NET_MODE_SHARED;
+  mode &= ~COSM_NET_MODE_SHARED;
+
+  if ( ( mode != COSM_NET_MODE_TCP ) && ( mode != COSM_NET_MODE_UDP ) )
+  {
+    return COSM_NET_ERROR_MODE;
+  }
+
+  if ( net->status != COSM_NET_STATUS_CLOSED )
+  {
+    return COSM_NET_ERROR_ORDER;
+  }
+
+  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  {
+    net->status = COSM_NET_STATUS_CLOSED;
+    return COSM_NET_ERROR_NO_NET;
+  }
+
+  if ( addr->type == COSM_NET_IPV4 )
+  {
+    if ( mode == COSM_NET_MODE_UDP )
+    {
+      socket_descriptor = (int) socket( PF_INET, SOCK_DGRAM, 0 );
+    }
+    else
+    {
+      socket_descriptor = (int) socket( PF_INET, SOCK_STREAM, 0 );
+    }
+  }
+  else if ( addr->type == COSM_NET_IPV6 )
+  {
+    if ( mode == COSM_NET_MODE_UDP )
+    {
+      socket_descriptor = (int) socket( PF_INET6, SOCK_DGRAM, 0 );
+    }
+    else
+    {
+      socket_descriptor = (int) socket( PF_INET6, SOCK_STREAM, 0 );
+    }
+  }
+  else
+  {
+    return COSM_NET_ERROR_ADDRTYPE;
+  }
+
+  if ( socket_descriptor == -1 )
+  {
+    /* unable to open the socket */
+    net->status = COSM_NET_STATUS_CLOSED;
+    return COSM_NET_ERROR_SOCKET;
+  }
+
+  /* so Cosm_NetClose can clean up after any failure below */
+  net->handle = (u64) socket_descriptor;
+  net->status = COSM_NET_STATUS_OPENING;
+
+  if ( shared )
+  {
+    /* let each listener own a socket on the same port */
+#if ( defined( SO_REUSEPORT ) )
+    on = 1;
+    if ( setsockopt( socket_descriptor, SOL_SOCKET, SO_REUSEPORT,
+      (const char *) &on, sizeof( on ) ) == -1 )
+    {
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_SOCKET;
+    }
+#else
+    Cosm_NetClose( net );
+    return COSM_NET_ERROR_MODE;
+#endif
+  }
+
+  Cosm_NetApplyOptions( socket_descriptor, options, backlog,
+    COSM_NET_APPLY_LISTEN );
+
+  if ( addr->type == COSM_NET_IPV4 )
+  {
+    addr_length = sizeof( addr4 );
+    CosmMemSet( &addr4, sizeof( addr4 ), 0 );
+    addr4.sin_family = AF_INET;
+    addr4.sin_port = htons( (u16) addr->port );
+    CosmU32Save( &addr4.sin_addr, &addr->ip.v4 );
+
+    if ( bind( socket_descriptor, (struct sockaddr *) &addr4,
+      addr_length ) == -1 )
+    {
+      /* unable to bind to the socket */
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_ADDRESS;
+    }
+  }
+  else /* IPv6 */
+  {
+    addr_length = sizeof( addr6 );
+    CosmMemSet( &addr6, sizeof( addr6 ), 0 );
+    addr6.sin6_family = AF_INET6;
+    addr6.sin6_port = htons( (u16) addr->port );
+    CosmU128Save( &addr6.sin6_addr, &addr->ip.v6 );
+
+    if ( bind( socket_descriptor, (struct sockaddr *) &addr6,
+      addr_length ) == -1 )
+    {
+      /* unable to bind to the socket */
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_ADDRESS;
+    }
+  }
+
+  /* UDP has no connections to queue */
+  if ( mode == COSM_NET_MODE_TCP )
+  {
+    if ( listen( socket_descriptor, (int) backlog ) == -1 )
+    {
+      /* unable to listen to the socket */
+      Cosm_NetClose( net );
+      return COSM_NET_ERROR_SOCKET;
+    }
+  }
+
+  if ( addr->port == 0 )
+  {
+    if ( addr->type == COSM_NET_IPV4 )
+    {
+      if ( getsockname( socket_descriptor, (struct sockaddr *)
+        &addr4, &addr_length ) == -1 )
+      {
+        /* unable to get the port the socket is listenning on */
+        Cosm_NetClose( net );
+        return COSM_NET_ERROR_SOCKET;
+      }
+      net->my_addr.port = ntohs( addr4.sin_port );
+    }
+    else /* IPv6 */
+    {
+      if ( getsockname( socket_descriptor, (struct sockaddr *)
+        &addr6, &addr_length ) == -1 )
+      {
+        /* unable to get the port the socket is listenning on */
+        Cosm_NetClose( net );
+        return COSM_NET_ERROR_SOCKET;
+      }
+      net->my_addr.port = ntohs( addr6.sin6_port );
+    }
+  }
+  else
+  {
+    net->my_addr.port = addr->port;
+  }
+
+  net->my_addr.type = addr->type;
+  net->my_addr.ip.v6 = addr->ip.v6; /* ip.v6 copies both */
+  net->handle = (u64) socket_descriptor;
+  net->mode = mode;
+  net->status = COSM_NET_STATUS_LISTEN;
+
+  return COSM_PASS;
+}
+
+s32 CosmNetAccept( cosm_NET * new_connection, cosm_NET * net,
+  cosm_NET_ACL * acl, u32 wait )
+{
+  SOCKET socket_descriptor, new_socket_descriptor;
+  struct sockaddr_in client_address, local_address;
+  unsigned int client_address_length, local_address_length;
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  unsigned long flags;
+#else
+  int flags;
+#endif
+  int result;
+  s32 acl_test_result;
+  s32 error;
+
+  if ( ( net == NULL ) || ( new_connection == NULL ) )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  if ( net->status != COSM_NET_STATUS_LISTEN )
+  {
+    return COSM_NET_ERROR_ORDER;
+  }
+
+  /* CosmNetAccept is not valid for UDP connections */
+  if ( net->mode != COSM_NET_MODE_TCP )
+  {
+    return COSM_NET_ERROR_MODE;
+  }
+
+  flags = 0;
+
+#if ( defined( CPU_64BIT ) )
+  socket_descriptor = net->handle;
+#else
+  socket_descriptor = (u32) net->handle;
+#endif
+
+  if ( wait == COSM_NET_ACCEPT_NOWAIT )
+  {
+    /* We want the check to return immediately */
+    result = Cosm_NetReadable( socket_descriptor, CosmClockMono() );
+
+    if ( result < 1 )
+    {
+      if ( result == -1 )
+      {
+        /* Error while waiting */
+        error = COSM_NET_ERROR_SOCKET;
+      }
+      else
+      {
+        /* No connection waiting */
+        error = COSM_NET_ERROR_TIMEOUT;
+      }
+      new_connection->status = COSM_NET_STATUS_CLOSED;
+      return error;
+    }
+
+    /* Making sure we won't block on accept() if the connection is lost */
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+    flags = 1; /* set nonblocking mode */
+    if ( ioctlsocket( socket_descriptor, FIONBIO, &flags ) != 0 )
+    {
+      /* Unable to set flags of the socket to non-blocking */
+      new_connection->status = COSM_NET_STATUS_CLOSED;
+      return COSM_NET_ERROR_SOCKET;
+    }
+#else
+    /* Change the socket's flags - Turn off blocking */
+    flags = fcntl( socket_descriptor, F_GETFL, 0 );
+    flags = flags | O_NONBLOCK;
+    if ( fcntl( socket_descriptor, F_SETFL, flags ) != 0 )
+    {
+      /* Unable to set flags of the socket to non-blocking */
+      new_connection->status = COSM_NET_STATUS_CLOSED;
+      return COSM_NET_ERROR_SOCKET;
+    }
+#endif
+  }
+
+  client_address_length = sizeof( client_address );
+
+  /* we loop if wait != COSM_NET_ACCEPT_NOWAIT and ACL failed. */
+  do
+  {
+    /* accept() the connection ... */
+    new_socket_descriptor = (int) accept( socket_descriptor,
+      (struct sockaddr *) &client_address, &client_address_length );
+    Cosm_NetCount( 1, 0, 0 );
+
+    /* if we connected ... */
+    if ( new_socket_descriptor == -1 )
+    {
+      new_connection->status = COSM_NET_STATUS_CLOSED;
+      return COSM_NET_ERROR_SOCKET;
+    }
     else
     {
-      socket_descriptor = (int) socket( PF_INET, SOCK_STREAM, 0 );
+      new_connection->addr.type = COSM_NET_IPV4;
+      new_connection->addr.ip.v4
+        = ntohl( client_address.sin_addr.s_addr );
+      new_connection->addr.port = ntohs( client_address.sin_port );
+
+      /* Make sure the host is allowed by ACL masks */
+      acl_test_result = CosmNetACLCheck( acl, &new_connection->addr );
+      if ( acl_test_result == COSM_NET_DENY )
+      {
+        close( new_socket_descriptor );
+      }
+    }
+  } while ( ( acl_test_result == COSM_NET_DENY )
+    && ( wait != COSM_NET_ACCEPT_NOWAIT ) );
+
+  new_connection->handle = (u64) new_socket_descriptor;
+
+  if ( wait == COSM_NET_ACCEPT_NOWAIT )
+  {
+    /*
+      The old socket need to be set blocking again in case the next
+      call to CosmNetListen() is with COSM_NET_ACCEPT_WAIT
+    */
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+    flags = 0; /* (re)set blocking mode */
+    if ( ioctlsocket( socket_descriptor, FIONBIO, &flags ) == -1 )
+    {
+      /* Unable to reset flags of the listenning socket to blocking */
+      new_connection->status = COSM_NET_STATUS_CLOSED;
+      return COSM_NET_ERROR_SOCKET;
+    }
+    if ( new_socket_descriptor > 0 )
+    {
+      if ( ioctlsocket( new_socket_descriptor, FIONBIO, &flags ) == -1 )
+      {
+        /* Unable to set flags of the new socket to blocking */
+        new_connection->status = COSM_NET_STATUS_CLOSED;
+        return COSM_NET_ERROR_SOCKET;
+      }
+    }
+#else
+    flags = flags & ~O_NONBLOCK;
+    if ( fcntl( socket_descriptor, F_SETFL, flags ) == -1 )
+    {
+      /* Unable to reset flags of the listenning socket to blocking */
+      new_connection->status = COSM_NET_STATUS_CLOSED;
+      return COSM_NET_ERROR_SOCKET;
+      /* The new connection may still be open, lets continue */
+    }
+#endif
+  }
+
+  /* We have nothing more to do with net */
+
+  /* check that we got a connection */
+  if ( new_socket_descriptor == -1 )
+  {
+    /* Unable to accept a client - some error ? */
+    /* On NOWAIT, may be a lost connection between the wait and accept() */
+    new_connection->status = COSM_NET_STATUS_CLOSED;
+    return COSM_NET_ERROR_CLOSED;
+  }
+
+  if ( wait == COSM_NET_ACCEPT_NOWAIT )
+  {
+    /* The new socket must also be set to blocking */
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+    flags = 0;
+    if ( ioctlsocket( new_socket_descriptor, FIONBIO, &flags ) == -1 )
+    {
+      /* Unable to set flags of the new socket to blocking */
+      new_connection->status = COSM_NET_STATUS_CLOSED;
+      return COSM_NET_ERROR_CLOSED;
+    }
+#else
+    /* Change the new socket's flags - Turn on blocking */
+    flags = fcntl( new_socket_descriptor, F_GETFL, 0 );
+    flags = flags & ~O_NONBLOCK;
+    if ( fcntl( new_socket_descriptor, F_SETFL, flags ) == -1 )
+    {
+      /* Unable to set flags of the new socket to blocking */
+      new_connection->status = COSM_NET_STATUS_CLOSED;
+      return COSM_NET_ERROR_CLOSED;
+    }
+#endif
+  }
+
+  /* verify which address the client has connected to */
+  local_address_length = sizeof( local_address );
+  if ( getsockname( new_socket_descriptor, (struct sockaddr *)
+    &local_address, &local_address_length ) == -1 )
+  {
+    /* unable to get the local address and port of the socket */
+    new_connection->status = COSM_NET_STATUS_CLOSED;
+    return COSM_NET_ERROR_CLOSED;
+  }
+
+  /* Filling the new connection cosm_NET struct */
+  new_connection->my_addr.type = COSM_NET_IPV4;
+  new_connection->my_addr.ip.v4 = ntohl( local_address.sin_addr.s_addr );
+  new_connection->my_addr.port = ntohs( local_address.sin_port );
+  new_connection->mode = COSM_NET_MODE_TCP;
+
+  new_connection->status = COSM_NET_STATUS_OPEN;
+  return COSM_PASS;
+}
+
+s32 CosmNetSetOptions( cosm_NET * net, const cosm_NET_OPTIONS * options )
+{
+  SOCKET socket_descriptor;
+
+  if ( ( net == NULL ) || ( options == NULL ) )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  if ( ( net->status != COSM_NET_STATUS_LISTEN )
+    && ( net->status != COSM_NET_STATUS_OPEN ) )
+  {
+    return COSM_NET_ERROR_CLOSED;
+  }
+
+#if ( defined( CPU_64BIT ) )
+  socket_descriptor = net->handle;
+#else
+  socket_descriptor = (u32) net->handle;
+#endif
+
+  Cosm_NetApplyOptions( socket_descriptor, options, 0,
+    COSM_NET_APPLY_LATER );
+
+  return COSM_PASS;
+}
+
+s32 CosmNetGetOptions( cosm_NET_OPTIONS * options, cosm_NET * net )
+{
+  SOCKET socket_descriptor;
+
+  if ( ( options == NULL ) || ( net == NULL ) )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  if ( ( net->status != COSM_NET_STATUS_LISTEN )
+    && ( net->status != COSM_NET_STATUS_OPEN ) )
+  {
+    return COSM_NET_ERROR_CLOSED;
+  }
+
+#if ( defined( CPU_64BIT ) )
+  socket_descriptor = net->handle;
+#else
+  socket_descriptor = (u32) net->handle;
+#endif
+
+  CosmMemSet( options, sizeof( cosm_NET_OPTIONS ), 0 );
+
+  if ( Cosm_NetGetOption( socket_descriptor, SOL_SOCKET, SO_REUSEADDR ) )
+  {
+    options->flags |= COSM_NET_OPTION_REUSEADDR;
+  }
+
+  options->send_buffer = Cosm_NetGetOption( socket_descriptor,
+    SOL_SOCKET, SO_SNDBUF );
+  options->recv_buffer = Cosm_NetGetOption( socket_descriptor,
+    SOL_SOCKET, SO_RCVBUF );
+#if ( defined( SO_BUSY_POLL ) )
+  options->busy_poll = Cosm_NetGetOption( socket_descriptor, SOL_SOCKET,
+    SO_BUSY_POLL );
+#endif
+#if ( defined( SO_ZEROCOPY ) )
+  if ( Cosm_NetGetOption( socket_descriptor, SOL_SOCKET, SO_ZEROCOPY ) )
+  {
+    options->flags |= COSM_NET_OPTION_ZEROCOPY;
+  }
+#endif
+
+  if ( net->mode != COSM_NET_MODE_TCP )
+  {
+    /* the rest are TCP options */
+    return COSM_PASS;
+  }
+
+  if ( Cosm_NetGetOption( socket_descriptor, IPPROTO_TCP, TCP_NODELAY ) )
+  {
+    options->flags |= COSM_NET_OPTION_NODELAY;
+  }
+#if ( defined( TCP_QUICKACK ) )
+  if ( Cosm_NetGetOption( socket_descriptor, IPPROTO_TCP, TCP_QUICKACK ) )
+  {
+    options->flags |= COSM_NET_OPTION_QUICKACK;
+  }
+#endif
+#if ( defined( TCP_FASTOPEN ) )
+  if ( Cosm_NetGetOption( socket_descriptor, IPPROTO_TCP, TCP_FASTOPEN ) )
+  {
+    options->flags |= COSM_NET_OPTION_FASTOPEN;
+  }
+#endif
+#if ( defined( TCP_FASTOPEN_CONNECT ) )
+  if ( Cosm_NetGetOption( socket_descriptor, IPPROTO_TCP,
+    TCP_FASTOPEN_CONNECT ) )
+  {
+    options->flags |= COSM_NET_OPTION_FASTOPEN;
+  }
+#endif
+
+  if ( Cosm_NetGetOption( socket_descriptor, SOL_SOCKET, SO_KEEPALIVE ) )
+  {
+    options->flags |= COSM_NET_OPTION_KEEPALIVE;
+  }
+#if ( defined( TCP_KEEPIDLE ) )
+  options->keepalive_idle = Cosm_NetGetOption( socket_descriptor,
+    IPPROTO_TCP, TCP_KEEPIDLE );
+#elif ( defined( TCP_KEEPALIVE ) )
+  options->keepalive_idle = Cosm_NetGetOption( socket_descriptor,
+    IPPROTO_TCP, TCP_KEEPALIVE );
+#endif
+#if ( defined( TCP_KEEPINTVL ) )
+  options->keepalive_interval = Cosm_NetGetOption( socket_descriptor,
+    IPPROTO_TCP, TCP_KEEPINTVL );
+#endif
+#if ( defined( TCP_KEEPCNT ) )
+  options->keepalive_count = Cosm_NetGetOption( socket_descriptor,
+    IPPROTO_TCP, TCP_KEEPCNT );
+#endif
+
+  return COSM_PASS;
+}
+
+void CosmNetCounters( u64 * sent, u64 * received, u64 * syscalls )
+{
+  if ( sent != NULL )
+  {
+    *sent = (u64) CosmCounterRead( &__cosm_net_sent );
+  }
+  if ( received != NULL )
+  {
+    *received = (u64) CosmCounterRead( &__cosm_net_received );
+  }
+  if ( syscalls != NULL )
+  {
+    *syscalls = (u64) CosmCounterRead( &__cosm_net_calls );
+  }
+}
+
+s32 CosmNetClose( cosm_NET * net )
+{
+  s32 error;
+
+  if ( net == NULL )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  {
+    net->status = COSM_NET_STATUS_CLOSED;
+    return COSM_NET_ERROR_NO_NET;
+  }
+
+  error = Cosm_NetClose( net );
+
+  return error;
+}
+
+s32 CosmNetPollerInit( cosm_NET_POLLER * poller )
+{
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  int handle;
+#endif
+
+  if ( poller == NULL )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  {
+    return COSM_NET_ERROR_NO_NET;
+  }
+
+  CosmMemSet( poller, sizeof( cosm_NET_POLLER ), 0 );
+
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  if ( ( handle = epoll_create1( EPOLL_CLOEXEC ) ) == -1 )
+  {
+    return COSM_NET_ERROR_SOCKET;
+  }
+  poller->handle = (u64) handle;
+#endif
+
+  return COSM_PASS;
+}
+
+s32 CosmNetPollerAdd( cosm_NET_POLLER * poller, cosm_NET * net,
+  u32 events )
+{
+  cosm_NET ** nets;
+  u32 * list;
+  u32 i, length;
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  struct epoll_event event;
+#endif
+
+  if ( ( poller == NULL ) || ( net == NULL ) || ( events == 0 )
+    || ( ( events & ~( COSM_NET_POLL_READ | COSM_NET_POLL_WRITE ) ) != 0 ) )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  if ( ( net->status != COSM_NET_STATUS_OPEN )
+    && ( net->status != COSM_NET_STATUS_LISTEN ) )
+  {
+    return COSM_NET_ERROR_CLOSED;
+  }
+
+  for ( i = 0 ; i < poller->count ; i++ )
+  {
+    if ( poller->nets[i] == net )
+    {
+      return COSM_NET_ERROR_ORDER;
+    }
+  }
+
+  if ( poller->count == poller->length )
+  {
+    length = ( poller->length == 0 ) ? 16 : ( poller->length * 2 );
+    if ( ( nets = CosmMemRealloc( poller->nets,
+      sizeof( cosm_NET * ) * length ) ) == NULL )
+    {
+      return COSM_NET_ERROR_FATAL;
+    }
+    poller->nets = nets;
+    if ( ( list = CosmMemRealloc( poller->events,
+      sizeof( u32 ) * length ) ) == NULL )
+    {
+      return COSM_NET_ERROR_FATAL;
+    }
+    poller->events = list;
+    poller->length = length;
+  }
+
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  /* level triggered, the same as poll() on other systems */
+  CosmMemSet( &event, sizeof( event ), 0 );
+  event.events = EPOLLRDHUP
+    | ( ( events & COSM_NET_POLL_READ ) ? EPOLLIN : 0 )
+    | ( ( events & COSM_NET_POLL_WRITE ) ? EPOLLOUT : 0 );
+  event.data.ptr = net;
+  if ( epoll_ctl( (int) poller->handle, EPOLL_CTL_ADD, (int) net->handle,
+    &event ) != 0 )
+  {
+    return COSM_NET_ERROR_SOCKET;
+  }
+#endif
+
+  poller->nets[poller->count] = net;
+  poller->events[poller->count++] = events;
+
+  return COSM_PASS;
+}
+
+s32 CosmNetPollerRemove( cosm_NET_POLLER * poller, cosm_NET * net )
+{
+  u32 i;
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  struct epoll_event event;
+#endif
+
+  if ( ( poller == NULL ) || ( net == NULL ) )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+  for ( i = 0 ; i < poller->count ; i++ )
+  {
+    if ( poller->nets[i] == net )
+    {
+      break;
+    }
+  }
+  if ( i == poller->count )
+  {
+    return COSM_NET_ERROR_ORDER;
+  }
+
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  /* a closed socket has already left the set, so ignore failure */
+  CosmMemSet( &event, sizeof( event ), 0 );
+  epoll_ctl( (int) poller->handle, EPOLL_CTL_DEL, (int) net->handle,
+    &event );
+#endif
+
+  poller->count--;
+  poller->nets[i] = poller->nets[poller->count];
+  poller->events[i] = poller->events[poller->count];
+
+  return COSM_PASS;
+}
+
+s32 CosmNetPollerWait( u32 * count, cosm_NET_EVENT * ready,
+  cosm_NET_POLLER * poller, u32 max, u32 wait_ms )
+{
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  struct epoll_event * os_events;
+#else
+  struct pollfd * os_events;
+#endif
+  void * memory;
+  u64 deadline, time_now, remaining;
+  u32 i, need, events, flags;
+  int result;
+
+  if ( ( count == NULL ) || ( ready == NULL ) || ( poller == NULL )
+    || ( max == 0 ) )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+  *count = 0;
+
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  need = max;
+#else
+  need = poller->count;
+  if ( need == 0 )
+  {
+    /* nothing to wait on, and WSAPoll fails on an empty set */
+    CosmSleep( wait_ms );
+    return COSM_PASS;
+  }
+#endif
+
+  if ( poller->os_length < need )
+  {
+    if ( ( memory = CosmMemRealloc( poller->os_events,
+      sizeof( *os_events ) * need ) ) == NULL )
+    {
+      return COSM_NET_ERROR_FATAL;
+    }
+    poller->os_events = memory;
+    poller->os_length = need;
+  }
+  os_events = poller->os_events;
+
+#if ( !( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) ) )
+  for ( i = 0 ; i < need ; i++ )
+  {
+#  if ( defined( CPU_64BIT ) )
+    os_events[i].fd = poller->nets[i]->handle;
+#  else
+    os_events[i].fd = (u32) poller->nets[i]->handle;
+#  endif
+    os_events[i].events =
+      ( ( poller->events[i] & COSM_NET_POLL_READ ) ? POLLIN : 0 )
+      | ( ( poller->events[i] & COSM_NET_POLL_WRITE ) ? POLLOUT : 0 );
+    os_events[i].revents = 0;
+  }
+#endif
+
+  deadline = CosmClockMono() + (u64) wait_ms * 1000000LL;
+  for ( ; ; )
+  {
+    time_now = CosmClockMono();
+    remaining = ( time_now < deadline ) ? ( deadline - time_now ) : 0;
+    remaining = ( remaining >= 0x7FFFFFFFLL * 1000000LL ) ? 0x7FFFFFFF
+      : ( ( remaining + 999999LL ) / 1000000LL );
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+    result = epoll_wait( (int) poller->handle, os_events, (int) max,
+      (int) remaining );
+#elif ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+    result = WSAPoll( os_events, need, (int) remaining );
+#else
+    result = poll( os_events, need, (int) remaining );
+#endif
+    Cosm_NetCount( 1, 0, 0 );
+    if ( result == -1 )
+    {
+#if ( !( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) ) )
+      if ( errno == EINTR )
+      {
+        continue;
+      }
+#endif
+      return COSM_NET_ERROR_SOCKET;
+    }
+    break;
+  }
+
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  for ( i = 0 ; i < (u32) result ; i++ )
+  {
+    flags = os_events[i].events;
+    events = ( ( flags & EPOLLIN ) ? COSM_NET_POLL_READ : 0 )
+      | ( ( flags & EPOLLOUT ) ? COSM_NET_POLL_WRITE : 0 )
+      | ( ( flags & ( EPOLLRDHUP | EPOLLHUP | EPOLLERR ) )
+      ? COSM_NET_POLL_CLOSED : 0 );
+    ready[i].net = (cosm_NET *) os_events[i].data.ptr;
+    ready[i].events = events;
+  }
+  *count = (u32) result;
+#else
+  for ( i = 0 ; ( i < need ) && ( *count < max ) ; i++ )
+  {
+    flags = (u32) os_events[i].revents;
+    if ( flags == 0 )
+    {
+      continue;
+    }
+    events = ( ( flags & POLLIN ) ? COSM_NET_POLL_READ : 0 )
+      | ( ( flags & POLLOUT ) ? COSM_NET_POLL_WRITE : 0 )
+      | ( ( flags & ( POLLHUP | POLLERR | POLLNVAL ) )
+      ? COSM_NET_POLL_CLOSED : 0 );
+    ready[*count].net = poller->nets[i];
+    ready[*count].events = events;
+    (*count)++;
+  }
+#endif
+
+  return COSM_PASS;
+}
+
+s32 CosmNetPollerFree( cosm_NET_POLLER * poller )
+{
+  if ( poller == NULL )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+
+#if ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  if ( poller->handle != 0 )
+  {
+    close( (int) poller->handle );
+  }
+#endif
+  CosmMemFree( poller->nets );
+  CosmMemFree( poller->events );
+  CosmMemFree( poller->os_events );
+  CosmMemSet( poller, sizeof( cosm_NET_POLLER ), 0 );
+
+  return COSM_PASS;
+}
+
+static u32 Cosm_NetDNSSystem( cosm_NET_ADDR * addr, u32 count,
+  const ascii * name, int flags )
+{
+  struct addrinfo hint, * entry, * addr_list;
+  u32 found;
+
+  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  {
+    return 0;
+  }
+
+  /* hint for just 1 version of each IP */
+  CosmMemSet( &hint, sizeof( hint ), 0 );
+  hint.ai_family = PF_UNSPEC;
+  hint.ai_socktype = SOCK_STREAM;
+  hint.ai_flags = flags;
+  if ( getaddrinfo( (const char *) name, NULL, &hint, &addr_list ) != 0 )
+  {
+    return 0;
+  }
+
+  found = 0;
+  entry = addr_list;
+  while ( ( entry != NULL ) && ( found < count ) )
+  {
+    if ( ( entry->ai_family == PF_INET )
+      && ( ( (struct sockaddr_in *) entry->ai_addr )->sin_family
+      == AF_INET ) )
+    {
+      /* IPv4 */
+      addr[found].type = COSM_NET_IPV4;
+      addr[found].port = 0;
+      /* set the ipv6 to avoid uninitilized memory warnings */
+      addr[found].ip.v6.hi = 0;
+      addr[found].ip.v6.lo = 0;
+      CosmU32Load( &addr[found].ip.v4,
+        &( ( (struct sockaddr_in *) entry->ai_addr )->sin_addr ) );
+      found++;
+    }
+    else if ( ( entry->ai_family == PF_INET6 )
+      && ( ( (struct sockaddr_in6 *) entry->ai_addr )->sin6_family
+      == AF_INET6 ) )
+    {
+      /* IPv6 */
+      addr[found].type = COSM_NET_IPV6;
+      addr[found].port = 0;
+      CosmU128Load( &addr[found].ip.v6,
+        &( ( (struct sockaddr_in6 *) entry->ai_addr )->sin6_addr ) );
+      found++;
     }
+
+    entry = entry->ai_next;
   }
-  else if ( addr->type == COSM_NET_IPV6 )
+
+  freeaddrinfo( addr_list );
+
+  return found;
+}
+
+#define COSM_NET_DNS_QUEUED   1
+#define COSM_NET_DNS_RUNNING  2
+#define COSM_NET_DNS_DONE     3
+#define COSM_NET_DNS_TRIES    2    /* times through the server list */
+#define COSM_NET_DNS_WAIT     1000 /* ms for a server to answer */
+#define COSM_NET_DNS_PACKET   512
+
+/* a CosmNetResolve caller waiting for a worker */
+typedef struct cosm_NET_DNS_WAIT
+{
+  cosm_NET_ADDR * addr;
+  u32 count;
+  u32 found;
+  cosm_SEMAPHORE done;
+} cosm_NET_DNS_WAIT;
+
+/* lower case copy of name to use as the cache key, and its hash */
+static s32 Cosm_NetDNSKey( ascii * key, u32 * hash, const ascii * name )
+{
+  u32 i;
+
+  *hash = 0x811C9DC5;
+  for ( i = 0 ; name[i] != 0 ; i++ )
   {
-    if ( mode == COSM_NET_MODE_UDP )
+    if ( i == ( COSM_NET_MAX_HOSTNAME - 1 ) )
     {
-      socket_descriptor = (int) socket( PF_INET6, SOCK_DGRAM, 0 );
+      return COSM_FAIL;
     }
-    else
+    key[i] = name[i];
+    if ( ( key[i] >= 'A' ) && ( key[i] <= 'Z' ) )
     {
-      socket_descriptor = (int) socket( PF_INET6, SOCK_STREAM, 0 );
+      key[i] += 'a' - 'A';
     }
+    *hash = ( *hash ^ (u8) key[i] ) * 0x01000193;
   }
-  else
+  key[i] = 0;
+
+  return ( i == 0 ) ? COSM_FAIL : COSM_PASS;
+}
+
+/* drop expired answers, or every answer if that isn't enough */
+static void Cosm_NetDNSTrim( cosm_NET_RESOLVER * resolver, u64 now )
+{
+  cosm_NET_DNS_ENTRY ** link;
+  cosm_NET_DNS_ENTRY * entry;
+  u32 i, pass;
+
+  for ( pass = 0 ; ( pass < 2 )
+    && ( resolver->count >= COSM_NET_DNS_ENTRIES ) ; pass++ )
   {
-    return COSM_NET_ERROR_ADDRTYPE;
+    for ( i = 0 ; i < COSM_NET_DNS_TABLE ; i++ )
+    {
+      link = &resolver->table[i];
+      while ( ( entry = *link ) != NULL )
+      {
+        if ( ( entry->state == COSM_NET_DNS_DONE )
+          && ( ( pass == 1 ) || ( now >= entry->expires ) ) )
+        {
+          *link = entry->next;
+          CosmMemFree( entry );
+          resolver->count--;
+        }
+        else
+        {
+          link = &entry->next;
+        }
+      }
+    }
   }
+}
 
-  if ( socket_descriptor == -1 )
+/* with the lock held, the entry for key, queueing a lookup if it's stale */
+static cosm_NET_DNS_ENTRY * Cosm_NetDNSEntry( cosm_NET_RESOLVER * resolver,
+  const ascii * key, u32 hash, u64 now )
+{
+  cosm_NET_DNS_ENTRY * entry;
+
+  hash %= COSM_NET_DNS_TABLE;
+  entry = resolver->table[hash];
+  while ( ( entry != NULL )
+    && ( CosmStrCmp( entry->name, key, COSM_NET_MAX_HOSTNAME ) != 0 ) )
   {
-    /* unable to open the socket */
-    net->status = COSM_NET_STATUS_CLOSED;
-    return COSM_NET_ERROR_SOCKET;
+    entry = entry->next;
   }
 
-  if ( addr->type == COSM_NET_IPV4 )
+  if ( entry == NULL )
   {
-    addr_length = sizeof( addr4 );
-    CosmMemSet( &addr4, sizeof( addr4 ), 0 );
-    addr4.sin_family = AF_INET;
-    addr4.sin_port = htons( (u16) addr->port );
-    CosmU32Save( &addr4.sin_addr, &addr->ip.v4 );
-
-    if ( bind( socket_descriptor, (struct sockaddr *) &addr4,
-      addr_length ) == -1 )
+    if ( resolver->count >= COSM_NET_DNS_ENTRIES )
     {
-      /* unable to bind to the socket */
-      Cosm_NetClose( net );
-      return COSM_NET_ERROR_ADDRESS;
+      Cosm_NetDNSTrim( resolver, now );
+    }
+    if ( ( entry = CosmMemAlloc( sizeof( cosm_NET_DNS_ENTRY ) ) ) == NULL )
+    {
+      return NULL;
     }
+    CosmStrCopy( entry->name, key, COSM_NET_MAX_HOSTNAME );
+    entry->next = resolver->table[hash];
+    resolver->table[hash] = entry;
+    resolver->count++;
   }
-  else /* IPv6 */
+  else if ( ( entry->state != COSM_NET_DNS_DONE ) || ( now < entry->expires ) )
   {
-    addr_length = sizeof( addr6 );
-    CosmMemSet( &addr6, sizeof( addr6 ), 0 );
-    addr6.sin6_family = AF_INET6;
-    addr6.sin6_port = htons( (u16) addr->port );
-    CosmU128Save( &addr6.sin6_addr, &addr->ip.v6 );
+    /* being looked up already, or still good */
+    return entry;
+  }
 
-    if ( bind( socket_descriptor, (struct sockaddr *) &addr6,
-      addr_length ) == -1 )
+  entry->state = COSM_NET_DNS_QUEUED;
+  entry->queue = NULL;
+  if ( resolver->queue_tail == NULL )
+  {
+    resolver->queue = entry;
+  }
+  else
+  {
+    resolver->queue_tail->queue = entry;
+  }
+  resolver->queue_tail = entry;
+  CosmSemaphoreUp( &resolver->work );
+
+  return entry;
+}
+
+/* call back a list of waiters, without the lock */
+static void Cosm_NetDNSCall( cosm_NET_DNS_WAITER * waiter,
+  const ascii * name, const cosm_NET_ADDR * addr, u32 count, s32 status )
+{
+  cosm_NET_DNS_WAITER * next;
+  u32 allocated;
+
+  while ( waiter != NULL )
+  {
+    /* a waiter on a caller's stack is gone once it's called */
+    next = waiter->next;
+    allocated = waiter->allocated;
+    waiter->callback( waiter->arg, name, addr, count, status );
+    if ( allocated )
     {
-      /* unable to bind to the socket */
-      Cosm_NetClose( net );
-      return COSM_NET_ERROR_ADDRESS;
+      CosmMemFree( waiter );
     }
+    waiter = next;
   }
+}
 
-  /* For UDP connection we're done now */
-  if ( mode == COSM_NET_MODE_UDP )
+/* wake a CosmNetResolve caller */
+static void Cosm_NetDNSWake( void * arg, const ascii * name,
+  const cosm_NET_ADDR * addr, u32 count, s32 status )
+{
+  cosm_NET_DNS_WAIT * wait;
+
+  wait = (cosm_NET_DNS_WAIT *) arg;
+  if ( count > wait->count )
   {
-    net->my_addr.port = addr->port;
+    count = wait->count;
   }
-  else /* TCP */
+  if ( count > 0 )
   {
-    if ( listen( socket_descriptor, queue ) == -1 )
-    {
-      /* unable to listen to the socket */
-      Cosm_NetClose( net );
-      return COSM_NET_ERROR_SOCKET;
-    }
+    CosmMemCopy( wait->addr, addr, sizeof( cosm_NET_ADDR ) * count );
+  }
+  wait->found = count;
+  CosmSemaphoreUp( &wait->done );
+}
+
+/* query IDs from the OS random source, replies can't be forged by guessing */
+static s32 Cosm_NetDNSRandom( u16 * id, u32 count )
+{
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  return RtlGenRandom( id, count * sizeof( u16 ) ) ? COSM_PASS : COSM_FAIL;
+#else
+  ssize_t got;
+  int fd;
+
+  if ( ( fd = open( "/dev/urandom", O_RDONLY ) ) < 0 )
+  {
+    return COSM_FAIL;
+  }
+  got = read( fd, id, count * sizeof( u16 ) );
+  close( fd );
+
+  return ( got == (ssize_t) ( count * sizeof( u16 ) ) ) ? COSM_PASS
+    : COSM_FAIL;
+#endif
+}
+
+/* build a recursive query for name, 0 if it isn't a valid name */
+static u32 Cosm_NetDNSPacket( u8 * packet, u16 id, u16 type,
+  const ascii * name )
+{
+  u32 length, label, i;
+  u16 number;
+
+  CosmMemSet( packet, 12, 0 );
+  CosmU16Save( &packet[0], &id );
+  packet[2] = 0x01; /* recursion desired */
+  packet[5] = 1;    /* one question */
 
-    if ( addr->port == 0 )
+  label = 12;
+  length = 13;
+  for ( i = 0 ; ; i++ )
+  {
+    if ( ( name[i] == '.' ) || ( name[i] == 0 ) )
     {
-      if ( addr->type == COSM_NET_IPV4 )
+      if ( ( length - label ) == 1 )
       {
-        if ( getsockname( socket_descriptor, (struct sockaddr *)
-          &addr4, &addr_length ) == -1 )
+        /* empty label, only allowed as a trailing dot */
+        if ( ( name[i] == 0 ) && ( i > 0 ) )
         {
-          /* unable to get the port the socket is listenning on */
-          Cosm_NetClose( net );
-          return COSM_NET_ERROR_SOCKET;
+          length = label;
+          break;
         }
-        net->my_addr.port = ntohs( addr4.sin_port );
+        return 0;
       }
-      else /* IPv6 */
+      if ( ( length - label ) > 64 )
       {
-        if ( getsockname( socket_descriptor, (struct sockaddr *)
-          &addr6, &addr_length ) == -1 )
-        {
-          /* unable to get the port the socket is listenning on */
-          Cosm_NetClose( net );
-          return COSM_NET_ERROR_SOCKET;
-        }
-        net->my_addr.port = ntohs( addr6.sin6_port );
+        return 0;
       }
+      packet[label] = (u8) ( length - label - 1 );
+      if ( name[i] == 0 )
+      {
+        break;
+      }
+      label = length++;
     }
     else
     {
-      net->my_addr.port = addr->port;
+      packet[length++] = (u8) name[i];
+    }
+    if ( length > ( 12 + 255 ) )
+    {
+      return 0;
     }
   }
+  packet[length++] = 0;
 
-  net->my_addr.type = addr->type;
-  net->my_addr.ip.v6 = addr->ip.v6; /* ip.v6 copies both */
-  net->handle = (u64) socket_descriptor;
-  net->mode = mode;
-  net->status = COSM_NET_STATUS_LISTEN;
+  CosmU16Save( &packet[length], &type );
+  length += 2;
+  number = 1; /* class IN */
+  CosmU16Save( &packet[length], &number );
+  length += 2;
 
-  return COSM_PASS;
+  return length;
 }
 
-s32 CosmNetAccept( cosm_NET * new_connection, cosm_NET * net,
-  cosm_NET_ACL * acl, u32 wait )
+/* skip the name at pos, 0 if it runs off the end of the packet */
+static u32 Cosm_NetDNSSkip( const u8 * packet, u32 length, u32 pos )
 {
-  SOCKET socket_descriptor, new_socket_descriptor;
-  struct sockaddr_in client_address, local_address;
-  unsigned int client_address_length, local_address_length;
-  fd_set descriptors_settings;
-  struct timeval select_time;
-#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-  unsigned long flags;
-#else
-  int flags;
-#endif
-  int result;
-  s32 acl_test_result;
-  s32 error;
-
-  if ( ( net == NULL ) || ( new_connection == NULL ) )
+  while ( pos < length )
   {
-    return COSM_NET_ERROR_PARAM;
+    if ( packet[pos] == 0 )
+    {
+      return pos + 1;
+    }
+    if ( ( packet[pos] & 0xC0 ) == 0xC0 )
+    {
+      /* compressed, the rest is somewhere else */
+      return ( ( pos + 2 ) <= length ) ? pos + 2 : 0;
+    }
+    if ( ( packet[pos] & 0xC0 ) != 0 )
+    {
+      return 0;
+    }
+    pos += packet[pos] + 1;
   }
 
-  if ( net->status != COSM_NET_STATUS_LISTEN )
+  return 0;
+}
+
+/*
+  Read the answer to the query of query_length bytes, adding its addresses
+  to addr and lowering ttl to theirs, and negative to the zone's negative
+  TTL. Returns the DNS response code, or -1 if this isn't a usable answer
+  to the query.
+*/
+static s32 Cosm_NetDNSParse( cosm_NET_ADDR * addr, u32 * count, u32 max,
+  u32 * ttl, u32 * negative, const u8 * packet, u32 length,
+  const u8 * query, u32 query_length )
+{
+  u16 answers, authority, type, size;
+  u32 pos, i, found, record_ttl, answer_ttl, zone_ttl;
+  u8 a, b;
+
+  if ( ( length < query_length ) || ( packet[0] != query[0] )
+    || ( packet[1] != query[1] ) || ( ( packet[2] & 0x80 ) == 0 )
+    || ( packet[4] != 0 ) || ( packet[5] != 1 ) )
   {
-    return COSM_NET_ERROR_ORDER;
+    return -1;
   }
+  CosmU16Load( &answers, &packet[6] );
+  CosmU16Load( &authority, &packet[8] );
 
-  /* CosmNetAccept is not valid for UDP connections */
-  if ( net->mode != COSM_NET_MODE_TCP )
+  /* the one question must be ours, the name in any case */
+  for ( pos = 12 ; pos < ( query_length - 4 ) ; pos++ )
   {
-    return COSM_NET_ERROR_MODE;
+    a = ( ( packet[pos] >= 'A' ) && ( packet[pos] <= 'Z' ) )
+      ? packet[pos] + 32 : packet[pos];
+    b = ( ( query[pos] >= 'A' ) && ( query[pos] <= 'Z' ) )
+      ? query[pos] + 32 : query[pos];
+    if ( a != b )
+    {
+      return -1;
+    }
   }
-
-  flags = 0;
-
-#if ( defined( CPU_64BIT ) )
-  socket_descriptor = net->handle;
-#else
-  socket_descriptor = (u32) net->handle;
-#endif
-
-  if ( wait == COSM_NET_ACCEPT_NOWAIT )
+  if ( CosmMemCmp( &packet[pos], &query[pos], 4 ) != 0 )
   {
-    /* We want select to return immediately */
-    select_time.tv_sec = 0;
-    select_time.tv_usec = 0;
+    return -1;
+  }
+  pos += 4;
 
-    FD_ZERO( &descriptors_settings );
-    FD_SET( socket_descriptor, &descriptors_settings );
-    result = select( (int) socket_descriptor + 1, &descriptors_settings,
-      (fd_set *) NULL, (fd_set *) NULL, &select_time );
+  found = *count;
+  answer_ttl = *ttl;
+  zone_ttl = *negative;
+  for ( i = 0 ; i < ( (u32) answers + authority ) ; i++ )
+  {
+    if ( ( ( pos = Cosm_NetDNSSkip( packet, length, pos ) ) == 0 )
+      || ( ( pos + 10 ) > length ) )
+    {
+      return -1;
+    }
+    CosmU16Load( &type, &packet[pos] );
+    CosmU32Load( &record_ttl, &packet[pos + 4] );
+    CosmU16Load( &size, &packet[pos + 8] );
+    pos += 10;
+    if ( ( pos + size ) > length )
+    {
+      return -1;
+    }
 
-    if ( result < 1 )
+    if ( i < answers )
     {
-      if ( result == -1 )
+      /* A and AAAA records, CNAMEs on the way to them are skipped */
+      if ( ( found < max ) && ( ( ( type == 1 ) && ( size == 4 ) )
+        || ( ( type == 28 ) && ( size == 16 ) ) ) )
       {
-        /* Error with select */
-        error = COSM_NET_ERROR_SOCKET;
+        CosmMemSet( &addr[found], sizeof( cosm_NET_ADDR ), 0 );
+        if ( type == 1 )
+        {
+          addr[found].type = COSM_NET_IPV4;
+          CosmU32Load( &addr[found].ip.v4, &packet[pos] );
+        }
+        else
+        {
+          addr[found].type = COSM_NET_IPV6;
+          CosmU128Load( &addr[found].ip.v6, &packet[pos] );
+        }
+        found++;
+        if ( record_ttl < answer_ttl )
+        {
+          answer_ttl = record_ttl;
+        }
       }
-      else
+    }
+    else if ( ( type == 6 ) && ( size >= 22 ) )
+    {
+      /* SOA, negative answers are kept the lower of its TTL and minimum */
+      if ( record_ttl < zone_ttl )
       {
-        /* No connection waiting */
-        error = COSM_NET_ERROR_TIMEOUT;
+        zone_ttl = record_ttl;
+      }
+      CosmU32Load( &record_ttl, &packet[pos + size - 4] );
+      if ( record_ttl < zone_ttl )
+      {
+        zone_ttl = record_ttl;
       }
-      new_connection->status = COSM_NET_STATUS_CLOSED;
-      return error;
     }
+    pos += size;
+  }
 
-    /* Making sure we won't block on accept() if the connection is lost */
-#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-    flags = 1; /* set nonblocking mode */
-    if ( ioctlsocket( socket_descriptor, FIONBIO, &flags ) != 0 )
+  *count = found;
+  *ttl = answer_ttl;
+  *negative = zone_ttl;
+
+  return (s32) ( packet[3] & 0x0F );
+}
+
+/* ask the servers in turn for A and AAAA records, and how long to keep them */
+static s32 Cosm_NetDNSQuery( cosm_NET_ADDR * addr, u32 * count, u32 * ttl,
+  cosm_NET_RESOLVER * resolver, const ascii * name )
+{
+  cosm_NET net;
+  cosm_NET_ADDR local;
+  cosm_NET_PACKET query[2];
+  cosm_NET_PACKET reply;
+  cosm_NET_ADDR * server;
+  u8 packets[2][COSM_NET_DNS_PACKET];
+  u8 packet[COSM_NET_DNS_PACKET];
+  u64 now, deadline;
+  u32 attempt, i, sent, received, answered, good, negative;
+  u16 id[2];
+  s32 rcode, status;
+
+  *count = 0;
+  *ttl = resolver->ttl;
+  negative = resolver->negative_ttl;
+
+  CosmMemSet( query, sizeof( query ), 0 );
+  query[0].data = packets[0];
+  query[1].data = packets[1];
+  if ( ( Cosm_NetDNSRandom( id, 2 ) != COSM_PASS )
+    || ( ( query[0].length = Cosm_NetDNSPacket( packets[0], id[0], 1,
+    name ) ) == 0 ) || ( ( query[1].length = Cosm_NetDNSPacket( packets[1],
+    id[1], 28, name ) ) == 0 ) )
+  {
+    *ttl = resolver->negative_ttl;
+    return COSM_NET_ERROR_DNS;
+  }
+
+  status = COSM_NET_ERROR_TIMEOUT;
+  for ( attempt = 0 ;
+    attempt < ( COSM_NET_DNS_TRIES * resolver->server_count ) ; attempt++ )
+  {
+    server = &resolver->servers[attempt % resolver->server_count];
+    query[0].addr = *server;
+    query[1].addr = *server;
+
+    /* a new port for each attempt, replies to old ones won't get mixed in */
+    CosmMemSet( &net, sizeof( cosm_NET ), 0 );
+    CosmMemSet( &local, sizeof( cosm_NET_ADDR ), 0 );
+    local.type = server->type;
+    if ( ( CosmNetListen( &net, &local, COSM_NET_MODE_UDP, 0 ) != COSM_PASS )
+      || ( CosmNetSendUDPBatch( &sent, &net, query, 2 ) != COSM_PASS ) )
+    {
+      CosmNetClose( &net );
+      continue;
+    }
+
+    answered = 0;
+    good = 0;
+    deadline = CosmClockMono() + (u64) COSM_NET_DNS_WAIT * 1000000LL;
+    while ( ( answered != 3 ) && ( ( now = CosmClockMono() ) < deadline ) )
+    {
+      CosmMemSet( &reply, sizeof( reply ), 0 );
+      reply.data = packet;
+      reply.size = sizeof( packet );
+      if ( CosmNetRecvUDPBatch( &received, &reply, &net, 1, NULL,
+        (u32) ( ( deadline - now ) / 1000000LL ) + 1 ) != COSM_PASS )
+      {
+        break;
+      }
+      if ( ( received == 0 ) || ( reply.addr.type != server->type )
+        || ( reply.addr.port != server->port )
+        || ( ( server->type == COSM_NET_IPV4 )
+        && ( reply.addr.ip.v4 != server->ip.v4 ) )
+        || ( ( server->type == COSM_NET_IPV6 )
+        && ( !CosmU128Eq( reply.addr.ip.v6, server->ip.v6 ) ) ) )
+      {
+        continue;
+      }
+      for ( i = 0 ; i < 2 ; i++ )
+      {
+        if ( ( ( answered & ( 1 << i ) ) == 0 )
+          && ( ( rcode = Cosm_NetDNSParse( addr, count, COSM_NET_DNS_ADDRS,
+          ttl, &negative, packet, reply.length, packets[i],
+          query[i].length ) ) >= 0 ) )
+        {
+          answered |= 1 << i;
+          /* no error, or no such name */
+          if ( ( rcode == 0 ) || ( rcode == 3 ) )
+          {
+            good |= 1 << i;
+          }
+        }
+      }
+    }
+    CosmNetClose( &net );
+
+    if ( *count > 0 )
     {
-      /* Unable to set flags of the socket to non-blocking */
-      new_connection->status = COSM_NET_STATUS_CLOSED;
-      return COSM_NET_ERROR_SOCKET;
+      return COSM_PASS;
     }
-#else
-    /* Change the socket's flags - Turn off blocking */
-    flags = fcntl( socket_descriptor, F_GETFL, 0 );
-    flags = flags | O_NONBLOCK;
-    if ( fcntl( socket_descriptor, F_SETFL, flags ) != 0 )
+    if ( good == 3 )
     {
-      /* Unable to set flags of the socket to non-blocking */
-      new_connection->status = COSM_NET_STATUS_CLOSED;
-      return COSM_NET_ERROR_SOCKET;
+      /* the server says there are no addresses */
+      *ttl = negative;
+      return COSM_NET_ERROR_DNS;
+    }
+    if ( answered != 0 )
+    {
+      status = COSM_NET_ERROR_DNS;
     }
-#endif
   }
 
-  client_address_length = sizeof( client_address );
+  *ttl = resolver->negative_ttl;
+  return status;
+}
 
-  /* we loop if wait != COSM_NET_ACCEPT_NOWAIT and ACL failed. */
-  do
-  {
-    /* accept() the connection ... */
-    new_socket_descriptor = (int) accept( socket_descriptor,
-      (struct sockaddr *) &client_address, &client_address_length );
+void Cosm_NetDNSWorker( void * arg )
+{
+  cosm_NET_RESOLVER * resolver;
+  cosm_NET_DNS_ENTRY * entry;
+  cosm_NET_DNS_WAITER * waiters;
+  cosm_NET_ADDR addr[COSM_NET_DNS_ADDRS];
+  ascii name[COSM_NET_MAX_HOSTNAME];
+  u32 count, ttl;
+  s32 status;
 
-    /* if we connected ... */
-    if ( new_socket_descriptor == -1 )
+  resolver = (cosm_NET_RESOLVER *) arg;
+
+  for ( ; ; )
+  {
+    CosmSemaphoreDown( &resolver->work, COSM_SEMAPHORE_WAIT );
+    CosmMutexLock( &resolver->lock, COSM_MUTEX_WAIT );
+    if ( resolver->stop )
     {
-      new_connection->status = COSM_NET_STATUS_CLOSED;
-      return COSM_NET_ERROR_SOCKET;
+      resolver->threads--;
+      CosmMutexUnlock( &resolver->lock );
+      return;
     }
-    else
+    if ( ( entry = resolver->queue ) == NULL )
     {
-      new_connection->addr.type = COSM_NET_IPV4;
-      new_connection->addr.ip.v4
-        = ntohl( client_address.sin_addr.s_addr );
-      new_connection->addr.port = ntohs( client_address.sin_port );
-
-      /* Make sure the host is allowed by ACL masks */
-      acl_test_result = CosmNetACLCheck( acl, &new_connection->addr );
-      if ( acl_test_result == COSM_NET_DENY )
-      {
-        close( new_socket_descriptor );
-      }
+      CosmMutexUnlock( &resolver->lock );
+      continue;
     }
-  } while ( ( acl_test_result == COSM_NET_DENY )
-    && ( wait != COSM_NET_ACCEPT_NOWAIT ) );
-
-  new_connection->handle = (u64) new_socket_descriptor;
+    if ( ( resolver->queue = entry->queue ) == NULL )
+    {
+      resolver->queue_tail = NULL;
+    }
+    entry->state = COSM_NET_DNS_RUNNING;
+    CosmStrCopy( name, entry->name, COSM_NET_MAX_HOSTNAME );
+    resolver->lookups++;
+    CosmMutexUnlock( &resolver->lock );
 
-  if ( wait == COSM_NET_ACCEPT_NOWAIT )
-  {
-    /*
-      The old socket need to be set blocking again in case the next
-      call to CosmNetListen() is with COSM_NET_ACCEPT_WAIT
-    */
-#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-    flags = 0; /* (re)set blocking mode */
-    if ( ioctlsocket( socket_descriptor, FIONBIO, &flags ) == -1 )
+    if ( resolver->server_count == 0 )
     {
-      /* Unable to reset flags of the listenning socket to blocking */
-      new_connection->status = COSM_NET_STATUS_CLOSED;
-      return COSM_NET_ERROR_SOCKET;
+      count = Cosm_NetDNSSystem( addr, COSM_NET_DNS_ADDRS, name, 0 );
+      status = ( count > 0 ) ? COSM_PASS : COSM_NET_ERROR_DNS;
+      ttl = ( count > 0 ) ? resolver->ttl : resolver->negative_ttl;
     }
-    if ( new_socket_descriptor > 0 )
+    else
     {
-      if ( ioctlsocket( new_socket_descriptor, FIONBIO, &flags ) == -1 )
+      status = Cosm_NetDNSQuery( addr, &count, &ttl, resolver, name );
+      if ( ( status != COSM_PASS ) && ( ttl > resolver->negative_ttl ) )
       {
-        /* Unable to set flags of the new socket to blocking */
-        new_connection->status = COSM_NET_STATUS_CLOSED;
-        return COSM_NET_ERROR_SOCKET;
+        ttl = resolver->negative_ttl;
       }
     }
-#else
-    flags = flags & ~O_NONBLOCK;
-    if ( fcntl( socket_descriptor, F_SETFL, flags ) == -1 )
+
+    CosmMutexLock( &resolver->lock, COSM_MUTEX_WAIT );
+    if ( count > 0 )
     {
-      /* Unable to reset flags of the listenning socket to blocking */
-      new_connection->status = COSM_NET_STATUS_CLOSED;
-      return COSM_NET_ERROR_SOCKET;
-      /* The new connection may still be open, lets continue */
+      CosmMemCopy( entry->addr, addr, sizeof( cosm_NET_ADDR ) * count );
     }
-#endif
+    entry->count = count;
+    entry->status = status;
+    entry->expires = CosmClockMono() + (u64) ttl * 1000000000LL;
+    entry->state = COSM_NET_DNS_DONE;
+    waiters = entry->waiters;
+    entry->waiters = NULL;
+    CosmMutexUnlock( &resolver->lock );
+
+    Cosm_NetDNSCall( waiters, name, addr, count, status );
   }
+}
 
-  /* We have nothing more to do with net */
+s32 CosmNetResolverInit( cosm_NET_RESOLVER * resolver,
+  const cosm_NET_ADDR * servers, u32 server_count, u32 threads,
+  u32 ttl, u32 negative_ttl )
+{
+  u64 thread_id;
+  u32 i;
 
-  /* check that we got a connection */
-  if ( new_socket_descriptor == -1 )
+  if ( ( resolver == NULL ) || ( threads == 0 )
+    || ( server_count > COSM_NET_DNS_SERVERS )
+    || ( ( server_count > 0 ) && ( servers == NULL ) ) )
   {
-    /* Unable to accept a client - some error ? */
-    /* On NOWAIT, may be a lost connection between select() and accept() */
-    new_connection->status = COSM_NET_STATUS_CLOSED;
-    return COSM_NET_ERROR_CLOSED;
+    return COSM_NET_ERROR_PARAM;
   }
 
-  if ( wait == COSM_NET_ACCEPT_NOWAIT )
+  if ( Cosm_NetGlobalInit() != COSM_PASS )
   {
-    /* The new socket must also be set to blocking */
-#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
-    flags = 0;
-    if ( ioctlsocket( new_socket_descriptor, FIONBIO, &flags ) == -1 )
+    return COSM_NET_ERROR_NO_NET;
+  }
+
+  CosmMemSet( resolver, sizeof( cosm_NET_RESOLVER ), 0 );
+  if ( CosmMutexInit( &resolver->lock ) != COSM_PASS )
+  {
+    return COSM_NET_ERROR_FATAL;
+  }
+  if ( CosmSemaphoreInit( &resolver->work, 0 ) != COSM_PASS )
+  {
+    CosmMutexFree( &resolver->lock );
+    return COSM_NET_ERROR_FATAL;
+  }
+
+  for ( i = 0 ; i < server_count ; i++ )
+  {
+    resolver->servers[i] = servers[i];
+  }
+  resolver->server_count = server_count;
+  resolver->ttl = ttl;
+  resolver->negative_ttl = negative_ttl;
+
+  CosmMutexLock( &resolver->lock, COSM_MUTEX_WAIT );
+  for ( i = 0 ; i < threads ; i++ )
+  {
+    if ( CosmThreadBegin( &thread_id, Cosm_NetDNSWorker, resolver,
+      128 * 1024 ) != COSM_PASS )
     {
-      /* Unable to set flags of the new socket to blocking */
-      new_connection->status = COSM_NET_STATUS_CLOSED;
-      return COSM_NET_ERROR_CLOSED;
+      break;
     }
-#else
-    /* Change the new socket's flags - Turn on blocking */
-    flags = fcntl( new_socket_descriptor, F_GETFL, 0 );
-    flags = flags & ~O_NONBLOCK;
-    if ( fcntl( new_socket_descriptor, F_SETFL, flags ) == -1 )
+    resolver->threads++;
+  }
+  CosmMutexUnlock( &resolver->lock );
+
+  if ( i == 0 )
+  {
+    CosmSemaphoreFree( &resolver->work );
+    CosmMutexFree( &resolver->lock );
+    return COSM_NET_ERROR_FATAL;
+  }
+
+  return COSM_PASS;
+}
+
+u32 CosmNetResolve( cosm_NET_ADDR * addr, u32 count,
+  cosm_NET_RESOLVER * resolver, const ascii * name )
+{
+  ascii key[COSM_NET_MAX_HOSTNAME];
+  cosm_NET_DNS_ENTRY * entry;
+  cosm_NET_DNS_WAITER waiter;
+  cosm_NET_DNS_WAIT wait;
+  u32 hash, found;
+
+  if ( ( addr == NULL ) || ( count == 0 ) || ( resolver == NULL )
+    || ( name == NULL ) || ( Cosm_NetDNSKey( key, &hash, name ) != COSM_PASS ) )
+  {
+    return 0;
+  }
+
+  /* IP addresses need no lookup */
+  if ( ( found = Cosm_NetDNSSystem( addr, count, name, AI_NUMERICHOST ) )
+    > 0 )
+  {
+    return found;
+  }
+
+  if ( CosmMutexLock( &resolver->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    return 0;
+  }
+  if ( ( entry = Cosm_NetDNSEntry( resolver, key, hash, CosmClockMono() ) )
+    == NULL )
+  {
+    CosmMutexUnlock( &resolver->lock );
+    return 0;
+  }
+
+  if ( entry->state == COSM_NET_DNS_DONE )
+  {
+    found = ( entry->count < count ) ? entry->count : count;
+    if ( found > 0 )
     {
-      /* Unable to set flags of the new socket to blocking */
-      new_connection->status = COSM_NET_STATUS_CLOSED;
-      return COSM_NET_ERROR_CLOSED;
+      CosmMemCopy( addr, entry->addr, sizeof( cosm_NET_ADDR ) * found );
     }
-#endif
+    CosmMutexUnlock( &resolver->lock );
+    return found;
   }
 
-  /* verify which address the client has connected to */
-  local_address_length = sizeof( local_address );
-  if ( getsockname( new_socket_descriptor, (struct sockaddr *)
-    &local_address, &local_address_length ) == -1 )
+  /* wait for the worker looking it up */
+  CosmMemSet( &wait, sizeof( wait ), 0 );
+  if ( CosmSemaphoreInit( &wait.done, 0 ) != COSM_PASS )
   {
-    /* unable to get the local address and port of the socket */
-    new_connection->status = COSM_NET_STATUS_CLOSED;
-    return COSM_NET_ERROR_CLOSED;
+    CosmMutexUnlock( &resolver->lock );
+    return 0;
   }
+  wait.addr = addr;
+  wait.count = count;
+  waiter.callback = Cosm_NetDNSWake;
+  waiter.arg = &wait;
+  waiter.allocated = 0;
+  waiter.next = entry->waiters;
+  entry->waiters = &waiter;
+  CosmMutexUnlock( &resolver->lock );
 
-  /* Filling the new connection cosm_NET struct */
-  new_connection->my_addr.type = COSM_NET_IPV4;
-  new_connection->my_addr.ip.v4 = ntohl( local_address.sin_addr.s_addr );
-  new_connection->my_addr.port = ntohs( local_address.sin_port );
-  new_connection->mode = COSM_NET_MODE_TCP;
+  CosmSemaphoreDown( &wait.done, COSM_SEMAPHORE_WAIT );
+  CosmSemaphoreFree( &wait.done );
 
-  new_connection->status = COSM_NET_STATUS_OPEN;
-  return COSM_PASS;
+  return wait.found;
 }
 
-s32 CosmNetClose( cosm_NET * net )
+s32 CosmNetResolveAsync( cosm_NET_RESOLVER * resolver, const ascii * name,
+  cosm_NET_DNS_CALLBACK callback, void * arg )
 {
-  s32 error;
+  ascii key[COSM_NET_MAX_HOSTNAME];
+  cosm_NET_ADDR addr[COSM_NET_DNS_ADDRS];
+  cosm_NET_DNS_ENTRY * entry;
+  cosm_NET_DNS_WAITER * waiter;
+  u32 hash, count;
+  s32 status;
 
-  if ( net == NULL )
+  if ( ( resolver == NULL ) || ( name == NULL ) || ( callback == NULL )
+    || ( Cosm_NetDNSKey( key, &hash, name ) != COSM_PASS ) )
   {
     return COSM_NET_ERROR_PARAM;
   }
 
-  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  if ( ( count = Cosm_NetDNSSystem( addr, COSM_NET_DNS_ADDRS, name,
+    AI_NUMERICHOST ) ) > 0 )
   {
-    net->status = COSM_NET_STATUS_CLOSED;
-    return COSM_NET_ERROR_NO_NET;
+    callback( arg, name, addr, count, COSM_PASS );
+    return COSM_PASS;
   }
 
-  error = Cosm_NetClose( net );
+  if ( CosmMutexLock( &resolver->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    return COSM_NET_ERROR_PARAM;
+  }
+  if ( ( entry = Cosm_NetDNSEntry( resolver, key, hash, CosmClockMono() ) )
+    == NULL )
+  {
+    CosmMutexUnlock( &resolver->lock );
+    return COSM_NET_ERROR_FATAL;
+  }
 
-  return error;
+  if ( entry->state == COSM_NET_DNS_DONE )
+  {
+    count = entry->count;
+    status = entry->status;
+    if ( count > 0 )
+    {
+      CosmMemCopy( addr, entry->addr, sizeof( cosm_NET_ADDR ) * count );
+    }
+    CosmMutexUnlock( &resolver->lock );
+    callback( arg, name, addr, count, status );
+    return COSM_PASS;
+  }
+
+  if ( ( waiter = CosmMemAlloc( sizeof( cosm_NET_DNS_WAITER ) ) ) == NULL )
+  {
+    CosmMutexUnlock( &resolver->lock );
+    return COSM_NET_ERROR_FATAL;
+  }
+  waiter->callback = callback;
+  waiter->arg = arg;
+  waiter->allocated = 1;
+  waiter->next = entry->waiters;
+  entry->waiters = waiter;
+  CosmMutexUnlock( &resolver->lock );
+
+  return COSM_PASS;
 }
 
-u32 CosmNetDNS( cosm_NET_ADDR * addr, u32 count, ascii * name )
+s32 CosmNetResolverFree( cosm_NET_RESOLVER * resolver )
 {
-  struct addrinfo hint, * entry, * addr_list;
-  u32 found;
+  cosm_NET_DNS_ENTRY * entry, * next;
+  u32 i, threads;
 
-  if ( ( addr == NULL ) || ( count == 0 ) || ( name == NULL ) )
+  if ( resolver == NULL )
   {
-    return 0;
+    return COSM_NET_ERROR_PARAM;
   }
 
-  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  if ( CosmMutexLock( &resolver->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
   {
-    return 0;
+    return COSM_NET_ERROR_ORDER;
   }
+  resolver->stop = 1;
+  threads = resolver->threads;
+  CosmMutexUnlock( &resolver->lock );
 
-  /* hint for just 1 version of each IP */
-  CosmMemSet( &hint, sizeof( hint ), 0 );
-  hint.ai_family = PF_UNSPEC;
-  hint.ai_socktype = SOCK_STREAM;
-  if ( getaddrinfo( name, NULL, &hint, &addr_list ) != 0 )
+  /* wake every worker, each finishes what it's doing and stops */
+  for ( i = 0 ; i < threads ; i++ )
   {
-    return 0;
+    CosmSemaphoreUp( &resolver->work );
+  }
+  while ( threads > 0 )
+  {
+    CosmSleep( 1 );
+    CosmMutexLock( &resolver->lock, COSM_MUTEX_WAIT );
+    threads = resolver->threads;
+    CosmMutexUnlock( &resolver->lock );
   }
 
-  found = 0;
-  entry = addr_list;
-  while ( ( entry != NULL ) && ( found < count ) )
+  for ( i = 0 ; i < COSM_NET_DNS_TABLE ; i++ )
   {
-    if ( ( entry->ai_family == PF_INET )
-      && ( ( (struct sockaddr_in *) entry->ai_addr )->sin_family
-      == AF_INET ) )
+    for ( entry = resolver->table[i] ; entry != NULL ; entry = next )
     {
-      /* IPv4 */
-      addr[found].type = COSM_NET_IPV4;
-      addr[found].port = 0;
-      /* set the ipv6 to avoid uninitilized memory warnings */
-      addr[found].ip.v6.hi = 0;
-      addr[found].ip.v6.lo = 0;
-      CosmU32Load( &addr[found].ip.v4,
-        &( ( (struct sockaddr_in *) entry->ai_addr )->sin_addr ) );
-      found++;
+      next = entry->next;
+      Cosm_NetDNSCall( entry->waiters, entry->name, entry->addr, 0,
+        COSM_NET_ERROR_CLOSED );
+      CosmMemFree( entry );
     }
-    else if ( ( entry->ai_family == PF_INET6 )
-      && ( ( (struct sockaddr_in6 *) entry->ai_addr )->sin6_family
-      == AF_INET6 ) )
+  }
+
+  CosmSemaphoreFree( &resolver->work );
+  CosmMutexFree( &resolver->lock );
+  CosmMemSet( resolver, sizeof( cosm_NET_RESOLVER ), 0 );
+
+  return COSM_PASS;
+}
+
+/* the resolver CosmNetDNS shares, started by the first caller to need it */
+static cosm_NET_RESOLVER * Cosm_NetDNSShared( void )
+{
+  cosm_NET_RESOLVER * resolver;
+
+  resolver = (cosm_NET_RESOLVER *)
+    CosmAtomicLoadPtr( (void * const *) &__cosm_net_dns );
+  if ( resolver != NULL )
+  {
+    return resolver;
+  }
+
+  if ( CosmAtomicAdd32( &__cosm_net_dns_claim, 1 ) == 1 )
+  {
+    if ( ( ( resolver = CosmMemAlloc( sizeof( cosm_NET_RESOLVER ) ) )
+      != NULL ) && ( CosmNetResolverInit( resolver, NULL, 0, 2,
+      COSM_NET_DNS_TTL, COSM_NET_DNS_NEG_TTL ) != COSM_PASS ) )
     {
-      /* IPv6 */
-      addr[found].type = COSM_NET_IPV6;
-      addr[found].port = 0;
-      CosmU128Load( &addr[found].ip.v6,
-        &( ( (struct sockaddr_in6 *) entry->ai_addr )->sin6_addr ) );
-      found++;
+      CosmMemFree( resolver );
+      resolver = NULL;
+    }
+    if ( resolver == NULL )
+    {
+      CosmAtomicAdd32( &__cosm_net_dns_failed, 1 );
+      return NULL;
     }
+    CosmAtomicStorePtr( (void **) &__cosm_net_dns, resolver );
+    return resolver;
+  }
+
+  /* another thread is starting it */
+  while ( ( ( resolver = (cosm_NET_RESOLVER *)
+    CosmAtomicLoadPtr( (void * const *) &__cosm_net_dns ) ) == NULL )
+    && ( CosmAtomicLoad32( &__cosm_net_dns_failed ) == 0 ) )
+  {
+    CosmYield();
+  }
+
+  return resolver;
+}
+
+u32 CosmNetDNS( cosm_NET_ADDR * addr, u32 count, ascii * name )
+{
+  cosm_NET_RESOLVER * resolver;
+  u32 found;
+
+  if ( ( addr == NULL ) || ( count == 0 ) || ( name == NULL ) )
+  {
+    return 0;
+  }
 
-    entry = entry->ai_next;
+  /* IP addresses need no lookup, or resolver */
+  if ( ( found = Cosm_NetDNSSystem( addr, count, name, AI_NUMERICHOST ) )
+    > 0 )
+  {
+    return found;
   }
 
-  freeaddrinfo( addr_list );
+  if ( ( resolver = Cosm_NetDNSShared() ) == NULL )
+  {
+    /* no worker threads, look it up ourselves */
+    return Cosm_NetDNSSystem( addr, count, name, 0 );
+  }
 
-  return found;
+  return CosmNetResolve( addr, count, resolver, name );
 }
 
 s32 CosmNetRevDNS( cosm_NET_HOSTNAME * name, const cosm_NET_ADDR * addr )
@@ -1569,185 +4053,628 @@ u32 CosmNetMyIP( cosm_NET_ADDR * addr, u32 count )
     current = current->ifa_next;
   }
 
-  freeifaddrs( head );
-#elif ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
-  /* Use netlink interface supported in Linux 2.2+ */
-  int sock;
-  int length;
-  struct nl_req
+  freeifaddrs( head );
+#elif ( ( OS_TYPE == OS_LINUX ) || ( OS_TYPE == OS_ANDROID ) )
+  /* Use netlink interface supported in Linux 2.2+ */
+  int sock;
+  int length;
+  struct nl_req
+  {
+    struct nlmsghdr header;
+    struct ifaddrmsg msg;
+  } request;
+  struct nlmsghdr * header;
+  struct ifaddrmsg * address_msg;
+  struct rtattr * rt_addr;
+  int rt_addr_length;
+  u8 buffer[32 * 1024];
+
+  CosmMemSet( &request, sizeof(request), 0 );
+  /* Request address information */
+  request.header.nlmsg_len = NLMSG_ALIGN(
+    NLMSG_LENGTH( sizeof(request) ) );
+  request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_ROOT | NLM_F_MATCH;
+  request.header.nlmsg_type = RTM_GETADDR;
+  request.header.nlmsg_pid = getpid();
+  /* IPv4 and IPv6 addresses for all interfaces */
+  request.msg.ifa_family = AF_UNSPEC;
+  request.msg.ifa_index = 0;
+
+  if ( ( sock = socket( PF_NETLINK, SOCK_DGRAM, NETLINK_ROUTE ) ) == -1 )
+  {
+    return 0;
+  }
+
+  if ( send( sock, &request, request.header.nlmsg_len, 0 ) == -1 )
+  {
+    close( sock );
+    return 0;
+  }
+
+  while ( ( length = recv( sock, buffer, sizeof( buffer ), 0 ) ) > 0 )
+  {
+    header = (struct nlmsghdr *) buffer;
+    while ( NLMSG_OK( header, length ) )
+    {
+      switch ( header->nlmsg_type )
+      {
+        case RTM_NEWADDR:
+          address_msg = (struct ifaddrmsg *) NLMSG_DATA( header );
+          if ( address_msg->ifa_family == AF_INET )
+          {
+            addr[found].type = COSM_NET_IPV4;
+          }
+          else if ( address_msg->ifa_family == AF_INET6 )
+          {
+            addr[found].type = COSM_NET_IPV6;
+          }
+          else
+          {
+            break;
+          }
+          addr[found].port = 0;
+          rt_addr = (struct rtattr *) IFA_RTA( address_msg );
+          rt_addr_length = IFA_PAYLOAD( header );
+          while ( RTA_OK( rt_addr, rt_addr_length ) )
+          {
+            if ( rt_addr->rta_type == IFA_ADDRESS )
+            {
+              if ( addr[found].type == COSM_NET_IPV4 )
+              {
+                CosmU32Load( &addr[found].ip.v4, RTA_DATA( rt_addr ) );
+              }
+              else
+              {
+                CosmU128Load( &addr[found].ip.v6, RTA_DATA( rt_addr ) );
+              }
+              found++;
+            }
+            rt_addr = RTA_NEXT( rt_addr, rt_addr_length );
+          }
+          break;
+        case NLMSG_DONE:
+        case NLMSG_ERROR:
+          close( sock );
+          return found;
+      }
+      header = NLMSG_NEXT( header, length );
+    }
+  }
+  close( sock );
+#else /* no getifaddrs or ipv6 */
+  cosm_NET_HOSTNAME my_name;
+
+  if ( ( addr == NULL ) || ( count == 0 ) )
+  {
+    return 0;
+  }
+
+  if ( Cosm_NetGlobalInit() != COSM_PASS )
+  {
+    return 0;
+  }
+
+  if ( gethostname( (char *) my_name, sizeof( my_name ) ) == -1 )
+  {
+    /* Can't get local hostname */
+    return 0;
+  }
+
+  if ( ( found = CosmNetDNS( addr, count, my_name ) ) == 0 )
+  {
+    /* Can't get IP matching local hostname */
+    return 0;
+  }
+#endif
+
+  return found;
+}
+
+#define COSM_NET_ACL_EMPTY   2    /* permission of a split node */
+#define COSM_NET_ACL_RETIRE  1024 /* retired nodes before waiting */
+
+static void Cosm_NetACLKey( u128 * key, u32 * max_bits,
+  const cosm_NET_ADDR * addr )
+{
+  if ( addr->type == COSM_NET_IPV4 )
+  {
+    key->hi = (u64) addr->ip.v4 << 32;
+    key->lo = 0;
+    *max_bits = 32;
+  }
+  else
+  {
+    *key = addr->ip.v6;
+    *max_bits = 128;
+  }
+}
+
+static u32 Cosm_NetACLBit( const u128 * key, u32 bit )
+{
+  /* bit 0 is the top bit */
+  if ( bit < 64 )
+  {
+    return (u32) ( key->hi >> ( 63 - bit ) ) & 1;
+  }
+  return (u32) ( key->lo >> ( 127 - bit ) ) & 1;
+}
+
+static u32 Cosm_NetACLMatch( const u128 * a, const u128 * b, u32 bits )
+{
+  /* do the top bits of a and b match */
+  if ( bits == 0 )
+  {
+    return 1;
+  }
+  if ( bits <= 64 )
+  {
+    return ( ( a->hi ^ b->hi ) >> ( 64 - bits ) ) == 0;
+  }
+  if ( a->hi != b->hi )
+  {
+    return 0;
+  }
+  return ( ( a->lo ^ b->lo ) >> ( 128 - bits ) ) == 0;
+}
+
+static void Cosm_NetACLMask( u128 * key, u32 bits )
+{
+  /* clear all but the top bits */
+  if ( bits == 0 )
+  {
+    key->hi = 0;
+    key->lo = 0;
+  }
+  else if ( bits < 64 )
+  {
+    key->hi &= ~( (u64) 0 ) << ( 64 - bits );
+    key->lo = 0;
+  }
+  else if ( bits == 64 )
+  {
+    key->lo = 0;
+  }
+  else if ( bits < 128 )
+  {
+    key->lo &= ~( (u64) 0 ) << ( 128 - bits );
+  }
+}
+
+static cosm_NET_ACL_NODE ** Cosm_NetACLRoot( cosm_NET_ACL * acl, u32 type )
+{
+  return ( type == COSM_NET_IPV4 ) ? &acl->v4 : &acl->v6;
+}
+
+static cosm_NET_ACL_NODE * Cosm_NetACLFind( cosm_NET_ACL_NODE * node,
+  const u128 * key, u32 bits )
+{
+  /* the node for exactly key/bits, writers only */
+  while ( ( node != NULL ) && ( node->bits <= bits )
+    && ( Cosm_NetACLMatch( &node->key, key, node->bits ) ) )
+  {
+    if ( node->bits == bits )
+    {
+      return node;
+    }
+    node = node->child[Cosm_NetACLBit( key, node->bits )];
+  }
+
+  return NULL;
+}
+
+/*
+  Changes copy the path from the root down to the change and publish the
+  new root in one store, so checks never see a half made change. New
+  nodes are chained on fresh in case the change fails part way, and the
+  nodes they replace on replaced, to be freed once no check can be using
+  them.
+*/
+
+static cosm_NET_ACL_NODE * Cosm_NetACLNode( cosm_NET_ACL_NODE ** fresh,
+  const cosm_NET_ACL_NODE * copy )
+{
+  cosm_NET_ACL_NODE * node;
+
+  if ( ( node = CosmMemAlloc( sizeof( cosm_NET_ACL_NODE ) ) ) == NULL )
+  {
+    return NULL;
+  }
+  if ( copy != NULL )
+  {
+    *node = *copy;
+  }
+  node->retired = *fresh;
+  *fresh = node;
+
+  return node;
+}
+
+static void Cosm_NetACLReplace( cosm_NET_ACL_NODE ** replaced,
+  cosm_NET_ACL_NODE * node )
+{
+  node->retired = *replaced;
+  *replaced = node;
+}
+
+static cosm_NET_ACL_NODE * Cosm_NetACLInsert( cosm_NET_ACL_NODE * node,
+  const cosm_NET_ACL_NODE * entry, cosm_NET_ACL_NODE ** fresh,
+  cosm_NET_ACL_NODE ** replaced )
+{
+  cosm_NET_ACL_NODE * copy;
+  cosm_NET_ACL_NODE * child;
+  u32 common, bit;
+
+  if ( node == NULL )
+  {
+    return Cosm_NetACLNode( fresh, entry );
+  }
+
+  common = ( node->bits < entry->bits ) ? node->bits : entry->bits;
+  bit = 0;
+  while ( ( bit < common ) && ( Cosm_NetACLBit( &node->key, bit )
+    == Cosm_NetACLBit( &entry->key, bit ) ) )
+  {
+    bit++;
+  }
+  common = bit;
+
+  if ( ( common == node->bits ) && ( common == entry->bits ) )
+  {
+    /* same prefix, replace the entry */
+    if ( ( copy = Cosm_NetACLNode( fresh, node ) ) == NULL )
+    {
+      return NULL;
+    }
+    copy->permission = entry->permission;
+    copy->expires = entry->expires;
+    copy->timer = entry->timer;
+    Cosm_NetACLReplace( replaced, node );
+    return copy;
+  }
+
+  if ( common == node->bits )
+  {
+    /* node is a prefix of the entry, go down */
+    bit = Cosm_NetACLBit( &entry->key, node->bits );
+    if ( ( ( child = Cosm_NetACLInsert( node->child[bit], entry, fresh,
+      replaced ) ) == NULL )
+      || ( ( copy = Cosm_NetACLNode( fresh, node ) ) == NULL ) )
+    {
+      return NULL;
+    }
+    copy->child[bit] = child;
+    Cosm_NetACLReplace( replaced, node );
+    return copy;
+  }
+
+  if ( common == entry->bits )
+  {
+    /* the entry is a prefix of node, goes above it */
+    if ( ( copy = Cosm_NetACLNode( fresh, entry ) ) == NULL )
+    {
+      return NULL;
+    }
+    copy->child[Cosm_NetACLBit( &node->key, entry->bits )] = node;
+    return copy;
+  }
+
+  /* they differ at common, split there */
+  if ( ( ( copy = Cosm_NetACLNode( fresh, NULL ) ) == NULL )
+    || ( ( child = Cosm_NetACLNode( fresh, entry ) ) == NULL ) )
+  {
+    return NULL;
+  }
+  copy->key = entry->key;
+  Cosm_NetACLMask( &copy->key, common );
+  copy->bits = common;
+  copy->permission = COSM_NET_ACL_EMPTY;
+  copy->child[Cosm_NetACLBit( &entry->key, common )] = child;
+  copy->child[Cosm_NetACLBit( &node->key, common )] = node;
+
+  return copy;
+}
+
+static cosm_NET_ACL_NODE * Cosm_NetACLRemove( cosm_NET_ACL_NODE * node,
+  const u128 * key, u32 bits, cosm_NET_ACL_NODE ** fresh,
+  cosm_NET_ACL_NODE ** replaced, u32 * failed )
+{
+  cosm_NET_ACL_NODE * copy;
+  cosm_NET_ACL_NODE * child;
+  u32 bit;
+
+  /* key/bits is known to be in the trie under node */
+  if ( node->bits == bits )
+  {
+    if ( ( node->child[0] != NULL ) && ( node->child[1] != NULL ) )
+    {
+      /* still needed to split its children */
+      if ( ( copy = Cosm_NetACLNode( fresh, node ) ) == NULL )
+      {
+        *failed = 1;
+        return node;
+      }
+      copy->permission = COSM_NET_ACL_EMPTY;
+      copy->timer = NULL;
+      Cosm_NetACLReplace( replaced, node );
+      return copy;
+    }
+    Cosm_NetACLReplace( replaced, node );
+    return ( node->child[0] != NULL ) ? node->child[0] : node->child[1];
+  }
+
+  bit = Cosm_NetACLBit( key, node->bits );
+  child = Cosm_NetACLRemove( node->child[bit], key, bits, fresh, replaced,
+    failed );
+  if ( *failed )
+  {
+    return node;
+  }
+
+  if ( ( child == NULL ) && ( node->permission == COSM_NET_ACL_EMPTY ) )
+  {
+    /* a split with one side left is not needed */
+    Cosm_NetACLReplace( replaced, node );
+    return node->child[bit ^ 1];
+  }
+
+  if ( ( copy = Cosm_NetACLNode( fresh, node ) ) == NULL )
+  {
+    *failed = 1;
+    return node;
+  }
+  copy->child[bit] = child;
+  Cosm_NetACLReplace( replaced, node );
+
+  return copy;
+}
+
+static void Cosm_NetACLReclaim( cosm_NET_ACL * acl )
+{
+  cosm_NET_ACL_NODE * node;
+  u32 old;
+
+  /*
+    New checks count themselves in the other half, once the checks in the
+    old half are done nothing can see the retired nodes.
+  */
+  old = CosmAtomicAdd32( &acl->epoch, 1 ) - 1;
+  while ( CosmAtomicLoad32( &acl->readers[old & 1] ) != 0 )
+  {
+    CosmYield();
+  }
+
+  while ( acl->retired != NULL )
+  {
+    node = acl->retired;
+    acl->retired = node->retired;
+    CosmMemFree( node );
+  }
+  acl->retired_count = 0;
+}
+
+static s32 Cosm_NetACLPublish( cosm_NET_ACL * acl, u32 type,
+  cosm_NET_ACL_NODE * root, cosm_NET_ACL_NODE * fresh,
+  cosm_NET_ACL_NODE * replaced, u32 failed )
+{
+  cosm_NET_ACL_NODE * node;
+
+  if ( failed )
+  {
+    /* nothing was published, the old trie is untouched */
+    while ( fresh != NULL )
+    {
+      node = fresh;
+      fresh = node->retired;
+      CosmMemFree( node );
+    }
+    return COSM_FAIL;
+  }
+
+  CosmAtomicStorePtr( (void **) Cosm_NetACLRoot( acl, type ), root );
+
+  while ( replaced != NULL )
+  {
+    node = replaced;
+    replaced = node->retired;
+    node->retired = acl->retired;
+    acl->retired = node;
+    acl->retired_count++;
+  }
+
+  if ( acl->retired_count >= COSM_NET_ACL_RETIRE )
   {
-    struct nlmsghdr header;
-    struct ifaddrmsg msg;
-  } request;
-  struct nlmsghdr * header;
-  struct ifaddrmsg * address_msg;
-  struct rtattr * rt_addr;
-  int rt_addr_length;
-  u8 buffer[32 * 1024];
+    Cosm_NetACLReclaim( acl );
+  }
 
-  CosmMemSet( &request, sizeof(request), 0 );
-  /* Request address information */
-  request.header.nlmsg_len = NLMSG_ALIGN(
-    NLMSG_LENGTH( sizeof(request) ) );
-  request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_ROOT | NLM_F_MATCH;
-  request.header.nlmsg_type = RTM_GETADDR;
-  request.header.nlmsg_pid = getpid();
-  /* IPv4 and IPv6 addresses for all interfaces */
-  request.msg.ifa_family = AF_UNSPEC;
-  request.msg.ifa_index = 0;
+  return COSM_PASS;
+}
 
-  if ( ( sock = socket( PF_NETLINK, SOCK_DGRAM, NETLINK_ROUTE ) ) == -1 )
+static s32 Cosm_NetACLDrop( cosm_NET_ACL * acl, u32 type, const u128 * key,
+  u32 bits )
+{
+  cosm_NET_ACL_NODE * fresh;
+  cosm_NET_ACL_NODE * replaced;
+  cosm_NET_ACL_NODE * root;
+  u32 failed;
+
+  root = *Cosm_NetACLRoot( acl, type );
+  fresh = NULL;
+  replaced = NULL;
+  failed = 0;
+  root = Cosm_NetACLRemove( root, key, bits, &fresh, &replaced, &failed );
+  if ( Cosm_NetACLPublish( acl, type, root, fresh, replaced, failed )
+    != COSM_PASS )
   {
-    return 0;
+    return COSM_FAIL;
   }
+  acl->count--;
 
-  if ( send( sock, &request, request.header.nlmsg_len, 0 ) == -1 )
+  return COSM_PASS;
+}
+
+static void Cosm_NetACLLink( cosm_NET_ACL * acl, cosm_NET_ACL_TIMER * timer )
+{
+  s64 second;
+
+  /* anything already expired goes in the next slot swept */
+  second = ( timer->expires.hi > acl->swept ) ? timer->expires.hi
+    : acl->swept + 1;
+  timer->slot = (u32) ( (u64) second % COSM_NET_ACL_WHEEL );
+  timer->prev = NULL;
+  timer->next = acl->wheel[timer->slot];
+  if ( timer->next != NULL )
   {
-    close( sock );
-    return 0;
+    timer->next->prev = timer;
   }
+  acl->wheel[timer->slot] = timer;
+}
 
-  while ( ( length = recv( sock, buffer, sizeof( buffer ), 0 ) ) > 0 )
+static void Cosm_NetACLUnlink( cosm_NET_ACL * acl, cosm_NET_ACL_TIMER * timer )
+{
+  if ( timer->prev != NULL )
   {
-    header = (struct nlmsghdr *) buffer;
-    while ( NLMSG_OK( header, length ) )
-    {
-      switch ( header->nlmsg_type )
-      {
-        case RTM_NEWADDR:
-          address_msg = (struct ifaddrmsg *) NLMSG_DATA( header );
-          if ( address_msg->ifa_family == AF_INET )
-          {
-            addr[found].type = COSM_NET_IPV4;
-          }
-          else if ( address_msg->ifa_family == AF_INET6 )
-          {
-            addr[found].type = COSM_NET_IPV6;
-          }
-          else
-          {
-            break;
-          }
-          addr[found].port = 0;
-          rt_addr = (struct rtattr *) IFA_RTA( address_msg );
-          rt_addr_length = IFA_PAYLOAD( header );
-          while ( RTA_OK( rt_addr, rt_addr_length ) )
-          {
-            if ( rt_addr->rta_type == IFA_ADDRESS )
-            {
-              if ( addr[found].type == COSM_NET_IPV4 )
-              {
-                CosmU32Load( &addr[found].ip.v4, RTA_DATA( rt_addr ) );
-              }
-              else
-              {
-                CosmU128Load( &addr[found].ip.v6, RTA_DATA( rt_addr ) );
-              }
-              found++;
-            }
-            rt_addr = RTA_NEXT( rt_addr, rt_addr_length );
-          }
-          break;
-        case NLMSG_DONE:
-        case NLMSG_ERROR:
-          close( sock );
-          return found;
-      }
-      header = NLMSG_NEXT( header, length );
-    }
+    timer->prev->next = timer->next;
   }
-  close( sock );
-#else /* no getifaddrs or ipv6 */
-  cosm_NET_HOSTNAME my_name;
-
-  if ( ( addr == NULL ) || ( count == 0 ) )
+  else
   {
-    return 0;
+    acl->wheel[timer->slot] = timer->next;
   }
+  if ( timer->next != NULL )
+  {
+    timer->next->prev = timer->prev;
+  }
+}
 
-  if ( Cosm_NetGlobalInit() != COSM_PASS )
+static void Cosm_NetACLSweep( cosm_NET_ACL * acl, const cosmtime * now )
+{
+  cosm_NET_ACL_TIMER * timer;
+  cosm_NET_ACL_TIMER * next;
+  s64 steps;
+
+  /* every slot for a whole second before now, at most once around */
+  steps = now->hi - 1 - acl->swept;
+  if ( steps > COSM_NET_ACL_WHEEL )
   {
-    return 0;
+    steps = COSM_NET_ACL_WHEEL;
   }
 
-  if ( gethostname( (char *) my_name, sizeof( my_name ) ) == -1 )
+  while ( steps-- > 0 )
   {
-    /* Can't get local hostname */
-    return 0;
+    next = acl->wheel[(u64) ( acl->swept + 1 + steps ) % COSM_NET_ACL_WHEEL];
+    while ( ( timer = next ) != NULL )
+    {
+      next = timer->next;
+      /* a later time around the wheel, or out of memory to try again */
+      if ( ( timer->expires.hi >= now->hi )
+        || ( Cosm_NetACLDrop( acl, timer->type, &timer->key, timer->bits )
+        != COSM_PASS ) )
+      {
+        continue;
+      }
+      Cosm_NetACLUnlink( acl, timer );
+      CosmMemFree( timer );
+    }
   }
 
-  if ( ( found = CosmNetDNS( addr, count, my_name ) ) == 0 )
+  acl->swept = now->hi - 1;
+}
+
+s32 CosmNetACLInit( cosm_NET_ACL * acl )
+{
+  if ( acl == NULL )
   {
-    /* Can't get IP matching local hostname */
-    return 0;
+    return COSM_FAIL;
   }
-#endif
 
-  return found;
+  return CosmMutexInit( &acl->lock );
 }
 
 s32 CosmNetACLAdd( cosm_NET_ACL * acl, const cosm_NET_ADDR * addr,
   u32 mask_bits, u32 permission, cosmtime expires )
 {
-  u32 i;
-  u64 size;
-  void * mem;
-
-  if ( ( acl == NULL ) || ( addr == NULL ) || ( mask_bits > 128 )
+  cosm_NET_ACL_NODE entry;
+  cosm_NET_ACL_NODE * fresh;
+  cosm_NET_ACL_NODE * replaced;
+  cosm_NET_ACL_NODE * root;
+  cosm_NET_ACL_NODE * node;
+  cosm_NET_ACL_TIMER * timer;
+  cosmtime now;
+  u32 max_bits;
+
+  if ( ( acl == NULL ) || ( addr == NULL )
     || ( ( permission != COSM_NET_ALLOW ) && ( permission != COSM_NET_DENY ) )
     || ( ( addr->type != COSM_NET_IPV4 ) && ( addr->type != COSM_NET_IPV6 ) ) )
   {
     return COSM_FAIL;
   }
 
-  CosmMutexLock( &acl->lock, COSM_MUTEX_WAIT );
+  CosmMemSet( &entry, sizeof( entry ), 0 );
+  Cosm_NetACLKey( &entry.key, &max_bits, addr );
+  if ( mask_bits > max_bits )
+  {
+    return COSM_FAIL;
+  }
+  Cosm_NetACLMask( &entry.key, mask_bits );
+  entry.bits = mask_bits;
+  entry.permission = permission;
+  entry.expires = expires;
+
+  if ( CosmMutexLock( &acl->lock, COSM_MUTEX_WAIT ) != COSM_PASS )
+  {
+    return COSM_FAIL;
+  }
 
-  if ( ( acl->count + 1 ) > acl->length )
+  if ( CosmSystemClock( &now ) == COSM_PASS )
   {
-    if ( acl->length == 0 )
+    if ( acl->swept == 0 )
     {
-      /* 16 at a time */
-      size = sizeof( cosm_NET_ACL_ENTRY ) << 4;
-      if ( ( mem = CosmMemAlloc( size ) ) == NULL )
-      {
-        CosmMutexUnlock( &acl->lock );
-        return COSM_FAIL;
-      }
-      acl->list = mem;
-      acl->length = 16;
+      acl->swept = now.hi - 1;
     }
-    else
+    Cosm_NetACLSweep( acl, &now );
+  }
+
+  root = *Cosm_NetACLRoot( acl, addr->type );
+  node = Cosm_NetACLFind( root, &entry.key, mask_bits );
+
+  /* a replaced entry keeps its timer, moved to the new time */
+  if ( ( node != NULL ) && ( node->timer != NULL ) )
+  {
+    timer = node->timer;
+  }
+  else if ( ( timer = CosmMemAlloc( sizeof( cosm_NET_ACL_TIMER ) ) ) == NULL )
+  {
+    CosmMutexUnlock( &acl->lock );
+    return COSM_FAIL;
+  }
+  entry.timer = timer;
+
+  fresh = NULL;
+  replaced = NULL;
+  root = Cosm_NetACLInsert( root, &entry, &fresh, &replaced );
+  if ( Cosm_NetACLPublish( acl, addr->type, root, fresh, replaced,
+    ( root == NULL ) ) != COSM_PASS )
+  {
+    if ( ( node == NULL ) || ( node->timer != timer ) )
     {
-      /* 16 at a time */
-      size = sizeof( cosm_NET_ACL_ENTRY ) * ( (u64) acl->length + 16LL );
-      if ( ( mem = CosmMemRealloc( acl->list, size ) ) == NULL )
-      {
-        CosmMutexUnlock( &acl->lock );
-        return COSM_FAIL;
-      }
-      acl->list = mem;
-      acl->length += 16;
+      CosmMemFree( timer );
     }
+    CosmMutexUnlock( &acl->lock );
+    return COSM_FAIL;
   }
 
-  i = acl->count++;
-  acl->list[i].expires = expires;
-  acl->list[i].addr = *addr;
-  acl->list[i].mask.type = addr->type;
-  acl->list[i].mask.port = addr->port;
-  if ( addr->type == COSM_NET_IPV4 )
+  if ( ( node != NULL ) && ( node->timer == timer ) )
   {
-    acl->list[i].mask.ip.v4 =
-      ( mask_bits == 0 ) ? 0 : ( 0xFFFFFFFF << ( 32 - mask_bits ) );
+    Cosm_NetACLUnlink( acl, timer );
   }
   else
   {
-    _COSM_SET128( acl->list[i].mask.ip.v6, FFFFFFFFFFFFFFFF,
-      FFFFFFFFFFFFFFFF );
-    acl->list[i].mask.ip.v6
-      = CosmU128Lsh( acl->list[i].mask.ip.v6, 128 - mask_bits );
+    timer->key = entry.key;
+    timer->bits = mask_bits;
+    timer->type = addr->type;
+    acl->count++;
   }
-  acl->list[i].permission = permission;
+  timer->expires = expires;
+  Cosm_NetACLLink( acl, timer );
 
   CosmMutexUnlock( &acl->lock );
   return COSM_PASS;
@@ -1756,11 +4683,14 @@ s32 CosmNetACLAdd( cosm_NET_ACL * acl, const cosm_NET_ADDR * addr,
 s32 CosmNetACLDelete( cosm_NET_ACL * acl, const cosm_NET_ADDR * addr,
   u32 mask_bits )
 {
-  u32 i, j;
-  cosm_NET_ACL_ENTRY * list;
-  cosm_NET_ADDR mask;
+  cosm_NET_ACL_NODE * node;
+  cosm_NET_ACL_TIMER * timer;
+  u128 key;
+  u32 max_bits;
+  s32 result;
 
-  if ( ( acl == NULL ) || ( addr == NULL ) )
+  if ( ( acl == NULL ) || ( addr == NULL )
+    || ( ( addr->type != COSM_NET_IPV4 ) && ( addr->type != COSM_NET_IPV6 ) ) )
   {
     return COSM_FAIL;
   }
@@ -1770,101 +4700,136 @@ s32 CosmNetACLDelete( cosm_NET_ACL * acl, const cosm_NET_ADDR * addr,
     return COSM_PASS;
   }
 
-  CosmMutexLock( &acl->lock, COSM_MUTEX_WAIT );
+  Cosm_NetACLKey( &key, &max_bits, addr );
+  if ( mask_bits > max_bits )
+  {
+    return COSM_FAIL;
+  }
+  Cosm_NetACLMask( &key, mask_bits );
 
-  list = acl->list;
+  CosmMutexLock( &acl->lock, COSM_MUTEX_WAIT );
 
-  i = 0;
-  mask.ip.v4 = ( 0xFFFFFFFF << ( 32 - mask_bits ) );
-  do
+  result = COSM_PASS;
+  node = Cosm_NetACLFind( *Cosm_NetACLRoot( acl, addr->type ), &key,
+    mask_bits );
+  if ( ( node != NULL ) && ( node->permission != COSM_NET_ACL_EMPTY ) )
   {
-    if ( ( addr->ip.v4 == list[i].addr.ip.v4 )
-      && ( mask.ip.v4 == list[i].mask.ip.v4 ) )
-    {
-      for ( j = i ; j < ( acl->count - 1 ) ; j++ )
-      {
-        list[j] = list[j+1];
-      }
-      acl->count--;
-    }
-    else
+    timer = node->timer;
+    if ( ( result = Cosm_NetACLDrop( acl, addr->type, &key, mask_bits ) )
+      == COSM_PASS )
     {
-      i++;
+      Cosm_NetACLUnlink( acl, timer );
+      CosmMemFree( timer );
     }
-  } while ( i < acl->count );
+  }
 
   CosmMutexUnlock( &acl->lock );
-  return COSM_PASS;
+  return result;
 }
 
 s32 CosmNetACLCheck( cosm_NET_ACL * acl, const cosm_NET_ADDR * addr )
 {
-  u32 i, j;
+  cosm_NET_ACL_NODE * node;
+  cosmtime now;
+  u128 key;
+  u32 max_bits, epoch;
   s32 result;
-  cosm_NET_ACL_ENTRY * list;
-  cosmtime time;
 
   if ( acl == NULL )
   {
     return COSM_NET_ALLOW;
   }
 
-  if ( acl->count == 0 )
+  if ( ( acl->count == 0 ) || ( CosmSystemClock( &now ) != COSM_PASS ) )
   {
     return COSM_NET_ALLOW;
   }
 
-  list = acl->list;
-  result = COSM_NET_ALLOW;
+  /* once a second, whoever gets the lock first removes expired entries */
+  if ( ( now.hi > acl->swept + 1 )
+    && ( CosmMutexLock( &acl->lock, COSM_MUTEX_NOWAIT ) == COSM_PASS ) )
+  {
+    Cosm_NetACLSweep( acl, &now );
+    CosmMutexUnlock( &acl->lock );
+  }
 
-  if ( CosmSystemClock( &time ) == COSM_PASS )
+  /* count this check in the current half so nodes it sees stay */
+  for ( ; ; )
   {
-    i = 0;
+    epoch = CosmAtomicLoad32( &acl->epoch );
+    CosmAtomicAdd32( &acl->readers[epoch & 1], 1 );
+    if ( CosmAtomicLoad32( &acl->epoch ) == epoch )
+    {
+      break;
+    }
+    CosmAtomicAdd32( &acl->readers[epoch & 1], -1 );
+  }
 
-    CosmMutexLock( &acl->lock, COSM_MUTEX_WAIT );
+  Cosm_NetACLKey( &key, &max_bits, addr );
+  node = CosmAtomicLoadPtr( (void * const *)
+    Cosm_NetACLRoot( acl, addr->type ) );
+  result = COSM_NET_ALLOW;
 
-    do
+  /* the longest matching prefix is the last one passed on the way down */
+  while ( ( node != NULL ) && ( node->bits <= max_bits )
+    && ( Cosm_NetACLMatch( &node->key, &key, node->bits ) ) )
+  {
+    if ( ( node->permission != COSM_NET_ACL_EMPTY )
+      && ( !CosmS128Lt( node->expires, now ) ) )
     {
-      /* expired? */
-      if ( CosmS128Lt( list[i].expires, time ) )
-      {
-        for ( j = i ; j < ( acl->count - 1 ) ; j++ )
-        {
-          list[j] = list[j+1];
-        }
-        acl->count--;
-      }
-      else
-      {
-        /* match? */
-        if ( ( addr->ip.v4 & list[i].mask.ip.v4 )
-          == ( list[i].addr.ip.v4 & list[i].mask.ip.v4 ) )
-        {
-          result = list[i].permission;
-        }
-        i++;
-      }
-    } while ( i < acl->count );
-
-    CosmMutexUnlock( &acl->lock );
+      result = (s32) node->permission;
+    }
+    if ( node->bits == max_bits )
+    {
+      break;
+    }
+    node = node->child[Cosm_NetACLBit( &key, node->bits )];
   }
 
+  CosmAtomicAdd32( &acl->readers[epoch & 1], -1 );
+
   return result;
 }
 
+static void Cosm_NetACLFreeTrie( cosm_NET_ACL_NODE * node )
+{
+  if ( node == NULL )
+  {
+    return;
+  }
+  Cosm_NetACLFreeTrie( node->child[0] );
+  Cosm_NetACLFreeTrie( node->child[1] );
+  CosmMemFree( node );
+}
+
 void CosmNetACLFree( cosm_NET_ACL * acl )
 {
-  if ( acl == NULL )
+  cosm_NET_ACL_TIMER * timer;
+  u32 i;
+
+  if ( ( acl == NULL ) || ( acl->lock.state != COSM_MUTEX_STATE_INIT ) )
   {
     return;
   }
 
   CosmMutexLock( &acl->lock, COSM_MUTEX_WAIT );
 
-  acl->length = 0;
+  Cosm_NetACLReclaim( acl );
+  Cosm_NetACLFreeTrie( acl->v4 );
+  Cosm_NetACLFreeTrie( acl->v6 );
+  acl->v4 = NULL;
+  acl->v6 = NULL;
   acl->count = 0;
 
-  CosmMemFree( acl->list );
+  for ( i = 0 ; i < COSM_NET_ACL_WHEEL ; i++ )
+  {
+    while ( ( timer = acl->wheel[i] ) != NULL )
+    {
+      acl->wheel[i] = timer->next;
+      CosmMemFree( timer );
+    }
+  }
+  acl->swept = 0;
 
   CosmMutexUnlock( &acl->lock );
 }
@@ -1958,51 +4923,226 @@ Cosm_NetLogPacket( const cosm_NET_ADDR * addr, ascii * tag,
     {
       line = 16;
     }
-    else
+    else
+    {
+      line = length;
+    }
+
+    CosmPrintFile( &file, " " );
+    for ( i = 0 ; i < line ; i++ )
+    {
+      CosmPrintFile( &file, " %02X", data[i] );
+    }
+    for ( i = 0 ; i < ( 16 - line ) ; i++ )
+    {
+      CosmPrintFile( &file, "  ", data[i] );
+    }
+    CosmPrintFile( &file, " | " );
+    for ( i = 0 ; i < line ; i++ )
+    {
+      if ( ( data[i] < 0x80 ) && ( data[i] > 0x1F ) )
+      {
+        CosmPrintFile( &file, "%c", data[i] );
+      }
+      else
+      {
+        CosmPrintFile( &file, " ", data[i] );
+      }
+    }
+    data = &data[line];
+    length -= line;
+    CosmPrintFile( &file, "\n" );
+  }
+
+  CosmFileClose( &file );
+
+  return COSM_PASS;
+}
+#endif
+
+/* Testing */
+
+typedef struct cosm_NET_DNS_TEST
+{
+  cosm_NET net;
+  u32 queries;  /* questions answered */
+  u32 called;   /* callbacks with an address */
+  u32 stop;     /* 1 asks the server to stop, 2 once it has */
+} cosm_NET_DNS_TEST;
+
+static u32 Cosm_NetDNSTestRecord( u8 * data, u32 length, u16 type,
+  u32 ttl, const void * rdata, u16 size )
+{
+  u16 number;
+
+  data[length++] = 0xC0; /* the name in the question */
+  data[length++] = 0x0C;
+  CosmU16Save( &data[length], &type );
+  number = 1;
+  CosmU16Save( &data[length + 2], &number );
+  CosmU32Save( &data[length + 4], &ttl );
+  CosmU16Save( &data[length + 8], &size );
+  CosmMemCopy( &data[length + 10], rdata, size );
+
+  return length + 10 + size;
+}
+
+void Cosm_NetDNSTestServer( void * arg )
+{
+  cosm_NET_DNS_TEST * test;
+  cosm_NET_PACKET packet;
+  u8 data[COSM_NET_DNS_PACKET];
+  u8 rdata[22];
+  ascii name[64];
+  u32 received, sent, pos, length, ttl;
+  u16 type;
+  u128 ip6;
+
+  test = (cosm_NET_DNS_TEST *) arg;
+
+  while ( CosmAtomicLoad32( &test->stop ) == 0 )
+  {
+    CosmMemSet( &packet, sizeof( packet ), 0 );
+    packet.data = data;
+    packet.size = sizeof( data );
+    if ( CosmNetRecvUDPBatch( &received, &packet, &test->net, 1, NULL, 50 )
+      != COSM_PASS )
+    {
+      break;
+    }
+    if ( ( received == 0 ) || ( packet.length < 17 ) )
     {
-      line = length;
+      continue;
     }
 
-    CosmPrintFile( &file, " " );
-    for ( i = 0 ; i < line ; i++ )
+    /* the question's name as text */
+    pos = 12;
+    length = 0;
+    while ( ( pos < packet.length ) && ( data[pos] != 0 )
+      && ( ( length + data[pos] + 1 ) < sizeof( name ) ) )
     {
-      CosmPrintFile( &file, " %02X", data[i] );
+      if ( length > 0 )
+      {
+        name[length++] = '.';
+      }
+      CosmMemCopy( &name[length], &data[pos + 1], data[pos] );
+      length += data[pos];
+      pos += data[pos] + 1;
     }
-    for ( i = 0 ; i < ( 16 - line ) ; i++ )
+    name[length] = 0;
+    pos++;
+    if ( ( pos + 4 ) > packet.length )
     {
-      CosmPrintFile( &file, "  ", data[i] );
+      continue;
     }
-    CosmPrintFile( &file, " | " );
-    for ( i = 0 ; i < line ; i++ )
+    CosmU16Load( &type, &data[pos] );
+    CosmAtomicAdd32( &test->queries, 1 );
+
+    /* answer after the question, with no other records */
+    length = pos + 4;
+    data[2] = 0x81;
+    data[3] = 0x80;
+    CosmMemSet( &data[6], 6, 0 );
+
+    if ( CosmStrCmp( name, "slow.test", sizeof( name ) ) == 0 )
     {
-      if ( ( data[i] < 0x80 ) && ( data[i] > 0x1F ) )
+      CosmSleep( 200 );
+    }
+    if ( ( CosmStrCmp( name, "a.test", sizeof( name ) ) == 0 )
+      || ( CosmStrCmp( name, "slow.test", sizeof( name ) ) == 0 )
+      || ( CosmStrCmp( name, "zero.test", sizeof( name ) ) == 0 ) )
+    {
+      if ( type == 1 )
       {
-        CosmPrintFile( &file, "%c", data[i] );
+        rdata[0] = 10;
+        rdata[1] = ( name[0] == 's' ) ? 4 : 1;
+        rdata[2] = ( name[0] == 's' ) ? 5 : 2;
+        rdata[3] = ( name[0] == 's' ) ? 6 : 3;
+        ttl = ( name[0] == 'z' ) ? 0 : 30;
+        length = Cosm_NetDNSTestRecord( data, length, 1, ttl, rdata, 4 );
+        data[7] = 1;
       }
-      else
+      else if ( ( type == 28 ) && ( name[0] == 'a' ) )
       {
-        CosmPrintFile( &file, " ", data[i] );
+        _COSM_SET128( ip6, 20010DB800000000, 0000000000000001 );
+        CosmU128Save( rdata, &ip6 );
+        length = Cosm_NetDNSTestRecord( data, length, 28, 3600, rdata, 16 );
+        data[7] = 1;
       }
     }
-    data = &data[line];
-    length -= line;
-    CosmPrintFile( &file, "\n" );
+    else
+    {
+      /* NXDOMAIN, with an SOA saying to keep that for a minute */
+      data[3] |= 3;
+      CosmMemSet( rdata, sizeof( rdata ), 0 );
+      rdata[21] = 60;
+      length = Cosm_NetDNSTestRecord( data, length, 6, 60, rdata, 22 );
+      data[9] = 1;
+    }
+
+    packet.length = length;
+    CosmNetSendUDPBatch( &sent, &test->net, &packet, 1 );
   }
 
-  CosmFileClose( &file );
+  CosmAtomicAdd32( &test->stop, 1 );
+}
 
-  return COSM_PASS;
+static void Cosm_NetDNSTestCallback( void * arg, const ascii * name,
+  const cosm_NET_ADDR * addr, u32 count, s32 status )
+{
+  if ( ( status == COSM_PASS ) && ( count > 0 ) )
+  {
+    CosmAtomicAdd32( &( (cosm_NET_DNS_TEST *) arg )->called, 1 );
+  }
 }
-#endif
 
-/* Testing */
+static u32 Cosm_NetACLTestTimers( cosm_NET_ACL * acl )
+{
+  cosm_NET_ACL_TIMER * timer;
+  u32 count, i;
+
+  count = 0;
+  for ( i = 0 ; i < COSM_NET_ACL_WHEEL ; i++ )
+  {
+    for ( timer = acl->wheel[i] ; timer != NULL ; timer = timer->next )
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
 
 s32 Cosm_TestOSNet( void )
 {
   cosm_NET netsrv, netsrv1, netsrv2, netclient1, netclient2;
   cosm_NET_ADDR my_addr, addr;
   cosm_NET_ACL net_acl;
+  cosm_FILE file;
+  cosm_NET_POLLER poller;
+  cosm_NET_EVENT ready[4];
+  cosm_NET_PACKET packets[4];
+  cosm_NET_OPTIONS options, got;
+  cosm_NET_VECTOR vector[3];
+  u8 * block;
+  u64 moved;
+  static const u32 acl_ips[5] = { 0x0A090909, 0x0A010505, 0x0A010203,
+    0x0B000001, 0x0C000001 };
+  static const s32 acl_results[5] = { COSM_NET_DENY, COSM_NET_ALLOW,
+    COSM_NET_DENY, COSM_NET_ALLOW, COSM_NET_ALLOW };
+  cosmtime expires, expired;
+  cosm_NET_RESOLVER resolver;
+  cosm_NET_DNS_TEST dns_test;
+  cosm_NET_ADDR dns_addr[4];
+  u8 dns_query[COSM_NET_DNS_PACKET];
+  u8 dns_reply[COSM_NET_DNS_PACKET];
+  u32 dns_spots[5];
+  u32 dns_found, dns_length, dns_reply_length, dns_ttl, dns_negative;
+  u64 thread_id;
+  u128 ip6;
   ascii buf1[128], buf2[128];
+  u64 written;
+  u64 traffic[3];
   /* cosm_NET_HOSTNAME host_name; */
   u32 bytes;
   u32 i;
@@ -2296,6 +5436,341 @@ s32 Cosm_TestOSNet( void )
   }
 */
 
+  /* send a header and part of a file on a new connection */
+  CosmMemSet( &file, sizeof( cosm_FILE ), 0 );
+  for ( i = 0 ; i < 64 ; i++ )
+  {
+    buf1[i] = (ascii) ( 'A' + ( i % 26 ) );
+  }
+  if ( ( CosmFileOpen( &file, "os_net.tst", COSM_FILE_MODE_CREATE
+    | COSM_FILE_MODE_READ | COSM_FILE_MODE_WRITE | COSM_FILE_MODE_TRUNCATE,
+    COSM_FILE_LOCK_NONE ) != COSM_PASS )
+    || ( CosmFileWrite( &file, &written, buf1, 64 ) != COSM_PASS ) )
+  {
+    return -40;
+  }
+
+  addr.type = COSM_NET_IPV4;
+  addr.ip.v4 = my_addr.ip.v4;
+  addr.port = netsrv.my_addr.port;
+  if ( ( _COSM_NETOPEN( &netclient1, &addr ) != COSM_PASS )
+    || ( CosmNetAccept( &netsrv1, &netsrv, NULL, COSM_NET_ACCEPT_WAIT )
+    != COSM_PASS ) )
+  {
+    return -41;
+  }
+
+  if ( ( CosmNetSendFile( &netsrv1, &written, &file, 10, 20, "head", 4 )
+    != COSM_PASS ) || ( written != 24 ) )
+  {
+    return -42;
+  }
+
+  CosmMemSet( buf2, sizeof( buf2 ), 0 );
+  if ( ( CosmNetRecv( buf2, &bytes, &netclient1, 24, wait_time )
+    != COSM_PASS ) || ( bytes != 24 )
+    || ( CosmMemCmp( buf2, "head", 4 ) != 0 )
+    || ( CosmMemCmp( &buf2[4], &buf1[10], 20 ) != 0 ) )
+  {
+    return -43;
+  }
+
+  /* past the end of the file */
+  if ( CosmNetSendFile( &netsrv1, &written, &file, 60, 10, NULL, 0 )
+    != COSM_NET_ERROR_FILE )
+  {
+    return -44;
+  }
+
+  CosmNetClose( &netsrv1 );
+  CosmNetClose( &netclient1 );
+  CosmFileClose( &file );
+  if ( CosmFileDelete( "os_net.tst" ) != COSM_PASS )
+  {
+    return -45;
+  }
+
+  /* one wait covers the listener and its connections */
+  if ( ( CosmNetPollerInit( &poller ) != COSM_PASS )
+    || ( CosmNetPollerAdd( &poller, &netsrv, COSM_NET_POLL_READ )
+    != COSM_PASS )
+    || ( CosmNetPollerAdd( &poller, &netsrv, COSM_NET_POLL_READ )
+    != COSM_NET_ERROR_ORDER ) )
+  {
+    return -46;
+  }
+
+  if ( ( _COSM_NETOPEN( &netclient1, &addr ) != COSM_PASS )
+    || ( CosmNetPollerWait( &bytes, ready, &poller, 4, 1000 ) != COSM_PASS )
+    || ( bytes != 1 ) || ( ready[0].net != &netsrv )
+    || ( ( ready[0].events & COSM_NET_POLL_READ ) == 0 ) )
+  {
+    return -47;
+  }
+
+  if ( ( CosmNetAccept( &netsrv1, &netsrv, NULL, COSM_NET_ACCEPT_NOWAIT )
+    != COSM_PASS )
+    || ( CosmNetPollerAdd( &poller, &netsrv1, COSM_NET_POLL_READ )
+    != COSM_PASS )
+    || ( CosmNetPollerWait( &bytes, ready, &poller, 4, 0 ) != COSM_PASS )
+    || ( bytes != 0 ) )
+  {
+    return -48;
+  }
+
+  if ( ( CosmNetSend( &netclient1, &bytes, buf1, 10 ) != COSM_PASS )
+    || ( CosmNetPollerWait( &bytes, ready, &poller, 4, 1000 ) != COSM_PASS )
+    || ( bytes != 1 ) || ( ready[0].net != &netsrv1 )
+    || ( ready[0].events != COSM_NET_POLL_READ )
+    || ( CosmNetRecv( buf2, &bytes, &netsrv1, 4, 0 ) != COSM_PASS )
+    || ( bytes != 4 ) )
+  {
+    return -49;
+  }
+
+  /* anything left unread is reported again */
+  if ( ( CosmNetPollerWait( &bytes, ready, &poller, 4, 0 ) != COSM_PASS )
+    || ( bytes != 1 ) || ( ready[0].net != &netsrv1 )
+    || ( CosmNetRecv( buf2, &bytes, &netsrv1, 100, 0 ) != COSM_PASS )
+    || ( bytes != 6 ) )
+  {
+    return -49;
+  }
+
+  CosmNetClose( &netclient1 );
+  if ( ( CosmNetPollerWait( &bytes, ready, &poller, 4, 1000 ) != COSM_PASS )
+    || ( bytes != 1 ) || ( ready[0].net != &netsrv1 )
+    || ( ( ready[0].events & ( COSM_NET_POLL_READ | COSM_NET_POLL_CLOSED ) )
+    == 0 ) || ( CosmNetRecv( buf2, &bytes, &netsrv1, 100, 0 )
+    != COSM_NET_ERROR_CLOSED ) )
+  {
+    return -50;
+  }
+
+  if ( ( CosmNetPollerRemove( &poller, &netsrv1 ) != COSM_PASS )
+    || ( CosmNetPollerRemove( &poller, &netsrv1 ) != COSM_NET_ERROR_ORDER )
+    || ( CosmNetPollerRemove( &poller, &netsrv ) != COSM_PASS )
+    || ( poller.count != 0 ) || ( CosmNetPollerFree( &poller ) != COSM_PASS ) )
+  {
+    return -51;
+  }
+
+  /* two UDP listeners sharing a port, then batches through one of them */
+  CosmMemCopy( &addr, &my_addr, sizeof( cosm_NET_ADDR ) );
+  if ( ( CosmNetListen( &netsrv1, &addr,
+    COSM_NET_MODE_UDP | COSM_NET_MODE_SHARED, 0 ) != COSM_PASS )
+    || ( netsrv1.my_addr.port == 0 ) )
+  {
+    return -52;
+  }
+  addr.port = netsrv1.my_addr.port;
+  if ( ( CosmNetListen( &netsrv2, &addr,
+    COSM_NET_MODE_UDP | COSM_NET_MODE_SHARED, 0 ) != COSM_PASS )
+    || ( CosmNetClose( &netsrv2 ) != COSM_PASS ) )
+  {
+    return -53;
+  }
+
+  CosmMemCopy( &addr, &my_addr, sizeof( cosm_NET_ADDR ) );
+  if ( CosmNetListen( &netclient1, &addr, COSM_NET_MODE_UDP, 0 )
+    != COSM_PASS )
+  {
+    return -54;
+  }
+
+  CosmMemSet( packets, sizeof( packets ), 0 );
+  for ( i = 0 ; i < 3 ; i++ )
+  {
+    CosmMemCopy( &packets[i].addr, &netsrv1.my_addr,
+      sizeof( cosm_NET_ADDR ) );
+    packets[i].data = &buf1[i * 10];
+    packets[i].length = 5 + i;
+  }
+  if ( ( CosmNetSendUDPBatch( &bytes, &netclient1, packets, 3 )
+    != COSM_PASS ) || ( bytes != 3 ) )
+  {
+    return -55;
+  }
+
+  CosmMemSet( packets, sizeof( packets ), 0 );
+  CosmMemSet( buf2, sizeof( buf2 ), 0 );
+  for ( i = 0 ; i < 4 ; i++ )
+  {
+    packets[i].data = &buf2[i * 32];
+    packets[i].size = 32;
+  }
+  if ( ( CosmNetRecvUDPBatch( &bytes, packets, &netsrv1, 4, NULL, 1000 )
+    != COSM_PASS ) || ( bytes != 3 ) )
+  {
+    return -56;
+  }
+  for ( i = 0 ; i < 3 ; i++ )
+  {
+    if ( ( packets[i].length != 5 + i )
+      || ( CosmMemCmp( packets[i].data, &buf1[i * 10], 5 + i ) != 0 )
+      || ( packets[i].addr.port != netclient1.my_addr.port ) )
+    {
+      return -57;
+    }
+  }
+
+  if ( ( CosmNetRecvUDPBatch( &bytes, packets, &netsrv1, 4, NULL, 0 )
+    != COSM_PASS ) || ( bytes != 0 ) )
+  {
+    return -58;
+  }
+
+  CosmNetClose( &netsrv1 );
+  CosmNetClose( &netclient1 );
+
+  /* socket options on a listener, a client and an accepted connection */
+  CosmMemSet( &options, sizeof( options ), 0 );
+  options.flags = COSM_NET_OPTION_NODELAY | COSM_NET_OPTION_REUSEADDR
+    | COSM_NET_OPTION_KEEPALIVE;
+  options.recv_buffer = 65536;
+  options.backlog = 4;
+  CosmMemCopy( &addr, &my_addr, sizeof( cosm_NET_ADDR ) );
+  if ( ( CosmNetListenOptions( &netsrv1, &addr, COSM_NET_MODE_TCP,
+    &options ) != COSM_PASS )
+    || ( CosmNetGetOptions( &got, &netsrv1 ) != COSM_PASS )
+    || ( ( got.flags & options.flags ) != options.flags )
+    || ( got.recv_buffer < options.recv_buffer ) || ( got.backlog != 0 ) )
+  {
+    return -59;
+  }
+
+  CosmMemSet( &options, sizeof( options ), 0 );
+  options.flags = COSM_NET_OPTION_NODELAY;
+  addr.port = netsrv1.my_addr.port;
+  if ( ( CosmNetOpenOptions( &netclient1, NULL, &addr, COSM_NET_MODE_TCP,
+    &options ) != COSM_PASS )
+    || ( CosmNetGetOptions( &got, &netclient1 ) != COSM_PASS )
+    || ( ( got.flags & COSM_NET_OPTION_NODELAY ) == 0 ) )
+  {
+    return -60;
+  }
+
+  if ( ( CosmNetAccept( &netsrv2, &netsrv1, NULL, COSM_NET_ACCEPT_WAIT )
+    != COSM_PASS )
+    || ( CosmNetSetOptions( &netsrv2, &options ) != COSM_PASS )
+    || ( CosmNetGetOptions( &got, &netsrv2 ) != COSM_PASS )
+    || ( ( got.flags & COSM_NET_OPTION_NODELAY ) == 0 ) )
+  {
+    return -61;
+  }
+
+  CosmNetClose( &netsrv2 );
+  CosmNetClose( &netclient1 );
+  CosmNetClose( &netsrv1 );
+  if ( CosmNetGetOptions( &got, &netsrv1 ) != COSM_NET_ERROR_CLOSED )
+  {
+    return -62;
+  }
+
+  /* vectored sends and receives, zerocopy if the OS has it */
+  CosmMemSet( &options, sizeof( options ), 0 );
+  options.flags = COSM_NET_OPTION_ZEROCOPY;
+  options.send_buffer = 1048576;
+  options.recv_buffer = 1048576;
+  CosmMemCopy( &addr, &my_addr, sizeof( cosm_NET_ADDR ) );
+  if ( ( CosmNetListenOptions( &netsrv1, &addr, COSM_NET_MODE_TCP,
+    &options ) != COSM_PASS ) )
+  {
+    return -81;
+  }
+  addr.port = netsrv1.my_addr.port;
+  if ( ( CosmNetOpenOptions( &netclient1, NULL, &addr, COSM_NET_MODE_TCP,
+    &options ) != COSM_PASS )
+    || ( CosmNetAccept( &netsrv2, &netsrv1, NULL, COSM_NET_ACCEPT_WAIT )
+    != COSM_PASS ) )
+  {
+    return -81;
+  }
+
+  vector[0].data = "Hello ";
+  vector[0].length = 6;
+  vector[1].data = NULL;
+  vector[1].length = 5;
+  if ( ( CosmNetSendV( &netclient1, &moved, vector, 0 )
+    != COSM_NET_ERROR_PARAM )
+    || ( CosmNetSendV( &netclient1, &moved, vector, 2 )
+    != COSM_NET_ERROR_PARAM ) )
+  {
+    return -82;
+  }
+
+  vector[1].data = "world";
+  if ( ( CosmNetSendV( &netclient1, &moved, vector, 2 ) != COSM_PASS )
+    || ( moved != 11 ) )
+  {
+    return -83;
+  }
+  vector[0].data = buf1;
+  vector[0].length = 4;
+  vector[1].data = buf2;
+  vector[1].length = 7;
+  if ( ( CosmNetRecvV( vector, &moved, &netsrv2, 2, wait_time )
+    != COSM_PASS ) || ( moved != 11 )
+    || ( CosmMemCmp( buf1, "Hell", 4 ) != 0 )
+    || ( CosmMemCmp( buf2, "o world", 7 ) != 0 ) )
+  {
+    return -83;
+  }
+
+  if ( ( block = CosmMemAlloc( 131072LL ) ) == NULL )
+  {
+    return -84;
+  }
+  for ( i = 0 ; i < 131072 ; i++ )
+  {
+    block[i] = (u8) ( i % 251 );
+  }
+  vector[0].data = "header\r\n\r\n";
+  vector[0].length = 10;
+  vector[1].data = block;
+  vector[1].length = 131072;
+  if ( ( CosmNetSendAll( &netclient1, &moved, vector, 2, 5000 )
+    != COSM_PASS ) || ( moved != 131082 ) )
+  {
+    CosmMemFree( block );
+    return -84;
+  }
+
+  /* scatter it across buffers that do not line up with the sends */
+  CosmMemSet( block, 131072LL, 0 );
+  vector[0].data = buf1;
+  vector[0].length = 100;
+  vector[1].data = block;
+  vector[1].length = 70000;
+  vector[2].data = &block[70000];
+  vector[2].length = 131082 - 100 - 70000;
+  if ( ( CosmNetRecvV( vector, &moved, &netsrv2, 3, 5000 ) != COSM_PASS )
+    || ( moved != 131082 ) || ( CosmMemCmp( buf1, "header\r\n\r\n", 10 ) )
+    || ( buf1[10] != 0 ) || ( block[0] != 90 )
+    || ( block[130981] != (u8) ( 131071 % 251 ) ) )
+  {
+    CosmMemFree( block );
+    return -85;
+  }
+  CosmMemFree( block );
+
+  /* nothing waiting, the time runs out */
+  if ( ( CosmNetRecvV( vector, &moved, &netsrv2, 3, 0 ) != COSM_PASS )
+    || ( moved != 0 ) )
+  {
+    return -86;
+  }
+
+  CosmNetClose( &netclient1 );
+  if ( ( CosmNetRecvV( vector, &moved, &netsrv2, 3, wait_time )
+    != COSM_NET_ERROR_CLOSED ) || ( moved != 0 )
+    || ( CosmNetSendV( &netsrv2, &moved, vector, 3 )
+    != COSM_NET_ERROR_CLOSED ) )
+  {
+    return -87;
+  }
+  CosmNetClose( &netsrv1 );
+
   if ( CosmNetClose( &netsrv ) != COSM_PASS )
   {
     return -35;
@@ -2326,5 +5801,274 @@ s32 Cosm_TestOSNet( void )
     Net ACL tests
   */
 
+  /* an acl never initialized refuses entries, it can't seem to hold them */
+  CosmMemSet( &net_acl, sizeof( cosm_NET_ACL ), 0 );
+  CosmSystemClock( &expires );
+  expires.hi += 3600;
+  addr.type = COSM_NET_IPV4;
+  addr.port = 0;
+  addr.ip.v4 = 0x0A000000;
+  if ( ( CosmNetACLAdd( &net_acl, &addr, 0, COSM_NET_DENY, expires )
+    != COSM_FAIL ) || ( net_acl.count != 0 ) )
+  {
+    return -89;
+  }
+
+  /* the longest unexpired match decides */
+  CosmMemSet( &net_acl, sizeof( cosm_NET_ACL ), 0 );
+  if ( ( CosmNetACLInit( &net_acl ) != COSM_PASS )
+    || ( CosmSystemClock( &expires ) != COSM_PASS ) )
+  {
+    return -63;
+  }
+  expired = expires;
+  expires.hi += 3600;
+  expired.hi -= 10;
+  addr.type = COSM_NET_IPV4;
+  addr.port = 0;
+  addr.ip.v4 = 0x0A000000;
+  if ( ( CosmNetACLAdd( &net_acl, &addr, 8, COSM_NET_DENY, expires )
+    != COSM_PASS ) || ( CosmNetACLAdd( &net_acl, &addr, 33, COSM_NET_DENY,
+    expires ) != COSM_FAIL ) )
+  {
+    return -64;
+  }
+  addr.ip.v4 = 0x0A010000;
+  CosmNetACLAdd( &net_acl, &addr, 16, COSM_NET_ALLOW, expires );
+  addr.ip.v4 = 0x0A010203;
+  CosmNetACLAdd( &net_acl, &addr, 32, COSM_NET_DENY, expires );
+  addr.ip.v4 = 0x0B000000;
+  CosmNetACLAdd( &net_acl, &addr, 8, COSM_NET_DENY, expired );
+  for ( i = 0 ; i < 5 ; i++ )
+  {
+    addr.ip.v4 = acl_ips[i];
+    if ( ( CosmNetACLCheck( &net_acl, &addr ) != acl_results[i] )
+      || ( net_acl.count != 4 ) )
+    {
+      return -65;
+    }
+  }
+
+  /* replace one entry, delete another */
+  addr.ip.v4 = 0x0A010203;
+  if ( ( CosmNetACLAdd( &net_acl, &addr, 32, COSM_NET_ALLOW, expires )
+    != COSM_PASS ) || ( net_acl.count != 4 )
+    || ( CosmNetACLCheck( &net_acl, &addr ) != COSM_NET_ALLOW ) )
+  {
+    return -66;
+  }
+  addr.ip.v4 = 0x0A01FFFF;
+  if ( ( CosmNetACLDelete( &net_acl, &addr, 16 ) != COSM_PASS )
+    || ( net_acl.count != 3 )
+    || ( CosmNetACLCheck( &net_acl, &addr ) != COSM_NET_DENY ) )
+  {
+    return -67;
+  }
+
+  /* refreshes and deletes leave one timer per entry */
+  for ( i = 0 ; i < 100 ; i++ )
+  {
+    addr.ip.v4 = 0x0A010203;
+    expires.hi++;
+    CosmNetACLAdd( &net_acl, &addr, 32, COSM_NET_ALLOW, expires );
+    addr.ip.v4 = 0x0C000000;
+    CosmNetACLAdd( &net_acl, &addr, 8, COSM_NET_DENY, expires );
+    CosmNetACLDelete( &net_acl, &addr, 8 );
+  }
+  if ( ( net_acl.count != 3 )
+    || ( Cosm_NetACLTestTimers( &net_acl ) != net_acl.count ) )
+  {
+    return -88;
+  }
+
+  /* IPv6 has its own trie */
+  addr.type = COSM_NET_IPV6;
+  _COSM_SET128( addr.ip.v6, 20010DB800000000, 0000000000000000 );
+  CosmNetACLAdd( &net_acl, &addr, 32, COSM_NET_DENY, expires );
+  _COSM_SET128( addr.ip.v6, 20010DB8FFFF0000, 0000000000000001 );
+  if ( CosmNetACLCheck( &net_acl, &addr ) != COSM_NET_DENY )
+  {
+    return -68;
+  }
+  _COSM_SET128( addr.ip.v6, 20010DB900000000, 0000000000000001 );
+  if ( CosmNetACLCheck( &net_acl, &addr ) != COSM_NET_ALLOW )
+  {
+    return -69;
+  }
+
+  /* the expired entry is swept out after its second */
+  CosmSleep( 1100 );
+  addr.type = COSM_NET_IPV4;
+  addr.ip.v4 = 0x0B000001;
+  if ( ( CosmNetACLCheck( &net_acl, &addr ) != COSM_NET_ALLOW )
+    || ( net_acl.count != 3 ) )
+  {
+    return -70;
+  }
+
+  CosmNetACLFree( &net_acl );
+  addr.ip.v4 = 0x0A000001;
+  if ( ( net_acl.count != 0 ) || ( net_acl.v4 != NULL )
+    || ( CosmNetACLCheck( &net_acl, &addr ) != COSM_NET_ALLOW ) )
+  {
+    return -71;
+  }
+
+  /* resolver, against a stub DNS server */
+  CosmMemSet( &dns_test, sizeof( dns_test ), 0 );
+  addr.type = COSM_NET_IPV4;
+  addr.ip.v4 = 0x7F000001;
+  addr.port = 0;
+  if ( ( CosmNetListen( &dns_test.net, &addr, COSM_NET_MODE_UDP, 0 )
+    != COSM_PASS ) || ( CosmThreadBegin( &thread_id, Cosm_NetDNSTestServer,
+    &dns_test, 64 * 1024 ) != COSM_PASS )
+    || ( CosmNetResolverInit( &resolver, &dns_test.net.my_addr, 1, 2, 60, 5 )
+    != COSM_PASS ) )
+  {
+    return -72;
+  }
+
+  dns_found = 0;
+  if ( CosmNetResolve( dns_addr, 4, &resolver, "A.Test" ) == 2 )
+  {
+    _COSM_SET128( ip6, 20010DB800000000, 0000000000000001 );
+    for ( i = 0 ; i < 2 ; i++ )
+    {
+      if ( ( dns_addr[i].type == COSM_NET_IPV4 )
+        && ( dns_addr[i].ip.v4 == 0x0A010203 ) )
+      {
+        dns_found |= 1;
+      }
+      if ( ( dns_addr[i].type == COSM_NET_IPV6 )
+        && ( CosmU128Eq( dns_addr[i].ip.v6, ip6 ) ) )
+      {
+        dns_found |= 2;
+      }
+    }
+  }
+  if ( ( dns_found != 3 ) || ( dns_test.queries != 2 ) )
+  {
+    return -73;
+  }
+
+  /* cached, no more questions */
+  if ( ( CosmNetResolve( dns_addr, 4, &resolver, "a.test" ) != 2 )
+    || ( CosmAtomicLoad32( &dns_test.queries ) != 2 ) )
+  {
+    return -74;
+  }
+
+  /* everyone asking at once shares one lookup */
+  for ( i = 0 ; i < 4 ; i++ )
+  {
+    if ( CosmNetResolveAsync( &resolver, "slow.test",
+      Cosm_NetDNSTestCallback, &dns_test ) != COSM_PASS )
+    {
+      return -75;
+    }
+  }
+  if ( ( CosmNetResolve( dns_addr, 4, &resolver, "slow.test" ) != 1 )
+    || ( dns_addr[0].ip.v4 != 0x0A040506 ) )
+  {
+    return -75;
+  }
+  for ( i = 0 ; ( i < 100 )
+    && ( CosmAtomicLoad32( &dns_test.called ) != 4 ) ; i++ )
+  {
+    CosmSleep( 10 );
+  }
+  if ( ( CosmAtomicLoad32( &dns_test.called ) != 4 )
+    || ( CosmAtomicLoad32( &dns_test.queries ) != 4 )
+    || ( resolver.lookups != 2 ) )
+  {
+    return -76;
+  }
+
+  /* no such name is kept too */
+  if ( ( CosmNetResolve( dns_addr, 4, &resolver, "missing.test" ) != 0 )
+    || ( CosmNetResolve( dns_addr, 4, &resolver, "missing.test" ) != 0 )
+    || ( CosmAtomicLoad32( &dns_test.queries ) != 6 ) )
+  {
+    return -77;
+  }
+
+  /* an answer with a TTL of 0 isn't */
+  if ( ( CosmNetResolve( dns_addr, 4, &resolver, "zero.test" ) != 1 )
+    || ( CosmNetResolve( dns_addr, 4, &resolver, "zero.test" ) != 1 )
+    || ( CosmAtomicLoad32( &dns_test.queries ) != 10 ) )
+  {
+    return -78;
+  }
+
+  /* cached names and IP addresses are called back right away */
+  dns_test.called = 0;
+  if ( ( CosmNetResolveAsync( &resolver, "a.test", Cosm_NetDNSTestCallback,
+    &dns_test ) != COSM_PASS ) || ( CosmNetResolveAsync( &resolver,
+    "127.0.0.1", Cosm_NetDNSTestCallback, &dns_test ) != COSM_PASS )
+    || ( dns_test.called != 2 )
+    || ( CosmAtomicLoad32( &dns_test.queries ) != 10 ) )
+  {
+    return -79;
+  }
+
+  /* a reply is an answer only if it repeats the question, in any case */
+  dns_length = Cosm_NetDNSPacket( dns_query, 0x1234, 1, "a.test" );
+  CosmMemCopy( dns_reply, dns_query, dns_length );
+  dns_reply[2] = 0x81;
+  dns_reply[3] = 0x80;
+  dns_reply[7] = 1;
+  dns_reply[13] = 'A';
+  dns_reply_length = Cosm_NetDNSTestRecord( dns_reply, dns_length, 1, 30,
+    "\x0A\x01\x02\x03", 4 );
+  dns_found = 0;
+  dns_ttl = 60;
+  dns_negative = 5;
+  if ( ( Cosm_NetDNSParse( dns_addr, &dns_found, 4, &dns_ttl, &dns_negative,
+    dns_reply, dns_reply_length, dns_query, dns_length ) != 0 )
+    || ( dns_found != 1 ) || ( dns_addr[0].ip.v4 != 0x0A010203 )
+    || ( dns_ttl != 30 ) )
+  {
+    return -90;
+  }
+  /* the ID, QDCOUNT, QNAME, QTYPE and QCLASS each have to match */
+  dns_spots[0] = 1;
+  dns_spots[1] = 5;
+  dns_spots[2] = 16;
+  dns_spots[3] = dns_length - 3;
+  dns_spots[4] = dns_length - 1;
+  for ( i = 0 ; i < 5 ; i++ )
+  {
+    dns_found = 0;
+    dns_reply[dns_spots[i]] ^= 2;
+    if ( ( Cosm_NetDNSParse( dns_addr, &dns_found, 4, &dns_ttl,
+      &dns_negative, dns_reply, dns_reply_length, dns_query, dns_length )
+      != -1 ) || ( dns_found != 0 ) )
+    {
+      return -90;
+    }
+    dns_reply[dns_spots[i]] ^= 2;
+  }
+
+  CosmAtomicAdd32( &dns_test.stop, 1 );
+  for ( i = 0 ; ( i < 100 )
+    && ( CosmAtomicLoad32( &dns_test.stop ) != 2 ) ; i++ )
+  {
+    CosmSleep( 10 );
+  }
+  CosmNetClose( &dns_test.net );
+  if ( ( CosmNetResolverFree( &resolver ) != COSM_PASS )
+    || ( dns_test.stop != 2 ) )
+  {
+    return -80;
+  }
+
+  /* everything above moved data through the counted calls */
+  CosmNetCounters( &traffic[0], &traffic[1], &traffic[2] );
+  if ( ( traffic[0] == 0 ) || ( traffic[1] == 0 )
+    || ( traffic[2] < 10 ) )
+  {
+    return -81;
+  }
+
   return COSM_PASS;
 }
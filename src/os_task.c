@@ -39,6 +39,7 @@ void Cosm_SignalWaitThread( void * arg );
 #include <sys/resource.h>
 #include <stdlib.h>
 #include <dlfcn.h>
+#include <time.h>
 #else /* OS */
 #if ( OS_TYPE == OS_NETBSD )
 #include <sys/sched.h>
@@ -50,6 +51,7 @@ void Cosm_SignalWaitThread( void * arg );
 #include <sys/resource.h>
 #include <stdlib.h>
 #include <dlfcn.h>
+#include <time.h>
 #endif /* OS */
 
 #if ( OS_TYPE == OS_FREEBSD )
@@ -67,6 +69,14 @@ void Cosm_SignalWaitThread( void * arg );
 #include <sys/procset.h>
 #endif
 
+/* coarse clock kept by Cosm_ClockTicker */
+volatile u64 __cosm_clock_coarse = 0;
+u32 __cosm_clock_ticker = 0; /* 1 once it runs, 2 if it can't start */
+u32 __cosm_clock_claim = 0;
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+u64 __cosm_clock_freq = 0;
+#endif
+
 /* Setup the size of Process ID */
 #if ( ( OS_TYPE != OS_WIN32 ) && ( OS_TYPE != OS_WIN64 ) )
 #if ( 0 )
@@ -988,6 +998,130 @@ void CosmSemaphoreFree( cosm_SEMAPHORE * sem )
   CosmMemSet( sem, sizeof( cosm_SEMAPHORE ), 0 );
 }
 
+void * CosmAtomicLoadPtr( void * const * pointer )
+{
+#if ( defined( __GNUC__ ) )
+  return __atomic_load_n( pointer, __ATOMIC_ACQUIRE );
+#elif ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  return InterlockedCompareExchangePointer( (PVOID volatile *) pointer,
+    NULL, NULL );
+#else
+#error "Incomplete CosmAtomicLoadPtr - see os_task.c"
+#endif
+}
+
+void CosmAtomicStorePtr( void ** pointer, void * value )
+{
+#if ( defined( __GNUC__ ) )
+  __atomic_store_n( pointer, value, __ATOMIC_RELEASE );
+#elif ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  (void) InterlockedExchangePointer( (PVOID volatile *) pointer, value );
+#else
+#error "Incomplete CosmAtomicStorePtr - see os_task.c"
+#endif
+}
+
+void * CosmAtomicSwapPtr( void ** pointer, void * value )
+{
+#if ( defined( __GNUC__ ) )
+  return __atomic_exchange_n( pointer, value, __ATOMIC_ACQ_REL );
+#elif ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  return InterlockedExchangePointer( (PVOID volatile *) pointer, value );
+#else
+#error "Incomplete CosmAtomicSwapPtr - see os_task.c"
+#endif
+}
+
+u32 CosmAtomicLoad32( const u32 * number )
+{
+#if ( defined( __GNUC__ ) )
+  return __atomic_load_n( number, __ATOMIC_SEQ_CST );
+#elif ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  return (u32) InterlockedCompareExchange( (LONG volatile *) number, 0, 0 );
+#else
+#error "Incomplete CosmAtomicLoad32 - see os_task.c"
+#endif
+}
+
+u32 CosmAtomicAdd32( u32 * number, s32 add )
+{
+#if ( defined( __GNUC__ ) )
+  return __atomic_add_fetch( number, (u32) add, __ATOMIC_SEQ_CST );
+#elif ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  return (u32) InterlockedExchangeAdd( (LONG volatile *) number, add )
+    + (u32) add;
+#else
+#error "Incomplete CosmAtomicAdd32 - see os_task.c"
+#endif
+}
+
+u64 CosmAtomicLoad64( const u64 * number )
+{
+#if ( defined( __GNUC__ ) )
+  return __atomic_load_n( number, __ATOMIC_SEQ_CST );
+#elif ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  return (u64) InterlockedCompareExchange64( (LONGLONG volatile *) number,
+    0, 0 );
+#else
+#error "Incomplete CosmAtomicLoad64 - see os_task.c"
+#endif
+}
+
+void CosmAtomicStore64( u64 * number, u64 value )
+{
+#if ( defined( __GNUC__ ) )
+  __atomic_store_n( number, value, __ATOMIC_SEQ_CST );
+#elif ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  (void) InterlockedExchange64( (LONGLONG volatile *) number,
+    (LONGLONG) value );
+#else
+#error "Incomplete CosmAtomicStore64 - see os_task.c"
+#endif
+}
+
+u64 CosmAtomicAdd64( u64 * number, s64 add )
+{
+#if ( defined( __GNUC__ ) )
+  return __atomic_add_fetch( number, (u64) add, __ATOMIC_SEQ_CST );
+#elif ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  return (u64) InterlockedExchangeAdd64( (LONGLONG volatile *) number, add )
+    + (u64) add;
+#else
+#error "Incomplete CosmAtomicAdd64 - see os_task.c"
+#endif
+}
+
+void CosmCounterAdd( cosm_COUNTER * counter, s64 add )
+{
+  u64 hash;
+
+  /*
+    Thread IDs are often aligned addresses, so mix all the bits down before
+    picking a shard. Shards are 8 u64s apart, one cache line each.
+  */
+  hash = CosmThreadID();
+  hash ^= ( hash >> 31 );
+  hash *= 0x9E3779B97F4A7C15LL;
+  hash >>= 32;
+
+  (void) CosmAtomicAdd64( &counter->shard[( (u32) hash
+    & ( COSM_COUNTER_SHARDS - 1 ) ) * 8], add );
+}
+
+s64 CosmCounterRead( const cosm_COUNTER * counter )
+{
+  u64 total;
+  u32 i;
+
+  total = 0;
+  for ( i = 0 ; i < COSM_COUNTER_SHARDS ; i++ )
+  {
+    total += CosmAtomicLoad64( &counter->shard[i * 8] );
+  }
+
+  return (s64) total;
+}
+
 void CosmSleep( u32 millisec )
 {
 #if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
@@ -1342,8 +1476,105 @@ s32 CosmSystemClock( cosmtime * clock )
   return COSM_PASS;
 }
 
+u64 CosmClockMono( void )
+{
+#if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
+  LARGE_INTEGER count, freq;
+  u64 ticks;
+
+  if ( __cosm_clock_freq == 0 )
+  {
+    if ( !QueryPerformanceFrequency( &freq ) )
+    {
+      return 0;
+    }
+    __cosm_clock_freq = (u64) freq.QuadPart;
+  }
+  QueryPerformanceCounter( &count );
+  ticks = (u64) count.QuadPart;
+
+  /* split so the multiply can't overflow */
+  return ( ( ticks / __cosm_clock_freq ) * 1000000000LL )
+    + ( ( ( ticks % __cosm_clock_freq ) * 1000000000LL )
+    / __cosm_clock_freq );
+#elif ( defined( CLOCK_MONOTONIC ) )
+  struct timespec now;
+
+  /* On Linux this is a vDSO call, no system call is made */
+  if ( clock_gettime( CLOCK_MONOTONIC, &now ) != 0 )
+  {
+    return 0;
+  }
+
+  return ( (u64) now.tv_sec * 1000000000LL ) + (u64) now.tv_nsec;
+#else
+  struct timeval now;
+
+  /* no monotonic clock, best we can do */
+  if ( gettimeofday( &now, NULL ) != 0 )
+  {
+    return 0;
+  }
+
+  return ( (u64) now.tv_sec * 1000000000LL )
+    + ( (u64) now.tv_usec * 1000LL );
+#endif
+}
+
+u64 CosmClockCoarse( void )
+{
+  u64 thread_id;
+  u32 ticker;
+#if ( defined( CPU_32BIT ) )
+  u64 a, b;
+#endif
+
+  if ( ( ticker = CosmAtomicLoad32( &__cosm_clock_ticker ) ) != 1 )
+  {
+    /* the first caller starts the ticker, any others wait for it */
+    if ( ( ticker == 0 )
+      && ( CosmAtomicAdd32( &__cosm_clock_claim, 1 ) == 1 ) )
+    {
+      __cosm_clock_coarse = CosmClockMono() / 1000000LL;
+      CosmAtomicAdd32( &__cosm_clock_ticker, ( CosmThreadBegin( &thread_id,
+        Cosm_ClockTicker, NULL, 4096 ) == COSM_PASS ) ? 1 : 2 );
+    }
+    while ( ( ticker = CosmAtomicLoad32( &__cosm_clock_ticker ) ) == 0 )
+    {
+      CosmYield();
+    }
+
+    if ( ticker != 1 )
+    {
+      /* no ticker, do it the slow way */
+      return CosmClockMono() / 1000000LL;
+    }
+  }
+
+#if ( defined( CPU_32BIT ) )
+  /* a u64 store isn't atomic here, read until we get a stable value */
+  do
+  {
+    a = __cosm_clock_coarse;
+    b = __cosm_clock_coarse;
+  } while ( a != b );
+  return a;
+#else
+  return __cosm_clock_coarse;
+#endif
+}
+
 /* low level functions */
 
+void Cosm_ClockTicker( void * arg )
+{
+  while ( 1 )
+  {
+    __cosm_clock_coarse = CosmClockMono() / 1000000LL;
+    CosmSleep( 1 );
+  }
+}
+
 u8 Cosm_PriorityToCosm( int pri )
 {
 #if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) )
@@ -1537,6 +1768,9 @@ s32 Cosm_TestOSTask( void )
   cosm_MUTEX mutex;
   cosm_SEMAPHORE semaphore;
   u32 cpu_count;
+  u64 clock_a, clock_b, clock_coarse;
+  void * atomic;
+  cosm_COUNTER counter;
 
 #if ( ( OS_TYPE == OS_WIN32 ) || ( OS_TYPE == OS_WIN64 ) \
   || ( OS_TYPE == OS_SOLARIS ) || ( OS_TYPE == LINUX ) )
@@ -1721,5 +1955,62 @@ s32 Cosm_TestOSTask( void )
   }
 #endif
 
+  /* monotonic clocks */
+  clock_a = CosmClockMono();
+  clock_coarse = CosmClockCoarse();
+  CosmSleep( 50 );
+  clock_b = CosmClockMono();
+  if ( ( clock_a == 0 ) || ( clock_b < ( clock_a + 40000000LL ) )
+    || ( clock_b > ( clock_a + 5000000000LL ) ) )
+  {
+    return -31;
+  }
+  if ( ( CosmClockCoarse() < ( clock_coarse + 40 ) )
+    || ( CosmClockCoarse() > ( clock_b / 1000000LL ) + 1000 ) )
+  {
+    return -32;
+  }
+
+  /* atomic pointers */
+  atomic = &clock_a;
+  if ( ( CosmAtomicLoadPtr( &atomic ) != &clock_a )
+    || ( CosmAtomicSwapPtr( &atomic, &clock_b ) != &clock_a )
+    || ( atomic != &clock_b ) )
+  {
+    return -33;
+  }
+  CosmAtomicStorePtr( &atomic, NULL );
+  if ( CosmAtomicLoadPtr( &atomic ) != NULL )
+  {
+    return -34;
+  }
+
+  /* atomic numbers */
+  done = 5;
+  if ( ( CosmAtomicAdd32( &done, 3 ) != 8 )
+    || ( CosmAtomicAdd32( &done, -8 ) != 0 )
+    || ( CosmAtomicAdd32( &done, -1 ) != 0xFFFFFFFF )
+    || ( CosmAtomicLoad32( &done ) != 0xFFFFFFFF ) )
+  {
+    return -35;
+  }
+  clock_a = 0;
+  CosmAtomicStore64( &clock_a, 0xFFFFFFFFLL );
+  if ( ( CosmAtomicAdd64( &clock_a, 2 ) != 0x100000001LL )
+    || ( CosmAtomicAdd64( &clock_a, -0x100000002LL ) != (u64) -1 )
+    || ( CosmAtomicLoad64( &clock_a ) != (u64) -1 ) )
+  {
+    return -36;
+  }
+
+  /* sharded counters */
+  CosmMemSet( &counter, sizeof( counter ), 0 );
+  CosmCounterAdd( &counter, 40 );
+  CosmCounterAdd( &counter, -42 );
+  if ( CosmCounterRead( &counter ) != -2 )
+  {
+    return -37;
+  }
+
   return COSM_PASS;
 }
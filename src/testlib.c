@@ -366,6 +366,22 @@ int main( int argc, char * argv[] )
     CosmPrint( "%.5s\n\n", ANSI_CLEAR );
   }
 
+  CosmPrint( "Run string function benchmark? [y/N] " );
+  CosmInput( buffer, 4, COSM_IO_ECHO );
+  if ( ( buffer[0] == 'y' ) || ( buffer[0] == 'Y' ) )
+  {
+    CosmBenchStr();
+    CosmPrint( "\n" );
+  }
+
+  CosmPrint( "Run HTTP client pool benchmark? [y/N] " );
+  CosmInput( buffer, 4, COSM_IO_ECHO );
+  if ( ( buffer[0] == 'y' ) || ( buffer[0] == 'Y' ) )
+  {
+    CosmBenchHTTP();
+    CosmPrint( "\n" );
+  }
+
   CosmPrint(
    "Type 20 characters, 15 will be read (should be echoed): " );
   CosmInput( buffer, 16, COSM_IO_ECHO );
@@ -77,7 +77,21 @@ s32 CosmTimeSet( cosm_TIME_CORRECTION * corrections,
   return -1;
 }
 
-s32 CosmTimeUnitsGregorian( cosm_TIME_UNITS * units, cosmtime time )
+/*
+  Day number of Jan 1, 2000 counted from Mar 1, year 0, the start of the
+  400 year cycle used by the civil conversions below.
+*/
+#define COSM_TIME_DAYS_0000_03_01 730425LL
+
+/* days in a 400 year Gregorian cycle */
+#define COSM_TIME_DAYS_ERA 146097LL
+
+/* per-thread copy of the last second converted by CosmTimeUnitsGregorian */
+static COSM_THREAD_LOCAL s64 time_cache_seconds;
+static COSM_THREAD_LOCAL u32 time_cache_valid;
+static COSM_THREAD_LOCAL cosm_TIME_UNITS time_cache_units;
+
+static s32 Cosm_TimeUnitsHistoric( cosm_TIME_UNITS * units, cosmtime time )
 {
   s64 seconds, leaps;
   u32 max_days[] = { 30, 28, 30, 29, 30, 29, 30, 30, 29, 30, 29, 30 };
@@ -238,40 +252,78 @@ s32 CosmTimeUnitsGregorian( cosm_TIME_UNITS * units, cosmtime time )
   return COSM_PASS;
 }
 
-s32 CosmTimeDigestGregorian( cosmtime * time,
-  const cosm_TIME_UNITS * const units )
+s32 CosmTimeUnitsGregorian( cosm_TIME_UNITS * units, cosmtime time )
 {
-  s64 tmp, seconds;
-  u32 max_days[] = { 30, 28, 30, 29, 30, 29, 30, 30, 29, 30, 29, 30 };
-  s32 total_days[] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273,
+  s64 seconds, days, rem;
+  u32 total_days[] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273,
                        304, 334 };
 
-  if ( ( time == NULL ) || ( units == NULL ) )
+  if ( units == NULL )
   {
     return COSM_FAIL;
   }
 
-  /* years */
-  tmp = ( units->year - 2000LL );
-  seconds = ( tmp * 365LL ) + ( tmp / 4LL ) - ( tmp / 100LL )
-    + ( tmp / 400LL );
+  seconds = time.hi;
 
-  if ( ( units->year < 2000LL ) )
+  /* Log lines and the like convert the same second over and over */
+  if ( time_cache_valid && ( time_cache_seconds == seconds ) )
   {
-    if ( ( units->month > 1 ) && Cosm_TimeIsYearLeap( units->year ) )
-    {
-      /* After Feb 29 on a leap year */
-      seconds++;
-    }
+    *units = time_cache_units;
+    units->subsec = time.lo;
+    return COSM_PASS;
   }
-  else
+
+  /* floor division, seconds may be negative */
+  days = seconds / 86400LL;
+  rem = seconds % 86400LL;
+  if ( rem < 0 )
   {
-    seconds++; /* Year 2000 leap day */
-    if ( ( units->month < 2 ) && Cosm_TimeIsYearLeap( units->year ) )
-    {
-      /* Before Feb 29 on a leap year */
-      seconds--;
-    }
+    days--;
+    rem += 86400LL;
+  }
+
+  Cosm_TimeCivilFromDays( &units->year, &units->month, &units->day, days );
+
+  /* Before the British calendar change leap years are not Gregorian */
+  if ( units->year <= 1752LL )
+  {
+    return Cosm_TimeUnitsHistoric( units, time );
+  }
+
+  units->yday = total_days[units->month] + units->day;
+  if ( ( units->month > 1 ) && Cosm_TimeIsYearLeap( units->year ) )
+  {
+    units->yday++;
+  }
+
+  /* January 1, 2000 is a Saturday */
+  units->wday = (u32) ( ( ( days % 7LL ) + 13LL ) % 7LL );
+
+  units->hour = (u32) ( rem / 3600LL );
+  units->min = (u32) ( ( rem / 60LL ) % 60LL );
+  units->sec = (u32) ( rem % 60LL );
+  units->subsec = 0;
+
+  time_cache_units = *units;
+  time_cache_seconds = seconds;
+  time_cache_valid = 1;
+
+  units->subsec = time.lo;
+
+  return COSM_PASS;
+}
+
+s32 CosmTimeDigestGregorian( cosmtime * time,
+  const cosm_TIME_UNITS * const units )
+{
+  s64 tmp, seconds;
+  u32 max_days[] = { 30, 28, 30, 29, 30, 29, 30, 30, 29, 30, 29, 30 };
+  s32 total_days[] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273,
+                       304, 334 };
+
+  if ( ( time == NULL ) || ( units == NULL ) )
+  {
+    return COSM_FAIL;
   }
 
   /* months */
@@ -281,8 +333,6 @@ s32 CosmTimeDigestGregorian( cosmtime * time,
     return COSM_FAIL;
   }
 
-  seconds += (s64) total_days[units->month];
-
   /* days */
   if ( units->day > max_days[units->month] )
   {
@@ -290,6 +340,27 @@ s32 CosmTimeDigestGregorian( cosmtime * time,
     return COSM_FAIL;
   }
 
+  if ( units->year > 1752LL )
+  {
+    /* Gregorian */
+    seconds = Cosm_TimeDaysFromCivil( units->year, units->month, 0 );
+  }
+  else
+  {
+    /* years */
+    tmp = ( units->year - 2000LL );
+    seconds = ( tmp * 365LL ) + ( tmp / 4LL ) - ( tmp / 100LL )
+      + ( tmp / 400LL );
+
+    if ( ( units->month > 1 ) && Cosm_TimeIsYearLeap( units->year ) )
+    {
+      /* After Feb 29 on a leap year */
+      seconds++;
+    }
+
+    seconds += (s64) total_days[units->month];
+  }
+
   if ( ( units->month == 1) && ( units->day == 28 ) )
   {
     /* Feb 29 -- Make sure the year IS leap */
@@ -403,16 +474,112 @@ s32 Cosm_TimeIsYearLeap( s64 year )
   return 0;
 }
 
+s64 Cosm_TimeDaysFromCivil( s64 year, u32 month, u32 day )
+{
+  s64 era, yoe, doy, doe, mp;
+
+  /* Count years from March so the leap day is the last day of a year */
+  if ( month < 2 )
+  {
+    year--;
+  }
+  era = ( ( year >= 0 ) ? year : ( year - 399LL ) ) / 400LL;
+  yoe = year - era * 400LL;
+  mp = ( month < 2 ) ? ( month + 10 ) : ( month - 2 );
+  doy = ( 153LL * mp + 2LL ) / 5LL + day;
+  doe = yoe * 365LL + yoe / 4LL - yoe / 100LL + doy;
+
+  return era * COSM_TIME_DAYS_ERA + doe - COSM_TIME_DAYS_0000_03_01;
+}
+
+void Cosm_TimeCivilFromDays( s64 * year, u32 * month, u32 * day, s64 days )
+{
+  s64 era, doe, yoe, doy, mp;
+
+  days += COSM_TIME_DAYS_0000_03_01;
+  era = ( ( days >= 0 ) ? days : ( days - COSM_TIME_DAYS_ERA + 1LL ) )
+    / COSM_TIME_DAYS_ERA;
+  doe = days - era * COSM_TIME_DAYS_ERA;
+  yoe = ( doe - doe / 1460LL + doe / 36524LL - doe / 146096LL ) / 365LL;
+  doy = doe - ( yoe * 365LL + yoe / 4LL - yoe / 100LL );
+  mp = ( doy * 5LL + 2LL ) / 153LL;
+
+  *day = (u32) ( doy - ( mp * 153LL + 2LL ) / 5LL );
+  *month = (u32) ( ( mp < 10 ) ? ( mp + 2 ) : ( mp - 10 ) );
+  *year = yoe + era * 400LL + ( ( *month < 2 ) ? 1 : 0 );
+}
+
 /* testing */
 
 s32 Cosm_TestTime( void )
 {
-  cosmtime time_test;
+  cosmtime time_test, time_back;
+  cosm_TIME_UNITS units;
+  s64 days;
+  u32 i;
+  struct
+  {
+    s64 seconds;
+    s64 year;
+    u32 month, day, wday, yday;
+  } dates[] =
+  {
+    { 0LL, 2000LL, 0, 0, 6, 0 },
+    { -86400LL, 1999LL, 11, 30, 5, 364 },
+    { -(s64) COSM_TIME_POSIX_DELTA, 1970LL, 0, 0, 4, 0 },
+    { 5097600LL, 2000LL, 1, 28, 2, 59 },
+    { 3160857600LL, 2100LL, 2, 0, 1, 59 },
+    { -7826112000LL, 1752LL, 0, 0, 6, 0 }
+  };
 
   if ( CosmSystemClock( &time_test ) != COSM_PASS )
   {
     return -1;
   }
 
+  for ( i = 0 ; i < sizeof( dates ) / sizeof( dates[0] ) ; i++ )
+  {
+    time_test.hi = dates[i].seconds + 3723LL;
+    time_test.lo = 0x8000000000000000LL;
+    if ( ( CosmTimeUnitsGregorian( &units, time_test ) != COSM_PASS )
+      || ( units.year != dates[i].year ) || ( units.month != dates[i].month )
+      || ( units.day != dates[i].day ) || ( units.yday != dates[i].yday )
+      || ( units.hour != 1 ) || ( units.min != 2 ) || ( units.sec != 3 )
+      || ( units.subsec != 0x8000000000000000LL ) )
+    {
+      return -2;
+    }
+    if ( ( dates[i].year > 1752LL ) && ( units.wday != dates[i].wday ) )
+    {
+      return -3;
+    }
+
+    /* same second again comes from the cache, only subsec changes */
+    time_test.lo = 42;
+    if ( ( CosmTimeUnitsGregorian( &units, time_test ) != COSM_PASS )
+      || ( units.year != dates[i].year ) || ( units.day != dates[i].day )
+      || ( units.sec != 3 ) || ( units.subsec != 42 ) )
+    {
+      return -4;
+    }
+
+    if ( ( CosmTimeDigestGregorian( &time_back, &units ) != COSM_PASS )
+      || ( time_back.hi != time_test.hi ) )
+    {
+      return -5;
+    }
+  }
+
+  /* civil <-> days over a few 400 year cycles */
+  for ( days = -300000LL ; days < 300000LL ; days += 7LL )
+  {
+    Cosm_TimeCivilFromDays( &units.year, &units.month, &units.day, days );
+    if ( Cosm_TimeDaysFromCivil( units.year, units.month, units.day )
+      != days )
+    {
+      return -6;
+    }
+  }
+
   return COSM_PASS;
 }
@@ -161,6 +161,48 @@ s32 CosmTransformEndAll( cosm_TRANSFORM * transform )
   return COSM_PASS;
 }
 
+s32 CosmTransformFromFile( cosm_TRANSFORM * transform, cosm_FILE * file,
+  u64 offset )
+{
+  cosm_FILE_MAP_READER reader;
+  const void * data;
+  u64 bytes;
+  s32 error, result;
+
+  if ( ( transform == NULL ) || ( file == NULL ) )
+  {
+    return COSM_TRANSFORM_ERROR_PARAM;
+  }
+
+  if ( CosmFileMapReadOpen( &reader, file, offset, 0 ) != COSM_PASS )
+  {
+    return COSM_TRANSFORM_ERROR_PARAM;
+  }
+
+  /* each window goes in whole, from the mapping */
+  result = COSM_PASS;
+  while ( ( error = CosmFileMapRead( &data, &bytes, &reader, 0 ) )
+    == COSM_PASS )
+  {
+    if ( ( result = CosmTransform( transform, data, bytes ) ) != COSM_PASS )
+    {
+      break;
+    }
+  }
+  CosmFileMapReadClose( &reader );
+
+  if ( result != COSM_PASS )
+  {
+    return result;
+  }
+  if ( error != COSM_FILE_ERROR_EOF )
+  {
+    return COSM_TRANSFORM_ERROR_FATAL;
+  }
+
+  return COSM_PASS;
+}
+
 /* Base64 code */
 
 typedef struct cosm_BASE64_TMP
@@ -543,19 +585,21 @@ s32 Cosm_TransformToNet( cosm_TRANSFORM * transform,
   const void * const data, u64 length )
 {
   cosm_NET * net = (cosm_NET *) transform->tmp_data;
-  u32 sent;
+  cosm_NET_VECTOR chunk;
+  u64 offset, sent;
   s32 result;
-  u32 chunk;
 
-  while ( length > 0 )
+  /* send all of it, a partial send would lose the rest of the stream */
+  for ( offset = 0 ; offset < length ; offset += chunk.length )
   {
-    chunk = ( length > 0x10000000 ) ? 0x10000000 : (u32) length;
-    if ( ( CosmNetSend( net, &sent, data, chunk ) != COSM_PASS )
-      || ( sent != chunk ) )
+    chunk.data = CosmMemOffset( data, offset );
+    chunk.length = ( ( length - offset ) > 0x10000000 ) ? 0x10000000
+      : (u32) ( length - offset );
+    if ( CosmNetSendAll( net, &sent, &chunk, 1, COSM_NET_WAIT_FOREVER )
+      != COSM_PASS )
     {
       return COSM_TRANSFORM_ERROR_FATAL;
     }
-    length -= chunk;
   }
 
   if ( transform->next_transform != NULL )
@@ -629,6 +673,8 @@ s32 Cosm_TestTransform( void )
   ascii answer[32] = "QWxhZGRpbjpvcGVuIHNlc2FtZQ==";
   ascii answer2[48] = "UVd4aFpHUnBianB2Y0dWdUlITmxjMkZ0WlE9PQ==";
   ascii text[48];
+  cosm_FILE file;
+  u64 bytes;
 
   /* test an encoding base64 */
   CosmMemSet( &buf, sizeof( cosm_BUFFER ), 0 );
@@ -757,5 +803,42 @@ s32 Cosm_TestTransform( void )
     return -17;
   }
 
+  /* file -> base64 -> buffer, read from a mapping of the file */
+  CosmMemSet( &file, sizeof( cosm_FILE ), 0 );
+  CosmMemSet( &buf, sizeof( cosm_BUFFER ), 0 );
+  CosmMemSet( &trans_buff, sizeof( cosm_TRANSFORM ), 0 );
+  CosmMemSet( &transform1, sizeof( cosm_TRANSFORM ), 0 );
+  if ( ( CosmFileOpen( &file, "transform.tst", COSM_FILE_MODE_CREATE
+    | COSM_FILE_MODE_READ | COSM_FILE_MODE_WRITE | COSM_FILE_MODE_TRUNCATE,
+    COSM_FILE_LOCK_NONE ) != COSM_PASS )
+    || ( CosmFileWrite( &file, &bytes, "xxAladdin:open sesame", 21LL )
+    != COSM_PASS )
+    || ( CosmBufferInit( &buf, 1024, COSM_BUFFER_MODE_QUEUE, 1024, NULL, 0 )
+    != COSM_PASS )
+    || ( CosmTransformInit( &trans_buff, COSM_TRANSFORM_TO_BUFFER,
+    NULL, &buf ) != COSM_PASS )
+    || ( CosmTransformInit( &transform1, COSM_BASE64_ENCODE, &trans_buff )
+    != COSM_PASS ) )
+  {
+    return -18;
+  }
+
+  CosmMemSet( text, sizeof( text ), 0 );
+  if ( ( CosmTransformFromFile( &transform1, &file, 2 ) != COSM_PASS )
+    || ( CosmTransformEnd( &transform1 ) != COSM_PASS )
+    || ( CosmBufferGet( text, (u64) 48, &buf ) != 28LL )
+    || ( CosmMemCmp( answer, text, 28LL ) != 0 ) )
+  {
+    CosmBufferFree( &buf );
+    return -19;
+  }
+
+  CosmBufferFree( &buf );
+  if ( ( CosmFileClose( &file ) != COSM_PASS )
+    || ( CosmFileDelete( "transform.tst" ) != COSM_PASS ) )
+  {
+    return -20;
+  }
+
   return COSM_PASS;
 }